@@ -50,6 +50,8 @@ BatchExtract::BatchExtract(QObject* parent)
       m_openDestinationAfterExtraction(false)
 {
     setCapabilities(KJob::Killable);
+    // The percentage is computed over all the archives, it must not follow the bytes of the current one.
+    setProgressUnit(KJob::Files);
 
     connect(this, &KJob::result, this, &BatchExtract::showFailedFiles);
 }
@@ -72,6 +74,12 @@ void BatchExtract::addExtraction(const QUrl& url)
 
     connect(job, SIGNAL(percent(KJob*,ulong)),
             this, SLOT(forwardProgress(KJob*,ulong)));
+    connect(job, SIGNAL(processedAmount(KJob*,KJob::Unit,qulonglong)),
+            this, SLOT(forwardProcessedAmount(KJob*,KJob::Unit,qulonglong)));
+    connect(job, SIGNAL(totalAmount(KJob*,KJob::Unit,qulonglong)),
+            this, SLOT(forwardTotalAmount(KJob*,KJob::Unit,qulonglong)));
+    connect(job, SIGNAL(speed(KJob*,ulong)),
+            this, SLOT(forwardSpeed(KJob*,ulong)));
     connect(job, &Kerfuffle::BatchExtractJob::userQuery,
             this, &BatchExtract::slotUserQuery);
 }
@@ -197,6 +205,24 @@ void BatchExtract::forwardProgress(KJob *job, unsigned long percent)
     setPercent(jobPart * remainingJobs + percent / static_cast<ulong>(m_initialJobCount));
 }
 
+void BatchExtract::forwardProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount)
+{
+    Q_UNUSED(job)
+    setProcessedAmount(unit, amount);
+}
+
+void BatchExtract::forwardTotalAmount(KJob *job, KJob::Unit unit, qulonglong amount)
+{
+    Q_UNUSED(job)
+    setTotalAmount(unit, amount);
+}
+
+void BatchExtract::forwardSpeed(KJob *job, unsigned long speed)
+{
+    Q_UNUSED(job)
+    emitSpeed(speed);
+}
+
 void BatchExtract::addInput(const QUrl& url)
 {
     qCDebug(ARK) << "Adding archive" << url.toLocalFile();
@@ -187,6 +187,14 @@ private Q_SLOTS:
      */
     void forwardProgress(KJob *job, unsigned long percent);
 
+    /**
+     * Updates the bytes extracted from the current archive and the extraction speed,
+     * from which the remaining time is shown.
+     */
+    void forwardProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount);
+    void forwardTotalAmount(KJob *job, KJob::Unit unit, qulonglong amount);
+    void forwardSpeed(KJob *job, unsigned long speed);
+
     /**
      * Shows a dialog with a list of all the files that could not
      * be successfully extracted.
@@ -27,6 +27,7 @@
 #include "batchextract.h"
 #include "addtoarchive.h"
 #include "pluginmanager.h"
+#include "tracer.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
@@ -196,6 +197,10 @@ int main(int argc, char **argv)
     parser.addOption(QCommandLineOption(QStringList() << QStringLiteral("m") << QStringLiteral("mimetypes"),
                                         i18n("List supported MIME types.")));
 
+    parser.addOption(QCommandLineOption(QStringList() << QStringLiteral("trace"),
+                                        i18n("Record the time spent in each phase of the operations, and write it to 'file' in the Chrome trace event format when Ark quits."),
+                                        QStringLiteral("file")));
+
     aboutData.setupCommandLine(&parser);
 
     // Do the command line parsing.
@@ -204,6 +209,10 @@ int main(int argc, char **argv)
     // Handle standard options.
     aboutData.processCommandLine(&parser);
 
+    if (parser.isSet(QStringLiteral("trace"))) {
+        Kerfuffle::Tracer::setOutputFile(parser.value(QStringLiteral("trace")));
+    }
+
     // This is needed to prevent Dolphin from freezing when opening an archive.
     KDBusService dbusService(KDBusService::Multiple | KDBusService::NoExitOnFailure);
 
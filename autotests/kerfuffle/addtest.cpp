@@ -28,6 +28,8 @@
 #include "jobs.h"
 #include "testhelper.h"
 
+#include <QDir>
+#include <QMimeDatabase>
 #include <QTest>
 
 using namespace Kerfuffle;
@@ -42,6 +44,8 @@ public:
 private Q_SLOTS:
     void testAdding_data();
     void testAdding();
+    void testReplacing_data();
+    void testReplacing();
 };
 
 QTEST_GUILESS_MAIN(AddTest)
@@ -165,11 +169,43 @@ void AddTest::testAdding()
     CompressionOptions options;
     options.setGlobalWorkDir(QFINDTESTDATA("data"));
     AddJob *addJob = archive->addFiles(targetEntries, destination, options);
+    QStringList emittedPaths;
+    connect(addJob, &Job::newEntry, this, [&emittedPaths](Archive::Entry *entry) {
+        emittedPaths << entry->fullPath(NoTrailingSlash);
+    });
     TestHelper::startAndWaitForResult(addJob);
 
     // Retrieve the resulting paths.
     QStringList newPaths = getEntryPaths(archive);
 
+    // The written entries are the new ones, including the parent directories created
+    // along with them, and the overwritten ones.
+    QStringList writtenPaths;
+    for (auto path : qAsConst(newPaths)) {
+        if (!oldPaths.contains(path)) {
+            if (path.endsWith(QLatin1Char('/'))) {
+                path.chop(1);
+            }
+            writtenPaths << path;
+        }
+    }
+    for (const auto entry : qAsConst(targetEntries)) {
+        const QString path = destination->fullPath() + entry->fullPath();
+        if (!path.endsWith(QLatin1Char('/')) && oldPaths.contains(path)) {
+            writtenPaths << path;
+        }
+    }
+
+    // Unless the plugin has to list the archive with a command line tool, only the written entries are emitted.
+    if (!plugin->metaData().pluginId().startsWith(QLatin1String("kerfuffle_cli"))) {
+        emittedPaths.sort();
+        writtenPaths.sort();
+        QCOMPARE(emittedPaths, writtenPaths);
+    }
+    for (const auto &path : qAsConst(expectedNewPaths)) {
+        QVERIFY(emittedPaths.contains(path));
+    }
+
     // Check that the expected paths are now in the archive.
     for (const auto &path : qAsConst(expectedNewPaths)) {
         QVERIFY(newPaths.contains(path));
@@ -182,4 +218,104 @@ void AddTest::testAdding()
     archive->deleteLater();
 }
 
+void AddTest::testReplacing_data()
+{
+    QTest::addColumn<QString>("archiveName");
+    QTest::addColumn<Plugin*>("plugin");
+    QTest::addColumn<QByteArray>("content");
+
+    // Within the blocks of the old entry, and beyond them (the tar archive is then rewritten).
+    const QVector<QPair<QString, QByteArray>> contents = {
+        qMakePair(QStringLiteral("same number of blocks"), QByteArray("replaced content\n")),
+        qMakePair(QStringLiteral("more blocks"), QByteArray(2000, 'x'))
+    };
+
+    const QStringList formats = {QStringLiteral("tar.bz2"), QStringLiteral("zip")};
+    for (const QString &format : formats) {
+        const QString filename = QStringLiteral("test.%1").arg(format);
+        const auto mime = QMimeDatabase().mimeTypeForFile(filename, QMimeDatabase::MatchExtension);
+
+        const auto plugins = m_pluginManager.preferredWritePluginsFor(mime);
+        for (const auto plugin : plugins) {
+            for (const auto &content : contents) {
+                QTest::newRow(QStringLiteral("%1 (%2, %3)").arg(content.first, format, plugin->metaData().pluginId()).toUtf8().constData())
+                    << filename
+                    << plugin
+                    << content.second;
+            }
+        }
+    }
+}
+
+void AddTest::testReplacing()
+{
+    QTemporaryDir temporaryDir;
+
+    QFETCH(QString, archiveName);
+    const QString archivePath = temporaryDir.path() + QLatin1Char('/') + archiveName;
+    QVERIFY(QFile::copy(QFINDTESTDATA(QStringLiteral("data/") + archiveName), archivePath));
+
+    QFETCH(Plugin*, plugin);
+    QVERIFY(plugin);
+
+    auto loadJob = Archive::load(archivePath, plugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    if (!archive->isValid()) {
+        QSKIP("Could not find a plugin to handle the archive. Skipping test.", SkipSingle);
+    }
+
+    const QStringList oldPaths = getEntryPaths(archive);
+    const uint oldNumberOfEntries = archive->numberOfEntries();
+
+    QFETCH(QByteArray, content);
+    const QString file = temporaryDir.path() + QStringLiteral("/a.txt");
+    QFile newFile(file);
+    QVERIFY(newFile.open(QIODevice::WriteOnly));
+    QCOMPARE(newFile.write(content), qint64(content.size()));
+    newFile.close();
+
+    Archive::Entry entry(this, QStringLiteral("a.txt"));
+    ReplaceJob *replaceJob = archive->replaceEntry(&entry, file);
+    if (!replaceJob) {
+        QSKIP("The plugin can't replace a single entry. Skipping test.", SkipSingle);
+    }
+
+    // Only the replaced entry is emitted.
+    QStringList emittedPaths;
+    qulonglong emittedSize = 0;
+    connect(replaceJob, &Job::newEntry, this, [&](Archive::Entry *newEntry) {
+        emittedPaths << newEntry->fullPath();
+        emittedSize = newEntry->property("size").toULongLong();
+    });
+    TestHelper::startAndWaitForResult(replaceJob);
+    QCOMPARE(emittedPaths, QStringList {QStringLiteral("a.txt")});
+    QCOMPARE(emittedSize, qulonglong(content.size()));
+    QCOMPARE(archive->numberOfEntries(), oldNumberOfEntries);
+
+    // The other entries are left as they were.
+    QCOMPARE(getEntryPaths(archive), oldPaths);
+
+    // Nothing is left behind next to the archive, e.g. the backup of an entry replaced in place.
+    QStringList leftFiles = QDir(temporaryDir.path()).entryList(QDir::Files | QDir::Hidden);
+    leftFiles.removeOne(archiveName);
+    QCOMPARE(leftFiles, QStringList {QStringLiteral("a.txt")});
+
+    QTemporaryDir destDir;
+    auto extractionJob = archive->extractFiles({&entry}, destDir.path());
+    TestHelper::startAndWaitForResult(extractionJob);
+
+    QFile extractedFile(destDir.path() + QStringLiteral("/a.txt"));
+    QVERIFY(extractedFile.open(QIODevice::ReadOnly));
+    QCOMPARE(extractedFile.readAll(), content);
+
+    loadJob->deleteLater();
+    archive->deleteLater();
+}
+
 #include "addtest.moc"
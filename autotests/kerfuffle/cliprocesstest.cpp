@@ -0,0 +1,144 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "cliprocess.h"
+
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+using namespace Kerfuffle;
+
+class CliProcessTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testOutput_data();
+    void testOutput();
+    void testBackPressure();
+};
+
+QTEST_GUILESS_MAIN(CliProcessTest)
+
+void CliProcessTest::testOutput_data()
+{
+    QTest::addColumn<QString>("script");
+    QTest::addColumn<QByteArray>("expectedOutput");
+
+    QTest::newRow("short output")
+            << QStringLiteral("printf 'first\\nsecond\\n'")
+            << QByteArrayLiteral("first\nsecond\n");
+
+    QTest::newRow("merged channels")
+            << QStringLiteral("echo out; echo err >&2")
+            << QByteArrayLiteral("out\nerr\n");
+
+    // Bigger than the default pipe buffer.
+    QByteArray longOutput;
+    for (int i = 0; i < 20000; ++i) {
+        longOutput += "line " + QByteArray::number(i) + " of the listing\n";
+    }
+    QTest::newRow("long output")
+            << QStringLiteral("i=0; while [ $i -lt 20000 ]; do echo \"line $i of the listing\"; i=$((i+1)); done")
+            << longOutput;
+
+    QTest::newRow("no output")
+            << QStringLiteral("true")
+            << QByteArray();
+}
+
+void CliProcessTest::testOutput()
+{
+    const QString sh = QStandardPaths::findExecutable(QStringLiteral("sh"));
+    if (sh.isEmpty()) {
+        QSKIP("sh not found.");
+    }
+
+    QFETCH(QString, script);
+    QFETCH(QByteArray, expectedOutput);
+
+    CliProcess process;
+    process.setOutputChannelMode(KProcess::MergedChannels);
+    process.setProgram(sh, {QStringLiteral("-c"), script});
+
+    QByteArray output;
+    connect(&process, &CliProcess::outputAvailable, this, [&]() {
+        output += process.takeOutput();
+    }, Qt::QueuedConnection);
+
+    QSignalSpy finishedSpy(&process, &CliProcess::finishedWithOutput);
+    process.startProcess();
+    QVERIFY(finishedSpy.wait(10000));
+
+    output += process.takeOutput();
+
+    QCOMPARE(output.size(), expectedOutput.size());
+    QCOMPARE(output, expectedOutput);
+}
+
+void CliProcessTest::testBackPressure()
+{
+    const QString sh = QStandardPaths::findExecutable(QStringLiteral("sh"));
+    if (sh.isEmpty()) {
+        QSKIP("sh not found.");
+    }
+
+    // Much more than the buffered output and the pipe can hold.
+    const int outputSize = 3 * CliProcess::maxBufferedOutputSize;
+
+    CliProcess process;
+    process.setOutputChannelMode(KProcess::MergedChannels);
+    process.setProgram(sh, {QStringLiteral("-c"), QStringLiteral("head -c %1 /dev/zero").arg(outputSize)});
+
+    QSignalSpy finishedSpy(&process, &CliProcess::finishedWithOutput);
+    process.startProcess();
+
+    // Nobody takes the output: the process must be stuck on the full pipe.
+    QVERIFY(!finishedSpy.wait(2000));
+    QCOMPARE(process.state(), QProcess::Running);
+
+    qint64 totalSize = 0;
+    QByteArray output = process.takeOutput();
+    QVERIFY(output.size() >= CliProcess::maxBufferedOutputSize);
+    QVERIFY(output.size() < CliProcess::maxBufferedOutputSize + 64 * 1024);
+    totalSize += output.size();
+
+    for (int i = 0; finishedSpy.isEmpty() && i < 100; ++i) {
+        finishedSpy.wait(100);
+        output = process.takeOutput();
+        QVERIFY(output.size() < CliProcess::maxBufferedOutputSize + 64 * 1024);
+        totalSize += output.size();
+    }
+    QCOMPARE(finishedSpy.count(), 1);
+    totalSize += process.takeOutput().size();
+
+    QCOMPARE(totalSize, static_cast<qint64>(outputSize));
+}
+
+#include "cliprocesstest.moc"
@@ -0,0 +1,183 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "extractedentrycache.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace Kerfuffle;
+
+class ExtractedEntryCacheTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void testRetrieve();
+    void testArchiveChanged();
+    void testEviction();
+    void testMaxEntrySize();
+    void testRemoveArchive();
+
+private:
+    QString writeFile(const QString &name, const QByteArray &content);
+    static QByteArray readFile(const QString &path);
+
+    QScopedPointer<QTemporaryDir> m_dir;
+    QString m_archive;
+};
+
+QTEST_GUILESS_MAIN(ExtractedEntryCacheTest)
+
+void ExtractedEntryCacheTest::init()
+{
+    m_dir.reset(new QTemporaryDir());
+    QVERIFY(m_dir->isValid());
+    m_archive = writeFile(QStringLiteral("archive.zip"), "archive");
+}
+
+QString ExtractedEntryCacheTest::writeFile(const QString &name, const QByteArray &content)
+{
+    const QString path = m_dir->path() + QLatin1Char('/') + name;
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return QString();
+    }
+    file.write(content);
+    return path;
+}
+
+QByteArray ExtractedEntryCacheTest::readFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+void ExtractedEntryCacheTest::testRetrieve()
+{
+    ExtractedEntryCache cache;
+    const QString destination = m_dir->path() + QStringLiteral("/out/dir/a.txt");
+
+    QVERIFY(!cache.retrieve(m_archive, QStringLiteral("dir/a.txt"), destination));
+
+    cache.insert(m_archive, QStringLiteral("dir/a.txt"), writeFile(QStringLiteral("a.txt"), "aaaa"));
+    QCOMPARE(cache.count(), 1);
+    QCOMPARE(cache.size(), qint64(4));
+    QVERIFY(cache.contains(m_archive, QStringLiteral("dir/a.txt")));
+
+    QVERIFY(cache.retrieve(m_archive, QStringLiteral("dir/a.txt"), destination));
+    QCOMPARE(readFile(destination), QByteArray("aaaa"));
+
+    // Other entries of the same archive are not affected.
+    QVERIFY(!cache.retrieve(m_archive, QStringLiteral("dir/b.txt"), m_dir->path() + QStringLiteral("/out/b.txt")));
+}
+
+void ExtractedEntryCacheTest::testArchiveChanged()
+{
+    ExtractedEntryCache cache;
+    cache.insert(m_archive, QStringLiteral("a.txt"), writeFile(QStringLiteral("a.txt"), "aaaa"));
+    QCOMPARE(cache.count(), 1);
+
+    writeFile(QStringLiteral("archive.zip"), "modified archive");
+    QVERIFY(!cache.contains(m_archive, QStringLiteral("a.txt")));
+
+    QVERIFY(!cache.retrieve(m_archive, QStringLiteral("a.txt"), m_dir->path() + QStringLiteral("/out/a.txt")));
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.size(), qint64(0));
+}
+
+void ExtractedEntryCacheTest::testEviction()
+{
+    ExtractedEntryCache cache;
+    cache.setMaxSize(10);
+
+    cache.insert(m_archive, QStringLiteral("a.txt"), writeFile(QStringLiteral("a.txt"), "aaaa"));
+    cache.insert(m_archive, QStringLiteral("b.txt"), writeFile(QStringLiteral("b.txt"), "bbbb"));
+
+    // Retrieving a.txt makes b.txt the least recently used entry.
+    QVERIFY(cache.retrieve(m_archive, QStringLiteral("a.txt"), m_dir->path() + QStringLiteral("/out/a.txt")));
+
+    cache.insert(m_archive, QStringLiteral("c.txt"), writeFile(QStringLiteral("c.txt"), "cccc"));
+    QCOMPARE(cache.count(), 2);
+    QCOMPARE(cache.size(), qint64(8));
+    QVERIFY(!cache.retrieve(m_archive, QStringLiteral("b.txt"), m_dir->path() + QStringLiteral("/out/b.txt")));
+    QVERIFY(cache.retrieve(m_archive, QStringLiteral("a.txt"), m_dir->path() + QStringLiteral("/out/a2.txt")));
+    QVERIFY(cache.retrieve(m_archive, QStringLiteral("c.txt"), m_dir->path() + QStringLiteral("/out/c.txt")));
+
+    // Files bigger than half of the cache are never cached.
+    cache.insert(m_archive, QStringLiteral("d.txt"), writeFile(QStringLiteral("d.txt"), "dddddd"));
+    QCOMPARE(cache.count(), 2);
+
+    cache.setMaxSize(4);
+    QCOMPARE(cache.count(), 1);
+    QCOMPARE(cache.size(), qint64(4));
+}
+
+void ExtractedEntryCacheTest::testMaxEntrySize()
+{
+    ExtractedEntryCache cache;
+    cache.setMaxEntrySize(3);
+
+    cache.insert(m_archive, QStringLiteral("a.txt"), writeFile(QStringLiteral("a.txt"), "aaaa"));
+    QCOMPARE(cache.count(), 0);
+
+    cache.insert(m_archive, QStringLiteral("b.txt"), writeFile(QStringLiteral("b.txt"), "bbb"));
+    QCOMPARE(cache.count(), 1);
+
+    cache.setMaxEntrySize(0);
+    cache.insert(m_archive, QStringLiteral("a.txt"), writeFile(QStringLiteral("a.txt"), "aaaa"));
+    QCOMPARE(cache.count(), 2);
+}
+
+void ExtractedEntryCacheTest::testRemoveArchive()
+{
+    ExtractedEntryCache cache;
+    const QString otherArchive = writeFile(QStringLiteral("other.zip"), "other");
+
+    cache.insert(m_archive, QStringLiteral("a.txt"), writeFile(QStringLiteral("a.txt"), "aaaa"));
+    cache.insert(m_archive, QStringLiteral("b.txt"), writeFile(QStringLiteral("b.txt"), "bbbb"));
+    cache.insert(otherArchive, QStringLiteral("a.txt"), writeFile(QStringLiteral("c.txt"), "cccc"));
+    QCOMPARE(cache.count(), 3);
+
+    cache.removeArchive(m_archive);
+    QCOMPARE(cache.count(), 1);
+    QCOMPARE(cache.size(), qint64(4));
+    QVERIFY(cache.retrieve(otherArchive, QStringLiteral("a.txt"), m_dir->path() + QStringLiteral("/out/a.txt")));
+    QCOMPARE(readFile(m_dir->path() + QStringLiteral("/out/a.txt")), QByteArray("cccc"));
+
+    cache.clear();
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.size(), qint64(0));
+}
+
+#include "extractedentrycachetest.moc"
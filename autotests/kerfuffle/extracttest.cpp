@@ -33,6 +33,7 @@
 
 #include <QDirIterator>
 #include <QMimeDatabase>
+#include <QScopedPointer>
 #include <QStandardPaths>
 #include <QTest>
 
@@ -48,6 +49,9 @@ private Q_SLOTS:
     void testExtraction();
     void testPreservePermissions_data();
     void testPreservePermissions();
+    void testEntryDevice_data();
+    void testEntryDevice();
+    void testEntryDeviceSequence();
 
 private:
     PluginManager m_pluginManager;
@@ -539,4 +543,139 @@ void ExtractTest::testPreservePermissions()
     archive->deleteLater();
 }
 
+void ExtractTest::testEntryDevice_data()
+{
+    QTest::addColumn<QString>("archiveName");
+    QTest::addColumn<Plugin*>("plugin");
+    QTest::addColumn<QString>("testFile");
+
+    const QStringList formats = TestHelper::testFormats();
+    for (const QString &format : formats) {
+        const QString filename = QFINDTESTDATA(QStringLiteral("data/test_permissions.%1").arg(format));
+        const auto mime = QMimeDatabase().mimeTypeForFile(filename, QMimeDatabase::MatchExtension);
+        const auto plugins = m_pluginManager.preferredPluginsFor(mime);
+        for (const auto plugin : plugins) {
+            QTest::newRow(QStringLiteral("stream an entry (%1, %2)").arg(format, plugin->metaData().pluginId()).toUtf8().constData())
+                << filename
+                << plugin
+                << QStringLiteral("0755.sh");
+        }
+    }
+}
+
+void ExtractTest::testEntryDevice()
+{
+    QFETCH(QString, archiveName);
+    QFETCH(Plugin*, plugin);
+    QVERIFY(plugin);
+    auto loadJob = Archive::load(archiveName, plugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    if (!archive->isValid()) {
+        QSKIP("Could not find a plugin to handle the archive. Skipping test.", SkipSingle);
+    }
+
+    QFETCH(QString, testFile);
+    Archive::Entry entry(nullptr, testFile);
+    QScopedPointer<QIODevice> device(archive->createEntryDevice(&entry));
+    if (!device) {
+        QSKIP("The plugin can't stream entries. Skipping test.", SkipSingle);
+    }
+
+    QVERIFY(device->isOpen());
+    QVERIFY(device->isSequential());
+    const QByteArray streamedData = device->readAll();
+    QVERIFY(device->atEnd());
+
+    // The streamed content must match the extracted one.
+    QTemporaryDir destDir;
+    if (!destDir.isValid()) {
+        QSKIP("Could not create a temporary directory for extraction. Skipping test.", SkipSingle);
+    }
+
+    auto extractionJob = archive->extractFiles({&entry}, destDir.path());
+    QVERIFY(extractionJob);
+    extractionJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(extractionJob);
+
+    QFile file(QStringLiteral("%1/%2").arg(destDir.path(), testFile));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(streamedData, file.readAll());
+
+    // Missing entries are not streamed, the plugin may find it out on the first read only.
+    Archive::Entry missingEntry(nullptr, QStringLiteral("missing.txt"));
+    QScopedPointer<QIODevice> missingDevice(archive->createEntryDevice(&missingEntry));
+    if (missingDevice) {
+        QVERIFY(missingDevice->readAll().isEmpty());
+        QVERIFY(!missingDevice->atEnd());
+    }
+
+    // An aborted device stops reading.
+    QScopedPointer<QIODevice> abortedDevice(archive->createEntryDevice(&entry));
+    QVERIFY(abortedDevice);
+    QVERIFY(QMetaObject::invokeMethod(abortedDevice.data(), "abort", Qt::DirectConnection));
+    abortedDevice->readAll();
+    QVERIFY(!abortedDevice->atEnd());
+
+    loadJob->deleteLater();
+    extractionJob->deleteLater();
+    archive->deleteLater();
+}
+
+void ExtractTest::testEntryDeviceSequence()
+{
+    // With 7z installed, the entries are streamed by the in-process reader loaded next to cli7z.
+    auto loadJob = Archive::load(QFINDTESTDATA("data/distinct_entries.7z"));
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    if (!archive->isValid()) {
+        QSKIP("Could not find a plugin to handle the archive. Skipping test.", SkipSingle);
+    }
+
+    const QHash<QString, QByteArray> contents = {
+        {QStringLiteral("1.txt"), QByteArrayLiteral("first\n")},
+        {QStringLiteral("dir/2.txt"), QByteArrayLiteral("second\n")},
+        {QStringLiteral("3.txt"), QByteArrayLiteral("third\n")}
+    };
+
+    // The reader of a device goes on with the next entries, and is reopened for the previous ones.
+    const QStringList paths = {QStringLiteral("1.txt"), QStringLiteral("3.txt"), QStringLiteral("dir/2.txt"),
+                               QStringLiteral("3.txt"), QStringLiteral("1.txt"), QStringLiteral("dir/2.txt")};
+    for (const QString &path : paths) {
+        Archive::Entry entry(nullptr, path);
+        QScopedPointer<QIODevice> device(archive->createEntryDevice(&entry));
+        if (!device) {
+            QSKIP("The plugin can't stream entries. Skipping test.", SkipSingle);
+        }
+
+        QCOMPARE(device->readAll(), contents.value(path));
+        QVERIFY(device->atEnd());
+    }
+
+    // Entries read in part don't shift the next ones.
+    Archive::Entry firstEntry(nullptr, QStringLiteral("1.txt"));
+    QScopedPointer<QIODevice> partialDevice(archive->createEntryDevice(&firstEntry));
+    QVERIFY(partialDevice);
+    QCOMPARE(partialDevice->read(2), QByteArrayLiteral("fi"));
+    partialDevice.reset();
+
+    Archive::Entry secondEntry(nullptr, QStringLiteral("dir/2.txt"));
+    QScopedPointer<QIODevice> nextDevice(archive->createEntryDevice(&secondEntry));
+    QVERIFY(nextDevice);
+    QCOMPARE(nextDevice->readAll(), contents.value(secondEntry.fullPath()));
+
+    loadJob->deleteLater();
+    archive->deleteLater();
+}
+
 #include "extracttest.moc"
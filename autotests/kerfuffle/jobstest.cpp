@@ -26,15 +26,100 @@
 
 #include "jsonarchiveinterface.h"
 #include "jobs.h"
+#include "jobthreadpool.h"
 
 #include <KPluginMetaData>
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QEventLoop>
+#include <QSemaphore>
+#include <QSignalSpy>
 #include <QTest>
+#include <QThread>
 
 using namespace Kerfuffle;
 
+/**
+ * Tests archives forever, like a plugin stuck in a big entry, until the operation is cancelled.
+ */
+class SlowJSONArchiveInterface : public JSONArchiveInterface
+{
+public:
+    using JSONArchiveInterface::JSONArchiveInterface;
+
+    bool testArchive() override
+    {
+        m_started.storeRelease(1);
+
+        QElapsedTimer timer;
+        timer.start();
+        while (!isCancellationRequested() && timer.elapsed() < 10000) {
+            QThread::msleep(1);
+        }
+
+        m_cancelled.storeRelease(isCancellationRequested());
+        return false;
+    }
+
+    QAtomicInt m_started;
+    QAtomicInt m_cancelled;
+};
+
+/**
+ * Tests archives until released, so that the next jobs get queued, and records the merged operations.
+ */
+class MergingJSONArchiveInterface : public JSONArchiveInterface
+{
+public:
+    using JSONArchiveInterface::JSONArchiveInterface;
+
+    bool testArchive() override
+    {
+        m_release.acquire();
+        return true;
+    }
+
+    QSemaphore m_release;
+    QVector<int> m_appliedOperations;
+
+protected:
+    QVector<bool> doApplyOperations(const QVector<ArchiveOperation> &operations) override
+    {
+        m_appliedOperations.append(operations.size());
+        return JSONArchiveInterface::doApplyOperations(operations);
+    }
+};
+
+/**
+ * Fails every extraction, like an in-process reader not supporting the compression method of the entries.
+ */
+class FailingJSONArchiveInterface : public JSONArchiveInterface
+{
+public:
+    using JSONArchiveInterface::JSONArchiveInterface;
+
+    bool extractFiles(const QVector<Archive::Entry*> &files, const QString &destinationDirectory, const ExtractionOptions &options) override
+    {
+        Q_UNUSED(files)
+        Q_UNUSED(destinationDirectory)
+        Q_UNUSED(options)
+
+        m_extractionsCount.ref();
+        emit error(QStringLiteral("Unsupported compression method"));
+        return false;
+    }
+
+    QAtomicInt m_extractionsCount;
+};
+
+class ProgressJSONArchiveInterface : public JSONArchiveInterface
+{
+public:
+    using JSONArchiveInterface::JSONArchiveInterface;
+    using JSONArchiveInterface::reportProgress;
+};
+
 class JobsTest : public QObject
 {
     Q_OBJECT
@@ -54,6 +139,7 @@ private Q_SLOTS:
     // ExtractJob-related tests
     void testExtractJobAccessors();
     void testTempExtractJob();
+    void testFallbackInterface();
 
     // DeleteJob-related tests
     void testRemoveEntries_data();
@@ -63,6 +149,16 @@ private Q_SLOTS:
     void testAddEntries_data();
     void testAddEntries();
 
+    // JobThreadPool-related tests
+    void testJobsOnSameInterface();
+    void testKillJob();
+    void testKillStuckJob();
+    void testInterruptJob();
+    void testMergeModifications();
+
+    // ReadOnlyArchiveInterface-related tests
+    void testProgressReporting();
+
 private:
     JSONArchiveInterface *createArchiveInterface(const QString& filePath);
     QVector<Archive::Entry*> listEntries(JSONArchiveInterface *iface);
@@ -247,6 +343,216 @@ void JobsTest::testExtractJobAccessors()
     delete job;
 }
 
+void JobsTest::testJobsOnSameInterface()
+{
+    JSONArchiveInterface *iface = createArchiveInterface(QFINDTESTDATA("data/archive001.json"));
+    QVERIFY(iface);
+
+    JobThreadPool *pool = JobThreadPool::instance();
+    pool->resetMetrics();
+
+    const int jobsCount = 5;
+    int finishedJobs = 0;
+    QVector<QStringList> jobEntries(jobsCount);
+    for (int i = 0; i < jobsCount; ++i) {
+        auto job = new LoadJob(iface);
+        connect(job, &Job::newEntry, this, [&jobEntries, i](Archive::Entry *entry) {
+            jobEntries[i].append(entry->fullPath());
+        });
+        connect(job, &KJob::result, this, [&]() {
+            if (++finishedJobs == jobsCount) {
+                m_eventLoop.quit();
+            }
+        });
+        job->start();
+    }
+    m_eventLoop.exec();
+
+    // The jobs ran one after another, each one reported only the entries it listed.
+    const QStringList expectedEntries = {QStringLiteral("a.txt"),
+                                         QStringLiteral("aDir/"),
+                                         QStringLiteral("aDir/b.txt"),
+                                         QStringLiteral("c.txt")};
+    for (int i = 0; i < jobsCount; ++i) {
+        QCOMPARE(jobEntries.at(i), expectedEntries);
+    }
+
+    QCOMPARE(pool->startedJobsCount(), jobsCount);
+    QVERIFY(pool->peakQueuedJobsCount() >= 1);
+    QCOMPARE(pool->queuedJobsCount(), 0);
+    QVERIFY(pool->totalWaitTime() >= pool->peakWaitTime());
+
+    iface->deleteLater();
+}
+
+void JobsTest::testKillJob()
+{
+    auto iface = new SlowJSONArchiveInterface(this, {QFINDTESTDATA("data/archive001.json"),
+                                                     QVariant().fromValue(KPluginMetaData())});
+    QVERIFY(iface->open());
+
+    auto testJob = new TestJob(iface);
+    testJob->start();
+    QTRY_VERIFY(iface->m_started.loadAcquire());
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(testJob->kill());
+    QVERIFY(timer.elapsed() < 1000);
+    QVERIFY(iface->m_cancelled.loadAcquire());
+
+    // The next job on the interface doesn't inherit the cancellation.
+    QCOMPARE(listEntries(iface).size(), 4);
+    QVERIFY(!iface->isCancellationRequested());
+
+    iface->deleteLater();
+}
+
+void JobsTest::testKillStuckJob()
+{
+    // Its testArchive() ignores the cancellation until released.
+    auto iface = new MergingJSONArchiveInterface(this, {QFINDTESTDATA("data/archive001.json"),
+                                                        QVariant().fromValue(KPluginMetaData())});
+    QVERIFY(iface->open());
+
+    auto testJob = new TestJob(iface);
+    QSignalSpy destroyedSpy(testJob, &QObject::destroyed);
+    testJob->start();
+    QTRY_COMPARE(JobThreadPool::instance()->activeJobsCount(), 1);
+
+    // The pool gives up waiting for the job, which is then deleted once it returns instead of blocking the caller.
+    QVERIFY(testJob->kill());
+    QTest::qWait(100);
+    QVERIFY(destroyedSpy.isEmpty());
+
+    iface->m_release.release();
+    QVERIFY(destroyedSpy.wait());
+    QCOMPARE(JobThreadPool::instance()->activeJobsCount(), 0);
+
+    iface->deleteLater();
+}
+
+void JobsTest::testInterruptJob()
+{
+    auto iface = new SlowJSONArchiveInterface(this, {QFINDTESTDATA("data/archive001.json"),
+                                                     QVariant().fromValue(KPluginMetaData())});
+    QVERIFY(iface->open());
+
+    auto testJob = new TestJob(iface);
+    testJob->setAutoDelete(false);
+    bool resultEmitted = false;
+    connect(testJob, &KJob::result, this, [&resultEmitted]() {
+        resultEmitted = true;
+    });
+    QSignalSpy interruptedSpy(testJob, &Job::interrupted);
+    testJob->start();
+    QTRY_VERIFY(iface->m_started.loadAcquire());
+
+    // The job is only told to stop, interrupted() is emitted once it did.
+    testJob->interrupt();
+    QVERIFY(interruptedSpy.wait());
+    QCOMPARE(interruptedSpy.count(), 1);
+    QVERIFY(iface->m_cancelled.loadAcquire());
+    QVERIFY(!resultEmitted);
+    testJob->deleteLater();
+
+    // A job interrupted before it started is just removed from the queue.
+    auto queuedJob = new TestJob(iface);
+    auto blockingJob = new TestJob(iface);
+    queuedJob->setAutoDelete(false);
+    QSignalSpy queuedSpy(queuedJob, &Job::interrupted);
+    iface->m_started.storeRelease(0);
+    blockingJob->start();
+    queuedJob->start();
+    QTRY_VERIFY(iface->m_started.loadAcquire());
+
+    queuedJob->interrupt();
+    QVERIFY(queuedSpy.wait());
+    QVERIFY(blockingJob->kill());
+    queuedJob->deleteLater();
+
+    iface->deleteLater();
+}
+
+void JobsTest::testMergeModifications()
+{
+    auto iface = new MergingJSONArchiveInterface(this, {QFINDTESTDATA("data/archive001.json"),
+                                                        QVariant().fromValue(KPluginMetaData())});
+    QVERIFY(iface->open());
+
+    JobThreadPool *pool = JobThreadPool::instance();
+    pool->resetMetrics();
+
+    // The deletions are queued while the interface is busy.
+    auto testJob = new TestJob(iface);
+    testJob->start();
+
+    const QStringList paths = {QStringLiteral("a.txt"), QStringLiteral("aDir/b.txt"), QStringLiteral("c.txt")};
+    QVector<QStringList> removedPaths(paths.size());
+    int finishedJobs = 0;
+    for (int i = 0; i < paths.size(); ++i) {
+        auto job = new DeleteJob({new Archive::Entry(this, paths.at(i))}, iface);
+        connect(job, &Job::entryRemoved, this, [&removedPaths, i](const QString &path) {
+            removedPaths[i].append(path);
+        });
+        connect(job, &KJob::result, this, [&](KJob *job) {
+            QCOMPARE(job->error(), 0);
+            if (++finishedJobs == paths.size()) {
+                m_eventLoop.quit();
+            }
+        });
+        job->start();
+    }
+
+    iface->m_release.release();
+    m_eventLoop.exec();
+
+    // The deletions were applied in one go, and each job reported its own removal.
+    QCOMPARE(iface->m_appliedOperations, QVector<int>{3});
+    QCOMPARE(pool->mergedJobsCount(), 2);
+    for (int i = 0; i < paths.size(); ++i) {
+        QCOMPARE(removedPaths.at(i), QStringList{paths.at(i)});
+    }
+    QCOMPARE(listEntries(iface).size(), 1);
+
+    iface->deleteLater();
+}
+
+void JobsTest::testProgressReporting()
+{
+    ProgressJSONArchiveInterface iface(this, {QFINDTESTDATA("data/archive001.json"),
+                                              QVariant().fromValue(KPluginMetaData())});
+    iface.beginOperation();
+
+    QVector<double> fractions;
+    QVector<qulonglong> processedEntries;
+    connect(&iface, &ReadOnlyArchiveInterface::progress, this, [&](double fraction) {
+        fractions.append(fraction);
+    });
+    connect(&iface, &ReadOnlyArchiveInterface::processedEntries, this, [&](qulonglong processed, qulonglong total) {
+        QCOMPARE(total, 100000ull);
+        processedEntries.append(processed);
+    });
+
+    const qulonglong entriesCount = 100000;
+    for (qulonglong i = 1; i <= entriesCount; ++i) {
+        iface.reportProgress(double(i) / entriesCount, i, entriesCount);
+    }
+
+    // The first update and the completion are always reported, most of the others are coalesced.
+    QVERIFY(fractions.size() >= 2);
+    QVERIFY(fractions.size() < 100);
+    QCOMPARE(fractions.first(), 1.0 / entriesCount);
+    QCOMPARE(fractions.last(), 1.0);
+    QCOMPARE(processedEntries.size(), fractions.size());
+    QCOMPARE(processedEntries.last(), entriesCount);
+
+    // The next operation starts reporting from scratch.
+    iface.beginOperation();
+    iface.reportProgress(0.5);
+    QCOMPARE(fractions.last(), 0.5);
+}
+
 void JobsTest::testTempExtractJob()
 {
     JSONArchiveInterface *iface = createArchiveInterface(QFINDTESTDATA("data/archive-malicious.json"));
@@ -269,6 +575,36 @@ void JobsTest::testTempExtractJob()
     delete job;
 }
 
+void JobsTest::testFallbackInterface()
+{
+    auto failingIface = new FailingJSONArchiveInterface(this, {QFINDTESTDATA("data/archive001.json"),
+                                                               QVariant().fromValue(KPluginMetaData())});
+    QVERIFY(failingIface->open());
+    JSONArchiveInterface *iface = createArchiveInterface(QFINDTESTDATA("data/archive001.json"));
+    QVERIFY(iface);
+
+    // Without a fallback, the failure is reported.
+    auto job = new PreviewJob(new Archive::Entry(this, QStringLiteral("a.txt")), false, failingIface);
+    job->setAutoDelete(false);
+    startAndWaitForResult(job);
+    QCOMPARE(job->error(), static_cast<int>(KJob::UserDefinedError));
+    QCOMPARE(failingIface->m_extractionsCount.loadAcquire(), 1);
+    delete job;
+
+    // With a fallback, the job runs again there and only its result is reported.
+    job = new PreviewJob(new Archive::Entry(this, QStringLiteral("a.txt")), false, failingIface);
+    job->setFallbackInterface(iface);
+    job->setAutoDelete(false);
+    startAndWaitForResult(job);
+    QCOMPARE(job->error(), 0);
+    QVERIFY(job->errorText().isEmpty());
+    QCOMPARE(failingIface->m_extractionsCount.loadAcquire(), 2);
+    delete job;
+
+    failingIface->deleteLater();
+    iface->deleteLater();
+}
+
 void JobsTest::testRemoveEntries_data()
 {
     QTest::addColumn<QString>("jsonArchive");
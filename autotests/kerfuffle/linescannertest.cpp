@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "linescanner.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QTest>
+
+using namespace Kerfuffle;
+
+class LineScannerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testLines_data();
+    void testLines();
+    void testPendingLine();
+    void testReadFrom();
+    void benchmarkScanning_data();
+    void benchmarkScanning();
+
+private:
+    static QByteArray readOutput(const QString &fileName);
+};
+
+QTEST_GUILESS_MAIN(LineScannerTest)
+
+void LineScannerTest::testLines_data()
+{
+    QTest::addColumn<QByteArray>("output");
+    QTest::addColumn<int>("chunkSize");
+
+    const QByteArray output7z = readOutput(QFINDTESTDATA("../plugins/cli7zplugin/data/archive-zip-AES256-1602.txt"));
+    const QByteArray outputUnrar = readOutput(QFINDTESTDATA("../plugins/clirarplugin/data/archive-with-symlink-unrar5.txt"));
+    QVERIFY(!output7z.isEmpty());
+    QVERIFY(!outputUnrar.isEmpty());
+
+    for (int chunkSize : {1, 7, 4096}) {
+        QTest::newRow(qPrintable(QStringLiteral("7z, %1 bytes chunks").arg(chunkSize))) << output7z << chunkSize;
+        QTest::newRow(qPrintable(QStringLiteral("unrar, %1 bytes chunks").arg(chunkSize))) << outputUnrar << chunkSize;
+    }
+
+    QTest::newRow("no trailing newline") << QByteArrayLiteral("first\nsecond\nthird") << 4;
+    QTest::newRow("empty lines") << QByteArrayLiteral("\n\nfirst\n\n\nsecond\n\n") << 3;
+    QTest::newRow("no newline") << QByteArrayLiteral("Enter password (will not be echoed):") << 5;
+    QTest::newRow("empty") << QByteArray() << 1;
+}
+
+void LineScannerTest::testLines()
+{
+    QFETCH(QByteArray, output);
+    QFETCH(int, chunkSize);
+
+    LineScanner scanner;
+    QList<QByteArray> lines;
+    QByteArray line;
+
+    for (int pos = 0; pos < output.size(); pos += chunkSize) {
+        scanner.append(output.mid(pos, chunkSize));
+        while (scanner.nextLine(&line)) {
+            // The line is a view of the scanner buffer, copy it.
+            lines.append(QByteArray(line.constData(), line.size()));
+        }
+    }
+    lines.append(QByteArray(scanner.takeAll()));
+
+    QCOMPARE(lines, output.split('\n'));
+    QVERIFY(!scanner.nextLine(&line));
+    QVERIFY(scanner.takeAll().isEmpty());
+}
+
+void LineScannerTest::testPendingLine()
+{
+    LineScanner scanner;
+    QByteArray line;
+
+    scanner.append(QByteArrayLiteral("Path = a\nEnter password "));
+    QCOMPARE(scanner.pendingLine(), QByteArrayLiteral("Enter password "));
+
+    QVERIFY(scanner.nextLine(&line));
+    QCOMPARE(line, QByteArrayLiteral("Path = a"));
+    QVERIFY(!scanner.nextLine(&line));
+
+    scanner.append(QByteArrayLiteral("(will not be echoed):"));
+    QCOMPARE(scanner.pendingLine(), QByteArrayLiteral("Enter password (will not be echoed):"));
+
+    scanner.append(QByteArrayLiteral("\n"));
+    QVERIFY(scanner.pendingLine().isEmpty());
+    QVERIFY(scanner.nextLine(&line));
+    QCOMPARE(line, QByteArrayLiteral("Enter password (will not be echoed):"));
+
+    scanner.append(QByteArrayLiteral("Everything is Ok"));
+    scanner.clear();
+    QVERIFY(scanner.pendingLine().isEmpty());
+    QVERIFY(scanner.takeAll().isEmpty());
+}
+
+void LineScannerTest::testReadFrom()
+{
+    LineScanner scanner;
+    QByteArray line;
+
+    QBuffer device;
+    QVERIFY(device.open(QIODevice::ReadWrite));
+    QVERIFY(!scanner.readFrom(&device));
+
+    device.write(QByteArrayLiteral("Size = 42\nCRC = "));
+    device.seek(0);
+    QVERIFY(scanner.readFrom(&device));
+    QVERIFY(!scanner.readFrom(&device));
+
+    QVERIFY(scanner.nextLine(&line));
+    QCOMPARE(line, QByteArrayLiteral("Size = 42"));
+    QVERIFY(!scanner.nextLine(&line));
+    QCOMPARE(scanner.pendingLine(), QByteArrayLiteral("CRC = "));
+}
+
+void LineScannerTest::benchmarkScanning_data()
+{
+    QTest::addColumn<QString>("outputFile");
+    QTest::addColumn<bool>("useScanner");
+
+    const QString output7z = QFINDTESTDATA("../plugins/cli7zplugin/data/archive-zip-AES256-1602.txt");
+    const QString outputUnrar = QFINDTESTDATA("../plugins/clirarplugin/data/archive-with-symlink-unrar5.txt");
+
+    QTest::newRow("7z, split") << output7z << false;
+    QTest::newRow("7z, scanner") << output7z << true;
+    QTest::newRow("unrar, split") << outputUnrar << false;
+    QTest::newRow("unrar, scanner") << outputUnrar << true;
+}
+
+void LineScannerTest::benchmarkScanning()
+{
+    QFETCH(QString, outputFile);
+    QFETCH(bool, useScanner);
+
+    // Replay the recorded listing until it looks like the one of a big archive,
+    // in chunks of the size usually returned by a read on the process pipe.
+    const QByteArray recordedOutput = readOutput(outputFile);
+    QVERIFY(!recordedOutput.isEmpty());
+    QByteArray output;
+    while (output.size() < 16 * 1024 * 1024) {
+        output += recordedOutput;
+    }
+    const int chunkSize = 4096;
+
+    qint64 decodedSize = 0;
+
+    if (useScanner) {
+        QBENCHMARK {
+            decodedSize = 0;
+            LineScanner scanner;
+            QByteArray line;
+            for (int pos = 0; pos < output.size(); pos += chunkSize) {
+                scanner.append(QByteArray::fromRawData(output.constData() + pos, qMin(chunkSize, output.size() - pos)));
+                const QByteArray pendingLine = scanner.pendingLine();
+                if (!pendingLine.isEmpty()) {
+                    decodedSize += QString::fromLocal8Bit(pendingLine).size();
+                }
+                while (scanner.nextLine(&line)) {
+                    if (!line.isEmpty()) {
+                        decodedSize += QString::fromLocal8Bit(line).size();
+                    }
+                }
+            }
+        }
+    } else {
+        // What CliInterface::readStdout() used to do.
+        QBENCHMARK {
+            decodedSize = 0;
+            QByteArray stdOutData;
+            for (int pos = 0; pos < output.size(); pos += chunkSize) {
+                stdOutData += output.mid(pos, chunkSize);
+                QList<QByteArray> lines = stdOutData.split('\n');
+                for (int i = 0; i < 4; ++i) {
+                    decodedSize += QString(QLatin1String(lines.last())).size();
+                }
+                stdOutData = lines.takeLast();
+                for (const QByteArray &line : qAsConst(lines)) {
+                    if (!line.isEmpty()) {
+                        decodedSize += QString::fromLocal8Bit(line).size();
+                    }
+                }
+            }
+        }
+    }
+
+    QVERIFY(decodedSize > 0);
+}
+
+QByteArray LineScannerTest::readOutput(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+#include "linescannertest.moc"
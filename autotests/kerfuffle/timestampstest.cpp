@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "timestamps.h"
+
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QTest>
+#include <QTextStream>
+
+using namespace Kerfuffle;
+
+enum Layout {
+    Long,
+    Compact,
+    Short
+};
+
+Q_DECLARE_METATYPE(Layout)
+
+class TimestampsTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRecordedTimestamps_data();
+    void testRecordedTimestamps();
+    void testTimestamp_data();
+    void testTimestamp();
+    void testInvalidTimestamp_data();
+    void testInvalidTimestamp();
+    void benchmarkParsing_data();
+    void benchmarkParsing();
+
+private:
+    static QDateTime parse(Layout layout, const QString &date, const QString &time);
+    static QDateTime parseWithFormat(Layout layout, const QString &date, const QString &time);
+    static void readRecordedTimestamps(const QString &directory, const QString &pattern, QStringList *dates, QStringList *times);
+};
+
+QTEST_GUILESS_MAIN(TimestampsTest)
+
+QDateTime TimestampsTest::parse(Layout layout, const QString &date, const QString &time)
+{
+    switch (layout) {
+    case Long: {
+        const QString text = date + QLatin1Char(' ') + time;
+        return parseTimestamp(QStringRef(&text));
+    }
+    case Compact:
+        return parseCompactTimestamp(QStringRef(&date), QStringRef(&time));
+    case Short:
+        return parseShortTimestamp(QStringRef(&date), QStringRef(&time));
+    }
+    return QDateTime();
+}
+
+// How the plugins parsed timestamps before the fixed layout parsers.
+QDateTime TimestampsTest::parseWithFormat(Layout layout, const QString &date, const QString &time)
+{
+    QDateTime ts;
+    switch (layout) {
+    case Long:
+        ts = QDateTime::fromString(date + QLatin1Char(' ') + time,
+                                   time.contains(QLatin1Char(',')) ? QStringLiteral("yyyy-MM-dd HH:mm:ss,zzz") : QStringLiteral("yyyy-MM-dd hh:mm:ss"));
+        break;
+    case Compact:
+        ts = QDateTime(QDate::fromString(date, QStringLiteral("yyyyMMdd")),
+                       QTime::fromString(time, QStringLiteral("hhmmss")));
+        break;
+    case Short:
+        ts = QDateTime::fromString(date + QLatin1Char(' ') + time, QStringLiteral("dd-MM-yy hh:mm"));
+        if (ts.date().year() < 1950) {
+            ts = ts.addYears(100);
+        }
+        break;
+    }
+    return ts;
+}
+
+void TimestampsTest::readRecordedTimestamps(const QString &directory, const QString &pattern, QStringList *dates, QStringList *times)
+{
+    const QRegularExpression rx(pattern);
+    const QStringList files = QDir(directory).entryList({QStringLiteral("*.txt")}, QDir::Files);
+    for (const QString &fileName : files) {
+        QFile file(QDir(directory).filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        QTextStream stream(&file);
+        while (!stream.atEnd()) {
+            const QRegularExpressionMatch match = rx.match(stream.readLine());
+            if (match.hasMatch()) {
+                dates->append(match.captured(1));
+                times->append(match.captured(2));
+            }
+        }
+    }
+}
+
+void TimestampsTest::testRecordedTimestamps_data()
+{
+    QTest::addColumn<Layout>("layout");
+    QTest::addColumn<QStringList>("dates");
+    QTest::addColumn<QStringList>("times");
+
+    const QString dataDir7z = QFINDTESTDATA("../plugins/cli7zplugin/data");
+    const QString dataDirRar = QFINDTESTDATA("../plugins/clirarplugin/data");
+    const QString dataDirZip = QFINDTESTDATA("../plugins/clizipplugin/data");
+    QVERIFY(!dataDir7z.isEmpty());
+    QVERIFY(!dataDirRar.isEmpty());
+    QVERIFY(!dataDirZip.isEmpty());
+
+    QStringList dates;
+    QStringList times;
+    readRecordedTimestamps(dataDir7z, QStringLiteral("^Modified = (\\S+) (\\S+)$"), &dates, &times);
+    QTest::newRow("7z") << Long << dates << times;
+
+    dates.clear();
+    times.clear();
+    readRecordedTimestamps(dataDirRar, QStringLiteral("^\\s+mtime: (\\S+) (\\S+)$"), &dates, &times);
+    QTest::newRow("unrar 5") << Long << dates << times;
+
+    dates.clear();
+    times.clear();
+    readRecordedTimestamps(dataDirRar, QStringLiteral("\\s(\\d\\d-\\d\\d-\\d\\d) (\\d\\d:\\d\\d)\\s"), &dates, &times);
+    QTest::newRow("unrar 4") << Short << dates << times;
+
+    dates.clear();
+    times.clear();
+    readRecordedTimestamps(dataDirZip, QStringLiteral("\\s(\\d{8})\\.(\\d{6})\\s"), &dates, &times);
+    QTest::newRow("zipinfo") << Compact << dates << times;
+}
+
+void TimestampsTest::testRecordedTimestamps()
+{
+    QFETCH(Layout, layout);
+    QFETCH(QStringList, dates);
+    QFETCH(QStringList, times);
+
+    QVERIFY(!dates.isEmpty());
+    for (int i = 0; i < dates.size(); ++i) {
+        // Some unrar 4 sub-headers have a zeroed, invalid date.
+        const QDateTime expected = parseWithFormat(layout, dates.at(i), times.at(i));
+        const QDateTime actual = parse(layout, dates.at(i), times.at(i));
+        QCOMPARE(actual.isValid(), expected.isValid());
+        if (expected.isValid()) {
+            QCOMPARE(actual, expected);
+        }
+    }
+}
+
+void TimestampsTest::testTimestamp_data()
+{
+    QTest::addColumn<Layout>("layout");
+    QTest::addColumn<QString>("date");
+    QTest::addColumn<QString>("time");
+    QTest::addColumn<QDateTime>("expected");
+
+    QTest::newRow("long") << Long << QStringLiteral("2016-03-21") << QStringLiteral("08:58:16")
+                          << QDateTime(QDate(2016, 3, 21), QTime(8, 58, 16));
+    QTest::newRow("long with milliseconds") << Long << QStringLiteral("2016-03-21") << QStringLiteral("23:58:16,250")
+                                            << QDateTime(QDate(2016, 3, 21), QTime(23, 58, 16, 250));
+    QTest::newRow("compact") << Compact << QStringLiteral("20100215") << QStringLiteral("211928")
+                             << QDateTime(QDate(2010, 2, 15), QTime(21, 19, 28));
+    QTest::newRow("short, 20th century") << Short << QStringLiteral("31-12-99") << QStringLiteral("23:59")
+                                         << QDateTime(QDate(1999, 12, 31), QTime(23, 59));
+    QTest::newRow("short, 21st century") << Short << QStringLiteral("01-01-00") << QStringLiteral("00:00")
+                                         << QDateTime(QDate(2000, 1, 1), QTime(0, 0));
+    QTest::newRow("short, leap day") << Short << QStringLiteral("29-02-16") << QStringLiteral("12:00")
+                                     << QDateTime(QDate(2016, 2, 29), QTime(12, 0));
+}
+
+void TimestampsTest::testTimestamp()
+{
+    QFETCH(Layout, layout);
+    QFETCH(QString, date);
+    QFETCH(QString, time);
+    QFETCH(QDateTime, expected);
+
+    QCOMPARE(parse(layout, date, time), expected);
+}
+
+void TimestampsTest::testInvalidTimestamp_data()
+{
+    QTest::addColumn<Layout>("layout");
+    QTest::addColumn<QString>("date");
+    QTest::addColumn<QString>("time");
+
+    QTest::newRow("long, empty") << Long << QString() << QString();
+    QTest::newRow("long, truncated") << Long << QStringLiteral("2016-03-21") << QStringLiteral("08:58");
+    QTest::newRow("long, wrong separator") << Long << QStringLiteral("2016/03/21") << QStringLiteral("08:58:16");
+    QTest::newRow("long, not a number") << Long << QStringLiteral("2016-0x-21") << QStringLiteral("08:58:16");
+    QTest::newRow("long, invalid month") << Long << QStringLiteral("2016-13-21") << QStringLiteral("08:58:16");
+    QTest::newRow("long, invalid day") << Long << QStringLiteral("2015-02-29") << QStringLiteral("08:58:16");
+    QTest::newRow("long, invalid hour") << Long << QStringLiteral("2016-03-21") << QStringLiteral("24:58:16");
+    QTest::newRow("long, bad milliseconds") << Long << QStringLiteral("2016-03-21") << QStringLiteral("08:58:16.250");
+    QTest::newRow("compact, truncated") << Compact << QStringLiteral("2010021") << QStringLiteral("211928");
+    QTest::newRow("compact, invalid minute") << Compact << QStringLiteral("20100215") << QStringLiteral("216028");
+    QTest::newRow("short, wrong separator") << Short << QStringLiteral("21.03.16") << QStringLiteral("08:57");
+    QTest::newRow("short, negative") << Short << QStringLiteral("21-03-16") << QStringLiteral("-8:57");
+}
+
+void TimestampsTest::testInvalidTimestamp()
+{
+    QFETCH(Layout, layout);
+    QFETCH(QString, date);
+    QFETCH(QString, time);
+
+    QVERIFY(!parse(layout, date, time).isValid());
+}
+
+void TimestampsTest::benchmarkParsing_data()
+{
+    QTest::addColumn<bool>("withFormat");
+
+    QTest::newRow("QDateTime::fromString") << true;
+    QTest::newRow("parseTimestamp") << false;
+}
+
+void TimestampsTest::benchmarkParsing()
+{
+    QFETCH(bool, withFormat);
+
+    // The mtime lines of a large unrar 5 listing.
+    QStringList timestamps;
+    for (int i = 0; i < 10000; ++i) {
+        timestamps.append(QStringLiteral("2016-03-21 08:%1:%2,000").arg(i / 60 % 60, 2, 10, QLatin1Char('0'))
+                                                                 .arg(i % 60, 2, 10, QLatin1Char('0')));
+    }
+
+    const QString format = QStringLiteral("yyyy-MM-dd HH:mm:ss,zzz");
+    int validCount = 0;
+    QBENCHMARK {
+        validCount = 0;
+        for (const QString &timestamp : qAsConst(timestamps)) {
+            const QDateTime ts = withFormat ? QDateTime::fromString(timestamp, format) : parseTimestamp(QStringRef(&timestamp));
+            if (ts.isValid()) {
+                validCount++;
+            }
+        }
+    }
+    QCOMPARE(validCount, timestamps.size());
+}
+
+#include "timestampstest.moc"
@@ -0,0 +1,202 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+
+using namespace Kerfuffle;
+
+class SpanThread : public QThread
+{
+protected:
+    void run() override
+    {
+        TraceSpan span("threaded", "test");
+    }
+};
+
+class TracerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testDisabled();
+    void testSpans();
+    void testCounters();
+    void testWrite();
+
+private:
+    static QJsonArray traceEvents(const QString &phase);
+};
+
+QTEST_GUILESS_MAIN(TracerTest)
+
+void TracerTest::init()
+{
+    Tracer::clear();
+}
+
+void TracerTest::cleanup()
+{
+    Tracer::setOutputFile(QString());
+    Tracer::clear();
+}
+
+QJsonArray TracerTest::traceEvents(const QString &phase)
+{
+    const QJsonObject document = QJsonDocument::fromJson(Tracer::toJson()).object();
+
+    QJsonArray events;
+    for (const QJsonValue &event : document.value(QStringLiteral("traceEvents")).toArray()) {
+        if (event.toObject().value(QStringLiteral("ph")).toString() == phase) {
+            events.append(event);
+        }
+    }
+
+    return events;
+}
+
+void TracerTest::testDisabled()
+{
+    Tracer::setOutputFile(QString());
+    QVERIFY(!Tracer::isEnabled());
+
+    {
+        TraceSpan span("ignored");
+        span.setArg(QStringLiteral("bytes"), 42);
+    }
+    Tracer::addCounter("ignored", {{QStringLiteral("bytes"), 42}});
+
+    QVERIFY(traceEvents(QStringLiteral("X")).isEmpty());
+    QVERIFY(traceEvents(QStringLiteral("C")).isEmpty());
+}
+
+void TracerTest::testSpans()
+{
+    QTemporaryDir dir;
+    Tracer::setOutputFile(dir.filePath(QStringLiteral("trace.json")));
+    QVERIFY(Tracer::isEnabled());
+
+    {
+        TraceSpan outer("outer", "test");
+        outer.setArg(QStringLiteral("entries"), 3);
+        TraceSpan inner("inner", "test");
+        QThread::msleep(5);
+        inner.end();
+        // Ending twice doesn't record the span again.
+        inner.end();
+    }
+
+    SpanThread thread;
+    thread.setObjectName(QStringLiteral("Worker"));
+    thread.start();
+    QVERIFY(thread.wait(5000));
+
+    const QJsonArray spans = traceEvents(QStringLiteral("X"));
+    QCOMPARE(spans.size(), 3);
+
+    const QJsonObject inner = spans.at(0).toObject();
+    const QJsonObject outer = spans.at(1).toObject();
+    const QJsonObject threaded = spans.at(2).toObject();
+    QCOMPARE(inner.value(QStringLiteral("name")).toString(), QStringLiteral("inner"));
+    QCOMPARE(outer.value(QStringLiteral("name")).toString(), QStringLiteral("outer"));
+    QCOMPARE(outer.value(QStringLiteral("cat")).toString(), QStringLiteral("test"));
+    QCOMPARE(outer.value(QStringLiteral("args")).toObject().value(QStringLiteral("entries")).toInt(), 3);
+    QVERIFY(inner.value(QStringLiteral("dur")).toDouble() >= 5000);
+    QVERIFY(outer.value(QStringLiteral("dur")).toDouble() >= inner.value(QStringLiteral("dur")).toDouble());
+    QVERIFY(outer.value(QStringLiteral("ts")).toDouble() <= inner.value(QStringLiteral("ts")).toDouble());
+    QCOMPARE(inner.value(QStringLiteral("tid")).toInt(), outer.value(QStringLiteral("tid")).toInt());
+    QVERIFY(threaded.value(QStringLiteral("tid")).toInt() != outer.value(QStringLiteral("tid")).toInt());
+
+    // Each thread is named once.
+    const QJsonArray metadata = traceEvents(QStringLiteral("M"));
+    QCOMPARE(metadata.size(), 2);
+    QCOMPARE(metadata.at(1).toObject().value(QStringLiteral("args")).toObject().value(QStringLiteral("name")).toString(), QStringLiteral("Worker"));
+}
+
+void TracerTest::testCounters()
+{
+    QTemporaryDir dir;
+    Tracer::setOutputFile(dir.filePath(QStringLiteral("trace.json")));
+
+    Tracer::addCounter("progress", {{QStringLiteral("bytes"), 1024}, {QStringLiteral("entries"), 2}});
+
+    const QJsonArray counters = traceEvents(QStringLiteral("C"));
+    QCOMPARE(counters.size(), 1);
+    const QJsonObject args = counters.at(0).toObject().value(QStringLiteral("args")).toObject();
+    QCOMPARE(args.value(QStringLiteral("bytes")).toInt(), 1024);
+    QCOMPARE(args.value(QStringLiteral("entries")).toInt(), 2);
+}
+
+void TracerTest::testWrite()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath(QStringLiteral("trace.json"));
+    Tracer::setOutputFile(fileName);
+    QCOMPARE(Tracer::outputFile(), fileName);
+
+    {
+        TraceSpan span("written");
+    }
+    QVERIFY(Tracer::write());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), Tracer::toJson());
+}
+
+void TracerTest::testWriteOnQuit()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath(QStringLiteral("trace.json"));
+    Tracer::setOutputFile(fileName);
+
+    {
+        TraceSpan span("beforeQuit");
+    }
+    // Drop what a periodic write might have written already.
+    QFile::remove(fileName);
+
+    // The trace is written before the application gets destroyed.
+    QVERIFY(QMetaObject::invokeMethod(QCoreApplication::instance(), "aboutToQuit"));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), Tracer::toJson());
+}
+
+#include "tracertest.moc"
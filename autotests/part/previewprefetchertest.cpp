@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2026 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "previewprefetcher.h"
+#include "archive_kerfuffle.h"
+#include "extractedentrycache.h"
+#include "jobs.h"
+#include "testhelper.h"
+
+#include <QFile>
+#include <QHash>
+#include <QTest>
+
+using namespace Kerfuffle;
+
+class PreviewPrefetcherTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testPrefetch();
+    void testStop();
+    void testReusePrefetchedEntry();
+
+private:
+    QVector<Archive::Entry*> entries(const QStringList &paths) const;
+
+    LoadJob *m_loadJob = nullptr;
+    Archive *m_archive = nullptr;
+    QHash<QString, Archive::Entry*> m_entries;
+};
+
+QTEST_GUILESS_MAIN(PreviewPrefetcherTest)
+
+void PreviewPrefetcherTest::init()
+{
+    ExtractedEntryCache::instance()->clear();
+
+    m_entries.clear();
+    m_loadJob = Archive::load(QFINDTESTDATA("data/simplearchive.tar.gz"));
+    m_loadJob->setAutoDelete(false);
+    connect(m_loadJob, &Job::newEntry, this, [this](Archive::Entry *entry) {
+        m_entries.insert(entry->fullPath(), entry);
+    });
+    TestHelper::startAndWaitForResult(m_loadJob);
+    m_archive = m_loadJob->archive();
+
+    if (!m_archive->isValid() || !m_archive->canQueueReadJobs()) {
+        QSKIP("No in-process plugin for tar.gz archives. Skipping test.", SkipSingle);
+    }
+}
+
+void PreviewPrefetcherTest::cleanup()
+{
+    ExtractedEntryCache::instance()->clear();
+
+    m_loadJob->deleteLater();
+    m_archive->deleteLater();
+}
+
+QVector<Archive::Entry*> PreviewPrefetcherTest::entries(const QStringList &paths) const
+{
+    QVector<Archive::Entry*> entries;
+    for (const QString &path : paths) {
+        entries.append(m_entries.value(path));
+    }
+    return entries;
+}
+
+void PreviewPrefetcherTest::testPrefetch()
+{
+    const QStringList paths = {QStringLiteral("a.txt"), QStringLiteral("aDir/b.txt"), QStringLiteral("c.txt")};
+    QCOMPARE(entries(paths).count(nullptr), 0);
+
+    PreviewPrefetcher prefetcher;
+    prefetcher.prefetch(m_archive, entries(paths));
+
+    // The entries are extracted one after another into the cache.
+    const ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    QTRY_VERIFY(cache->contains(m_archive->fileName(), QStringLiteral("c.txt")));
+    for (const QString &path : paths) {
+        QVERIFY(cache->contains(m_archive->fileName(), path));
+    }
+    QCOMPARE(cache->count(), paths.size());
+}
+
+void PreviewPrefetcherTest::testStop()
+{
+    PreviewPrefetcher prefetcher;
+    prefetcher.prefetch(m_archive, entries({QStringLiteral("a.txt"), QStringLiteral("aDir/b.txt"), QStringLiteral("c.txt")}));
+
+    // The pending entries are dropped, the extraction in progress is interrupted without being waited for.
+    prefetcher.stop();
+    prefetcher.waitForJobs();
+    QTest::qWait(100);
+
+    const ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    QVERIFY(!cache->contains(m_archive->fileName(), QStringLiteral("aDir/b.txt")));
+    QVERIFY(!cache->contains(m_archive->fileName(), QStringLiteral("c.txt")));
+
+    // A new prefetching starts from scratch.
+    prefetcher.prefetch(m_archive, entries({QStringLiteral("c.txt")}));
+    QTRY_VERIFY(cache->contains(m_archive->fileName(), QStringLiteral("c.txt")));
+}
+
+void PreviewPrefetcherTest::testReusePrefetchedEntry()
+{
+    PreviewPrefetcher prefetcher;
+    prefetcher.prefetch(m_archive, entries({QStringLiteral("a.txt")}));
+
+    // The user previews the entry being prefetched: the prefetching goes on
+    // and the preview, queued after it, copies the entry from the cache.
+    auto job = m_archive->preview(m_entries.value(QStringLiteral("a.txt")));
+    job->setAutoDelete(false);
+    prefetcher.stop(job);
+    TestHelper::startAndWaitForResult(job);
+
+    QCOMPARE(job->error(), 0);
+    QVERIFY(job->isExtractedFromCache());
+    QFile file(job->validatedFilePath());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), QByteArrayLiteral("ark\n"));
+
+    job->deleteLater();
+}
+
+#include "previewprefetchertest.moc"
@@ -26,9 +26,11 @@
 #include "cli7ztest.h"
 #include "cliplugin.h"
 #include "archive_kerfuffle.h"
+#include "extractedentrycache.h"
 #include "jobs.h"
 #include "testhelper.h"
 
+#include <QDirIterator>
 #include <QFile>
 #include <QSignalSpy>
 #include <QTest>
@@ -242,6 +244,118 @@ void Cli7zTest::testList()
     plugin->deleteLater();
 }
 
+void Cli7zTest::testSolid_data()
+{
+    QTest::addColumn<QString>("outputTextFile");
+    QTest::addColumn<bool>("isSolid");
+
+    QTest::newRow("solid 7z")
+            << QFINDTESTDATA("data/archive-encrypted-1602.txt") << true;
+
+    QTest::newRow("zip")
+            << QFINDTESTDATA("data/archive-zip-AES256-1602.txt") << false;
+}
+
+void Cli7zTest::testSolid()
+{
+    qRegisterMetaType<Archive::Entry*>("Archive::Entry*");
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.7z"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+
+    QFETCH(QString, outputTextFile);
+    QFile outputText(outputTextFile);
+    QVERIFY(outputText.open(QIODevice::ReadOnly));
+
+    QTextStream outputStream(&outputText);
+    while (!outputStream.atEnd()) {
+        QVERIFY(plugin->readListLine(outputStream.readLine()));
+    }
+
+    QFETCH(bool, isSolid);
+    QCOMPARE(plugin->isSolid(), isSolid);
+
+    plugin->deleteLater();
+}
+
+void Cli7zTest::testSolidBatch()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("cli7z plugin not available. Skipping test.", SkipSingle);
+    }
+
+    const QString archivePath = QFINDTESTDATA("data/solid.7z");
+    auto loadJob = Archive::load(archivePath, m_plugin, this);
+    QVERIFY(loadJob);
+
+    QHash<QString, Archive::Entry*> entries;
+    connect(loadJob, &Job::newEntry, this, [&entries](Archive::Entry *entry) {
+        entries.insert(entry->fullPath(), entry);
+    });
+
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    if (!archive->isValid()) {
+        QSKIP("Could not load the cli7z plugin. Skipping test.", SkipSingle);
+    }
+
+    // The archive holds a.txt, b.txt, c.txt and d.txt, in this order and of 1000 bytes each.
+    QCOMPARE(entries.size(), 4);
+    ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    QVERIFY(cache);
+    const qint64 defaultMaxSize = cache->maxSize();
+    cache->clear();
+    cache->setMaxSize(4000);
+
+    auto preview = [&](const QString &path) {
+        auto previewJob = archive->preview(entries.value(path));
+        previewJob->setAutoDelete(false);
+        TestHelper::startAndWaitForResult(previewJob);
+        QCOMPARE(previewJob->error(), 0);
+
+        QFile previewedFile(previewJob->validatedFilePath());
+        QVERIFY(previewedFile.open(QIODevice::ReadOnly));
+        QCOMPARE(previewedFile.readAll(), QByteArray(path.toUtf8().left(1).repeated(99) + '\n').repeated(10));
+
+        // Only the previewed file is left in the preview dir.
+        QStringList previewDirFiles;
+        QDirIterator dirIt(previewJob->tempDir()->path(), QDir::Files | QDir::System | QDir::Hidden, QDirIterator::Subdirectories);
+        while (dirIt.hasNext()) {
+            previewDirFiles << QDir(previewJob->tempDir()->path()).relativeFilePath(dirIt.next());
+        }
+        QCOMPARE(previewDirFiles, QStringList{path});
+
+        delete previewJob;
+    };
+
+    // The batch holds the previous files up to half of the cache size.
+    preview(QStringLiteral("d.txt"));
+    QCOMPARE(cache->count(), 2);
+    QVERIFY(cache->contains(archivePath, QStringLiteral("c.txt")));
+    QVERIFY(cache->contains(archivePath, QStringLiteral("d.txt")));
+
+    // Cached files are left out of the next batches.
+    preview(QStringLiteral("b.txt"));
+    QCOMPARE(cache->count(), 4);
+    QVERIFY(cache->contains(archivePath, QStringLiteral("a.txt")));
+    QVERIFY(cache->contains(archivePath, QStringLiteral("b.txt")));
+
+    // Previews of the cached files are hits, and make them the most recently used.
+    preview(QStringLiteral("c.txt"));
+    preview(QStringLiteral("d.txt"));
+    QCOMPARE(cache->count(), 4);
+
+    cache->setMaxSize(2000);
+    QCOMPARE(cache->count(), 2);
+    QVERIFY(cache->contains(archivePath, QStringLiteral("c.txt")));
+    QVERIFY(cache->contains(archivePath, QStringLiteral("d.txt")));
+
+    cache->setMaxSize(defaultMaxSize);
+    cache->clear();
+    archive->deleteLater();
+}
+
 void Cli7zTest::testListArgs_data()
 {
     QTest::addColumn<QString>("archiveName");
@@ -305,6 +419,8 @@ void Cli7zTest::testAddArgs_data()
             << QStringList {
                    QStringLiteral("a"),
                    QStringLiteral("-l"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-mx=5"),
                    QStringLiteral("-m0=LZMA2"),
                    QStringLiteral("/tmp/foo.7z")
@@ -316,6 +432,8 @@ void Cli7zTest::testAddArgs_data()
             << QStringList {
                    QStringLiteral("a"),
                    QStringLiteral("-l"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-p1234"),
                    QStringLiteral("-mx=5"),
                    QStringLiteral("-m0=LZMA2"),
@@ -328,6 +446,8 @@ void Cli7zTest::testAddArgs_data()
             << QStringList {
                    QStringLiteral("a"),
                    QStringLiteral("-l"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-p1234"),
                    QStringLiteral("-mhe=on"),
                    QStringLiteral("-mx=5"),
@@ -341,6 +461,8 @@ void Cli7zTest::testAddArgs_data()
             << QStringList {
                    QStringLiteral("a"),
                    QStringLiteral("-l"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-mx=5"),
                    QStringLiteral("-m0=LZMA2"),
                    QStringLiteral("-v2500k"),
@@ -353,6 +475,8 @@ void Cli7zTest::testAddArgs_data()
             << QStringList {
                    QStringLiteral("a"),
                    QStringLiteral("-l"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-mx=5"),
                    QStringLiteral("-m0=BZip2"),
                    QStringLiteral("/tmp/foo.7z")
@@ -401,6 +525,8 @@ void Cli7zTest::testExtractArgs_data()
             << true << QStringLiteral("1234")
             << QStringList {
                    QStringLiteral("x"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-p1234"),
                    QStringLiteral("/tmp/foo.7z"),
                    QStringLiteral("aDir/textfile2.txt"),
@@ -416,6 +542,8 @@ void Cli7zTest::testExtractArgs_data()
             << true << QString()
             << QStringList {
                    QStringLiteral("x"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("/tmp/foo.7z"),
                    QStringLiteral("aDir/textfile2.txt"),
                    QStringLiteral("c.txt"),
@@ -430,6 +558,8 @@ void Cli7zTest::testExtractArgs_data()
             << false << QStringLiteral("1234")
             << QStringList {
                    QStringLiteral("e"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("-p1234"),
                    QStringLiteral("/tmp/foo.7z"),
                    QStringLiteral("aDir/textfile2.txt"),
@@ -445,6 +575,8 @@ void Cli7zTest::testExtractArgs_data()
             << false << QString()
             << QStringList {
                    QStringLiteral("e"),
+                   QStringLiteral("-bsp1"),
+                   QStringLiteral("-bb1"),
                    QStringLiteral("/tmp/foo.7z"),
                    QStringLiteral("aDir/textfile2.txt"),
                    QStringLiteral("c.txt"),
@@ -479,6 +611,190 @@ void Cli7zTest::testExtractArgs()
     plugin->deleteLater();
 }
 
+void Cli7zTest::testMoveArgs_data()
+{
+    QTest::addColumn<QString>("archiveName");
+    QTest::addColumn<QVector<Archive::Entry*>>("entries");
+    QTest::addColumn<Archive::Entry*>("destination");
+    QTest::addColumn<QString>("password");
+    QTest::addColumn<bool>("encryptHeader");
+    QTest::addColumn<QStringList>("expectedArgs");
+
+    QTest::newRow("rename a file")
+            << QStringLiteral("/tmp/foo.7z")
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("aDir/textfile2.txt"), QStringLiteral("aDir"))
+               }
+            << new Archive::Entry(this, QStringLiteral("aDir/renamed.txt"), QStringLiteral("aDir"))
+            << QString() << false
+            << QStringList {
+                   QStringLiteral("rn"),
+                   QStringLiteral("/tmp/foo.7z"),
+                   QStringLiteral("aDir/textfile2.txt"),
+                   QStringLiteral("aDir/renamed.txt")
+               };
+
+    QTest::newRow("move entries to a folder")
+            << QStringLiteral("/tmp/foo.7z")
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("aDir/"), QString()),
+                   new Archive::Entry(this, QStringLiteral("c.txt"), QString())
+               }
+            << new Archive::Entry(this, QStringLiteral("anotherDir/"), QString())
+            << QString() << false
+            << QStringList {
+                   QStringLiteral("rn"),
+                   QStringLiteral("/tmp/foo.7z"),
+                   QStringLiteral("aDir"),
+                   QStringLiteral("anotherDir/aDir"),
+                   QStringLiteral("c.txt"),
+                   QStringLiteral("anotherDir/c.txt")
+               };
+
+    QTest::newRow("encrypted")
+            << QStringLiteral("/tmp/foo.7z")
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("c.txt"), QString())
+               }
+            << new Archive::Entry(this, QStringLiteral("d.txt"), QString())
+            << QStringLiteral("1234") << false
+            << QStringList {
+                   QStringLiteral("rn"),
+                   QStringLiteral("-p1234"),
+                   QStringLiteral("/tmp/foo.7z"),
+                   QStringLiteral("c.txt"),
+                   QStringLiteral("d.txt")
+               };
+
+    // The headers are rewritten and must stay encrypted.
+    QTest::newRow("header-encrypted")
+            << QStringLiteral("/tmp/foo.7z")
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("c.txt"), QString())
+               }
+            << new Archive::Entry(this, QStringLiteral("d.txt"), QString())
+            << QStringLiteral("1234") << true
+            << QStringList {
+                   QStringLiteral("rn"),
+                   QStringLiteral("-p1234"),
+                   QStringLiteral("-mhe=on"),
+                   QStringLiteral("/tmp/foo.7z"),
+                   QStringLiteral("c.txt"),
+                   QStringLiteral("d.txt")
+               };
+}
+
+void Cli7zTest::testMoveArgs()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("cli7z plugin not available. Skipping test.", SkipSingle);
+    }
+
+    QFETCH(QString, archiveName);
+    CliPlugin *plugin = new CliPlugin(this, {QVariant(archiveName),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QVERIFY(plugin);
+
+    QFETCH(QVector<Archive::Entry*>, entries);
+    QFETCH(Archive::Entry*, destination);
+    QFETCH(QString, password);
+    QFETCH(bool, encryptHeader);
+
+    const auto replacedArgs = plugin->cliProperties()->moveArgs(archiveName, entries, destination, password, encryptHeader);
+
+    QFETCH(QStringList, expectedArgs);
+    QCOMPARE(replacedArgs, expectedArgs);
+
+    plugin->deleteLater();
+}
+
+void Cli7zTest::testProgress_data()
+{
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<int>("expectedPercentage");
+    QTest::addColumn<bool>("expectedEntryProcessed");
+
+    // Lines printed by 7z -bsp1 -bb1, which overwrites the progress with backspaces.
+    QTest::newRow("first update") << QStringLiteral("  0%") << 0 << false;
+    QTest::newRow("update with current entry")
+            << QStringLiteral("  0%\b\b\b\b    \b\b\b\b 45% 3 - aDir/textfile2.txt") << 45 << false;
+    QTest::newRow("last update") << QStringLiteral(" 99%\b\b\b\b100%") << 100 << false;
+    QTest::newRow("extracted entry after erased progress")
+            << QStringLiteral("\b\b\b\b    \b\b\b\b- aDir/textfile2.txt") << -1 << true;
+    QTest::newRow("added entry") << QStringLiteral("+ c.txt") << -1 << true;
+    QTest::newRow("entry named like a percentage") << QStringLiteral("- 50% off.txt") << -1 << true;
+    QTest::newRow("error") << QStringLiteral("ERROR: CRC Failed : c.txt") << -1 << false;
+    QTest::newRow("summary") << QStringLiteral("Everything is Ok") << -1 << false;
+}
+
+void Cli7zTest::testProgress()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("cli7z plugin not available. Skipping test.", SkipSingle);
+    }
+
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.7z"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QVERIFY(plugin);
+
+    QFETCH(QString, line);
+    QFETCH(int, expectedPercentage);
+    QFETCH(bool, expectedEntryProcessed);
+
+    QCOMPARE(plugin->readProgressPercentage(line), expectedPercentage);
+    QCOMPARE(plugin->isEntryProcessedMsg(line), expectedEntryProcessed);
+
+    plugin->deleteLater();
+}
+
+void Cli7zTest::testErasedProgress()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("cli7z plugin not available. Skipping test.", SkipSingle);
+    }
+
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.7z"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QVERIFY(plugin);
+
+    // Output of 7z x -bsp1 -bb1, where messages and the prompt follow the erased progress.
+    QFile outputText(QFINDTESTDATA("data/extract-overwrite-bsp1-1602.txt"));
+    QVERIFY(outputText.open(QIODevice::ReadOnly));
+
+    int fileExistsPrompts = 0;
+    int processedEntries = 0;
+    QString existingFileName;
+    bool isTestPassed = false;
+
+    QTextStream outputStream(&outputText);
+    while (!outputStream.atEnd()) {
+        const QString line = plugin->stripErasedText(outputStream.readLine());
+
+        if (plugin->isFileExistsFileName(line)) {
+            existingFileName = plugin->cliProperties()->fileExistsFileName(line);
+        }
+        if (plugin->isFileExistsMsg(line)) {
+            fileExistsPrompts++;
+        }
+        if (plugin->isEntryProcessedMsg(line)) {
+            processedEntries++;
+        }
+        isTestPassed |= plugin->cliProperties()->isTestPassedMsg(line);
+
+        QVERIFY(!plugin->isPasswordPrompt(line));
+        QVERIFY(!plugin->isWrongPasswordMsg(line));
+        QVERIFY(!plugin->isCorruptArchiveMsg(line));
+        QVERIFY(plugin->readExtractLine(line));
+    }
+
+    QCOMPARE(fileExistsPrompts, 1);
+    QCOMPARE(existingFileName, QStringLiteral("aDir/c.txt"));
+    QCOMPARE(processedEntries, 2);
+    QVERIFY(isTestPassed);
+
+    plugin->deleteLater();
+}
+
 void Cli7zTest::testRDAAttributes()
 {
     if (!m_plugin->isValid()) {
@@ -499,3 +815,50 @@ void Cli7zTest::testRDAAttributes()
     QCOMPARE(numberOfFolders, 2);
 }
 
+void Cli7zTest::benchmarkList_data()
+{
+    QTest::addColumn<QString>("outputTextFile");
+    QTest::addColumn<int>("expectedEntriesCount");
+
+    QTest::newRow("normal-file-1602")
+            << QFINDTESTDATA("data/archive-with-symlink-1602.txt") << 10;
+    QTest::newRow("zip-with-AES256-encryption")
+            << QFINDTESTDATA("data/archive-zip-AES256-1602.txt") << 4;
+    QTest::newRow("normal-file-9381")
+            << QFINDTESTDATA("data/archive-with-symlink-9381.txt") << 10;
+}
+
+void Cli7zTest::benchmarkList()
+{
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.7z"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+
+    int entriesCount = 0;
+    connect(plugin, &CliPlugin::entry, this, [&entriesCount](Archive::Entry *entry) {
+        entriesCount++;
+        delete entry;
+    });
+
+    QFETCH(QString, outputTextFile);
+    QFile outputText(outputTextFile);
+    QVERIFY(outputText.open(QIODevice::ReadOnly));
+
+    QStringList lines;
+    QTextStream outputStream(&outputText);
+    while (!outputStream.atEnd()) {
+        lines.append(outputStream.readLine());
+    }
+
+    QBENCHMARK {
+        entriesCount = 0;
+        plugin->resetParsing();
+        for (const QString &line : qAsConst(lines)) {
+            QVERIFY(plugin->readListLine(line));
+        }
+    }
+
+    QFETCH(int, expectedEntriesCount);
+    QCOMPARE(entriesCount, expectedEntriesCount);
+
+    plugin->deleteLater();
+}
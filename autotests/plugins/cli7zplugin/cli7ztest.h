@@ -40,13 +40,23 @@ private Q_SLOTS:
     void testArchive();
     void testList_data();
     void testList();
+    void testSolid_data();
+    void testSolid();
+    void testSolidBatch();
     void testListArgs_data();
     void testListArgs();
     void testAddArgs_data();
     void testAddArgs();
     void testExtractArgs_data();
     void testExtractArgs();
+    void testMoveArgs_data();
+    void testMoveArgs();
+    void testProgress_data();
+    void testProgress();
+    void testErasedProgress();
     void testRDAAttributes();
+    void benchmarkList_data();
+    void benchmarkList();
 
 private:
     PluginManager m_pluginManger;
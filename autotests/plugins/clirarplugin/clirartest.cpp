@@ -521,3 +521,91 @@ void CliRarTest::testExtractArgs()
 
     plugin->deleteLater();
 }
+
+void CliRarTest::testProgress_data()
+{
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<int>("expectedPercentage");
+    QTest::addColumn<bool>("expectedEntryProcessed");
+
+    // Lines printed by unrar and rar, which overwrite the progress with backspaces.
+    QTest::newRow("first update")
+            << QStringLiteral("Extracting  test.txt                                                  \b\b\b\b  5%") << 5 << false;
+    QTest::newRow("several updates")
+            << QStringLiteral("Extracting  test.txt                                                  \b\b\b\b  5%\b\b\b\b 45%\b\b\b\b 99%") << 99 << false;
+    QTest::newRow("finished entry")
+            << QStringLiteral("Extracting  test.txt                                                  \b\b\b\b 99%\b\b\b\b\b  OK ") << -1 << false;
+    QTest::newRow("adding")
+            << QStringLiteral("Adding    test.txt                                                    \b\b\b\b 10%") << 10 << false;
+    QTest::newRow("header") << QStringLiteral("Extracting from test.rar") << -1 << false;
+}
+
+void CliRarTest::testProgress()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("clirar plugin not available. Skipping test.", SkipSingle);
+    }
+
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.rar"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QVERIFY(plugin);
+
+    QFETCH(QString, line);
+    QFETCH(int, expectedPercentage);
+    QFETCH(bool, expectedEntryProcessed);
+
+    QCOMPARE(plugin->readProgressPercentage(line), expectedPercentage);
+    QCOMPARE(plugin->isEntryProcessedMsg(line), expectedEntryProcessed);
+
+    plugin->deleteLater();
+}
+
+void CliRarTest::benchmarkList_data()
+{
+    QTest::addColumn<QString>("outputTextFile");
+    QTest::addColumn<int>("expectedEntriesCount");
+
+    QTest::newRow("normal-file-unrar5")
+            << QFINDTESTDATA("data/archive-with-symlink-unrar5.txt") << 8;
+    QTest::newRow("multivolume-archive-unrar5")
+            << QFINDTESTDATA("data/archive-multivol-unrar5.txt") << 6;
+    QTest::newRow("normal-file-unrar4")
+            << QFINDTESTDATA("data/archive-with-symlink-unrar4.txt") << 8;
+    QTest::newRow("recovery-record-unrar4")
+            << QFINDTESTDATA("data/archive-recovery-record-unrar4.txt") << 3;
+}
+
+void CliRarTest::benchmarkList()
+{
+    CliPlugin *rarPlugin = new CliPlugin(this, {QStringLiteral("dummy.rar"),
+                                                QVariant::fromValue(m_plugin->metaData())});
+
+    int entriesCount = 0;
+    connect(rarPlugin, &CliPlugin::entry, this, [&entriesCount](Archive::Entry *entry) {
+        entriesCount++;
+        delete entry;
+    });
+
+    QFETCH(QString, outputTextFile);
+    QFile outputText(outputTextFile);
+    QVERIFY(outputText.open(QIODevice::ReadOnly));
+
+    QStringList lines;
+    QTextStream outputStream(&outputText);
+    while (!outputStream.atEnd()) {
+        lines.append(outputStream.readLine());
+    }
+
+    QBENCHMARK {
+        entriesCount = 0;
+        rarPlugin->resetParsing();
+        for (const QString &line : qAsConst(lines)) {
+            QVERIFY(rarPlugin->readListLine(line));
+        }
+    }
+
+    QFETCH(int, expectedEntriesCount);
+    QCOMPARE(entriesCount, expectedEntriesCount);
+
+    rarPlugin->deleteLater();
+}
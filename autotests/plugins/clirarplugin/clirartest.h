@@ -47,6 +47,10 @@ private Q_SLOTS:
     void testAddArgs();
     void testExtractArgs_data();
     void testExtractArgs();
+    void testProgress_data();
+    void testProgress();
+    void benchmarkList_data();
+    void benchmarkList();
 
 private:
     PluginManager m_pluginManger;
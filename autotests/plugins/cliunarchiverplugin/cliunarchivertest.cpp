@@ -33,6 +33,41 @@ QTEST_GUILESS_MAIN(CliUnarchiverTest)
 
 using namespace Kerfuffle;
 
+// Creates the given files below dir. Paths ending with a slash are created as folders.
+static bool createEntries(const QDir &dir, const QStringList &paths)
+{
+    for (const QString &path : paths) {
+        if (path.endsWith(QLatin1Char('/'))) {
+            if (!dir.mkpath(path)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (!dir.mkpath(QFileInfo(path).path())) {
+            return false;
+        }
+        QFile file(dir.filePath(path));
+        if (!file.open(QIODevice::WriteOnly) || file.write(path.toUtf8()) != path.toUtf8().size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Returns the paths of all the entries below dir, relative to it and sorted.
+static QStringList entriesBelow(const QDir &dir)
+{
+    QStringList paths;
+    QDirIterator dirIt(dir.path(), QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (dirIt.hasNext()) {
+        paths << dir.relativeFilePath(dirIt.next());
+    }
+    paths.sort();
+    return paths;
+}
+
 void CliUnarchiverTest::initTestCase()
 {
     m_plugin = new Plugin(this);
@@ -185,6 +220,61 @@ void CliUnarchiverTest::testList()
     plugin->deleteLater();
 }
 
+void CliUnarchiverTest::testListIncremental_data()
+{
+    QTest::addColumn<QString>("jsonFilePath");
+    QTest::addColumn<int>("chunkSize");
+    QTest::addColumn<int>("expectedEntriesCount");
+    QTest::addColumn<QString>("expectedEncryptionMethod");
+
+    QTest::newRow("huge archive, 1 byte chunks")
+            << QFINDTESTDATA("data/huge_archive.json") << 1 << 250 << QString();
+    QTest::newRow("huge archive, 4096 bytes chunks")
+            << QFINDTESTDATA("data/huge_archive.json") << 4096 << 250 << QString();
+    QTest::newRow("archive with encrypted entries, 100 bytes chunks")
+            << QFINDTESTDATA("data/encrypted_entries.json") << 100 << 9 << QStringLiteral("AES128");
+}
+
+void CliUnarchiverTest::testListIncremental()
+{
+    qRegisterMetaType<Archive::Entry*>("Archive::Entry*");
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.rar"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QSignalSpy signalSpy(plugin, &CliPlugin::entry);
+    QSignalSpy signalSpyEncMethod(plugin, &CliPlugin::encryptionMethodFound);
+
+    QFETCH(QString, jsonFilePath);
+    QFETCH(int, chunkSize);
+    QFETCH(int, expectedEntriesCount);
+
+    QFile jsonFile(jsonFilePath);
+    QVERIFY(jsonFile.open(QIODevice::ReadOnly));
+    const QString json = QTextStream(&jsonFile).readAll();
+
+    // The entries must be emitted while the output is still being read.
+    const int half = json.size() / 2;
+    for (int i = 0; i < half; i += chunkSize) {
+        plugin->setJsonOutput(json.mid(i, qMin(chunkSize, half - i)));
+    }
+    QVERIFY(signalSpy.count() > 0);
+    QVERIFY(signalSpy.count() < expectedEntriesCount);
+
+    for (int i = half; i < json.size(); i += chunkSize) {
+        plugin->setJsonOutput(json.mid(i, chunkSize));
+    }
+    QCOMPARE(signalSpy.count(), expectedEntriesCount);
+
+    QFETCH(QString, expectedEncryptionMethod);
+    if (expectedEncryptionMethod.isEmpty()) {
+        QCOMPARE(signalSpyEncMethod.count(), 0);
+    } else {
+        QCOMPARE(signalSpyEncMethod.count(), 1);
+        QCOMPARE(signalSpyEncMethod.at(0).at(0).toString(), expectedEncryptionMethod);
+    }
+
+    plugin->deleteLater();
+}
+
 void CliUnarchiverTest::testListArgs_data()
 {
     QTest::addColumn<QString>("archiveName");
@@ -235,6 +325,7 @@ void CliUnarchiverTest::testExtraction_data()
     QTest::addColumn<QString>("archivePath");
     QTest::addColumn<QVector<Archive::Entry*>>("entriesToExtract");
     QTest::addColumn<ExtractionOptions>("extractionOptions");
+    QTest::addColumn<QStringList>("existingEntries");
     QTest::addColumn<int>("expectedExtractedEntriesCount");
 
     ExtractionOptions defaultOptions;
@@ -250,6 +341,7 @@ void CliUnarchiverTest::testExtraction_data()
             << QFINDTESTDATA("data/multiple_toplevel_entries.rar")
             << QVector<Archive::Entry*>()
             << defaultOptions
+            << QStringList()
             << 12;
 
     QTest::newRow("extract selected entries from a rar, without paths")
@@ -259,6 +351,7 @@ void CliUnarchiverTest::testExtraction_data()
                    new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
                }
             << optionsNoPaths
+            << QStringList()
             << 2;
 
     QTest::newRow("extract selected entries from a rar, preserve paths")
@@ -268,6 +361,7 @@ void CliUnarchiverTest::testExtraction_data()
                    new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
                }
             << defaultOptions
+            << QStringList()
             << 4;
 
     QTest::newRow("extract selected entries from a rar, drag-and-drop")
@@ -279,18 +373,57 @@ void CliUnarchiverTest::testExtraction_data()
                    new Archive::Entry(this, QStringLiteral("A/B/C/test2.txt"), QStringLiteral("A/B/"))
                }
             << dragAndDropOptions
+            << QStringList()
             << 4;
 
+    // Nothing to overwrite in the empty destination: extracted without a temporary directory.
+    QTest::newRow("extract the whole multiple_toplevel_entries.rar in place")
+            << QFINDTESTDATA("data/multiple_toplevel_entries.rar")
+            << QVector<Archive::Entry*>()
+            << ExtractionOptions()
+            << QStringList()
+            << 12;
+
+    QTest::newRow("extract selected entries from a rar in place, preserve paths")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("A/test2.txt"), QStringLiteral("A")),
+                   new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
+               }
+            << ExtractionOptions()
+            << QStringList()
+            << 4;
+
+    // The top-level folder exists: extracted to a temporary directory and merged into it.
+    QTest::newRow("extract the whole one_toplevel_folder.rar into an existing folder")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QVector<Archive::Entry*>()
+            << ExtractionOptions()
+            << QStringList {QStringLiteral("A/old.txt")}
+            << 10;
+
+    QTest::newRow("extract selected entries from a rar into an existing folder, preserve paths")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("A/test2.txt"), QStringLiteral("A")),
+                   new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
+               }
+            << ExtractionOptions()
+            << QStringList {QStringLiteral("A/B/old.txt")}
+            << 5;
+
     QTest::newRow("rar with empty folders")
             << QFINDTESTDATA("data/empty_folders.rar")
             << QVector<Archive::Entry*>()
             << defaultOptions
+            << QStringList()
             << 5;
 
     QTest::newRow("rar with hidden folder and files")
             << QFINDTESTDATA("data/hidden_files.rar")
             << QVector<Archive::Entry*>()
             << defaultOptions
+            << QStringList()
             << 4;
 }
 
@@ -319,6 +452,9 @@ void CliUnarchiverTest::testExtraction()
         QSKIP("Could not create a temporary directory for extraction. Skipping test.", SkipSingle);
     }
 
+    QFETCH(QStringList, existingEntries);
+    QVERIFY(createEntries(QDir(destDir.path()), existingEntries));
+
     QFETCH(QVector<Archive::Entry*>, entriesToExtract);
     QFETCH(ExtractionOptions, extractionOptions);
     auto extractionJob = archive->extractFiles(entriesToExtract, destDir.path(), extractionOptions);
@@ -339,9 +475,203 @@ void CliUnarchiverTest::testExtraction()
 
     QCOMPARE(extractedEntriesCount, expectedExtractedEntriesCount);
 
+    // The existing files must never be overwritten by the extraction.
+    for (const QString &existingEntry : qAsConst(existingEntries)) {
+        QFile existingFile(QDir(destDir.path()).filePath(existingEntry));
+        QVERIFY(existingFile.open(QIODevice::ReadOnly));
+        QCOMPARE(existingFile.readAll(), existingEntry.toUtf8());
+    }
+
     archive->deleteLater();
 }
 
+void CliUnarchiverTest::testExtractionConflicts_data()
+{
+    QTest::addColumn<QString>("archivePath");
+    QTest::addColumn<QStringList>("existingEntries");
+    QTest::addColumn<QVector<Archive::Entry*>>("entriesToExtract");
+    QTest::addColumn<bool>("preservePaths");
+    QTest::addColumn<bool>("expectedConflicts");
+
+    QTest::newRow("whole archive, empty destination")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList()
+            << QVector<Archive::Entry*>()
+            << true
+            << false;
+
+    QTest::newRow("whole archive, unrelated entries in the destination")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList {QStringLiteral("B/test2.txt"), QStringLiteral("test1.txt")}
+            << QVector<Archive::Entry*>()
+            << true
+            << false;
+
+    QTest::newRow("whole archive, existing top-level folder")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList {QStringLiteral("A/")}
+            << QVector<Archive::Entry*>()
+            << true
+            << true;
+
+    QTest::newRow("whole archive, existing top-level file")
+            << QFINDTESTDATA("data/multiple_toplevel_entries.rar")
+            << QStringList {QStringLiteral("rar.json")}
+            << QVector<Archive::Entry*>()
+            << true
+            << true;
+
+    // The names of all the entries would be needed to tell.
+    QTest::newRow("whole archive, without paths")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList()
+            << QVector<Archive::Entry*>()
+            << false
+            << true;
+
+    QTest::newRow("selected entries, existing top-level folder")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList {QStringLiteral("A/")}
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
+               }
+            << true
+            << true;
+
+    QTest::newRow("selected entries, other top-level folder")
+            << QFINDTESTDATA("data/multiple_toplevel_entries.rar")
+            << QStringList {QStringLiteral("data/")}
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("7z.json"), QString())
+               }
+            << true
+            << false;
+
+    QTest::newRow("selected entries without paths, existing file")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList {QStringLiteral("test1.txt")}
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
+               }
+            << false
+            << true;
+
+    QTest::newRow("selected entries without paths, existing top-level folder")
+            << QFINDTESTDATA("data/one_toplevel_folder.rar")
+            << QStringList {QStringLiteral("A/")}
+            << QVector<Archive::Entry*> {
+                   new Archive::Entry(this, QStringLiteral("A/B/test1.txt"), QStringLiteral("A/B"))
+               }
+            << false
+            << false;
+}
+
+void CliUnarchiverTest::testExtractionConflicts()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("cliunarchiver plugin not available. Skipping test.", SkipSingle);
+    }
+
+    // The top-level names come from the listing of the archive.
+    QFETCH(QString, archivePath);
+    auto loadJob = Archive::load(archivePath, m_plugin, this);
+    QVERIFY(loadJob);
+
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    if (!archive->isValid()) {
+        QSKIP("Could not load the cliunarchiver plugin. Skipping test.", SkipSingle);
+    }
+
+    auto cliInterface = qobject_cast<CliInterface*>(archive->interface());
+    QVERIFY(cliInterface);
+
+    QTemporaryDir destDir;
+    if (!destDir.isValid()) {
+        QSKIP("Could not create a temporary directory for extraction. Skipping test.", SkipSingle);
+    }
+
+    QFETCH(QStringList, existingEntries);
+    QVERIFY(createEntries(QDir(destDir.path()), existingEntries));
+
+    QFETCH(QVector<Archive::Entry*>, entriesToExtract);
+    QFETCH(bool, preservePaths);
+    QFETCH(bool, expectedConflicts);
+    QCOMPARE(cliInterface->hasExtractionConflicts(entriesToExtract, destDir.path(), preservePaths), expectedConflicts);
+
+    archive->deleteLater();
+}
+
+void CliUnarchiverTest::testMoveToDestination_data()
+{
+    QTest::addColumn<QStringList>("extractedEntries");
+    QTest::addColumn<QStringList>("existingEntries");
+    QTest::addColumn<bool>("preservePaths");
+    QTest::addColumn<QStringList>("expectedEntries");
+
+    QTest::newRow("empty destination")
+            << QStringList {QStringLiteral("A/B/test1.txt"), QStringLiteral("A/test2.txt"), QStringLiteral("test3.txt")}
+            << QStringList()
+            << true
+            << QStringList {QStringLiteral("A"), QStringLiteral("A/B"), QStringLiteral("A/B/test1.txt"), QStringLiteral("A/test2.txt"), QStringLiteral("test3.txt")};
+
+    QTest::newRow("existing top-level folder")
+            << QStringList {QStringLiteral("A/B/test1.txt"), QStringLiteral("A/test2.txt"), QStringLiteral("C/test3.txt")}
+            << QStringList {QStringLiteral("A/old.txt")}
+            << true
+            << QStringList {QStringLiteral("A"), QStringLiteral("A/B"), QStringLiteral("A/B/test1.txt"), QStringLiteral("A/old.txt"),
+                            QStringLiteral("A/test2.txt"), QStringLiteral("C"), QStringLiteral("C/test3.txt")};
+
+    QTest::newRow("existing nested folder")
+            << QStringList {QStringLiteral("A/B/C/test1.txt"), QStringLiteral("A/B/test2.txt")}
+            << QStringList {QStringLiteral("A/B/old.txt"), QStringLiteral("A/D/")}
+            << true
+            << QStringList {QStringLiteral("A"), QStringLiteral("A/B"), QStringLiteral("A/B/C"), QStringLiteral("A/B/C/test1.txt"),
+                            QStringLiteral("A/B/old.txt"), QStringLiteral("A/B/test2.txt"), QStringLiteral("A/D")};
+
+    QTest::newRow("without paths")
+            << QStringList {QStringLiteral("A/B/test1.txt"), QStringLiteral("A/test2.txt")}
+            << QStringList {QStringLiteral("A/old.txt")}
+            << false
+            << QStringList {QStringLiteral("A"), QStringLiteral("A/old.txt"), QStringLiteral("test1.txt"), QStringLiteral("test2.txt")};
+}
+
+void CliUnarchiverTest::testMoveToDestination()
+{
+    QTemporaryDir tempDir;
+    QTemporaryDir destDir;
+    if (!tempDir.isValid() || !destDir.isValid()) {
+        QSKIP("Could not create the temporary directories. Skipping test.", SkipSingle);
+    }
+
+    QFETCH(QStringList, extractedEntries);
+    QVERIFY(createEntries(QDir(tempDir.path()), extractedEntries));
+
+    QFETCH(QStringList, existingEntries);
+    QVERIFY(createEntries(QDir(destDir.path()), existingEntries));
+
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.rar"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+
+    QFETCH(bool, preservePaths);
+    QVERIFY(plugin->moveToDestination(QDir(tempDir.path()), QDir(destDir.path()), preservePaths));
+
+    QFETCH(QStringList, expectedEntries);
+    QCOMPARE(entriesBelow(QDir(destDir.path())), expectedEntries);
+
+    // Every extracted file has been moved, and its contents didn't change.
+    for (const QString &extractedEntry : qAsConst(extractedEntries)) {
+        QFile movedFile(QDir(destDir.path()).filePath(preservePaths ? extractedEntry : QFileInfo(extractedEntry).fileName()));
+        QVERIFY(movedFile.open(QIODevice::ReadOnly));
+        QCOMPARE(movedFile.readAll(), extractedEntry.toUtf8());
+        QVERIFY(!QFileInfo::exists(QDir(tempDir.path()).filePath(extractedEntry)));
+    }
+
+    plugin->deleteLater();
+}
+
 void CliUnarchiverTest::testExtractArgs_data()
 {
     QTest::addColumn<QString>("archiveName");
@@ -358,6 +688,7 @@ void CliUnarchiverTest::testExtractArgs_data()
             << QStringLiteral("1234")
             << QStringList {
                    QStringLiteral("-D"),
+                   QStringLiteral("-s"),
                    QStringLiteral("-password"),
                    QStringLiteral("1234"),
                    QStringLiteral("/tmp/foo.rar"),
@@ -374,6 +705,7 @@ void CliUnarchiverTest::testExtractArgs_data()
             << QString()
             << QStringList {
                    QStringLiteral("-D"),
+                   QStringLiteral("-s"),
                    QStringLiteral("/tmp/foo.rar"),
                    QStringLiteral("aDir/b.txt"),
                    QStringLiteral("c.txt"),
@@ -406,3 +738,36 @@ void CliUnarchiverTest::testExtractArgs()
 
     plugin->deleteLater();
 }
+
+void CliUnarchiverTest::testProgress_data()
+{
+    QTest::addColumn<QString>("line");
+    QTest::addColumn<int>("expectedPercentage");
+    QTest::addColumn<bool>("expectedEntryProcessed");
+
+    // unar does not print percentages, only the extracted entries.
+    QTest::newRow("extracted entry") << QStringLiteral("  aDir/b.txt  (12 B)... OK.") << -1 << true;
+    QTest::newRow("failed entry") << QStringLiteral("  aDir/b.txt  (12 B)... Failed! (Wrong checksum)") << -1 << false;
+    QTest::newRow("header") << QStringLiteral("test.rar: RAR") << -1 << false;
+    QTest::newRow("summary") << QStringLiteral("Successfully extracted to \"test\".") << -1 << false;
+}
+
+void CliUnarchiverTest::testProgress()
+{
+    if (!m_plugin->isValid()) {
+        QSKIP("cliunarchiver plugin not available. Skipping test.", SkipSingle);
+    }
+
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.rar"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QVERIFY(plugin);
+
+    QFETCH(QString, line);
+    QFETCH(int, expectedPercentage);
+    QFETCH(bool, expectedEntryProcessed);
+
+    QCOMPARE(plugin->readProgressPercentage(line), expectedPercentage);
+    QCOMPARE(plugin->isEntryProcessedMsg(line), expectedEntryProcessed);
+
+    plugin->deleteLater();
+}
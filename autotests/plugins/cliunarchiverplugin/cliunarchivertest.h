@@ -36,12 +36,20 @@ private Q_SLOTS:
     void testArchive();
     void testList_data();
     void testList();
+    void testListIncremental_data();
+    void testListIncremental();
     void testListArgs_data();
     void testListArgs();
     void testExtraction_data();
     void testExtraction();
+    void testExtractionConflicts_data();
+    void testExtractionConflicts();
+    void testMoveToDestination_data();
+    void testMoveToDestination();
     void testExtractArgs_data();
     void testExtractArgs();
+    void testProgress_data();
+    void testProgress();
 
 private:
 
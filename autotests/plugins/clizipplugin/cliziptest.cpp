@@ -26,7 +26,10 @@
 #include "cliziptest.h"
 #include "cliplugin.h"
 
+#include <QFile>
+#include <QSignalSpy>
 #include <QTest>
+#include <QTextStream>
 
 QTEST_GUILESS_MAIN(CliZipTest)
 
@@ -44,6 +47,79 @@ void CliZipTest::initTestCase()
     }
 }
 
+void CliZipTest::testList_data()
+{
+    QTest::addColumn<QString>("outputTextFile");
+    QTest::addColumn<int>("expectedEntriesCount");
+    QTest::addColumn<QString>("expectedComment");
+    // Index of some entry to be tested.
+    QTest::addColumn<int>("someEntryIndex");
+    // Entry metadata.
+    QTest::addColumn<QString>("expectedName");
+    QTest::addColumn<bool>("isDirectory");
+    QTest::addColumn<bool>("isPasswordProtected");
+    QTest::addColumn<qulonglong>("expectedSize");
+    QTest::addColumn<QString>("expectedTimestamp");
+
+    QTest::newRow("with-dirs")
+            << QFINDTESTDATA("data/archive-with-dirs-zipinfo.txt") << 13 << QString()
+            << 5 << QStringLiteral("dir1/dir/") << true << false << (qulonglong) 0 << QStringLiteral("2016-07-23T00:10:44");
+
+    QTest::newRow("with-comment")
+            << QFINDTESTDATA("data/archive-with-comment-zipinfo.txt") << 4 << QStringLiteral("Some comment\nspanning two lines")
+            << 2 << QStringLiteral("testarchive/dir1/file2.txt") << false << false << (qulonglong) 4 << QStringLiteral("2017-02-11T10:21:34");
+
+    QTest::newRow("encrypted")
+            << QFINDTESTDATA("data/archive-encrypted-zipinfo.txt") << 1 << QString()
+            << 0 << QStringLiteral("foo.txt") << false << true << (qulonglong) 4 << QStringLiteral("2010-02-15T21:19:28");
+}
+
+void CliZipTest::testList()
+{
+    qRegisterMetaType<Archive::Entry*>("Archive::Entry*");
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.zip"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+    QSignalSpy signalSpyEntry(plugin, &CliPlugin::entry);
+
+    QFETCH(QString, outputTextFile);
+    QFETCH(int, expectedEntriesCount);
+
+    QFile outputText(outputTextFile);
+    QVERIFY(outputText.open(QIODevice::ReadOnly));
+
+    QTextStream outputStream(&outputText);
+    while (!outputStream.atEnd()) {
+        const QString line(outputStream.readLine());
+        QVERIFY(plugin->readListLine(line));
+    }
+
+    QCOMPARE(signalSpyEntry.count(), expectedEntriesCount);
+
+    QFETCH(QString, expectedComment);
+    QCOMPARE(plugin->comment(), expectedComment);
+
+    QFETCH(int, someEntryIndex);
+    QVERIFY(someEntryIndex < signalSpyEntry.count());
+    Archive::Entry *entry = signalSpyEntry.at(someEntryIndex).at(0).value<Archive::Entry*>();
+
+    QFETCH(QString, expectedName);
+    QCOMPARE(entry->fullPath(), expectedName);
+
+    QFETCH(bool, isDirectory);
+    QCOMPARE(entry->isDir(), isDirectory);
+
+    QFETCH(bool, isPasswordProtected);
+    QCOMPARE(entry->property("isPasswordProtected").toBool(), isPasswordProtected);
+
+    QFETCH(qulonglong, expectedSize);
+    QCOMPARE(entry->property("size").toULongLong(), expectedSize);
+
+    QFETCH(QString, expectedTimestamp);
+    QCOMPARE(entry->property("timestamp").toDateTime().toString(Qt::ISODate), expectedTimestamp);
+
+    plugin->deleteLater();
+}
+
 void CliZipTest::testListArgs_data()
 {
     QTest::addColumn<QString>("archiveName");
@@ -245,3 +321,49 @@ void CliZipTest::testExtractArgs()
 
     plugin->deleteLater();
 }
+
+void CliZipTest::benchmarkList_data()
+{
+    QTest::addColumn<QString>("outputTextFile");
+    QTest::addColumn<int>("expectedEntriesCount");
+
+    QTest::newRow("with-dirs")
+            << QFINDTESTDATA("data/archive-with-dirs-zipinfo.txt") << 13;
+    QTest::newRow("with-comment")
+            << QFINDTESTDATA("data/archive-with-comment-zipinfo.txt") << 4;
+}
+
+void CliZipTest::benchmarkList()
+{
+    CliPlugin *plugin = new CliPlugin(this, {QStringLiteral("dummy.zip"),
+                                             QVariant::fromValue(m_plugin->metaData())});
+
+    int entriesCount = 0;
+    connect(plugin, &CliPlugin::entry, this, [&entriesCount](Archive::Entry *entry) {
+        entriesCount++;
+        delete entry;
+    });
+
+    QFETCH(QString, outputTextFile);
+    QFile outputText(outputTextFile);
+    QVERIFY(outputText.open(QIODevice::ReadOnly));
+
+    QStringList lines;
+    QTextStream outputStream(&outputText);
+    while (!outputStream.atEnd()) {
+        lines.append(outputStream.readLine());
+    }
+
+    QBENCHMARK {
+        entriesCount = 0;
+        plugin->resetParsing();
+        for (const QString &line : qAsConst(lines)) {
+            QVERIFY(plugin->readListLine(line));
+        }
+    }
+
+    QFETCH(int, expectedEntriesCount);
+    QCOMPARE(entriesCount, expectedEntriesCount);
+
+    plugin->deleteLater();
+}
@@ -36,12 +36,16 @@ class CliZipTest : public QObject
 
 private Q_SLOTS:
     void initTestCase();
+    void testList_data();
+    void testList();
     void testListArgs_data();
     void testListArgs();
     void testAddArgs_data();
     void testAddArgs();
     void testExtractArgs_data();
     void testExtractArgs();
+    void benchmarkList_data();
+    void benchmarkList();
 
 private:
     PluginManager m_pluginManger;
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2026 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_kerfuffle.h"
+#include "jobs.h"
+#include "pluginmanager.h"
+#include "testhelper.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace Kerfuffle;
+
+class LibarchiveTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testArchive_data();
+    void testArchive();
+    void testApplyOperations_data();
+    void testApplyOperations();
+
+private:
+    Plugin *plugin(const QString &pluginId) const;
+    static QStringList listEntries(const QString &fileName, Plugin *plugin);
+
+    PluginManager m_pluginManager;
+};
+
+QTEST_GUILESS_MAIN(LibarchiveTest)
+
+void LibarchiveTest::testArchive_data()
+{
+    QTest::addColumn<QString>("archiveName");
+    QTest::addColumn<QString>("pluginId");
+    QTest::addColumn<bool>("isCorrupt");
+
+    QTest::newRow("tar")
+            << QStringLiteral("test.tar") << QStringLiteral("kerfuffle_libarchive") << false;
+    // The checksum of the header of the second file is wrong.
+    QTest::newRow("tar, corrupt header")
+            << QStringLiteral("test_corrupt.tar") << QStringLiteral("kerfuffle_libarchive") << true;
+    QTest::newRow("7z")
+            << QStringLiteral("test.7z") << QStringLiteral("kerfuffle_libarchive_readonly") << false;
+    // A byte of the compressed data is flipped.
+    QTest::newRow("7z, corrupt data")
+            << QStringLiteral("test_corrupt.7z") << QStringLiteral("kerfuffle_libarchive_readonly") << true;
+}
+
+void LibarchiveTest::testArchive()
+{
+    QFETCH(QString, pluginId);
+    Plugin *libarchivePlugin = plugin(pluginId);
+    if (!libarchivePlugin) {
+        QSKIP("Libarchive plugin not available. Skipping test.", SkipSingle);
+    }
+
+    QFETCH(QString, archiveName);
+    auto loadJob = Archive::load(QFINDTESTDATA(QStringLiteral("data/") + archiveName), libarchivePlugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    auto testJob = archive->testArchive();
+    QVERIFY(testJob);
+    testJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(testJob);
+
+    QFETCH(bool, isCorrupt);
+    QCOMPARE(testJob->testSucceeded(), !isCorrupt);
+
+    loadJob->deleteLater();
+    testJob->deleteLater();
+    archive->deleteLater();
+}
+
+void LibarchiveTest::testApplyOperations_data()
+{
+    // Each operation is "add <path>", "delete <path>" or "move <path> <new path>".
+    QTest::addColumn<QStringList>("operations");
+    QTest::addColumn<QStringList>("expectedEntries");
+    QTest::addColumn<QString>("checkedEntry");
+    QTest::addColumn<QByteArray>("expectedContent");
+
+    const QStringList oldEntries = {QStringLiteral("dir/"),
+                                    QStringLiteral("dir/file1.txt"),
+                                    QStringLiteral("dir/file2.txt"),
+                                    QStringLiteral("dir/file3.txt")};
+
+    QTest::newRow("add, then delete the new file")
+            << QStringList {QStringLiteral("add new.txt"), QStringLiteral("delete new.txt")}
+            << oldEntries
+            << QString()
+            << QByteArray();
+
+    QTest::newRow("delete, then add at the same path")
+            << QStringList {QStringLiteral("delete dir/file1.txt"), QStringLiteral("add dir/file1.txt")}
+            << oldEntries
+            << QStringLiteral("dir/file1.txt")
+            << QByteArrayLiteral("new dir/file1.txt\n");
+
+    QTest::newRow("move, then delete")
+            << QStringList {QStringLiteral("move dir/file2.txt renamed.txt"), QStringLiteral("delete dir/file3.txt")}
+            << QStringList {QStringLiteral("dir/"), QStringLiteral("dir/file1.txt"), QStringLiteral("renamed.txt")}
+            << QString()
+            << QByteArray();
+
+    QTest::newRow("add, then move the new file")
+            << QStringList {QStringLiteral("add new.txt"), QStringLiteral("move new.txt dir/new.txt")}
+            << (oldEntries + QStringList {QStringLiteral("dir/new.txt")})
+            << QStringLiteral("dir/new.txt")
+            << QByteArrayLiteral("new new.txt\n");
+
+    QTest::newRow("move, then add at the old path")
+            << QStringList {QStringLiteral("move dir/file1.txt moved.txt"), QStringLiteral("add dir/file1.txt")}
+            << (oldEntries + QStringList {QStringLiteral("moved.txt")})
+            << QStringLiteral("dir/file1.txt")
+            << QByteArrayLiteral("new dir/file1.txt\n");
+}
+
+void LibarchiveTest::testApplyOperations()
+{
+    Plugin *libarchivePlugin = plugin(QStringLiteral("kerfuffle_libarchive"));
+    if (!libarchivePlugin) {
+        QSKIP("Libarchive plugin not available. Skipping test.", SkipSingle);
+    }
+
+    QTemporaryDir temporaryDir;
+    const QString fileName = temporaryDir.filePath(QStringLiteral("archive.tar"));
+    QVERIFY(QFile::copy(QFINDTESTDATA("data/test.tar"), fileName));
+    QVERIFY(QFile::setPermissions(fileName, QFile::ReadOwner | QFile::WriteOwner));
+
+    // The files to add, whose content is their path.
+    const QDir workDir(temporaryDir.filePath(QStringLiteral("work")));
+    QVERIFY(workDir.mkpath(QStringLiteral("dir")));
+    for (const QString &path : {QStringLiteral("new.txt"), QStringLiteral("dir/file1.txt")}) {
+        QFile file(workDir.filePath(path));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("new " + path.toUtf8() + '\n');
+    }
+
+    auto loadJob = Archive::load(fileName, libarchivePlugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive && archive->isValid());
+    auto writeInterface = qobject_cast<ReadWriteArchiveInterface*>(archive->interface());
+    QVERIFY(writeInterface);
+
+    QFETCH(QStringList, operations);
+    QVector<ArchiveOperation> archiveOperations;
+    for (const QString &description : qAsConst(operations)) {
+        const QStringList words = description.split(QLatin1Char(' '));
+        ArchiveOperation operation;
+        operation.entries.append(new Archive::Entry(this, words.at(1)));
+        if (words.at(0) == QLatin1String("add")) {
+            operation.mode = ReadWriteArchiveInterface::Add;
+            operation.options.setGlobalWorkDir(workDir.path());
+        } else if (words.at(0) == QLatin1String("delete")) {
+            operation.mode = ReadWriteArchiveInterface::Delete;
+        } else {
+            operation.mode = ReadWriteArchiveInterface::Move;
+            operation.destination = new Archive::Entry(this, words.at(2));
+        }
+        archiveOperations.append(operation);
+    }
+
+    // The archive is rewritten once for all the operations.
+    QSignalSpy finishedSpy(writeInterface, &ReadWriteArchiveInterface::operationFinished);
+    const QString oldWorkingDir = QDir::currentPath();
+    QDir::setCurrent(workDir.path());
+    const bool isSuccessful = writeInterface->applyOperations(archiveOperations);
+    QDir::setCurrent(oldWorkingDir);
+    QVERIFY(isSuccessful);
+    QCOMPARE(finishedSpy.count(), operations.size());
+
+    QFETCH(QStringList, expectedEntries);
+    QStringList entries = listEntries(fileName, libarchivePlugin);
+    entries.sort();
+    expectedEntries.sort();
+    QCOMPARE(entries, expectedEntries);
+
+    QFETCH(QString, checkedEntry);
+    if (!checkedEntry.isEmpty()) {
+        QTemporaryDir extractionDir;
+        auto extractJob = archive->extractFiles({new Archive::Entry(this, checkedEntry)}, extractionDir.path());
+        QVERIFY(extractJob);
+        TestHelper::startAndWaitForResult(extractJob);
+
+        QFile file(extractionDir.filePath(checkedEntry));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QFETCH(QByteArray, expectedContent);
+        QCOMPARE(file.readAll(), expectedContent);
+    }
+
+    loadJob->deleteLater();
+    archive->deleteLater();
+}
+
+QStringList LibarchiveTest::listEntries(const QString &fileName, Plugin *plugin)
+{
+    QStringList entries;
+    auto loadJob = Archive::load(fileName, plugin);
+    loadJob->setAutoDelete(false);
+    QObject::connect(loadJob, &Job::newEntry, [&entries](Archive::Entry *entry) {
+        entries.append(entry->fullPath());
+    });
+    TestHelper::startAndWaitForResult(loadJob);
+
+    loadJob->archive()->deleteLater();
+    loadJob->deleteLater();
+
+    return entries;
+}
+
+Plugin *LibarchiveTest::plugin(const QString &pluginId) const
+{
+    const auto plugins = m_pluginManager.availablePlugins();
+    for (Plugin *plugin : plugins) {
+        if (plugin->metaData().pluginId() == pluginId) {
+            return plugin;
+        }
+    }
+
+    return nullptr;
+}
+
+#include "libarchivetest.moc"
@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_kerfuffle.h"
+#include "jobs.h"
+#include "pluginmanager.h"
+#include "testhelper.h"
+#include "tracer.h"
+
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTest>
+
+using namespace Kerfuffle;
+
+class SingleFileTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testExtraction_data();
+    void testExtraction();
+    void testIntegrity_data();
+    void testIntegrity();
+    void testGzipSize_data();
+    void testGzipSize();
+    void benchmarkExtraction_data();
+    void benchmarkExtraction();
+
+private:
+    /**
+     * Writes @p size bytes of half compressible, half random data to @p fileName.
+     */
+    static bool generateData(const QString &fileName, qint64 size);
+
+    /**
+     * Compresses @p fileName with @p program into @p archiveName, running it once per slice
+     * of the file and concatenating the results, the way pigz and pbzip2 do.
+     */
+    bool compress(const QString &fileName, const QString &archiveName, const QString &program, const QStringList &arguments, int slices);
+
+    Plugin *plugin(const QString &pluginId) const;
+    void extract(const QString &archiveName, Plugin *plugin, const QString &destination, qulonglong *unpackedSize = nullptr);
+
+    /**
+     * @return The number of chunks decoded in parallel by the last extraction, according to its trace.
+     */
+    static int decodedChunks();
+
+    PluginManager m_pluginManager;
+    QTemporaryDir m_tempDir;
+};
+
+QTEST_GUILESS_MAIN(SingleFileTest)
+
+void SingleFileTest::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+
+    // The trace tells whether a file was actually decoded in parallel.
+    Tracer::setOutputFile(m_tempDir.path() + QLatin1String("/trace.json"));
+}
+
+void SingleFileTest::cleanupTestCase()
+{
+    Tracer::setOutputFile(QString());
+    Tracer::clear();
+}
+
+void SingleFileTest::testExtraction_data()
+{
+    QTest::addColumn<QString>("pluginId");
+    QTest::addColumn<QString>("program");
+    QTest::addColumn<QStringList>("arguments");
+    QTest::addColumn<int>("slices");
+    // Whether the uncompressed size can be listed without decompressing the file.
+    QTest::addColumn<bool>("isSizeKnown");
+    // Whether the file has to be decoded in parallel, in more than one chunk.
+    QTest::addColumn<bool>("isSplit");
+
+    // Files made of gzip members or bzip2 streams are only scanned when they are bigger than
+    // two parallel chunks, 8 MiB. Half of the data is random, so the files are about 12 MiB.
+    QTest::newRow("gzip, concatenated members")
+            << QStringLiteral("kerfuffle_libgz") << QStringLiteral("gzip")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c")} << 4 << false << true;
+    // The size in the trailer of a member this big could have wrapped around, see testGzipSize().
+    QTest::newRow("gzip, single member")
+            << QStringLiteral("kerfuffle_libgz") << QStringLiteral("gzip")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c")} << 1 << false << false;
+    QTest::newRow("bzip2, concatenated streams")
+            << QStringLiteral("kerfuffle_libbz2") << QStringLiteral("bzip2")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c")} << 4 << false << true;
+    QTest::newRow("bzip2, single stream")
+            << QStringLiteral("kerfuffle_libbz2") << QStringLiteral("bzip2")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c")} << 1 << false << false;
+    QTest::newRow("xz, multiple blocks")
+            << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c"), QStringLiteral("-T2"), QStringLiteral("--block-size=3MiB")} << 1 << true << true;
+    QTest::newRow("xz, concatenated streams")
+            << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c"), QStringLiteral("-T2"), QStringLiteral("--block-size=1MiB")} << 3 << true << true;
+    QTest::newRow("xz, single block")
+            << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c"), QStringLiteral("-T1")} << 1 << true << false;
+    // zstd can't store the content size when compressing from stdin.
+    QTest::newRow("zstd, concatenated frames")
+            << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("zstd")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c")} << 4 << false << true;
+    QTest::newRow("zstd, single frame")
+            << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("zstd")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c"), QStringLiteral("-T0")} << 1 << false << false;
+    QTest::newRow("zstd, single frame with size")
+            << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("zstd")
+            << QStringList {QStringLiteral("-1"), QStringLiteral("-c"), QStringLiteral("--stream-size=25165824")} << 1 << true << false;
+}
+
+void SingleFileTest::testExtraction()
+{
+    QFETCH(QString, pluginId);
+    QFETCH(QString, program);
+
+    Plugin *singleFilePlugin = plugin(pluginId);
+    if (!singleFilePlugin) {
+        QSKIP("Single-file plugin not available. Skipping test.", SkipSingle);
+    }
+    if (QStandardPaths::findExecutable(program).isEmpty()) {
+        QSKIP("Compressor not available. Skipping test.", SkipSingle);
+    }
+
+    const QString fileName = m_tempDir.path() + QLatin1String("/data.bin");
+    if (!QFile::exists(fileName)) {
+        QVERIFY(generateData(fileName, 24 * 1024 * 1024));
+    }
+
+    QFETCH(QStringList, arguments);
+    QFETCH(int, slices);
+    const QString archiveName = m_tempDir.path() + QLatin1String("/archive.bin");
+    QVERIFY(compress(fileName, archiveName, program, arguments, slices));
+
+    QTemporaryDir destDir;
+    qulonglong unpackedSize = 0;
+    Tracer::clear();
+    extract(archiveName, singleFilePlugin, destDir.path(), &unpackedSize);
+
+    QFETCH(bool, isSplit);
+    if (isSplit) {
+        QVERIFY2(decodedChunks() > 1, "The file wasn't decoded in parallel");
+    }
+
+    QFETCH(bool, isSizeKnown);
+    QCOMPARE(unpackedSize, isSizeKnown ? qulonglong(QFileInfo(fileName).size()) : qulonglong(0));
+
+    QFile originalFile(fileName);
+    QFile extractedFile(destDir.path() + QLatin1String("/archive.bin.uncompressed"));
+    QVERIFY(originalFile.open(QIODevice::ReadOnly));
+    QVERIFY(extractedFile.open(QIODevice::ReadOnly));
+    QCOMPARE(extractedFile.size(), originalFile.size());
+
+    QCryptographicHash originalHash(QCryptographicHash::Sha1);
+    QCryptographicHash extractedHash(QCryptographicHash::Sha1);
+    QVERIFY(originalHash.addData(&originalFile));
+    QVERIFY(extractedHash.addData(&extractedFile));
+    QCOMPARE(extractedHash.result(), originalHash.result());
+}
+
+void SingleFileTest::testIntegrity_data()
+{
+    QTest::addColumn<QString>("pluginId");
+    QTest::addColumn<QString>("program");
+    QTest::addColumn<bool>("isCorrupt");
+
+    QTest::newRow("gzip") << QStringLiteral("kerfuffle_libgz") << QStringLiteral("gzip") << false;
+    QTest::newRow("corrupt gzip") << QStringLiteral("kerfuffle_libgz") << QStringLiteral("gzip") << true;
+    QTest::newRow("bzip2") << QStringLiteral("kerfuffle_libbz2") << QStringLiteral("bzip2") << false;
+    QTest::newRow("corrupt bzip2") << QStringLiteral("kerfuffle_libbz2") << QStringLiteral("bzip2") << true;
+    QTest::newRow("xz") << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz") << false;
+    QTest::newRow("corrupt xz") << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz") << true;
+    QTest::newRow("zstd") << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("zstd") << false;
+    QTest::newRow("corrupt zstd") << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("zstd") << true;
+}
+
+void SingleFileTest::testIntegrity()
+{
+    QFETCH(QString, pluginId);
+    QFETCH(QString, program);
+
+    Plugin *singleFilePlugin = plugin(pluginId);
+    if (!singleFilePlugin) {
+        QSKIP("Single-file plugin not available. Skipping test.", SkipSingle);
+    }
+    if (QStandardPaths::findExecutable(program).isEmpty()) {
+        QSKIP("Compressor not available. Skipping test.", SkipSingle);
+    }
+
+    const QString fileName = m_tempDir.path() + QLatin1String("/data.bin");
+    if (!QFile::exists(fileName)) {
+        QVERIFY(generateData(fileName, 24 * 1024 * 1024));
+    }
+
+    const QString archiveName = m_tempDir.path() + QLatin1String("/archive.bin");
+    QVERIFY(compress(fileName, archiveName, program, {QStringLiteral("-1"), QStringLiteral("-c")}, 2));
+
+    QFETCH(bool, isCorrupt);
+    if (isCorrupt) {
+        QFile archiveFile(archiveName);
+        QVERIFY(archiveFile.open(QIODevice::ReadWrite));
+        QVERIFY(archiveFile.seek(archiveFile.size() / 2));
+        const char byte = archiveFile.peek(1).at(0);
+        QVERIFY(archiveFile.putChar(~byte));
+    }
+
+    auto loadJob = Archive::load(archiveName, singleFilePlugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    auto testJob = archive->testArchive();
+    QVERIFY(testJob);
+    testJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(testJob);
+    QCOMPARE(testJob->testSucceeded(), !isCorrupt);
+
+    loadJob->deleteLater();
+    testJob->deleteLater();
+    archive->deleteLater();
+}
+
+void SingleFileTest::testGzipSize_data()
+{
+    QTest::addColumn<int>("slices");
+    QTest::addColumn<bool>("isSizeKnown");
+
+    // Only the size of the last member is stored at the end of the file.
+    QTest::newRow("single member") << 1 << true;
+    QTest::newRow("concatenated members") << 2 << false;
+}
+
+void SingleFileTest::testGzipSize()
+{
+    Plugin *gzipPlugin = plugin(QStringLiteral("kerfuffle_libgz"));
+    if (!gzipPlugin) {
+        QSKIP("Single-file plugin not available. Skipping test.", SkipSingle);
+    }
+    if (QStandardPaths::findExecutable(QStringLiteral("gzip")).isEmpty()) {
+        QSKIP("Compressor not available. Skipping test.", SkipSingle);
+    }
+
+    // Small enough for the size in the trailer not to wrap around.
+    const QString fileName = m_tempDir.path() + QLatin1String("/small.bin");
+    if (!QFile::exists(fileName)) {
+        QVERIFY(generateData(fileName, 2 * 1024 * 1024));
+    }
+
+    QFETCH(int, slices);
+    const QString archiveName = m_tempDir.path() + QLatin1String("/small.gz");
+    QVERIFY(compress(fileName, archiveName, QStringLiteral("gzip"), {QStringLiteral("-1"), QStringLiteral("-c")}, slices));
+
+    auto loadJob = Archive::load(archiveName, gzipPlugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+
+    QFETCH(bool, isSizeKnown);
+    QCOMPARE(archive->unpackedSize(), isSizeKnown ? qulonglong(QFileInfo(fileName).size()) : qulonglong(0));
+
+    loadJob->deleteLater();
+    archive->deleteLater();
+}
+
+void SingleFileTest::benchmarkExtraction_data()
+{
+    QTest::addColumn<QString>("pluginId");
+    QTest::addColumn<QString>("program");
+    QTest::addColumn<QStringList>("arguments");
+
+    const QString threads = QStringLiteral("-p%1").arg(QThread::idealThreadCount());
+
+    QTest::newRow("bzip2")
+            << QStringLiteral("kerfuffle_libbz2") << QStringLiteral("bzip2")
+            << QStringList {QStringLiteral("-c")};
+    QTest::newRow("pbzip2")
+            << QStringLiteral("kerfuffle_libbz2") << QStringLiteral("pbzip2")
+            << QStringList {QStringLiteral("-c"), threads};
+    QTest::newRow("xz -T1")
+            << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz")
+            << QStringList {QStringLiteral("-c"), QStringLiteral("-T1")};
+    QTest::newRow("xz -T0")
+            << QStringLiteral("kerfuffle_libxz") << QStringLiteral("xz")
+            << QStringList {QStringLiteral("-c"), QStringLiteral("-T0")};
+    QTest::newRow("zstd")
+            << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("zstd")
+            << QStringList {QStringLiteral("-c"), QStringLiteral("-T0")};
+    QTest::newRow("pzstd")
+            << QStringLiteral("kerfuffle_libzstd") << QStringLiteral("pzstd")
+            << QStringList {QStringLiteral("-c"), QStringLiteral("-p"), QString::number(QThread::idealThreadCount())};
+}
+
+void SingleFileTest::benchmarkExtraction()
+{
+    QFETCH(QString, pluginId);
+    QFETCH(QString, program);
+    QFETCH(QStringList, arguments);
+
+    Plugin *singleFilePlugin = plugin(pluginId);
+    if (!singleFilePlugin) {
+        QSKIP("Single-file plugin not available. Skipping benchmark.", SkipSingle);
+    }
+    if (QStandardPaths::findExecutable(program).isEmpty()) {
+        QSKIP("Compressor not available. Skipping benchmark.", SkipSingle);
+    }
+
+    const QString fileName = m_tempDir.path() + QLatin1String("/benchmark.bin");
+    if (!QFile::exists(fileName)) {
+        QVERIFY(generateData(fileName, 128 * 1024 * 1024));
+    }
+
+    const QString archiveName = m_tempDir.path() + QLatin1String("/benchmark-archive.bin");
+    QVERIFY(compress(fileName, archiveName, program, arguments, 1));
+
+    QBENCHMARK {
+        QTemporaryDir destDir;
+        extract(archiveName, singleFilePlugin, destDir.path());
+    }
+}
+
+bool SingleFileTest::generateData(const QString &fileName, qint64 size)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    const QByteArray text = QByteArrayLiteral("The quick brown fox jumps over the lazy dog. ");
+    QByteArray block(1024 * 1024, '\0');
+    quint32 seed = 42;
+
+    for (qint64 written = 0; written < size; written += block.size()) {
+        for (int i = 0; i < block.size(); ++i) {
+            if ((i / 4096) % 2) {
+                block[i] = text.at(i % text.size());
+            } else {
+                seed = seed * 1103515245 + 12345;
+                block[i] = static_cast<char>(seed >> 24);
+            }
+        }
+        if (file.write(block) != block.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SingleFileTest::compress(const QString &fileName, const QString &archiveName, const QString &program, const QStringList &arguments, int slices)
+{
+    QFile::remove(archiveName);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 sliceSize = file.size() / slices + 1;
+    const QString sliceName = m_tempDir.path() + QLatin1String("/slice.bin");
+
+    for (int i = 0; i < slices; ++i) {
+        QFile slice(sliceName);
+        if (!slice.open(QIODevice::WriteOnly) || slice.write(file.read(sliceSize)) < 0) {
+            return false;
+        }
+        slice.close();
+
+        QProcess process;
+        process.setStandardInputFile(sliceName);
+        process.setStandardOutputFile(archiveName, QIODevice::Append);
+        process.start(program, arguments);
+        if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Plugin *SingleFileTest::plugin(const QString &pluginId) const
+{
+    const auto plugins = m_pluginManager.availablePlugins();
+    for (Plugin *plugin : plugins) {
+        if (plugin->metaData().pluginId() == pluginId) {
+            return plugin;
+        }
+    }
+
+    return nullptr;
+}
+
+void SingleFileTest::extract(const QString &archiveName, Plugin *plugin, const QString &destination, qulonglong *unpackedSize)
+{
+    auto loadJob = Archive::load(archiveName, plugin);
+    QVERIFY(loadJob);
+    loadJob->setAutoDelete(false);
+
+    TestHelper::startAndWaitForResult(loadJob);
+    auto archive = loadJob->archive();
+    QVERIFY(archive);
+    QVERIFY(archive->isValid());
+    if (unpackedSize) {
+        *unpackedSize = archive->unpackedSize();
+    }
+
+    auto extractionJob = archive->extractFiles(QVector<Archive::Entry*>(), destination, ExtractionOptions());
+    QVERIFY(extractionJob);
+    extractionJob->setAutoDelete(false);
+
+    TestHelper::startAndWaitForResult(extractionJob);
+    QCOMPARE(extractionJob->error(), 0);
+
+    loadJob->deleteLater();
+    extractionJob->deleteLater();
+    archive->deleteLater();
+}
+
+int SingleFileTest::decodedChunks()
+{
+    const QJsonObject document = QJsonDocument::fromJson(Tracer::toJson()).object();
+    for (const QJsonValue &event : document.value(QStringLiteral("traceEvents")).toArray()) {
+        const QJsonObject object = event.toObject();
+        if (object.value(QStringLiteral("name")).toString() == QLatin1String("decodeInParallel")) {
+            return object.value(QStringLiteral("args")).toObject().value(QStringLiteral("decodedChunks")).toInt();
+        }
+    }
+
+    return 0;
+}
+
+#include "singlefiletest.moc"
@@ -0,0 +1,45 @@
+# Find libzstd library and headers
+#
+# The module defines the following variables:
+#
+# ::
+#
+#   Zstd_FOUND               - true if libzstd was found
+#   Zstd_INCLUDE_DIRS        - include search path
+#   Zstd_LIBRARIES           - libraries to link
+#   Zstd_VERSION             - libzstd 3-component version number
+
+find_package(PkgConfig)
+pkg_check_modules(PC_ZSTD QUIET libzstd)
+
+find_path(Zstd_INCLUDE_DIR zstd.h
+  HINTS ${PC_ZSTD_INCLUDEDIR} ${PC_ZSTD_INCLUDE_DIRS})
+
+find_library(Zstd_LIBRARIES
+  NAMES zstd libzstd
+  HINTS ${PC_ZSTD_LIBDIR} ${PC_ZSTD_LIBRARY_DIRS})
+
+# The version is also available without pkg-config, e.g. on Windows.
+if(PC_ZSTD_VERSION)
+  set(Zstd_VERSION ${PC_ZSTD_VERSION})
+elseif(Zstd_INCLUDE_DIR AND EXISTS "${Zstd_INCLUDE_DIR}/zstd.h")
+  file(STRINGS "${Zstd_INCLUDE_DIR}/zstd.h" _zstd_version_lines REGEX "^#define ZSTD_VERSION_(MAJOR|MINOR|RELEASE)[ \t]+[0-9]+")
+  string(REGEX REPLACE ".*ZSTD_VERSION_MAJOR[ \t]+([0-9]+).*" "\\1" _zstd_major "${_zstd_version_lines}")
+  string(REGEX REPLACE ".*ZSTD_VERSION_MINOR[ \t]+([0-9]+).*" "\\1" _zstd_minor "${_zstd_version_lines}")
+  string(REGEX REPLACE ".*ZSTD_VERSION_RELEASE[ \t]+([0-9]+).*" "\\1" _zstd_release "${_zstd_version_lines}")
+  set(Zstd_VERSION "${_zstd_major}.${_zstd_minor}.${_zstd_release}")
+  unset(_zstd_version_lines)
+  unset(_zstd_major)
+  unset(_zstd_minor)
+  unset(_zstd_release)
+endif()
+
+set(Zstd_INCLUDE_DIRS ${Zstd_INCLUDE_DIR})
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd
+                                  FOUND_VAR Zstd_FOUND
+                                  REQUIRED_VARS Zstd_LIBRARIES Zstd_INCLUDE_DIR
+                                  VERSION_VAR Zstd_VERSION)
+
+mark_as_advanced(Zstd_INCLUDE_DIR)
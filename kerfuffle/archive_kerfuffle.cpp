@@ -32,6 +32,7 @@
 #include "jobs.h"
 #include "mimetypes.h"
 #include "pluginmanager.h"
+#include "tracer.h"
 
 #include <KPluginFactory>
 #include <KPluginLoader>
@@ -65,6 +66,10 @@ Archive *Archive::create(const QString &fileName, const QString &fixedMimeType,
         archive = create(fileName, plugin, parent);
         // Use the first valid plugin, according to the priority sorting.
         if (archive->isValid()) {
+            // Plugins running an external executable pay a new process for each preview.
+            if (!plugin->readOnlyExecutables().isEmpty()) {
+                archive->loadInProcessReader(fileName, pluginManager.preferredInProcessPluginsFor(mimeType));
+            }
             return archive;
         }
     }
@@ -79,10 +84,29 @@ Archive *Archive::create(const QString &fileName, Plugin *plugin, QObject *paren
 
     qCDebug(ARK) << "Checking plugin" << plugin->metaData().pluginId();
 
+    ReadOnlyArchiveInterface *iface = createInterface(fileName, plugin);
+    if (!iface) {
+        return new Archive(FailedPlugin, parent);
+    }
+
+    if (!plugin->isValid()) {
+        qCDebug(ARK) << "Cannot use plugin" << plugin->metaData().pluginId() << "- check whether" << plugin->readOnlyExecutables() << "are installed.";
+        return new Archive(FailedPlugin, parent);
+    }
+
+    qCDebug(ARK) << "Successfully loaded plugin" << plugin->metaData().pluginId();
+    return new Archive(iface, !plugin->isReadWrite(), parent);
+}
+
+ReadOnlyArchiveInterface *Archive::createInterface(const QString &fileName, Plugin *plugin)
+{
+    TraceSpan span("open", "archive");
+    span.setArg(QStringLiteral("plugin"), plugin->metaData().pluginId());
+
     KPluginFactory *factory = KPluginLoader(plugin->metaData().fileName()).factory();
     if (!factory) {
         qCWarning(ARK) << "Invalid plugin factory for" << plugin->metaData().pluginId();
-        return new Archive(FailedPlugin, parent);
+        return nullptr;
     }
 
     const QVariantList args = {QVariant(QFileInfo(fileName).absoluteFilePath()),
@@ -90,16 +114,26 @@ Archive *Archive::create(const QString &fileName, Plugin *plugin, QObject *paren
     ReadOnlyArchiveInterface *iface = factory->create<ReadOnlyArchiveInterface>(nullptr, args);
     if (!iface) {
         qCWarning(ARK) << "Could not create plugin instance" << plugin->metaData().pluginId();
-        return new Archive(FailedPlugin, parent);
     }
 
-    if (!plugin->isValid()) {
-        qCDebug(ARK) << "Cannot use plugin" << plugin->metaData().pluginId() << "- check whether" << plugin->readOnlyExecutables() << "are installed.";
-        return new Archive(FailedPlugin, parent);
-    }
+    return iface;
+}
 
-    qCDebug(ARK) << "Successfully loaded plugin" << plugin->metaData().pluginId();
-    return new Archive(iface, !plugin->isReadWrite(), parent);
+void Archive::loadInProcessReader(const QString &fileName, const QVector<Plugin*> &plugins)
+{
+    for (Plugin *plugin : plugins) {
+        if (!plugin->isValid()) {
+            continue;
+        }
+
+        ReadOnlyArchiveInterface *iface = createInterface(fileName, plugin);
+        if (iface) {
+            qCDebug(ARK) << "Using plugin" << plugin->metaData().pluginId() << "as in-process reader";
+            m_readerIface = iface;
+            m_readerIface->setParent(this);
+            return;
+        }
+    }
 }
 
 BatchExtractJob *Archive::batchExtract(const QString &fileName, const QString &destination, bool autoSubfolder, bool preservePaths, QObject *parent)
@@ -150,6 +184,7 @@ LoadJob *Archive::load(const QString &fileName, Plugin *plugin, QObject *parent)
 Archive::Archive(ArchiveError errorCode, QObject *parent)
         : QObject(parent)
         , m_iface(nullptr)
+        , m_readerIface(nullptr)
         , m_error(errorCode)
 {
     qCDebug(ARK) << "Created archive instance with error";
@@ -158,6 +193,7 @@ Archive::Archive(ArchiveError errorCode, QObject *parent)
 Archive::Archive(ReadOnlyArchiveInterface *archiveInterface, bool isReadOnly, QObject *parent)
         : QObject(parent)
         , m_iface(archiveInterface)
+        , m_readerIface(nullptr)
         , m_isReadOnly(isReadOnly)
         , m_isSingleFolder(false)
         , m_isMultiVolume(false)
@@ -416,6 +452,27 @@ AddJob* Archive::addFiles(const QVector<Archive::Entry*> &files, const Archive::
     return newJob;
 }
 
+ReplaceJob* Archive::replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions& options)
+{
+    if (!isValid() || m_iface->isReadOnly()) {
+        return nullptr;
+    }
+
+    ReadWriteArchiveInterface *writeInterface = qobject_cast<ReadWriteArchiveInterface*>(m_iface);
+    if (!writeInterface || !writeInterface->canReplaceEntries()) {
+        return nullptr;
+    }
+
+    CompressionOptions newOptions = options;
+    if (encryptionType() != Unencrypted) {
+        newOptions.setEncryptedArchiveHint(true);
+    }
+
+    qCDebug(ARK) << "Going to replace" << entry->fullPath() << "with" << file << "and options" << newOptions;
+
+    return new ReplaceJob(entry, file, newOptions, writeInterface);
+}
+
 MoveJob* Archive::moveFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions& options)
 {
     if (!isValid()) {
@@ -463,7 +520,10 @@ ExtractJob* Archive::extractFiles(const QVector<Archive::Entry*> &files, const Q
         newOptions.setEncryptedArchiveHint(true);
     }
 
-    ExtractJob *newJob = new ExtractJob(files, destinationDir, newOptions, m_iface);
+    // Extracting everything is left to the main interface, which also reports the byte progress.
+    ReadOnlyArchiveInterface *iface = files.isEmpty() ? m_iface : readInterface();
+    ExtractJob *newJob = new ExtractJob(files, destinationDir, newOptions, iface);
+    setReaderFallback(newJob, iface);
     return newJob;
 }
 
@@ -473,17 +533,36 @@ PreviewJob *Archive::preview(Archive::Entry *entry)
         return nullptr;
     }
 
-    PreviewJob *job = new PreviewJob(entry, (encryptionType() != Unencrypted), m_iface);
+    ReadOnlyArchiveInterface *iface = readInterface();
+    PreviewJob *job = new PreviewJob(entry, (encryptionType() != Unencrypted), iface);
+    setReaderFallback(job, iface);
     return job;
 }
 
+QIODevice *Archive::createEntryDevice(const Archive::Entry *entry)
+{
+    // The devices don't know the password.
+    if (!isValid() || encryptionType() != Unencrypted) {
+        return nullptr;
+    }
+
+    QIODevice *device = readInterface()->createEntryDevice(entry);
+    if (!device && readInterface() != m_iface) {
+        device = m_iface->createEntryDevice(entry);
+    }
+
+    return device;
+}
+
 OpenJob *Archive::open(Archive::Entry *entry)
 {
     if (!isValid()) {
         return nullptr;
     }
 
-    OpenJob *job = new OpenJob(entry, (encryptionType() != Unencrypted), m_iface);
+    ReadOnlyArchiveInterface *iface = readInterface();
+    OpenJob *job = new OpenJob(entry, (encryptionType() != Unencrypted), iface);
+    setReaderFallback(job, iface);
     return job;
 }
 
@@ -493,7 +572,9 @@ OpenWithJob *Archive::openWith(Archive::Entry *entry)
         return nullptr;
     }
 
-    OpenWithJob *job = new OpenWithJob(entry, (encryptionType() != Unencrypted), m_iface);
+    ReadOnlyArchiveInterface *iface = readInterface();
+    OpenWithJob *job = new OpenWithJob(entry, (encryptionType() != Unencrypted), iface);
+    setReaderFallback(job, iface);
     return job;
 }
 
@@ -536,9 +617,31 @@ ReadOnlyArchiveInterface *Archive::interface()
     return m_iface;
 }
 
+ReadOnlyArchiveInterface *Archive::readInterface() const
+{
+    // The in-process reader knows neither the password nor the other volumes.
+    if (m_readerIface && encryptionType() == Unencrypted && !isMultiVolume()) {
+        return m_readerIface;
+    }
+
+    return m_iface;
+}
+
+void Archive::setReaderFallback(Job *job, ReadOnlyArchiveInterface *iface)
+{
+    if (iface != m_iface) {
+        job->setFallbackInterface(m_iface);
+    }
+}
+
 bool Archive::hasMultipleTopLevelEntries() const
 {
     return !isSingleFile() && !isSingleFolder();
 }
 
+bool Archive::canQueueReadJobs() const
+{
+    return isValid() && !readInterface()->waitForFinishedSignal();
+}
+
 } // namespace Kerfuffle
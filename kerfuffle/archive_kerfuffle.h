@@ -38,8 +38,11 @@
 #include <QHash>
 #include <QMimeType>
 
+class QIODevice;
+
 namespace Kerfuffle
 {
+class Job;
 class LoadJob;
 class BatchExtractJob;
 class CreateJob;
@@ -49,6 +52,7 @@ class AddJob;
 class MoveJob;
 class CopyJob;
 class CommentJob;
+class ReplaceJob;
 class TestJob;
 class OpenJob;
 class OpenWithJob;
@@ -127,6 +131,13 @@ public:
      */
     bool hasMultipleTopLevelEntries() const;
 
+    /**
+     * @return Whether the jobs reading entries, such as previews, run one after another
+     * in the JobThreadPool, so that they can be started while another one is running.
+     * Interfaces running an external executable can only run one job at a time.
+     */
+    bool canQueueReadJobs() const;
+
     /**
      * @return Batch extraction job for @p filename to @p destination.
      * @param autoSubfolder Whether the job will extract into a subfolder.
@@ -197,9 +208,24 @@ public:
      */
     CopyJob* copyFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions& options = CompressionOptions());
 
+    /**
+     * Replaces the content of the file @p entry with the file @p file on disk.
+     *
+     * @return The job, or nullptr if the plugin can't replace a single entry.
+     * The entry must then be updated with addFiles().
+     */
+    ReplaceJob* replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions& options = CompressionOptions());
+
     ExtractJob* extractFiles(const QVector<Archive::Entry*> &files, const QString &destinationDir, const ExtractionOptions &options = ExtractionOptions());
 
     PreviewJob* preview(Archive::Entry *entry);
+
+    /**
+     * @return A sequential device streaming the decompressed content of @p entry, owned by the caller,
+     * or nullptr if the plugin can't stream entries or the archive is encrypted.
+     * @see ReadOnlyArchiveInterface::createEntryDevice()
+     */
+    QIODevice *createEntryDevice(const Archive::Entry *entry);
     OpenJob* open(Archive::Entry *entry);
     OpenWithJob* openWith(Archive::Entry *entry);
 
@@ -228,7 +254,34 @@ private:
      * @return A valid archive if the plugin could be loaded, an invalid one otherwise (with the FailedPlugin error set).
      */
     static Archive *create(const QString &fileName, Plugin *plugin, QObject *parent = nullptr);
+
+    /**
+     * Instantiate the archive interface provided by @p plugin for @p fileName.
+     * @return The new interface, or nullptr if the plugin could not be loaded.
+     */
+    static ReadOnlyArchiveInterface *createInterface(const QString &fileName, Plugin *plugin);
+
+    /**
+     * Load the first usable plugin among @p plugins as in-process reader of this archive.
+     * The reader is kept for the lifetime of the archive, so that previews and partial
+     * extractions don't need to spawn an external process each time.
+     */
+    void loadInProcessReader(const QString &fileName, const QVector<Plugin*> &plugins);
+
+    /**
+     * @return The interface to be used by the jobs which only read entries from the archive.
+     * This is the in-process reader when available and able to handle the archive, m_iface otherwise.
+     */
+    ReadOnlyArchiveInterface *readInterface() const;
+
+    /**
+     * Let @p job run again on m_iface if it fails on the in-process reader @p iface,
+     * e.g. because libarchive doesn't support the compression method of an entry.
+     */
+    void setReaderFallback(Job *job, ReadOnlyArchiveInterface *iface);
+
     ReadOnlyArchiveInterface *m_iface;
+    ReadOnlyArchiveInterface *m_readerIface;
     bool m_isReadOnly;
     bool m_isSingleFolder;
     bool m_isMultiVolume;
@@ -63,6 +63,21 @@ void Archive::Entry::copyMetaData(const Archive::Entry *sourceEntry)
     setProperty("isPasswordProtected", sourceEntry->property("isPasswordProtected"));
 }
 
+bool Archive::Entry::hasSameMetaData(const Archive::Entry *sourceEntry) const
+{
+    static const char *const metaDataProperties[] = {
+        "fullPath", "permissions", "owner", "group", "size", "compressedSize", "link", "ratio",
+        "CRC", "BLAKE2", "method", "version", "timestamp", "isDirectory", "isPasswordProtected"
+    };
+
+    for (const char *name : metaDataProperties) {
+        if (property(name) != sourceEntry->property(name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 QVector<Archive::Entry*> Archive::Entry::entries()
 {
     Q_ASSERT(isDir());
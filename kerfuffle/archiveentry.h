@@ -76,6 +76,11 @@ public:
 
     void copyMetaData(const Archive::Entry *sourceEntry);
 
+    /**
+     * @return Whether copyMetaData() would leave this entry unchanged.
+     */
+    bool hasSameMetaData(const Archive::Entry *sourceEntry) const;
+
     QVector<Entry*> entries();
     const QVector<Entry*> entries() const;
     void setEntryAt(int index, Entry *value);
@@ -29,12 +29,17 @@
 #include "archiveinterface.h"
 #include "ark_debug.h"
 #include "mimetypes.h"
+#include "tracer.h"
 
 #include <QDir>
 #include <QFileInfo>
 
 namespace Kerfuffle
 {
+
+// Minimum delay in milliseconds between two progress updates.
+static const qint64 progressInterval = 100;
+
 ReadOnlyArchiveInterface::ReadOnlyArchiveInterface(QObject *parent, const QVariantList & args)
         : QObject(parent)
         , m_numberOfVolumes(0)
@@ -43,6 +48,7 @@ ReadOnlyArchiveInterface::ReadOnlyArchiveInterface(QObject *parent, const QVaria
         , m_isHeaderEncryptionEnabled(false)
         , m_isCorrupt(false)
         , m_isMultiVolume(false)
+        , m_reportedPermille(-1)
 {
     Q_ASSERT(args.size() >= 2);
 
@@ -104,6 +110,54 @@ bool ReadOnlyArchiveInterface::doKill()
     return false;
 }
 
+void ReadOnlyArchiveInterface::requestCancellation()
+{
+    m_cancellationRequested.storeRelease(1);
+}
+
+bool ReadOnlyArchiveInterface::isCancellationRequested() const
+{
+    return m_cancellationRequested.loadAcquire();
+}
+
+void ReadOnlyArchiveInterface::beginOperation()
+{
+    m_cancellationRequested.storeRelease(0);
+    m_progressTimer.invalidate();
+    m_reportedPermille = -1;
+}
+
+void ReadOnlyArchiveInterface::reportProgress(double fraction,
+                                              qulonglong entries, qulonglong totalEntries,
+                                              qulonglong bytes, qulonglong totalBytes)
+{
+    // Each update is a queued signal into the job and then into the job tracker,
+    // so we don't send more than the user can possibly see.
+    const int permille = qBound(0, qRound(fraction * 1000), 1000);
+    if (permille == m_reportedPermille) {
+        return;
+    }
+    if (permille < 1000 && m_progressTimer.isValid() && m_progressTimer.elapsed() < progressInterval) {
+        return;
+    }
+    m_progressTimer.start();
+    m_reportedPermille = permille;
+
+    emit progress(fraction);
+    if (totalEntries > 0) {
+        emit processedEntries(entries, totalEntries);
+    }
+    if (totalBytes > 0) {
+        emit processedSize(bytes, totalBytes);
+    }
+
+    if (Tracer::isEnabled()) {
+        Tracer::addCounter("progress", {{QStringLiteral("permille"), permille},
+                                        {QStringLiteral("entries"), entries},
+                                        {QStringLiteral("bytes"), bytes}});
+    }
+}
+
 void ReadOnlyArchiveInterface::setCorrupt(bool isCorrupt)
 {
     m_isCorrupt = isCorrupt;
@@ -151,6 +205,12 @@ bool ReadOnlyArchiveInterface::waitForFinishedSignal()
     return m_waitForFinishedSignal;
 }
 
+QIODevice *ReadOnlyArchiveInterface::createEntryDevice(const Archive::Entry *entry)
+{
+    Q_UNUSED(entry)
+    return nullptr;
+}
+
 int ReadOnlyArchiveInterface::moveRequiredSignals() const {
     return 1;
 }
@@ -279,11 +339,87 @@ bool ReadWriteArchiveInterface::isReadOnly() const
     }
 }
 
+bool ReadWriteArchiveInterface::canReplaceEntries() const
+{
+    return false;
+}
+
+bool ReadWriteArchiveInterface::replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions &options)
+{
+    Q_UNUSED(entry)
+    Q_UNUSED(file)
+    Q_UNUSED(options)
+    return false;
+}
+
 uint ReadOnlyArchiveInterface::numberOfEntries() const
 {
     return m_numberOfEntries;
 }
 
+bool ReadWriteArchiveInterface::applyOperations(const QVector<ArchiveOperation> &operations)
+{
+    // The receivers start with the first operation.
+    m_currentOperation = 0;
+    const QVector<bool> results = doApplyOperations(operations);
+    Q_ASSERT(results.size() == operations.size());
+
+    bool isSuccessful = true;
+    for (int i = 0; i < results.size(); ++i) {
+        emit operationFinished(i, results.at(i));
+        isSuccessful = isSuccessful && results.at(i);
+    }
+
+    return isSuccessful;
+}
+
+QVector<bool> ReadWriteArchiveInterface::doApplyOperations(const QVector<ArchiveOperation> &operations)
+{
+    QVector<bool> results;
+    results.reserve(operations.size());
+
+    for (int i = 0; i < operations.size(); ++i) {
+        const ArchiveOperation &operation = operations.at(i);
+        setCurrentOperation(i);
+
+        bool result = false;
+        if (!isCancellationRequested()) {
+            switch (operation.mode) {
+            case Add:
+                result = addFiles(operation.entries, operation.destination, operation.options, operation.numberOfEntriesToAdd);
+                break;
+            case Move:
+                result = moveFiles(operation.entries, operation.destination, operation.options);
+                break;
+            case Copy:
+                result = copyFiles(operation.entries, operation.destination, operation.options);
+                break;
+            case Delete:
+                result = deleteFiles(operation.entries);
+                break;
+            case Comment:
+                result = addComment(operation.comment);
+                break;
+            default:
+                qCWarning(ARK) << "Operation mode" << operation.mode << "can't be applied";
+                break;
+            }
+        }
+
+        results.append(result);
+    }
+
+    return results;
+}
+
+void ReadWriteArchiveInterface::setCurrentOperation(int index)
+{
+    if (index != m_currentOperation) {
+        m_currentOperation = index;
+        emit currentOperationChanged(index);
+    }
+}
+
 void ReadWriteArchiveInterface::onEntryRemoved(const QString &path)
 {
     Q_UNUSED(path)
@@ -33,6 +33,9 @@
 #include "kerfuffle_export.h"
 #include "archiveentry.h"
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QIODevice>
 #include <QObject>
 #include <QStringList>
 #include <QString>
@@ -100,6 +103,16 @@ public:
      */
     virtual bool extractFiles(const QVector<Archive::Entry*> &files, const QString &destinationDirectory, const ExtractionOptions &options) = 0;
 
+    /**
+     * Opens a sequential device streaming the decompressed content of @p entry, without writing it to disk.
+     * The device reads the archive on its own: it can be used from any thread, while other jobs run on this interface.
+     * It doesn't stop when their operations are cancelled, but has an abort() invokable method of its own instead.
+     * The default implementation returns nullptr, plugins able to stream entries override it.
+     * Plugins may look for @p entry on the first read, which then fails if it is missing.
+     * @return The device, opened in read-only mode and owned by the caller, or nullptr if @p entry can't be streamed.
+     */
+    virtual QIODevice *createEntryDevice(const Archive::Entry *entry);
+
     /**
      * @return Whether the plugins do NOT run the functions in their own thread.
      * @see setWaitForFinishedSignal()
@@ -157,6 +170,25 @@ public:
      */
     virtual bool doKill();
 
+    /**
+     * Asks the running operation to stop. Plugins poll isCancellationRequested() at least
+     * once per chunk of data they copy, so the request is honored within a bounded delay
+     * even in the middle of a big entry.
+     */
+    void requestCancellation();
+
+    /**
+     * @return Whether the running operation should stop and clean up its partial output.
+     * Unlike QThread::isInterruptionRequested(), this can be called from any thread.
+     */
+    bool isCancellationRequested() const;
+
+    /**
+     * Resets the state of the previous operation, i.e. the cancellation request
+     * and the progress reported so far. Called before a new operation is started.
+     */
+    void beginOperation();
+
     bool isHeaderEncryptionEnabled() const;
     virtual QString multiVolumeName() const;
     void setMultiVolume(bool value);
@@ -184,6 +216,18 @@ Q_SIGNALS:
     void error(const QString &message, const QString &details = QString());
     void entry(Archive::Entry *archiveEntry);
     void progress(double progress);
+
+    /**
+     * Emitted with the number of bytes that have been processed so far by an operation,
+     * along with the total number of bytes it is going to process.
+     */
+    void processedSize(qulonglong processed, qulonglong total);
+
+    /**
+     * Emitted with the number of entries that have been processed so far by an operation,
+     * along with the total number of entries it is going to process.
+     */
+    void processedEntries(qulonglong processed, qulonglong total);
     void info(const QString &info);
     void finished(bool result);
     void testSuccess();
@@ -205,6 +249,18 @@ protected:
 
     void setCorrupt(bool isCorrupt);
     bool isCorrupt() const;
+
+    /**
+     * Reports the progress of the current operation, along with the number of entries and bytes
+     * processed so far when their total is known (i.e. not 0).
+     * Updates are coalesced: they are emitted only if the fraction changed by at least a permille
+     * and some time passed since the previous update, or once the operation is complete.
+     * This makes it cheap to call for each entry or chunk of data, even for huge archives.
+     */
+    void reportProgress(double fraction,
+                        qulonglong entries = 0, qulonglong totalEntries = 0,
+                        qulonglong bytes = 0, qulonglong totalBytes = 0);
+
     QString m_comment;
     int m_numberOfVolumes;
     uint m_numberOfEntries;
@@ -218,11 +274,16 @@ private:
     bool m_isHeaderEncryptionEnabled;
     bool m_isCorrupt;
     bool m_isMultiVolume;
+    QAtomicInt m_cancellationRequested;
+    QElapsedTimer m_progressTimer;
+    int m_reportedPermille;
 
 private Q_SLOTS:
     void onEntry(Archive::Entry *archiveEntry);
 };
 
+struct ArchiveOperation;
+
 class KERFUFFLE_EXPORT ReadWriteArchiveInterface: public ReadOnlyArchiveInterface
 {
     Q_OBJECT
@@ -259,16 +320,73 @@ public:
     virtual bool deleteFiles(const QVector<Archive::Entry*> &files) = 0;
     virtual bool addComment(const QString &comment) = 0;
 
+    /**
+     * @return Whether the plugin implements replaceEntry().
+     */
+    virtual bool canReplaceEntries() const;
+
+    /**
+     * Replaces the content of the file @p entry with the file @p file on disk, leaving the other entries as they are.
+     * Only the replaced entry is emitted again, with its new metadata.
+     * The default implementation does nothing: the archive is then updated by adding the file.
+     * @return Whether the operation succeeded.
+     * @note If returning false, make sure to emit the error() signal beforewards to notify
+     * the user of the error condition.
+     */
+    virtual bool replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions &options);
+
+    /**
+     * Applies the given @p operations in order, e.g. the modifications queued by several jobs.
+     * The signals emitted while applying an operation are preceded by currentOperationChanged(),
+     * and operationFinished() is emitted for each operation once they have all been applied.
+     * @return Whether all the operations succeeded.
+     */
+    bool applyOperations(const QVector<ArchiveOperation> &operations);
+
 Q_SIGNALS:
     void entryRemoved(const QString &path);
 
+    /**
+     * Emitted when the following signals relate to the operation at @p index.
+     */
+    void currentOperationChanged(int index);
+    void operationFinished(int index, bool result);
+
 protected:
+    /**
+     * Applies the operations one after another, with the methods above.
+     * Plugins that rewrite the whole archive for each modification should apply them in a single pass instead.
+     * @return The result of each operation.
+     */
+    virtual QVector<bool> doApplyOperations(const QVector<ArchiveOperation> &operations);
+
+    /**
+     * Makes the signals emitted from now on relate to the operation at @p index.
+     */
+    void setCurrentOperation(int index);
+
     OperationMode m_operationMode = NoOperation;
 
+private:
+    int m_currentOperation = 0;
+
 private Q_SLOTS:
     void onEntryRemoved(const QString &path);
 };
 
+/**
+ * A modification of a read-write archive, with the arguments of the matching method of ReadWriteArchiveInterface.
+ */
+struct ArchiveOperation
+{
+    ReadWriteArchiveInterface::OperationMode mode = ReadWriteArchiveInterface::NoOperation;
+    QVector<Archive::Entry*> entries;
+    Archive::Entry *destination = nullptr;
+    CompressionOptions options;
+    uint numberOfEntriesToAdd = 0;
+    QString comment;
+};
+
 } // namespace Kerfuffle
 
 #endif // ARCHIVEINTERFACE_H
@@ -29,7 +29,9 @@
 
 #include "cliinterface.h"
 #include "ark_debug.h"
+#include "extractedentrycache.h"
 #include "queries.h"
+#include "tracer.h"
 
 #ifdef Q_OS_WIN
 # include <KProcess>
@@ -45,7 +47,6 @@
 #include <QFile>
 #include <QMimeDatabase>
 #include <QProcess>
-#include <QRegularExpression>
 #include <QStandardPaths>
 #include <QTemporaryDir>
 #include <QTemporaryFile>
@@ -55,6 +56,11 @@
 
 namespace Kerfuffle
 {
+
+// Limits of the files extracted along with a preview from a solid archive.
+static const qulonglong solidBatchMaxSize = 64 * 1024 * 1024;
+static const int solidBatchMaxEntries = 64;
+
 CliInterface::CliInterface(QObject *parent, const QVariantList & args)
     : ReadWriteArchiveInterface(parent, args)
 {
@@ -90,7 +96,11 @@ bool CliInterface::list()
 
     // To compute progress.
     m_archiveSizeOnDisk = static_cast<qulonglong>(QFileInfo(filename()).size());
-    connect(this, &ReadOnlyArchiveInterface::entry, this, &CliInterface::onEntry);
+    m_listedSize = 0;
+    m_listedUnpackedSize = 0;
+    m_listedTopLevelNames.clear();
+    m_listedFiles.clear();
+    connect(this, &ReadOnlyArchiveInterface::entry, this, &CliInterface::onEntry, Qt::UniqueConnection);
 
     return runProcess(m_cliProps->property("listProgram").toString(), m_cliProps->listArgs(filename(), password()));
 }
@@ -103,8 +113,24 @@ bool CliInterface::extractFiles(const QVector<Archive::Entry*> &files, const QSt
     m_extractionOptions = options;
     m_extractedFiles = files;
     m_extractDestDir = destinationDirectory;
+    m_solidBatch.clear();
 
+    // Decrypted entries are not kept around any longer than needed.
+    qulonglong solidBatchSize = 0;
+    if (options.isTemporaryExtraction() && files.size() == 1 && isSolid() && options.preservePaths() &&
+        !options.encryptedArchiveHint() && password().isEmpty() && ExtractedEntryCache::instance()) {
+        m_solidBatch = solidBatchFor(files.first(), &solidBatchSize);
+    }
 
+    if (files.isEmpty()) {
+        resetProgress(static_cast<int>(m_numberOfEntries), m_listedUnpackedSize);
+    } else {
+        qulonglong size = solidBatchSize;
+        for (const Archive::Entry *entry : files) {
+            size += entry->property("size").toULongLong();
+        }
+        resetProgress(files.size() + m_solidBatch.size(), size);
+    }
 
     if (!m_cliProps->property("passwordSwitch").toStringList().isEmpty() && options.encryptedArchiveHint() && password().isEmpty()) {
         qCDebug(ARK) << "Password hint enabled, querying user";
@@ -115,13 +141,15 @@ bool CliInterface::extractFiles(const QVector<Archive::Entry*> &files, const QSt
 
     QUrl destDir = QUrl(destinationDirectory);
     m_oldWorkingDirExtraction = QDir::currentPath();
-    QDir::setCurrent(destDir.adjusted(QUrl::RemoveScheme).url());
+    const QString destPath = destDir.adjusted(QUrl::RemoveScheme).url();
+    QDir::setCurrent(destPath);
 
     const bool useTmpExtractDir = options.isDragAndDropEnabled() || options.alwaysUseTempDir();
 
     if (useTmpExtractDir) {
-        // Create an hidden temp folder in the current directory.
-        m_extractTempDir.reset(new QTemporaryDir(QStringLiteral(".%1-").arg(QCoreApplication::applicationName())));
+        // Create an hidden temp folder in the destination, so that it is on the same filesystem
+        // and the extracted files can be moved by renaming them instead of copying them.
+        m_extractTempDir.reset(new QTemporaryDir(QDir(destPath).filePath(QStringLiteral(".%1-").arg(QCoreApplication::applicationName()))));
 
         qCDebug(ARK) << "Using temporary extraction dir:" << m_extractTempDir->path();
         if (!m_extractTempDir->isValid()) {
@@ -133,18 +161,22 @@ bool CliInterface::extractFiles(const QVector<Archive::Entry*> &files, const QSt
         QDir::setCurrent(destDir.adjusted(QUrl::RemoveScheme).url());
     }
 
+    QStringList filesList = extractFilesList(files);
+    for (const QString &fullPath : qAsConst(m_solidBatch)) {
+        filesList << escapeFileName(fullPath);
+    }
+
     return runProcess(m_cliProps->property("extractProgram").toString(),
                     m_cliProps->extractArgs(filename(),
-                                            extractFilesList(files),
+                                            filesList,
                                             options.preservePaths(),
                                             password()));
 }
 
 bool CliInterface::addFiles(const QVector<Archive::Entry*> &files, const Archive::Entry *destination, const CompressionOptions& options, uint numberOfEntriesToAdd)
 {
-    Q_UNUSED(numberOfEntriesToAdd)
-
     m_operationMode = Add;
+    resetProgress(static_cast<int>(numberOfEntriesToAdd), 0);
 
     QVector<Archive::Entry*> filesToPass = QVector<Archive::Entry*>();
     // If destination path is specified, we have recreate its structure inside the temp directory
@@ -221,7 +253,8 @@ bool CliInterface::moveFiles(const QVector<Archive::Entry*> &files, Archive::Ent
                       m_cliProps->moveArgs(filename(),
                                            withoutChildren,
                                            destination,
-                                           password()));
+                                           password(),
+                                           isHeaderEncryptionEnabled()));
 }
 
 bool CliInterface::copyFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options)
@@ -248,7 +281,7 @@ bool CliInterface::deleteFiles(const QVector<Archive::Entry*> &files)
     m_removedFiles = files;
 
     return runProcess(m_cliProps->property("deleteProgram").toString(),
-                      m_cliProps->deleteArgs(filename(), files, password()));
+                      m_cliProps->deleteArgs(filename(), files, password(), isHeaderEncryptionEnabled()));
 }
 
 bool CliInterface::testArchive()
@@ -275,7 +308,7 @@ bool CliInterface::runProcess(const QString& programName, const QStringList& arg
 #ifdef Q_OS_WIN
     m_process = new KProcess;
 #else
-    m_process = new KPtyProcess;
+    m_process = new CliProcess;
     m_process->setPtyChannels(KPtyProcess::StdinChannel);
 #endif
 
@@ -283,20 +316,44 @@ bool CliInterface::runProcess(const QString& programName, const QStringList& arg
     m_process->setNextOpenMode(QIODevice::ReadWrite | QIODevice::Unbuffered | QIODevice::Text);
     m_process->setProgram(programPath, arguments);
 
+#ifdef Q_OS_WIN
     connect(m_process, &QProcess::readyReadStandardOutput, this, [=]() {
         readStdout();
     });
+#else
+    // The output is read by another thread: the notification may arrive after the process is gone.
+    connect(m_process, &CliProcess::outputAvailable, this, [=]() {
+        if (m_process) {
+            readStdout();
+        }
+    }, Qt::QueuedConnection);
+#endif
 
+#ifdef Q_OS_WIN
     if (m_operationMode == Extract) {
         // Extraction jobs need a dedicated post-processing function.
         connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &CliInterface::extractProcessFinished);
     } else {
         connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &CliInterface::processFinished);
     }
+#else
+    // Wait for the rest of the output without blocking the event loop.
+    if (m_operationMode == Extract) {
+        // Extraction jobs need a dedicated post-processing function.
+        connect(m_process, &CliProcess::finishedWithOutput, this, &CliInterface::extractProcessFinished);
+    } else {
+        connect(m_process, &CliProcess::finishedWithOutput, this, &CliInterface::processFinished);
+    }
+#endif
 
-    m_stdOutData.clear();
+    m_stdOutScanner.clear();
+    m_entryTraceStart = Tracer::now();
 
+#ifdef Q_OS_WIN
     m_process->start();
+#else
+    m_process->startProcess();
+#endif
 
     return true;
 }
@@ -314,12 +371,6 @@ void CliInterface::processFinished(int exitCode, QProcess::ExitStatus exitStatus
         m_process = nullptr;
     }
 
-    // #193908 - #222392
-    // Don't emit finished() if the job was killed quietly.
-    if (m_abortingOperation) {
-        return;
-    }
-
     if (m_operationMode == Delete || m_operationMode == Move) {
         const QStringList removedFullPaths = entryFullPaths(m_removedFiles);
         for (const QString &fullPath : removedFullPaths) {
@@ -364,28 +415,25 @@ void CliInterface::extractProcessFinished(int exitCode, QProcess::ExitStatus exi
         m_process = nullptr;
     }
 
-    // Don't emit finished() if the job was killed quietly.
-    if (m_abortingOperation) {
+    if (isExtractionFailedExitCode(m_exitCode)) {
+        if (password().isEmpty()) {
+            qCWarning(ARK) << "Extraction aborted, destination folder might not have enough space.";
+            emit error(i18n("Extraction failed. Make sure that enough space is available."));
+        } else {
+            qCWarning(ARK) << "Extraction aborted, either the password is wrong or the destination folder doesn't have enough space.";
+            emit error(i18n("Extraction failed. Make sure you provided the correct password and that enough space is available."));
+            setPassword(QString());
+        }
+        cleanUpExtracting();
+        emit finished(false);
         return;
     }
 
-    if (m_extractionOptions.alwaysUseTempDir()) {
-        // unar exits with code 1 if extraction fails.
-        // This happens at least with wrong passwords or not enough space in the destination folder.
-        if (m_exitCode == 1) {
-            if (password().isEmpty()) {
-                qCWarning(ARK) << "Extraction aborted, destination folder might not have enough space.";
-                emit error(i18n("Extraction failed. Make sure that enough space is available."));
-            } else {
-                qCWarning(ARK) << "Extraction aborted, either the password is wrong or the destination folder doesn't have enough space.";
-                emit error(i18n("Extraction failed. Make sure you provided the correct password and that enough space is available."));
-                setPassword(QString());
-            }
-            cleanUpExtracting();
-            emit finished(false);
-            return;
-        }
+    if (!m_solidBatch.isEmpty()) {
+        storeSolidBatch(QDir::current());
+    }
 
+    if (m_extractionOptions.alwaysUseTempDir()) {
         if (!m_extractionOptions.isDragAndDropEnabled()) {
             if (!moveToDestination(QDir::current(), QDir(m_extractDestDir), m_extractionOptions.preservePaths())) {
                 emit error(i18ncp("@info",
@@ -525,14 +573,6 @@ bool CliInterface::moveDroppedFilesToDest(const QVector<Archive::Entry*> &files,
     return true;
 }
 
-bool CliInterface::isEmptyDir(const QDir &dir)
-{
-    QDir d = dir;
-    d.setFilter(QDir::AllEntries | QDir::NoDotAndDotDot);
-
-    return d.count() == 0;
-}
-
 void CliInterface::cleanUpExtracting()
 {
     restoreWorkingDirExtraction();
@@ -567,78 +607,206 @@ bool CliInterface::moveToDestination(const QDir &tempDir, const QDir &destDir, b
     bool overwriteAll = false;
     bool skipAll = false;
 
+    if (preservePaths) {
+        return moveSubtrees(tempDir, destDir, overwriteAll, skipAll);
+    }
+
+    // Without paths, all the files end up in the destination dir itself.
     QDirIterator dirIt(tempDir.path(), QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
     while (dirIt.hasNext()) {
         dirIt.next();
 
-        // We skip directories if:
-        // 1. We are not preserving paths
-        // 2. The dir is not empty. Only empty directories need to be explicitly moved.
-        // The non-empty ones are created by QDir::mkpath() below.
         if (dirIt.fileInfo().isDir()) {
-            if (!preservePaths || !isEmptyDir(QDir(dirIt.filePath()))) {
-                continue;
-            }
+            continue;
         }
 
-        QFileInfo relEntry;
-        if (preservePaths) {
-            relEntry = QFileInfo(dirIt.filePath().remove(tempDir.path() + QLatin1Char('/')));
-        } else {
-            relEntry = QFileInfo(dirIt.fileName());
+        const QString destPath = destDir.filePath(dirIt.fileName());
+        bool skip = false;
+        if (!handleExistingDestination(destPath, overwriteAll, skipAll, &skip)) {
+            return false;
+        }
+        if (skip) {
+            continue;
         }
 
-        QFileInfo absDestEntry(destDir.path() + QLatin1Char('/') + relEntry.filePath());
-
-        if (absDestEntry.exists()) {
-            qCWarning(ARK) << "File" << absDestEntry.absoluteFilePath() << "exists.";
-
-            Kerfuffle::OverwriteQuery query(absDestEntry.absoluteFilePath());
-            query.setNoRenameMode(true);
-            query.execute();
+        if (!QFile(dirIt.filePath()).rename(destPath)) {
+            qCWarning(ARK) << "Failed to move file" << dirIt.filePath() << "to final destination.";
+            return false;
+        }
+    }
 
-            if (query.responseOverwrite() || query.responseOverwriteAll()) {
-                if (query.responseOverwriteAll()) {
-                    overwriteAll = true;
-                }
-                if (!QFile::remove(absDestEntry.absoluteFilePath())) {
-                    qCWarning(ARK) << "Failed to remove" << absDestEntry.absoluteFilePath();
-                }
+    return true;
+}
 
-            } else if (query.responseSkip() || query.responseAutoSkip()) {
-                if (query.responseAutoSkip()) {
-                    skipAll = true;
+bool CliInterface::moveSubtrees(const QDir &sourceDir, const QDir &destDir, bool &overwriteAll, bool &skipAll)
+{
+    const QFileInfoList sources = sourceDir.entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    for (const QFileInfo &source : sources) {
+        const QString destPath = destDir.filePath(source.fileName());
+        const QFileInfo dest(destPath);
+
+        // Entries without a counterpart in the destination are moved with their whole subtree at once.
+        if (dest.exists() || dest.isSymLink()) {
+            if (source.isDir() && !source.isSymLink() && dest.isDir() && !dest.isSymLink()) {
+                if (!moveSubtrees(QDir(source.filePath()), QDir(destPath), overwriteAll, skipAll)) {
+                    return false;
                 }
                 continue;
-            } else if (query.responseCancelled()) {
-                qCDebug(ARK) << "Copy action cancelled.";
+            }
+
+            bool skip = false;
+            if (!handleExistingDestination(destPath, overwriteAll, skipAll, &skip)) {
                 return false;
             }
-        } else if (skipAll) {
-            continue;
-        } else if (overwriteAll) {
-            if (!QFile::remove(absDestEntry.absoluteFilePath())) {
-                qCWarning(ARK) << "Failed to remove" << absDestEntry.absoluteFilePath();
+            if (skip) {
+                continue;
             }
         }
 
-        if (preservePaths) {
-            // Create any parent directories.
-            if (!destDir.mkpath(relEntry.path())) {
-                qCWarning(ARK) << "Failed to create parent directory for file:" << absDestEntry.filePath();
-            }
+        if (!QDir().rename(source.filePath(), destPath)) {
+            qCWarning(ARK) << "Failed to move" << source.filePath() << "to final destination.";
+            return false;
         }
+    }
 
-        // Move file to the final destination.
-        if (!QFile(dirIt.filePath()).rename(absDestEntry.absoluteFilePath())) {
-            qCWarning(ARK) << "Failed to move file" << dirIt.filePath() << "to final destination.";
+    return true;
+}
+
+bool CliInterface::handleExistingDestination(const QString &path, bool &overwriteAll, bool &skipAll, bool *skip)
+{
+    *skip = false;
+
+    const QFileInfo destEntry(path);
+    if (!destEntry.exists() && !destEntry.isSymLink()) {
+        return true;
+    }
+
+    qCWarning(ARK) << "File" << path << "exists.";
+
+    if (skipAll) {
+        *skip = true;
+        return true;
+    }
+
+    if (!overwriteAll) {
+        Kerfuffle::OverwriteQuery query(path);
+        query.setNoRenameMode(true);
+        query.execute();
+
+        if (query.responseCancelled()) {
+            qCDebug(ARK) << "Copy action cancelled.";
             return false;
         }
+
+        if (query.responseSkip() || query.responseAutoSkip()) {
+            skipAll = query.responseAutoSkip();
+            *skip = true;
+            return true;
+        }
+
+        overwriteAll = query.responseOverwriteAll();
+    }
+
+    if (!QFile::remove(path)) {
+        qCWarning(ARK) << "Failed to remove" << path;
     }
 
     return true;
 }
 
+bool CliInterface::hasExtractionConflicts(const QVector<Archive::Entry*> &files, const QString &destinationDirectory, bool preservePaths) const
+{
+    QSet<QString> names;
+    if (files.isEmpty()) {
+        // Without paths, we would need the names of all the listed entries.
+        if (!preservePaths) {
+            return true;
+        }
+        names = m_listedTopLevelNames;
+    } else {
+        for (const Archive::Entry *file : files) {
+            const QString path = file->fullPath(NoTrailingSlash);
+            names.insert(preservePaths ? path.left(path.indexOf(QLatin1Char('/'))) : file->name());
+        }
+    }
+
+    // Files can only be overwritten if a top-level entry already exists.
+    const QDir destDir(destinationDirectory);
+    for (const QString &name : qAsConst(names)) {
+        const QFileInfo destEntry(destDir.filePath(name));
+        if (destEntry.exists() || destEntry.isSymLink()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CliInterface::isExtractionFailedExitCode(int exitCode) const
+{
+    Q_UNUSED(exitCode);
+    return false;
+}
+
+bool CliInterface::isSolid() const
+{
+    return false;
+}
+
+QStringList CliInterface::solidBatchFor(const Archive::Entry *entry, qulonglong *batchSize) const
+{
+    const ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    const QString fullPath = entry->fullPath(NoTrailingSlash);
+
+    int index = m_listedFiles.size() - 1;
+    while (index >= 0 && m_listedFiles.at(index).first != fullPath) {
+        --index;
+    }
+
+    // The batch must not evict itself, nor the requested entry, from the cache.
+    const qulonglong maxBatchSize = qMin(solidBatchMaxSize, static_cast<qulonglong>(cache->maxSize() / 2));
+    const qulonglong maxEntrySize = static_cast<qulonglong>(cache->maxEntrySize());
+
+    QStringList batch;
+    const qulonglong entrySize = entry->property("size").toULongLong();
+    *batchSize = 0;
+    for (int i = index - 1; i >= 0 && batch.size() < solidBatchMaxEntries; --i) {
+        const QString &path = m_listedFiles.at(i).first;
+        const qulonglong size = m_listedFiles.at(i).second;
+        if ((maxEntrySize > 0 && size > maxEntrySize) || path.contains(QLatin1String("../")) ||
+            cache->contains(filename(), path)) {
+            continue;
+        }
+
+        if (entrySize + *batchSize + size > maxBatchSize) {
+            break;
+        }
+
+        *batchSize += size;
+        batch.prepend(path);
+    }
+
+    return batch;
+}
+
+void CliInterface::storeSolidBatch(const QDir &extractionDir)
+{
+    ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    for (const QString &fullPath : qAsConst(m_solidBatch)) {
+        const QString extractedPath = extractionDir.filePath(fullPath);
+        if (cache) {
+            cache->insert(filename(), fullPath, extractedPath);
+        }
+
+        // Only the requested entry must be left to the caller, whether the batch file got cached or not.
+        QFile::remove(extractedPath);
+        const QString parentPath = QFileInfo(fullPath).path();
+        if (parentPath != QLatin1String(".")) {
+            extractionDir.rmpath(parentPath);
+        }
+    }
+}
+
 void CliInterface::setNewMovedFiles(const QVector<Archive::Entry*> &entries, const Archive::Entry *destination, int entriesWithoutChildren)
 {
     m_newMovedFiles.clear();
@@ -701,17 +869,30 @@ void CliInterface::killProcess(bool emitFinished)
         return;
     }
 
-    m_abortingOperation = !emitFinished;
-
-    // Give some time for the application to finish gracefully
-    if (!m_process->waitForFinished(5)) {
+    // The process is not waited for, that would block the GUI until it's gone.
+    if (emitFinished) {
+        // The finished handlers run once it exited, as usual.
         m_process->kill();
+        return;
+    }
 
-        // It takes a few hundred ms for the process to be killed.
-        m_process->waitForFinished(1000);
+    // #193908 - #222392
+    // Nothing must be emitted for a process killed quietly: forget about it right away.
+    auto process = m_process;
+    m_process = nullptr;
+    disconnect(process, nullptr, this, nullptr);
+
+    if (process->state() == QProcess::NotRunning) {
+        process->deleteLater();
+        return;
     }
 
-    m_abortingOperation = false;
+#ifdef Q_OS_WIN
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), process, &QObject::deleteLater);
+#else
+    connect(process, &CliProcess::finishedWithOutput, process, &QObject::deleteLater);
+#endif
+    process->kill();
 }
 
 bool CliInterface::passwordQuery()
@@ -749,73 +930,180 @@ void CliInterface::readStdout(bool handleAll)
     //etc), so keep in mind that this function is supposed to handle
     //all those special cases and be the lowest common denominator
 
-    if (m_abortingOperation)
-        return;
-
     Q_ASSERT(m_process);
 
-    if (!m_process->bytesAvailable()) {
+    TraceSpan span("parseOutput", "cli");
+
+#ifdef Q_OS_WIN
+    if (!m_stdOutScanner.readFrom(m_process)) {
         //if process has no more data, we can just bail out
         return;
     }
-
-    QByteArray dd = m_process->readAllStandardOutput();
-    m_stdOutData += dd;
-
-    QList<QByteArray> lines = m_stdOutData.split('\n');
+#else
+    //all the output that piled up since the last call is handled at once
+    const QByteArray output = m_process->takeOutput();
+    if (output.isEmpty()) {
+        //if process has no more data, we can just bail out
+        return;
+    }
+    m_stdOutScanner.append(output);
+#endif
 
     //The reason for this check is that archivers often do not end
     //queries (such as file exists, wrong password) on a new line, but
     //freeze waiting for input. So we check for errors on the last line in
     //all cases.
-    // TODO: QLatin1String() might not be the best choice here.
-    //       The call to handleLine() at the end of the method uses
-    //       QString::fromLocal8Bit(), for example.
-    // TODO: The same check methods are called in handleLine(), this
-    //       is suboptimal.
-
-    bool wrongPasswordMessage = isWrongPasswordMsg(QLatin1String(lines.last()));
+    const QByteArray pendingLine = m_stdOutScanner.pendingLine();
+    if (!pendingLine.isEmpty()) {
+        const QString lastLine = stripErasedText(QString::fromLocal8Bit(pendingLine));
+        const bool wrongPasswordMessage = isWrongPasswordMsg(lastLine);
+
+        const bool foundErrorMessage =
+            (wrongPasswordMessage ||
+             isDiskFullMsg(lastLine) ||
+             isFileExistsMsg(lastLine) ||
+             isPasswordPrompt(lastLine));
+
+        if (foundErrorMessage) {
+            handleAll = true;
+        }
 
-    bool foundErrorMessage =
-        (wrongPasswordMessage ||
-         isDiskFullMsg(QLatin1String(lines.last())) ||
-         isFileExistsMsg(QLatin1String(lines.last()))) ||
-         isPasswordPrompt(QLatin1String(lines.last()));
+        if (wrongPasswordMessage) {
+            setPassword(QString());
+        }
 
-    if (foundErrorMessage) {
-        handleAll = true;
+        //Progress is usually updated in place, without a newline.
+        if (m_operationMode == Extract || m_operationMode == Add) {
+            updateProgress(lastLine, false);
+        }
     }
 
-    if (wrongPasswordMessage) {
-        setPassword(QString());
+    //The lines are views of the scanner buffer: they are only decoded if
+    //the plugin is interested in them, and they must not be used after
+    //handleLine(), which may end up reading more output.
+    QByteArray line;
+    while (m_stdOutScanner.nextLine(&line)) {
+        if (!handleStdoutLine(line)) {
+            return;
+        }
     }
 
-    //this is complex, here's an explanation:
     //if there is no newline, then there is no guaranteed full line to
     //handle in the output. The exception is that it is supposed to handle
     //all the data, OR if there's been an error message found in the
-    //partial data.
-    if (lines.size() == 1 && !handleAll) {
-        return;
+    //partial data. Note that the last line may be an empty string if the
+    //stdout data ends with a newline.
+    if (handleAll) {
+        handleStdoutLine(m_stdOutScanner.takeAll());
     }
+}
 
-    if (handleAll) {
-        m_stdOutData.clear();
-    } else {
-        //because the last line might be incomplete we leave it for now
-        //note, this last line may be an empty string if the stdoutdata ends
-        //with a newline
-        m_stdOutData = lines.takeLast();
+bool CliInterface::handleStdoutLine(const QByteArray &line)
+{
+    if (line.isEmpty() && !(m_listEmptyLines && m_operationMode == List)) {
+        return true;
     }
 
-    for (const QByteArray& line : qAsConst(lines)) {
-        if (!line.isEmpty() || (m_listEmptyLines && m_operationMode == List)) {
-            if (!handleLine(QString::fromLocal8Bit(line))) {
-                killProcess();
-                return;
-            }
-        }
+    if (isIgnoredLine(line)) {
+        return true;
+    }
+
+    if (!handleLine(stripErasedText(QString::fromLocal8Bit(line)))) {
+        //the lines following an error are not handled
+        m_stdOutScanner.clear();
+        killProcess();
+        return false;
     }
+
+    return true;
+}
+
+QString CliInterface::stripErasedText(const QString &line) const
+{
+    return line;
+}
+
+bool CliInterface::isIgnoredLine(const QByteArray &line) const
+{
+    Q_UNUSED(line);
+    return false;
+}
+
+int CliInterface::readProgressPercentage(const QString &line) const
+{
+    if (!m_cliProps->property("captureProgress").toBool()) {
+        return -1;
+    }
+
+    // The percentage may be followed by e.g. the name of the current entry.
+    const QStringRef text = lastWrittenText(line).trimmed();
+    int digits = 0;
+    while (digits < 3 && digits < text.size() && text.at(digits).isDigit()) {
+        digits++;
+    }
+
+    if (digits == 0 || digits == text.size() || text.at(digits) != QLatin1Char('%')) {
+        return -1;
+    }
+
+    return qMin(text.left(digits).toInt(), 100);
+}
+
+bool CliInterface::isEntryProcessedMsg(const QString &line) const
+{
+    Q_UNUSED(line);
+    return false;
+}
+
+QStringRef CliInterface::lastWrittenText(const QString &line)
+{
+    // Ignore the carriage returns ending the line, which a pty adds before newlines.
+    int end = line.size();
+    while (end > 0 && line.at(end - 1) == QLatin1Char('\r')) {
+        end--;
+    }
+
+    int start = end;
+    while (start > 0 && line.at(start - 1) != QLatin1Char('\b') && line.at(start - 1) != QLatin1Char('\r')) {
+        start--;
+    }
+
+    return line.midRef(start, end - start);
+}
+
+void CliInterface::resetProgress(int entries, qulonglong size)
+{
+    m_progressTotalEntries = entries;
+    m_progressProcessedEntries = 0;
+    m_progressTotalSize = size;
+    m_hasProgressPercentage = false;
+}
+
+void CliInterface::updateProgress(const QString &line, bool complete)
+{
+    const int percentage = readProgressPercentage(line);
+    if (percentage >= 0) {
+        m_hasProgressPercentage = true;
+        reportFraction(percentage / 100.0);
+        return;
+    }
+
+    // Fall back to counting the entries, unless the program reports percentages.
+    if (complete && !m_hasProgressPercentage && m_progressTotalEntries > 0 && isEntryProcessedMsg(line)) {
+        m_progressProcessedEntries = qMin(m_progressProcessedEntries + 1, m_progressTotalEntries);
+        reportFraction(static_cast<double>(m_progressProcessedEntries) / m_progressTotalEntries);
+    }
+}
+
+void CliInterface::reportFraction(double fraction)
+{
+    // Programs may report the same percentage many times, e.g. for each backspace,
+    // reportProgress() drops the updates which don't change anything.
+    // The processed entries are only known when we count them ourselves.
+    const qulonglong totalEntries = m_hasProgressPercentage ? 0 : static_cast<qulonglong>(m_progressTotalEntries);
+    reportProgress(fraction,
+                   static_cast<qulonglong>(m_progressProcessedEntries), totalEntries,
+                   static_cast<qulonglong>(fraction * m_progressTotalSize), m_progressTotalSize);
 }
 
 bool CliInterface::setAddedFiles()
@@ -834,16 +1122,8 @@ bool CliInterface::setAddedFiles()
 
 bool CliInterface::handleLine(const QString& line)
 {
-    // TODO: This should be implemented by each plugin; the way progress is
-    //       shown by each CLI application is subject to a lot of variation.
-    if ((m_operationMode == Extract || m_operationMode == Add) && m_cliProps->property("captureProgress").toBool()) {
-        //read the percentage
-        int pos = line.indexOf(QLatin1Char( '%' ));
-        if (pos > 1) {
-            int percentage = line.midRef(pos - 2, 2).toInt();
-            emit progress(float(percentage) / 100);
-            return true;
-        }
+    if (m_operationMode == Extract || m_operationMode == Add) {
+        updateProgress(line, true);
     }
 
     if (m_operationMode == Extract) {
@@ -884,6 +1164,15 @@ bool CliInterface::handleLine(const QString& line)
             return true;
         }
 
+        if (Tracer::isEnabled() && isEntryProcessedMsg(line)) {
+            // Spans from one entry reported by the program to the next one,
+            // as seen when the output is parsed.
+            const qint64 now = Tracer::now();
+            Tracer::addSpan("extractEntry", "cli", m_entryTraceStart, now - m_entryTraceStart,
+                            {{QStringLiteral("entry"), lastWrittenText(line).trimmed().toString()}});
+            m_entryTraceStart = now;
+        }
+
         return readExtractLine(line);
     }
 
@@ -957,15 +1246,10 @@ bool CliInterface::handleFileExistsMessage(const QString& line)
 {
     // Check for a filename and store it.
     if (isFileExistsFileName(line)) {
-        const QStringList fileExistsFileNameRegExp = m_cliProps->property("fileExistsFileNameRegExp").toStringList();
-        for (const QString &pattern : fileExistsFileNameRegExp) {
-            const QRegularExpression rxFileNamePattern(pattern);
-            const QRegularExpressionMatch rxMatch = rxFileNamePattern.match(line);
-
-            if (rxMatch.hasMatch()) {
-                m_storedFileName = rxMatch.captured(1);
-                qCWarning(ARK) << "Detected existing file:" << m_storedFileName;
-            }
+        const QString fileName = m_cliProps->fileExistsFileName(line);
+        if (!fileName.isNull()) {
+            m_storedFileName = fileName;
+            qCWarning(ARK) << "Detected existing file:" << m_storedFileName;
         }
     }
 
@@ -1008,7 +1292,14 @@ bool CliInterface::handleFileExistsMessage(const QString& line)
 bool CliInterface::doKill()
 {
     if (m_process) {
+        requestCancellation();
         killProcess(false);
+
+        // The finished handlers return early for a killed process, drop its partial output here.
+        if (m_operationMode == Extract) {
+            m_solidBatch.clear();
+            cleanUpExtracting();
+        }
         return true;
     }
 
@@ -1087,6 +1378,11 @@ QString CliInterface::multiVolumeName() const
     return name;
 }
 
+bool CliInterface::hasBatchExtractionProgress() const
+{
+    return true;
+}
+
 CliProperties *CliInterface::cliProperties() const
 {
     return m_cliProps;
@@ -1094,13 +1390,21 @@ CliProperties *CliInterface::cliProperties() const
 
 void CliInterface::onEntry(Archive::Entry *archiveEntry)
 {
+    m_listedUnpackedSize += archiveEntry->property("size").toULongLong();
+
+    const QString fullPath = archiveEntry->fullPath(NoTrailingSlash);
+    m_listedTopLevelNames.insert(fullPath.left(fullPath.indexOf(QLatin1Char('/'))));
+    if (!archiveEntry->isDir()) {
+        m_listedFiles.append(qMakePair(fullPath, archiveEntry->property("size").toULongLong()));
+    }
+
     if (archiveEntry->compressedSizeIsSet) {
         m_listedSize += archiveEntry->property("compressedSize").toULongLong();
         if (m_listedSize <= m_archiveSizeOnDisk) {
-            emit progress(float(m_listedSize)/float(m_archiveSizeOnDisk));
+            reportProgress(float(m_listedSize)/float(m_archiveSizeOnDisk));
         } else {
             // In case summed compressed size exceeds archive size on disk.
-            emit progress(1);
+            reportProgress(1);
         }
     }
 }
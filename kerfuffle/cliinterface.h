@@ -33,12 +33,17 @@
 #include "archiveentry.h"
 #include "cliproperties.h"
 #include "kerfuffle_export.h"
+#include "linescanner.h"
+
+#ifndef Q_OS_WIN
+#include "cliprocess.h"
+#endif
 
 #include <QProcess>
 #include <QRegularExpression>
+#include <QSet>
 
 class KProcess;
-class KPtyProcess;
 
 class QDir;
 class QTemporaryDir;
@@ -76,6 +81,58 @@ public:
     virtual bool isDiskFullMsg(const QString &line);
     virtual bool isFileExistsMsg(const QString &line);
     virtual bool isFileExistsFileName(const QString &line);
+
+    /**
+     * Reads the progress that the CLI program reports in @p line while extracting or adding files.
+     * Since progress is usually updated in place, @p line may be incomplete.
+     *
+     * The default implementation reads the percentage written at the start of the line,
+     * or after the last cursor movement, if the captureProgress property is set.
+     * @return The percentage of the operation that is done, or -1 if @p line does not report it.
+     */
+    virtual int readProgressPercentage(const QString &line) const;
+
+    /**
+     * Used to compute the progress of the CLI programs that don't report percentages.
+     * @return Whether @p line reports that an entry has been extracted or added.
+     *
+     * The default implementation returns false.
+     */
+    virtual bool isEntryProcessedMsg(const QString &line) const;
+
+    /**
+     * @return Whether the extraction program failed when exiting with @p exitCode,
+     * e.g. because of a wrong password or not enough space in the destination folder.
+     *
+     * The default implementation returns false.
+     */
+    virtual bool isExtractionFailedExitCode(int exitCode) const;
+
+    /**
+     * @return Whether the archive is solid, i.e. whether extracting an entry
+     * requires decompressing the entries stored before it.
+     *
+     * The default implementation returns false.
+     */
+    virtual bool isSolid() const;
+
+    /**
+     * Some CLI programs erase the progress they reported before writing a message on the same line.
+     * The process output goes through this before any other parsing, so that handleLine() and
+     * the checks for messages and prompts get the message alone.
+     *
+     * The default implementation returns @p line unchanged.
+     */
+    virtual QString stripErasedText(const QString &line) const;
+
+    /**
+     * Lets the plugin drop lines of the process output before they are decoded
+     * and passed to handleLine(). Should only be used for lines that the plugin
+     * would ignore anyway, e.g. entry properties that are not shown by Ark.
+     *
+     * The default implementation keeps all the lines.
+     */
+    virtual bool isIgnoredLine(const QByteArray &line) const;
     bool doKill() override;
 
     /**
@@ -91,6 +148,14 @@ public:
      */
     bool moveToDestination(const QDir &tempDir, const QDir &destDir, bool preservePaths);
 
+    /**
+     * Checks, using the listing instead of the extracted files, whether extracting @p files
+     * (all the entries if empty) to @p destinationDirectory would overwrite existing files.
+     * Only the top-level entries need to be checked in the destination.
+     * @return True if files may be overwritten.
+     */
+    bool hasExtractionConflicts(const QVector<Archive::Entry*> &files, const QString &destinationDirectory, bool preservePaths) const;
+
     /**
      * @see ArchiveModel::entryPathsFromDestination
      */
@@ -102,9 +167,17 @@ public:
     QStringList extractFilesList(const QVector<Archive::Entry*> &files) const;
 
     QString multiVolumeName() const override;
+    bool hasBatchExtractionProgress() const override;
 
     CliProperties *cliProperties() const;
 
+    /**
+     * CLI programs update their progress in place, by moving the cursor back
+     * with backspaces or carriage returns and overwriting the previous text.
+     * @return The text of @p line written after the last cursor movement.
+     */
+    static QStringRef lastWrittenText(const QString &line);
+
 protected:
 
     bool setAddedFiles();
@@ -128,7 +201,8 @@ protected:
     bool runProcess(const QString& programName, const QStringList& arguments);
 
     /**
-     * Kill the running process. The finished signal is emitted according to @p emitFinished.
+     * Kill the running process, without waiting for it to exit.
+     * The finished signal is emitted according to @p emitFinished, once the process exited.
      */
     void killProcess(bool emitFinished = true);
 
@@ -154,11 +228,9 @@ protected:
 #ifdef Q_OS_WIN
     KProcess *m_process = nullptr;
 #else
-    KPtyProcess *m_process = nullptr;
+    CliProcess *m_process = nullptr;
 #endif
 
-    bool m_abortingOperation = false;
-
 protected Q_SLOTS:
     virtual void readStdout(bool handleAll = false);
 
@@ -166,6 +238,25 @@ private:
 
     bool handleFileExistsMessage(const QString& filename);
 
+    /**
+     * Decodes @p line and passes it to handleLine(), unless it is empty or ignored.
+     * @return False if the process has been killed because of the line.
+     */
+    bool handleStdoutLine(const QByteArray &line);
+
+    /**
+     * Sets up the progress of an extraction or addition of @p entries entries,
+     * that are @p size bytes big in total (0 if unknown).
+     */
+    void resetProgress(int entries, qulonglong size);
+
+    /**
+     * Reports the progress read from @p line. Entries are only counted if @p complete is true,
+     * otherwise the same line would be counted again once it is complete.
+     */
+    void updateProgress(const QString &line, bool complete);
+    void reportFraction(double fraction);
+
     /**
      * Returns a list of path pairs which will be supplied to rn command.
      * <src_file_1> <dest_file_1> [ <src_file_2> <dest_file_2> ... ]
@@ -189,9 +280,19 @@ private:
     bool moveDroppedFilesToDest(const QVector<Archive::Entry*> &files, const QString &finalDest);
 
     /**
-     * @return Whether @p dir is an empty directory.
+     * Moves the entries of @p sourceDir into @p destDir. Entries that don't exist in @p destDir
+     * are moved with their whole subtree by a single rename, existing directories are merged.
+     * @return Whether the operation has been successful.
      */
-    bool isEmptyDir(const QDir &dir);
+    bool moveSubtrees(const QDir &sourceDir, const QDir &destDir, bool &overwriteAll, bool &skipAll);
+
+    /**
+     * Asks the user whether @p path should be overwritten if it exists, unless
+     * the question has already been answered for all the files.
+     * @param skip Set to whether the file must not be moved to @p path. Otherwise, @p path has been removed.
+     * @return False if the user cancelled the operation.
+     */
+    bool handleExistingDestination(const QString &path, bool &overwriteAll, bool &skipAll, bool *skip);
 
     /**
      * Performs any additional escaping and processing on @p fileName
@@ -208,9 +309,21 @@ private:
 
     void finishCopying(bool result);
 
-    QByteArray m_stdOutData;
-    QRegularExpression m_passwordPromptPattern;
-    QHash<int, QList<QRegularExpression> > m_patternCache;
+    /**
+     * @return The full paths of the files stored before @p entry that are worth
+     * extracting in the same pass, since the archiver has to decompress them anyway.
+     * Files already in the ExtractedEntryCache, or too big for it, are left out.
+     * @param batchSize Set to the total size of the returned files.
+     */
+    QStringList solidBatchFor(const Archive::Entry *entry, qulonglong *batchSize) const;
+
+    /**
+     * Moves the batch files extracted in @p extractionDir to the ExtractedEntryCache.
+     * The files that can't be cached are removed as well.
+     */
+    void storeSolidBatch(const QDir &extractionDir);
+
+    LineScanner m_stdOutScanner;
 
     QVector<Archive::Entry*> m_removedFiles;
     QVector<Archive::Entry*> m_newMovedFiles;
@@ -225,6 +338,17 @@ private:
     QVector<Archive::Entry*> m_extractedFiles;
     qulonglong m_archiveSizeOnDisk = 0;
     qulonglong m_listedSize = 0;
+    qulonglong m_listedUnpackedSize = 0;
+    QSet<QString> m_listedTopLevelNames;
+    QVector<QPair<QString, qulonglong>> m_listedFiles; // Full path and size, in archive order.
+
+    QStringList m_solidBatch;
+
+    int m_progressTotalEntries = 0;
+    int m_progressProcessedEntries = 0;
+    qulonglong m_progressTotalSize = 0;
+    bool m_hasProgressPercentage = false;
+    qint64 m_entryTraceStart = 0;
 
 protected Q_SLOTS:
     virtual void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
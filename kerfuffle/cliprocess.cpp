@@ -0,0 +1,244 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "cliprocess.h"
+#include "ark_debug.h"
+
+#include <QThread>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace Kerfuffle
+{
+
+// The default pipe buffer is only 64 KiB on Linux.
+static const int pipeBufferSize = 1024 * 1024;
+static const int readChunkSize = 64 * 1024;
+// How long the output may stay open after the process exited, e.g. kept by a child of the process.
+static const int outputClosedTimeout = 1000;
+
+class CliProcess::Reader : public QThread
+{
+public:
+    explicit Reader(CliProcess *process)
+        : m_process(process)
+    {
+    }
+
+    void run() override;
+
+private:
+    CliProcess *m_process;
+};
+
+void CliProcess::Reader::run()
+{
+    QByteArray buffer(readChunkSize, Qt::Uninitialized);
+    pollfd pfd;
+    pfd.fd = m_process->m_readFd;
+    pfd.events = POLLIN;
+
+    // Wake up regularly, so that the thread can be stopped even if
+    // the pipe is kept open by a child of the process.
+    while (m_process->waitForRoom()) {
+        const int ready = poll(&pfd, 1, 100);
+        if (ready < 0 && errno != EINTR) {
+            qCWarning(ARK) << "Failed to poll the process output:" << strerror(errno);
+            return;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        const ssize_t bytesRead = read(pfd.fd, buffer.data(), readChunkSize);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            // All the copies of the write end have been closed.
+            return;
+        }
+
+        m_process->appendOutput(buffer.constData(), static_cast<int>(bytesRead));
+    }
+}
+
+CliProcess::CliProcess(QObject *parent)
+    : KPtyProcess(parent)
+    , m_reader(new Reader(this))
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        qCWarning(ARK) << "Failed to create the output pipe, falling back to the process channels:" << strerror(errno);
+        connect(this, &QProcess::readyReadStandardOutput, this, &CliProcess::outputAvailable);
+        connect(this, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &CliProcess::finishedWithOutput);
+        return;
+    }
+
+    m_readFd = fds[0];
+    m_writeFd = fds[1];
+
+    connect(this, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, &CliProcess::onProcessFinished);
+    connect(m_reader, &QThread::finished, this, [this]() {
+        if (m_processFinished) {
+            emitFinishedWithOutput();
+        }
+    });
+
+    m_outputClosedTimer.setSingleShot(true);
+    m_outputClosedTimer.setInterval(outputClosedTimeout);
+    connect(&m_outputClosedTimer, &QTimer::timeout, this, [this]() {
+        qCWarning(ARK) << "The output of the process is still open after it exited";
+        emitFinishedWithOutput();
+    });
+
+    // Only the duplicates made in the child must survive the exec.
+    fcntl(m_readFd, F_SETFD, FD_CLOEXEC);
+    fcntl(m_writeFd, F_SETFD, FD_CLOEXEC);
+
+#ifdef F_SETPIPE_SZ
+    if (fcntl(m_readFd, F_SETPIPE_SZ, pipeBufferSize) < 0) {
+        qCDebug(ARK) << "Could not enlarge the output pipe:" << strerror(errno);
+    }
+#endif
+}
+
+CliProcess::~CliProcess()
+{
+    {
+        QMutexLocker locker(&m_outputMutex);
+        m_reader->requestInterruption();
+        m_outputTaken.wakeAll();
+    }
+    m_reader->wait();
+    delete m_reader;
+
+    if (m_readFd >= 0) {
+        close(m_readFd);
+    }
+    if (m_writeFd >= 0) {
+        close(m_writeFd);
+    }
+}
+
+void CliProcess::startProcess()
+{
+    start();
+
+    if (m_writeFd < 0) {
+        return;
+    }
+
+    // The child has its own copy of the write end by now: closing ours
+    // lets the reader see the end of the output when the child exits.
+    close(m_writeFd);
+    m_writeFd = -1;
+
+    m_reader->start();
+}
+
+QByteArray CliProcess::takeOutput()
+{
+    if (m_readFd < 0) {
+        return readAllStandardOutput();
+    }
+
+    QMutexLocker locker(&m_outputMutex);
+    m_outputNotified = false;
+    m_outputTaken.wakeAll();
+
+    QByteArray output;
+    output.swap(m_output);
+    return output;
+}
+
+void CliProcess::setupChildProcess()
+{
+    KPtyProcess::setupChildProcess();
+
+    // This runs in the child, right before the exec.
+    if (m_writeFd >= 0) {
+        dup2(m_writeFd, STDOUT_FILENO);
+        dup2(m_writeFd, STDERR_FILENO);
+    }
+}
+
+bool CliProcess::waitForRoom()
+{
+    QMutexLocker locker(&m_outputMutex);
+    while (m_output.size() >= maxBufferedOutputSize && !m_reader->isInterruptionRequested()) {
+        m_outputTaken.wait(&m_outputMutex);
+    }
+
+    return !m_reader->isInterruptionRequested();
+}
+
+void CliProcess::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    m_exitCode = exitCode;
+    m_exitStatus = exitStatus;
+    m_processFinished = true;
+
+    if (!m_reader->isRunning()) {
+        emitFinishedWithOutput();
+    } else {
+        m_outputClosedTimer.start();
+    }
+}
+
+void CliProcess::emitFinishedWithOutput()
+{
+    if (m_finishedWithOutputEmitted) {
+        return;
+    }
+    m_finishedWithOutputEmitted = true;
+    m_outputClosedTimer.stop();
+
+    emit finishedWithOutput(m_exitCode, m_exitStatus);
+}
+
+void CliProcess::appendOutput(const char *data, int size)
+{
+    QMutexLocker locker(&m_outputMutex);
+    m_output.append(data, size);
+
+    // The receiver takes everything at once: one notification per batch is enough.
+    if (m_outputNotified) {
+        return;
+    }
+    m_outputNotified = true;
+    locker.unlock();
+
+    emit outputAvailable();
+}
+
+}
@@ -0,0 +1,124 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CLIPROCESS_H
+#define CLIPROCESS_H
+
+#include "kerfuffle_export.h"
+
+#include <KPtyProcess>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QTimer>
+#include <QWaitCondition>
+
+namespace Kerfuffle
+{
+
+/**
+ * A KPtyProcess whose merged standard output and error are read by a dedicated thread,
+ * through a pipe with a large buffer, instead of by the event loop of the thread that
+ * started the process. Once the pipe is full, the process would otherwise be blocked
+ * for as long as that event loop is busy, e.g. while the GUI inserts the listed entries.
+ *
+ * The output piles up in memory and is handed out in batches with takeOutput().
+ * Once maxBufferedOutputSize bytes are waiting, the thread stops reading until they
+ * are taken, so that the full pipe blocks the process instead of exhausting the memory.
+ */
+class KERFUFFLE_EXPORT CliProcess : public KPtyProcess
+{
+    Q_OBJECT
+
+public:
+    static const int maxBufferedOutputSize = 4 * 1024 * 1024;
+
+    explicit CliProcess(QObject *parent = nullptr);
+    ~CliProcess() override;
+
+    /**
+     * Starts the process and the thread reading its output.
+     */
+    void startProcess();
+
+    /**
+     * @return The output read since the last call, which is removed from the internal buffer.
+     */
+    QByteArray takeOutput();
+
+Q_SIGNALS:
+    /**
+     * Emitted when some output is available and the previous batch has been taken.
+     * This is emitted by the reader thread, so receivers get it through a queued connection.
+     */
+    void outputAvailable();
+
+    /**
+     * Emitted once the process exited and its output has been closed, so that
+     * takeOutput() returns everything the process wrote. If a child of the process
+     * keeps the output open, it's emitted anyway shortly after the exit.
+     * Unlike QProcess::finished(), nobody needs to wait for the output.
+     */
+    void finishedWithOutput(int exitCode, QProcess::ExitStatus exitStatus);
+
+protected:
+    void setupChildProcess() override;
+
+private:
+    class Reader;
+
+    void appendOutput(const char *data, int size);
+
+    /**
+     * Blocks the reader thread while the buffered output is full.
+     * @return False if the reader must stop.
+     */
+    bool waitForRoom();
+
+    void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void emitFinishedWithOutput();
+
+    Reader *m_reader;
+    int m_readFd = -1;
+    int m_writeFd = -1;
+
+    QMutex m_outputMutex;
+    QWaitCondition m_outputTaken;
+    QByteArray m_output;
+    bool m_outputNotified = false;
+
+    QTimer m_outputClosedTimer;
+    int m_exitCode = 0;
+    QProcess::ExitStatus m_exitStatus = QProcess::NormalExit;
+    bool m_processFinished = false;
+    bool m_finishedWithOutputEmitted = false;
+};
+
+}
+
+#endif // CLIPROCESS_H
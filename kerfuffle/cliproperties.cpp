@@ -85,12 +85,12 @@ QStringList CliProperties::commentArgs(const QString &archive, const QString &co
     return args;
 }
 
-QStringList CliProperties::deleteArgs(const QString &archive, const QVector<Archive::Entry*> &files, const QString &password)
+QStringList CliProperties::deleteArgs(const QString &archive, const QVector<Archive::Entry*> &files, const QString &password, bool headerEncryption)
 {
     QStringList args;
     args << m_deleteSwitch;
     if (!password.isEmpty()) {
-        args << substitutePasswordSwitch(password);
+        args << substitutePasswordSwitch(password, headerEncryption);
     }
     args << archive;
     for (const Archive::Entry *e : files) {
@@ -138,12 +138,13 @@ QStringList CliProperties::listArgs(const QString &archive, const QString &passw
     return args;
 }
 
-QStringList CliProperties::moveArgs(const QString &archive, const QVector<Archive::Entry*> &entries, Archive::Entry *destination, const QString &password)
+QStringList CliProperties::moveArgs(const QString &archive, const QVector<Archive::Entry*> &entries, Archive::Entry *destination, const QString &password, bool headerEncryption)
 {
     QStringList args;
     args << m_moveSwitch;
+    // The entries are renamed in place, by rewriting only the headers: they must stay encrypted.
     if (!password.isEmpty()) {
-        args << substitutePasswordSwitch(password);
+        args << substitutePasswordSwitch(password, headerEncryption);
     }
     args << archive;
     if (entries.count() > 1) {
@@ -291,14 +292,55 @@ QString CliProperties::substituteMultiVolumeSwitch(ulong volumeSize) const
     return multiVolumeSwitch;
 }
 
-bool CliProperties::isTestPassedMsg(const QString &line)
+bool CliProperties::isTestPassedMsg(const QString &line) const
 {
-    for (const QString &rx : qAsConst(m_testPassedPatterns)) {
-        if (QRegularExpression(rx).match(line).hasMatch()) {
+    for (const QRegularExpression &rx : m_testPassedRegExps) {
+        if (rx.match(line).hasMatch()) {
             return true;
         }
     }
     return false;
 }
 
+QString CliProperties::fileExistsFileName(const QString &line) const
+{
+    for (const QRegularExpression &rx : m_fileExistsFileNameRegExps) {
+        const QRegularExpressionMatch rxMatch = rx.match(line);
+        if (rxMatch.hasMatch()) {
+            return rxMatch.captured(1);
+        }
+    }
+    return QString();
+}
+
+void CliProperties::setTestPassedPatterns(const QStringList &patterns)
+{
+    m_testPassedPatterns = patterns;
+    m_testPassedRegExps = compilePatterns(patterns);
+}
+
+void CliProperties::setFileExistsFileNameRegExp(const QStringList &patterns)
+{
+    m_fileExistsFileNameRegExp = patterns;
+    m_fileExistsFileNameRegExps = compilePatterns(patterns);
+}
+
+QVector<QRegularExpression> CliProperties::compilePatterns(const QStringList &patterns)
+{
+    // The patterns are matched against every line of output, so compile
+    // them (and JIT them where supported) once, when they are set.
+    QVector<QRegularExpression> regExps;
+    regExps.reserve(patterns.size());
+    for (const QString &pattern : patterns) {
+        QRegularExpression rx(pattern);
+        if (!rx.isValid()) {
+            qCWarning(ARK) << "Invalid pattern" << pattern << ":" << rx.errorString();
+            continue;
+        }
+        rx.optimize();
+        regExps.append(rx);
+    }
+    return regExps;
+}
+
 }
@@ -30,6 +30,7 @@
 #include "archiveinterface.h"
 #include "kerfuffle_export.h"
 
+#include <QRegularExpression>
 
 namespace Kerfuffle
 {
@@ -61,8 +62,8 @@ class KERFUFFLE_EXPORT CliProperties: public QObject
     Q_PROPERTY(QHash<QString,QVariant> encryptionMethodSwitch MEMBER m_encryptionMethodSwitch)
     Q_PROPERTY(QString multiVolumeSwitch MEMBER m_multiVolumeSwitch)
 
-    Q_PROPERTY(QStringList testPassedPatterns MEMBER m_testPassedPatterns)
-    Q_PROPERTY(QStringList fileExistsFileNameRegExp MEMBER m_fileExistsFileNameRegExp)
+    Q_PROPERTY(QStringList testPassedPatterns MEMBER m_testPassedPatterns WRITE setTestPassedPatterns)
+    Q_PROPERTY(QStringList fileExistsFileNameRegExp MEMBER m_fileExistsFileNameRegExp WRITE setFileExistsFileNameRegExp)
 
     Q_PROPERTY(QStringList fileExistsInput MEMBER m_fileExistsInput)
     Q_PROPERTY(QStringList multiVolumeSuffix MEMBER m_multiVolumeSuffix)
@@ -81,15 +82,26 @@ public:
                         const QString &encryptionMethod,
                         ulong volumeSize);
     QStringList commentArgs(const QString &archive, const QString &commentfile);
-    QStringList deleteArgs(const QString &archive, const QVector<Archive::Entry*> &files, const QString &password);
+    QStringList deleteArgs(const QString &archive, const QVector<Archive::Entry*> &files, const QString &password, bool headerEncryption);
     QStringList extractArgs(const QString &archive, const QStringList &files, bool preservePaths, const QString &password);
     QStringList listArgs(const QString &archive, const QString &password);
-    QStringList moveArgs(const QString &archive, const QVector<Archive::Entry *> &entries, Archive::Entry *destination, const QString &password);
+    QStringList moveArgs(const QString &archive, const QVector<Archive::Entry *> &entries, Archive::Entry *destination, const QString &password, bool headerEncryption);
     QStringList testArgs(const QString &archive, const QString &password);
 
-    bool isTestPassedMsg(const QString &line);
+    bool isTestPassedMsg(const QString &line) const;
+
+    /**
+     * @return The file name captured by the first fileExistsFileNameRegExp matching @p line,
+     * or a null string if none matches.
+     */
+    QString fileExistsFileName(const QString &line) const;
+
+    void setTestPassedPatterns(const QStringList &patterns);
+    void setFileExistsFileNameRegExp(const QStringList &patterns);
 
 private:
+    static QVector<QRegularExpression> compilePatterns(const QStringList &patterns);
+
     QStringList substituteCommentSwitch(const QString &commentfile) const;
     QStringList substitutePasswordSwitch(const QString &password, bool headerEnc = false) const;
     QString substituteCompressionLevelSwitch(int level) const;
@@ -122,6 +134,8 @@ private:
 
     QStringList m_testPassedPatterns;
     QStringList m_fileExistsFileNameRegExp;
+    QVector<QRegularExpression> m_testPassedRegExps;
+    QVector<QRegularExpression> m_fileExistsFileNameRegExps;
 
     QStringList m_fileExistsInput;
     QStringList m_multiVolumeSuffix;
@@ -0,0 +1,238 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "extractedentrycache.h"
+#include "ark_debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+namespace Kerfuffle
+{
+
+// Enough for a couple of files at the default preview size limit.
+static const qint64 defaultMaxSize = 512 * 1024 * 1024;
+
+Q_GLOBAL_STATIC(ExtractedEntryCache, s_extractedEntryCache)
+
+ExtractedEntryCache::ExtractedEntryCache()
+    : m_maxSize(defaultMaxSize)
+{
+}
+
+ExtractedEntryCache::~ExtractedEntryCache()
+{
+}
+
+ExtractedEntryCache *ExtractedEntryCache::instance()
+{
+    return s_extractedEntryCache.isDestroyed() ? nullptr : s_extractedEntryCache();
+}
+
+bool ExtractedEntryCache::retrieve(const QString &archivePath, const QString &entryPath, const QString &destinationPath)
+{
+    const QFileInfo archiveInfo(archivePath);
+    const Key key(archiveInfo.absoluteFilePath(), entryPath);
+
+    QString cachePath;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const auto it = m_entries.constFind(key);
+        if (it == m_entries.constEnd()) {
+            return false;
+        }
+
+        if (it->archiveModified != archiveInfo.lastModified() || it->archiveSize != archiveInfo.size()) {
+            qCDebug(ARK) << "Dropping cached" << entryPath << "the archive changed since it was extracted";
+            remove(key);
+            return false;
+        }
+
+        cachePath = it->cachePath;
+        m_order.removeOne(key);
+        m_order.append(key);
+    }
+
+    // The copy is done unlocked, if the entry got evicted meanwhile it's just a miss.
+    QDir().mkpath(QFileInfo(destinationPath).absolutePath());
+    if (!QFile::copy(cachePath, destinationPath)) {
+        qCDebug(ARK) << "Could not copy cached" << entryPath << "to" << destinationPath;
+        return false;
+    }
+
+    qCDebug(ARK) << "Retrieved" << entryPath << "from the extracted entries cache";
+    return true;
+}
+
+void ExtractedEntryCache::insert(const QString &archivePath, const QString &entryPath, const QString &extractedPath)
+{
+    const QFileInfo archiveInfo(archivePath);
+    const QFileInfo extractedInfo(extractedPath);
+    const Key key(archiveInfo.absoluteFilePath(), entryPath);
+
+    if (!extractedInfo.isFile() || extractedInfo.isSymLink()) {
+        return;
+    }
+
+    QString cachePath;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if ((m_maxEntrySize > 0 && extractedInfo.size() > m_maxEntrySize) || extractedInfo.size() > m_maxSize / 2) {
+            qCDebug(ARK) << "Not caching" << entryPath << "it's too big:" << extractedInfo.size() << "bytes";
+            return;
+        }
+
+        if (!m_dir) {
+            m_dir.reset(new QTemporaryDir());
+        }
+        if (!m_dir->isValid()) {
+            return;
+        }
+
+        // Entry paths may be anything, cached files are just numbered.
+        cachePath = QDir(m_dir->path()).filePath(QString::number(m_nextFileId++));
+    }
+
+    if (!QFile::copy(extractedPath, cachePath)) {
+        qCDebug(ARK) << "Could not cache" << entryPath;
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    remove(key);
+    evict(m_maxSize - extractedInfo.size());
+
+    CachedEntry cachedEntry;
+    cachedEntry.archiveModified = archiveInfo.lastModified();
+    cachedEntry.archiveSize = archiveInfo.size();
+    cachedEntry.cachePath = cachePath;
+    cachedEntry.size = extractedInfo.size();
+    m_entries.insert(key, cachedEntry);
+    m_order.append(key);
+    m_size += cachedEntry.size;
+
+    qCDebug(ARK) << "Extracted entries cache holds" << m_entries.size() << "files," << m_size << "bytes";
+}
+
+bool ExtractedEntryCache::contains(const QString &archivePath, const QString &entryPath) const
+{
+    const QFileInfo archiveInfo(archivePath);
+    const Key key(archiveInfo.absoluteFilePath(), entryPath);
+
+    QMutexLocker locker(&m_mutex);
+
+    const auto it = m_entries.constFind(key);
+    return it != m_entries.constEnd() &&
+           it->archiveModified == archiveInfo.lastModified() &&
+           it->archiveSize == archiveInfo.size();
+}
+
+void ExtractedEntryCache::removeArchive(const QString &archivePath)
+{
+    const QString absolutePath = QFileInfo(archivePath).absoluteFilePath();
+
+    QMutexLocker locker(&m_mutex);
+
+    const QList<Key> keys = m_order;
+    for (const Key &key : keys) {
+        if (key.first == absolutePath) {
+            remove(key);
+        }
+    }
+}
+
+void ExtractedEntryCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    evict(0);
+}
+
+int ExtractedEntryCache::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+qint64 ExtractedEntryCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_size;
+}
+
+qint64 ExtractedEntryCache::maxSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxSize;
+}
+
+void ExtractedEntryCache::setMaxSize(qint64 maxSize)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxSize = maxSize;
+    evict(m_maxSize);
+}
+
+qint64 ExtractedEntryCache::maxEntrySize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxEntrySize;
+}
+
+void ExtractedEntryCache::setMaxEntrySize(qint64 maxEntrySize)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxEntrySize = maxEntrySize;
+}
+
+void ExtractedEntryCache::remove(const Key &key)
+{
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    QFile::remove(it->cachePath);
+    m_size -= it->size;
+    m_entries.erase(it);
+    m_order.removeOne(key);
+}
+
+void ExtractedEntryCache::evict(qint64 maxSize)
+{
+    while (m_size > maxSize && !m_order.isEmpty()) {
+        const Key key = m_order.first();
+        remove(key);
+    }
+}
+
+}
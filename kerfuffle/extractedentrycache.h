@@ -0,0 +1,134 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef EXTRACTEDENTRYCACHE_H
+#define EXTRACTEDENTRYCACHE_H
+
+#include "kerfuffle_export.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QScopedPointer>
+#include <QString>
+
+class QTemporaryDir;
+
+namespace Kerfuffle
+{
+
+/**
+ * Keeps copies of the entries extracted for previewing or opening them, so that
+ * extracting the same entry again is a file copy instead of a decompression.
+ *
+ * Entries are identified by the path of their archive and their path within it.
+ * An entry is only reused while its archive keeps the modification time and the
+ * size it had when the entry was cached. The least recently used entries are
+ * evicted once the cache grows beyond maxSize().
+ *
+ * The cache is shared by all the archives of the process and is thread-safe.
+ */
+class KERFUFFLE_EXPORT ExtractedEntryCache
+{
+public:
+    ExtractedEntryCache();
+    ~ExtractedEntryCache();
+
+    /**
+     * @return The cache used by TempExtractJob, or nullptr once it has been destroyed at exit.
+     */
+    static ExtractedEntryCache *instance();
+
+    /**
+     * Copies the cached extraction of @p entryPath from @p archivePath to @p destinationPath,
+     * creating its parent directories.
+     * @return False if the entry is not cached or its archive changed since it was cached.
+     */
+    bool retrieve(const QString &archivePath, const QString &entryPath, const QString &destinationPath);
+
+    /**
+     * Caches a copy of @p extractedPath, the extraction of @p entryPath from @p archivePath.
+     * Files bigger than maxEntrySize() or than half of maxSize() are not cached.
+     */
+    void insert(const QString &archivePath, const QString &entryPath, const QString &extractedPath);
+
+    /**
+     * @return Whether retrieve() would find @p entryPath from @p archivePath.
+     */
+    bool contains(const QString &archivePath, const QString &entryPath) const;
+
+    /**
+     * Drops the entries of @p archivePath, e.g. once it's closed.
+     */
+    void removeArchive(const QString &archivePath);
+    void clear();
+
+    /**
+     * @return The number of cached entries and their total size in bytes.
+     */
+    int count() const;
+    qint64 size() const;
+
+    qint64 maxSize() const;
+    void setMaxSize(qint64 maxSize);
+
+    /**
+     * @return The size in bytes of the biggest file that can be cached, 0 if only maxSize() applies.
+     */
+    qint64 maxEntrySize() const;
+    void setMaxEntrySize(qint64 maxEntrySize);
+
+private:
+    typedef QPair<QString, QString> Key;
+
+    struct CachedEntry {
+        QDateTime archiveModified;
+        qint64 archiveSize;
+        QString cachePath;
+        qint64 size;
+    };
+
+    void remove(const Key &key);
+    void evict(qint64 maxSize);
+
+    mutable QMutex m_mutex;
+    QScopedPointer<QTemporaryDir> m_dir;
+    QHash<Key, CachedEntry> m_entries;
+    // Least recently used first.
+    QList<Key> m_order;
+    qint64 m_size = 0;
+    qint64 m_maxSize;
+    qint64 m_maxEntrySize = 0;
+    quint64 m_nextFileId = 0;
+};
+
+}
+
+#endif // EXTRACTEDENTRYCACHE_H
@@ -29,48 +29,152 @@
 #include "jobs.h"
 #include "archiveentry.h"
 #include "ark_debug.h"
+#include "extractedentrycache.h"
+#include "jobthreadpool.h"
+#include "tracer.h"
 
 #include <QDir>
 #include <QDirIterator>
 #include <QFileInfo>
+#include <QPointer>
 #include <QRegularExpression>
-#include <QThread>
+#include <QScopedPointer>
+#include <QStorageInfo>
 #include <QTimer>
 #include <QUrl>
 
+#include <KIO/Global>
 #include <KIO/RenameDialog>
 #include <KLocalizedString>
 
 namespace Kerfuffle
 {
 
-class Job::Private : public QThread
-{
-    Q_OBJECT
+// Plugins check for cancellation at least once per chunk of data they copy,
+// this is how long a cancelled job can keep the GUI waiting.
+static const int cancellationTimeout = 1000;
 
-public:
-    Private(Job *job, QObject *parent = nullptr)
-        : QThread(parent)
-        , q(job)
-    {
-    }
+// Previews of bigger entries are extracted to a temporary file, the smaller ones are read in memory.
+static const qint64 defaultMaxInMemoryPreviewSize = 4 * 1024 * 1024;
 
-    void run() override;
+/**
+ * Forwards the signals of an interface applying merged modifications to the job
+ * that queued the current operation, or to all the jobs for the overall progress.
+ * It lives in the thread of the jobs, so that it gets the signals in the order they were emitted.
+ */
+class MergedJobs : public QObject
+{
+public:
+    MergedJobs(const QVector<Job*> &jobs, ReadWriteArchiveInterface *interface);
 
 private:
-    Job *q;
+    Job *currentJob() const;
+    QVector<Job*> runningJobs() const;
+    void onOperationFinished(int index, bool result);
+
+    QVector<QPointer<Job>> m_jobs;
+    int m_currentOperation = 0;
 };
 
-void Job::Private::run()
+MergedJobs::MergedJobs(const QVector<Job*> &jobs, ReadWriteArchiveInterface *interface)
+{
+    for (Job *job : jobs) {
+        m_jobs.append(job);
+    }
+
+    moveToThread(jobs.first()->thread());
+
+    connect(interface, &ReadWriteArchiveInterface::currentOperationChanged, this, [this](int index) {
+        m_currentOperation = index;
+    });
+    connect(interface, &ReadWriteArchiveInterface::operationFinished, this, &MergedJobs::onOperationFinished);
+
+    connect(interface, &ReadOnlyArchiveInterface::error, this, [this](const QString &message, const QString &details) {
+        if (Job *job = currentJob()) {
+            job->onError(message, details);
+        }
+    });
+    connect(interface, &ReadOnlyArchiveInterface::entry, this, [this](Archive::Entry *entry) {
+        if (Job *job = currentJob()) {
+            job->onEntry(entry);
+        }
+    });
+    connect(interface, &ReadWriteArchiveInterface::entryRemoved, this, [this](const QString &path) {
+        if (Job *job = currentJob()) {
+            job->onEntryRemoved(path);
+        }
+    });
+    connect(interface, &ReadOnlyArchiveInterface::userQuery, this, [this](Query *query) {
+        if (Job *job = currentJob()) {
+            job->onUserQuery(query);
+        }
+    });
+
+    connect(interface, &ReadOnlyArchiveInterface::cancelled, this, [this]() {
+        for (Job *job : runningJobs()) {
+            job->onCancelled();
+        }
+    });
+    connect(interface, &ReadOnlyArchiveInterface::info, this, [this](const QString &info) {
+        for (Job *job : runningJobs()) {
+            job->onInfo(info);
+        }
+    });
+    connect(interface, &ReadOnlyArchiveInterface::progress, this, [this](double progress) {
+        for (Job *job : runningJobs()) {
+            job->onProgress(progress);
+        }
+    });
+    connect(interface, &ReadOnlyArchiveInterface::processedSize, this, [this](qulonglong processed, qulonglong total) {
+        for (Job *job : runningJobs()) {
+            job->onProcessedSize(processed, total);
+        }
+    });
+    connect(interface, &ReadOnlyArchiveInterface::processedEntries, this, [this](qulonglong processed, qulonglong total) {
+        for (Job *job : runningJobs()) {
+            job->onProcessedEntries(processed, total);
+        }
+    });
+}
+
+Job *MergedJobs::currentJob() const
 {
-    q->doWork();
+    return m_jobs.value(m_currentOperation).data();
+}
+
+QVector<Job*> MergedJobs::runningJobs() const
+{
+    QVector<Job*> jobs;
+    for (const QPointer<Job> &job : m_jobs) {
+        if (job) {
+            jobs.append(job.data());
+        }
+    }
+    return jobs;
+}
+
+void MergedJobs::onOperationFinished(int index, bool result)
+{
+    // Finished jobs are left alone, they get deleted once they emitted their result.
+    Job *job = m_jobs.value(index).data();
+    if (!job) {
+        return;
+    }
+    m_jobs[index].clear();
+
+    if (!result && job->error() == KJob::NoError) {
+        // The operation failed without an error of its own, because another
+        // merged operation failed or was cancelled and aborted the whole modification.
+        job->setError(KJob::KilledJobError);
+    }
+
+    job->onFinished(result);
 }
 
 Job::Job(Archive *archive, ReadOnlyArchiveInterface *interface)
     : KJob()
     , m_archive(archive)
     , m_archiveInterface(interface)
-    , d(new Private(this))
 {
     setCapabilities(KJob::Killable);
 }
@@ -85,11 +189,10 @@ Job::Job(ReadOnlyArchiveInterface *interface)
 
 Job::~Job()
 {
-    if (d->isRunning()) {
-        d->wait();
+    // Only the jobs deleted by their owner while they run are waited for, see doKill().
+    if (JobThreadPool *pool = JobThreadPool::instance()) {
+        pool->waitForJob(this);
     }
-
-    delete d;
 }
 
 ReadOnlyArchiveInterface *Job::archiveInterface()
@@ -130,6 +233,7 @@ QString Job::errorString() const
 void Job::start()
 {
     jobTimer.start();
+    m_traceStart = Tracer::now();
 
     // We have an archive but it's not valid, nothing to do.
     if (archive() && !archive()->isValid()) {
@@ -141,27 +245,110 @@ void Job::start()
 
     if (archiveInterface()->waitForFinishedSignal()) {
         // CLI-based interfaces run a QProcess, no need to use threads.
+        archiveInterface()->beginOperation();
         QTimer::singleShot(0, this, &Job::doWork);
     } else {
-        // Run the job in another thread.
-        d->start();
+        // Run the job in a pooled thread, after the previous jobs on the same interface.
+        JobThreadPool::instance()->enqueue(this, archiveInterface());
     }
 }
 
+ArchiveOperation Job::operation() const
+{
+    return ArchiveOperation();
+}
+
+void Job::prepareOperation()
+{
+}
+
+void Job::prepareFallback()
+{
+}
+
+void Job::setFallbackInterface(ReadOnlyArchiveInterface *interface)
+{
+    m_fallbackInterface = interface;
+}
+
+void Job::startOnFallbackInterface()
+{
+    // The job could have been killed while this call was queued.
+    if (error() == KJob::KilledJobError) {
+        return;
+    }
+
+    qCWarning(ARK) << "Running the job again on" << m_fallbackInterface->metaObject()->className();
+
+    // Signals of the failed run still queued would be mistaken for the ones of the new run.
+    disconnect(m_archiveInterface, nullptr, this, nullptr);
+    m_archiveInterface = m_fallbackInterface;
+    m_fallbackInterface = nullptr;
+
+    setError(KJob::NoError);
+    setErrorText(QString());
+    prepareFallback();
+    start();
+}
+
+void Job::doMergedWork(const QVector<Job*> &jobs)
+{
+    auto writeInterface = qobject_cast<ReadWriteArchiveInterface*>(jobs.first()->archiveInterface());
+    Q_ASSERT(writeInterface);
+
+    qCDebug(ARK) << "Applying" << jobs.size() << "merged modifications to" << writeInterface->filename();
+
+    QVector<ArchiveOperation> operations;
+    operations.reserve(jobs.size());
+    for (Job *job : jobs) {
+        job->prepareOperation();
+        operations.append(job->operation());
+    }
+
+    auto mergedJobs = new MergedJobs(jobs, writeInterface);
+    writeInterface->applyOperations(operations);
+
+    // The signals emitted so far are still delivered, the deletion comes after them.
+    QObject::disconnect(writeInterface, nullptr, mergedJobs, nullptr);
+    mergedJobs->deleteLater();
+}
+
 void Job::connectToArchiveInterfaceSignals()
 {
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::cancelled, this, &Job::onCancelled);
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::error, this, &Job::onError);
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::entry, this, &Job::onEntry);
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::progress, this, &Job::onProgress);
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::info, this, &Job::onInfo);
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::finished, this, &Job::onFinished);
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::userQuery, this, &Job::onUserQuery);
+    QMutexLocker locker(&m_interfaceConnectionsMutex);
+
+    m_interfaceConnections
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::cancelled, this, &Job::onCancelled)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::error, this, &Job::onError)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::entry, this, &Job::onEntry)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::progress, this, &Job::onProgress)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::processedSize, this, &Job::onProcessedSize)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::processedEntries, this, &Job::onProcessedEntries)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::info, this, &Job::onInfo)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::finished, this, &Job::onFinished)
+        << connect(archiveInterface(), &ReadOnlyArchiveInterface::userQuery, this, &Job::onUserQuery);
 
     auto readWriteInterface = qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
     if (readWriteInterface) {
-        connect(readWriteInterface, &ReadWriteArchiveInterface::entryRemoved, this, &Job::onEntryRemoved);
+        m_interfaceConnections << connect(readWriteInterface, &ReadWriteArchiveInterface::entryRemoved, this, &Job::onEntryRemoved);
+    }
+}
+
+void Job::addArchiveInterfaceConnection(const QMetaObject::Connection &connection)
+{
+    QMutexLocker locker(&m_interfaceConnectionsMutex);
+    m_interfaceConnections << connection;
+}
+
+void Job::disconnectFromArchiveInterfaceSignals()
+{
+    // Called by the worker thread of the job and by onFinished(), wherever the latter runs.
+    QMutexLocker locker(&m_interfaceConnectionsMutex);
+
+    for (const QMetaObject::Connection &connection : qAsConst(m_interfaceConnections)) {
+        disconnect(connection);
     }
+    m_interfaceConnections.clear();
 }
 
 void Job::onCancelled()
@@ -189,6 +376,32 @@ void Job::onProgress(double value)
     setPercent(static_cast<unsigned long>(100.0*value));
 }
 
+void Job::onProcessedEntries(qulonglong processed, qulonglong total)
+{
+    setTotalAmount(KJob::Files, total);
+    setProcessedAmount(KJob::Files, processed);
+}
+
+void Job::onProcessedSize(qulonglong processed, qulonglong total)
+{
+    setTotalAmount(KJob::Bytes, total);
+    setProcessedAmount(KJob::Bytes, processed);
+
+    // The speed is averaged from the first report on, so that it doesn't include the time
+    // spent before the processing actually started (e.g. loading the archive in a BatchExtractJob).
+    // Job trackers compute the remaining time from the speed and the amounts.
+    if (!m_speedTimer.isValid()) {
+        m_speedTimer.start();
+        m_speedBaseSize = processed;
+        return;
+    }
+
+    const qint64 elapsed = m_speedTimer.elapsed();
+    if (elapsed > 0 && processed >= m_speedBaseSize) {
+        emitSpeed(static_cast<unsigned long>((processed - m_speedBaseSize) * 1000 / static_cast<qulonglong>(elapsed)));
+    }
+}
+
 void Job::onInfo(const QString& info)
 {
     emit infoMessage(this, info);
@@ -203,13 +416,32 @@ void Job::onFinished(bool result)
 {
     qCDebug(ARK) << "Job finished, result:" << result << ", time:" << jobTimer.elapsed() << "ms";
 
+    // Jobs run by the pool are disconnected by their worker, before the next job on the interface starts.
+    disconnectFromArchiveInterfaceSignals();
+
+    if (Tracer::isEnabled()) {
+        QVariantMap args = {{QStringLiteral("result"), result}};
+        if (archiveInterface()) {
+            args.insert(QStringLiteral("archive"), archiveInterface()->filename());
+        }
+        Tracer::addSpan(metaObject()->className(), "job", m_traceStart, Tracer::now() - m_traceStart, args);
+    }
+
     if (archive() && !archive()->isValid()) {
         setError(KJob::UserDefinedError);
     }
 
-    if (!d->isInterruptionRequested()) {
-        emitResult();
+    if (JobThreadPool::instance()->isInterruptionRequested(this)) {
+        return;
+    }
+
+    // Queued, so that it comes after the signals of the failed run, e.g. error().
+    if (!result && m_fallbackInterface && !m_archiveInterface->isCancellationRequested()) {
+        QMetaObject::invokeMethod(this, "startOnFallbackInterface", Qt::QueuedConnection);
+        return;
     }
+
+    emitResult();
 }
 
 void Job::onUserQuery(Query *query)
@@ -228,15 +460,31 @@ bool Job::doKill()
         return true;
     }
 
-    if (d->isRunning()) {
-        qCDebug(ARK) << "Requesting graceful thread interruption, will abort in one second otherwise.";
-        d->requestInterruption();
-        d->wait(1000);
+    JobThreadPool *pool = JobThreadPool::instance();
+    if (pool->interrupt(this, cancellationTimeout)) {
+        // Deleting the job now would block until it returns.
+        setAutoDelete(false);
+        pool->deleteWhenDone(this);
     }
 
     return true;
 }
 
+void Job::interrupt()
+{
+    if (archiveInterface()->waitForFinishedSignal()) {
+        // CLI-based interfaces kill their process right away.
+        kill(KJob::Quietly);
+    } else if (JobThreadPool::instance()->interrupt(this, 0)) {
+        // The pool emits interrupted() once the job returns.
+        return;
+    }
+
+    QTimer::singleShot(0, this, [this]() {
+        emit interrupted(this);
+    });
+}
+
 LoadJob::LoadJob(Archive *archive, ReadOnlyArchiveInterface *interface)
     : Job(archive, interface)
     , m_isSingleFolderArchive(true)
@@ -281,10 +529,17 @@ void LoadJob::onFinished(bool result)
         const auto name = subfolderName().isEmpty() ? archive()->completeBaseName() : subfolderName();
         archive()->setProperty("subfolderName", name);
         if (isPasswordProtected()) {
-            archive()->setProperty("encryptionType",  archive()->password().isEmpty() ? Archive::Encrypted : Archive::HeaderEncrypted);
+            const bool headerEncrypted = !archive()->password().isEmpty();
+            archive()->setProperty("encryptionType",  headerEncrypted ? Archive::HeaderEncrypted : Archive::Encrypted);
+            // Operations that rewrite the archive in place must keep its headers encrypted.
+            archiveInterface()->setHeaderEncryptionEnabled(headerEncrypted);
         }
     }
 
+    Tracer::addCounter("loadedEntries", {{QStringLiteral("files"), m_filesCount},
+                                         {QStringLiteral("folders"), m_dirCount},
+                                         {QStringLiteral("bytes"), m_extractedFilesSize}});
+
     Job::onFinished(result);
 }
 
@@ -351,6 +606,9 @@ BatchExtractJob::BatchExtractJob(LoadJob *loadJob, const QString &destination, b
     , m_autoSubfolder(autoSubfolder)
     , m_preservePaths(preservePaths)
 {
+    // The percentage is split between loading and extraction, it must not follow the extracted bytes.
+    setProgressUnit(KJob::Files);
+
     qCDebug(ARK) << "Created job instance";
 }
 
@@ -401,6 +659,18 @@ void BatchExtractJob::slotLoadingFinished(KJob *job)
         return;
     }
 
+    // Don't start an extraction that is known to run out of space midway.
+    // Entries whose size is unknown are listed with a size of 0, skip the check if none is known.
+    const QStorageInfo storage(m_destination);
+    const qulonglong unpackedSize = archive()->unpackedSize();
+    if (unpackedSize > 0 && storage.isValid() && storage.bytesAvailable() >= 0 && unpackedSize > qulonglong(storage.bytesAvailable())) {
+        onError(xi18nc("@info", "There is not enough free space in <filename>%1</filename> to extract the archive "
+                                "(%2 needed, %3 available).",
+                       m_destination, KIO::convertSize(unpackedSize), KIO::convertSize(storage.bytesAvailable())), QString());
+        onFinished(false);
+        return;
+    }
+
     // Now we can start extraction.
     setupDestination();
 
@@ -415,6 +685,8 @@ void BatchExtractJob::slotLoadingFinished(KJob *job)
             // The LoadJob is done, change slot and start setting the percentage from m_lastPercentage on.
             disconnect(archiveInterface(), &ReadOnlyArchiveInterface::progress, this, &BatchExtractJob::slotLoadingProgress);
             connect(archiveInterface(), &ReadOnlyArchiveInterface::progress, this, &BatchExtractJob::slotExtractProgress);
+            connect(archiveInterface(), &ReadOnlyArchiveInterface::processedSize, this, &BatchExtractJob::onProcessedSize);
+            connect(archiveInterface(), &ReadOnlyArchiveInterface::processedEntries, this, &BatchExtractJob::onProcessedEntries);
         }
         m_step = Extracting;
         m_extractJob->start();
@@ -564,6 +836,7 @@ QString TempExtractJob::validatedFilePath() const
 ExtractionOptions TempExtractJob::extractionOptions() const
 {
     ExtractionOptions options;
+    options.setTemporaryExtraction(true);
 
     if (m_passwordProtectedHint) {
         options.setEncryptedArchiveHint(true);
@@ -586,6 +859,12 @@ void TempExtractJob::doWork()
 
     qCDebug(ARK) << "Extracting:" << m_entry;
 
+    if (isCacheable() && ExtractedEntryCache::instance()->retrieve(archiveInterface()->filename(), m_entry->fullPath(), validatedFilePath())) {
+        m_extractedFromCache = true;
+        onFinished(true);
+        return;
+    }
+
     bool ret = archiveInterface()->extractFiles({m_entry}, extractionDir(), extractionOptions());
 
     if (!archiveInterface()->waitForFinishedSignal()) {
@@ -593,17 +872,136 @@ void TempExtractJob::doWork()
     }
 }
 
+void TempExtractJob::onFinished(bool result)
+{
+    // An interrupted job must not cache its entry, e.g. after the entries of its archive were removed.
+    if (result && error() == KJob::NoError && !m_extractedFromCache && isCacheable() &&
+        !JobThreadPool::instance()->isInterruptionRequested(this)) {
+        ExtractedEntryCache::instance()->insert(archiveInterface()->filename(), m_entry->fullPath(), validatedFilePath());
+    }
+
+    Job::onFinished(result);
+}
+
+void TempExtractJob::prepareFallback()
+{
+    // Files left by the failed run would trigger overwrite queries.
+    QDir(extractionDir()).removeRecursively();
+    QDir().mkpath(extractionDir());
+}
+
+Archive::Entry *TempExtractJob::entry() const
+{
+    return m_entry;
+}
+
+bool TempExtractJob::isExtractedFromCache() const
+{
+    return m_extractedFromCache;
+}
+
 QString TempExtractJob::extractionDir() const
 {
     return m_tmpExtractDir->path();
 }
 
+bool TempExtractJob::isCacheable()
+{
+    return ExtractedEntryCache::instance() &&
+           !m_passwordProtectedHint &&
+           archiveInterface()->password().isEmpty();
+}
+
 PreviewJob::PreviewJob(Archive::Entry *entry, bool passwordProtectedHint, ReadOnlyArchiveInterface *interface)
     : TempExtractJob(entry, passwordProtectedHint, interface)
+    , m_maxInMemorySize(defaultMaxInMemoryPreviewSize)
 {
     qCDebug(ARK) << "Created job instance";
 }
 
+bool PreviewJob::isInMemory() const
+{
+    return m_isInMemory;
+}
+
+QByteArray PreviewJob::data() const
+{
+    return m_data;
+}
+
+void PreviewJob::setMaxInMemorySize(qint64 maxInMemorySize)
+{
+    m_maxInMemorySize = maxInMemorySize;
+}
+
+void PreviewJob::doWork()
+{
+    const ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    const bool isSmall = entry()->property("size").toLongLong() <= m_maxInMemorySize;
+
+    // The devices don't know the password. Entries already cached on disk are copied from there.
+    if (!isSmall || extractionOptions().encryptedArchiveHint() ||
+        (cache && cache->contains(archiveInterface()->filename(), entry()->fullPath()))) {
+        TempExtractJob::doWork();
+        return;
+    }
+
+    QScopedPointer<QIODevice> device(archiveInterface()->createEntryDevice(entry()));
+    if (!device) {
+        TempExtractJob::doWork();
+        return;
+    }
+
+    // The device doesn't stop when the interface is asked to, see doKill().
+    // It may look for the entry on the first read, only once doKill() can abort it.
+    {
+        QMutexLocker locker(&m_deviceMutex);
+        if (m_killed) {
+            onFinished(false);
+            return;
+        }
+        m_device = device.data();
+    }
+
+    emit description(this, i18np("Extracting one file", "Extracting %1 files", 1));
+    qCDebug(ARK) << "Reading in memory:" << entry();
+
+    m_data = device->readAll();
+
+    {
+        QMutexLocker locker(&m_deviceMutex);
+        m_device = nullptr;
+        if (m_killed) {
+            m_data.clear();
+            onFinished(false);
+            return;
+        }
+    }
+
+    if (!device->atEnd()) {
+        qCWarning(ARK) << "Could not read" << entry()->fullPath() << "in memory:" << device->errorString();
+        m_data.clear();
+        TempExtractJob::doWork();
+        return;
+    }
+
+    m_isInMemory = true;
+    Job::onFinished(true);
+}
+
+bool PreviewJob::doKill()
+{
+    {
+        QMutexLocker locker(&m_deviceMutex);
+        m_killed = true;
+        if (m_device) {
+            QMetaObject::invokeMethod(m_device, "abort", Qt::DirectConnection);
+        }
+    }
+
+    return TempExtractJob::doKill();
+}
+
 OpenJob::OpenJob(Archive::Entry *entry, bool passwordProtectedHint, ReadOnlyArchiveInterface *interface)
     : TempExtractJob(entry, passwordProtectedHint, interface)
 {
@@ -625,12 +1023,41 @@ AddJob::AddJob(const QVector<Archive::Entry*> &entries, const Archive::Entry *de
     qCDebug(ARK) << "Created job instance";
 }
 
+ArchiveOperation AddJob::operation() const
+{
+    ArchiveOperation operation;
+    operation.mode = ReadWriteArchiveInterface::Add;
+    operation.entries = m_entries;
+    // Additions don't modify their destination, the pointer is only non-const for moving and copying.
+    operation.destination = const_cast<Archive::Entry*>(m_destination);
+    operation.options = m_options;
+    operation.numberOfEntriesToAdd = m_totalCount;
+    return operation;
+}
+
 void AddJob::doWork()
 {
-    // Set current dir.
+    prepareOperation();
+
+    ReadWriteArchiveInterface *m_writeInterface =
+        qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
+
+    Q_ASSERT(m_writeInterface);
+
+    connectToArchiveInterfaceSignals();
+    bool ret = m_writeInterface->addFiles(m_entries, m_destination, m_options, m_totalCount);
+
+    if (!archiveInterface()->waitForFinishedSignal()) {
+        onFinished(ret);
+    }
+}
+
+void AddJob::prepareOperation()
+{
+    // Set current dir. Merged additions share it, only the first one changes it and restores it.
     const QString globalWorkDir = m_options.globalWorkDir();
     const QDir workDir = globalWorkDir.isEmpty() ? QDir::current() : QDir(globalWorkDir);
-    if (!globalWorkDir.isEmpty()) {
+    if (!globalWorkDir.isEmpty() && QDir::current() != workDir) {
         qCDebug(ARK) << "GlobalWorkDir is set, changing dir to " << globalWorkDir;
         m_oldWorkingDir = QDir::currentPath();
         QDir::setCurrent(globalWorkDir);
@@ -656,11 +1083,6 @@ void AddJob::doWork()
     const QString desc = i18np("Compressing a file", "Compressing %1 files", totalCount);
     emit description(this, desc, qMakePair(i18n("Archive"), archiveInterface()->filename()));
 
-    ReadWriteArchiveInterface *m_writeInterface =
-        qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
-
-    Q_ASSERT(m_writeInterface);
-
     // The file paths must be relative to GlobalWorkDir.
     for (Archive::Entry *entry : qAsConst(m_entries)) {
         // #191821: workDir must be used instead of QDir::current()
@@ -675,12 +1097,7 @@ void AddJob::doWork()
         entry->setFullPath(relativePath);
     }
 
-    connectToArchiveInterfaceSignals();
-    bool ret = m_writeInterface->addFiles(m_entries, m_destination, m_options, totalCount);
-
-    if (!archiveInterface()->waitForFinishedSignal()) {
-        onFinished(ret);
-    }
+    m_totalCount = totalCount;
 }
 
 void AddJob::onFinished(bool result)
@@ -702,12 +1119,19 @@ MoveJob::MoveJob(const QVector<Archive::Entry*> &entries, Archive::Entry *destin
     qCDebug(ARK) << "Created job instance";
 }
 
-void MoveJob::doWork()
+ArchiveOperation MoveJob::operation() const
 {
-    qCDebug(ARK) << "Going to move" << m_entries.count() << "file(s)";
+    ArchiveOperation operation;
+    operation.mode = ReadWriteArchiveInterface::Move;
+    operation.entries = m_entries;
+    operation.destination = m_destination;
+    operation.options = m_options;
+    return operation;
+}
 
-    QString desc = i18np("Moving a file", "Moving %1 files", m_entries.count());
-    emit description(this, desc, qMakePair(i18n("Archive"), archiveInterface()->filename()));
+void MoveJob::doWork()
+{
+    prepareOperation();
 
     ReadWriteArchiveInterface *m_writeInterface =
         qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
@@ -722,6 +1146,14 @@ void MoveJob::doWork()
     }
 }
 
+void MoveJob::prepareOperation()
+{
+    qCDebug(ARK) << "Going to move" << m_entries.count() << "file(s)";
+
+    QString desc = i18np("Moving a file", "Moving %1 files", m_entries.count());
+    emit description(this, desc, qMakePair(i18n("Archive"), archiveInterface()->filename()));
+}
+
 void MoveJob::onFinished(bool result)
 {
     m_finishedSignalsCount++;
@@ -740,12 +1172,19 @@ CopyJob::CopyJob(const QVector<Archive::Entry*> &entries, Archive::Entry *destin
     qCDebug(ARK) << "Created job instance";
 }
 
-void CopyJob::doWork()
+ArchiveOperation CopyJob::operation() const
 {
-    qCDebug(ARK) << "Going to copy" << m_entries.count() << "file(s)";
+    ArchiveOperation operation;
+    operation.mode = ReadWriteArchiveInterface::Copy;
+    operation.entries = m_entries;
+    operation.destination = m_destination;
+    operation.options = m_options;
+    return operation;
+}
 
-    QString desc = i18np("Copying a file", "Copying %1 files", m_entries.count());
-    emit description(this, desc, qMakePair(i18n("Archive"), archiveInterface()->filename()));
+void CopyJob::doWork()
+{
+    prepareOperation();
 
     ReadWriteArchiveInterface *m_writeInterface =
         qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
@@ -760,6 +1199,14 @@ void CopyJob::doWork()
     }
 }
 
+void CopyJob::prepareOperation()
+{
+    qCDebug(ARK) << "Going to copy" << m_entries.count() << "file(s)";
+
+    QString desc = i18np("Copying a file", "Copying %1 files", m_entries.count());
+    emit description(this, desc, qMakePair(i18n("Archive"), archiveInterface()->filename()));
+}
+
 void CopyJob::onFinished(bool result)
 {
     m_finishedSignalsCount++;
@@ -774,10 +1221,49 @@ DeleteJob::DeleteJob(const QVector<Archive::Entry*> &entries, ReadWriteArchiveIn
 {
 }
 
+ArchiveOperation DeleteJob::operation() const
+{
+    ArchiveOperation operation;
+    operation.mode = ReadWriteArchiveInterface::Delete;
+    operation.entries = m_entries;
+    return operation;
+}
+
 void DeleteJob::doWork()
+{
+    prepareOperation();
+
+    ReadWriteArchiveInterface *m_writeInterface =
+        qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
+
+    Q_ASSERT(m_writeInterface);
+
+    connectToArchiveInterfaceSignals();
+    bool ret = m_writeInterface->deleteFiles(m_entries);
+
+    if (!archiveInterface()->waitForFinishedSignal()) {
+        onFinished(ret);
+    }
+}
+
+void DeleteJob::prepareOperation()
 {
     QString desc = i18np("Deleting a file from the archive", "Deleting %1 files", m_entries.count());
     emit description(this, desc, qMakePair(i18n("Archive"), archiveInterface()->filename()));
+}
+
+ReplaceJob::ReplaceJob(const Archive::Entry *entry, const QString &file, const CompressionOptions &options, ReadWriteArchiveInterface *interface)
+    : Job(interface)
+    , m_entry(entry)
+    , m_file(file)
+    , m_options(options)
+{
+    qCDebug(ARK) << "Created job instance";
+}
+
+void ReplaceJob::doWork()
+{
+    emit description(this, i18n("Updating a file in the archive"), qMakePair(i18n("File"), m_entry->fullPath()));
 
     ReadWriteArchiveInterface *m_writeInterface =
         qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
@@ -785,7 +1271,7 @@ void DeleteJob::doWork()
     Q_ASSERT(m_writeInterface);
 
     connectToArchiveInterfaceSignals();
-    bool ret = m_writeInterface->deleteFiles(m_entries);
+    bool ret = m_writeInterface->replaceEntry(m_entry, m_file, m_options);
 
     if (!archiveInterface()->waitForFinishedSignal()) {
         onFinished(ret);
@@ -798,9 +1284,17 @@ CommentJob::CommentJob(const QString& comment, ReadWriteArchiveInterface *interf
 {
 }
 
+ArchiveOperation CommentJob::operation() const
+{
+    ArchiveOperation operation;
+    operation.mode = ReadWriteArchiveInterface::Comment;
+    operation.comment = m_comment;
+    return operation;
+}
+
 void CommentJob::doWork()
 {
-    emit description(this, i18n("Adding comment"));
+    prepareOperation();
 
     ReadWriteArchiveInterface *m_writeInterface =
         qobject_cast<ReadWriteArchiveInterface*>(archiveInterface());
@@ -815,6 +1309,11 @@ void CommentJob::doWork()
     }
 }
 
+void CommentJob::prepareOperation()
+{
+    emit description(this, i18n("Adding comment"));
+}
+
 TestJob::TestJob(ReadOnlyArchiveInterface *interface)
     : Job(interface)
 {
@@ -828,7 +1327,7 @@ void TestJob::doWork()
     emit description(this, i18n("Testing archive"), qMakePair(i18n("Archive"), archiveInterface()->filename()));
 
     connectToArchiveInterfaceSignals();
-    connect(archiveInterface(), &ReadOnlyArchiveInterface::testSuccess, this, &TestJob::onTestSuccess);
+    addArchiveInterfaceConnection(connect(archiveInterface(), &ReadOnlyArchiveInterface::testSuccess, this, &TestJob::onTestSuccess));
 
     bool ret = archiveInterface()->testArchive();
 
@@ -848,5 +1347,3 @@ bool TestJob::testSucceeded()
 }
 
 } // namespace Kerfuffle
-
-#include "jobs.moc"
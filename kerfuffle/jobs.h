@@ -38,15 +38,20 @@
 #include <KJob>
 
 #include <QElapsedTimer>
+#include <QMutex>
 #include <QTemporaryDir>
 
 namespace Kerfuffle
 {
 
+class MergedJobs;
+
 class KERFUFFLE_EXPORT Job : public KJob
 {
     Q_OBJECT
 
+    friend class MergedJobs;
+
 public:
 
     /**
@@ -57,6 +62,40 @@ public:
     QString errorString() const override;
     void start() override;
 
+    /**
+     * @return The modification of the archive done by this job, or an operation
+     * with the NoOperation mode if the job doesn't modify the archive.
+     * The pool uses it to merge the modifications queued on the same archive.
+     */
+    virtual ArchiveOperation operation() const;
+
+    /**
+     * Applies the modifications of @p jobs, all on the same read-write interface, in one go.
+     * Each job still reports the entries added or removed by its own modification and its own result.
+     * Called by the pool instead of doWork() when several modifications are queued on the same archive.
+     */
+    static void doMergedWork(const QVector<Job*> &jobs);
+
+    /**
+     * Asks the job to stop without waiting for it, unlike kill() which blocks the caller
+     * until the job stops or a timeout expires. The result of the job is not emitted:
+     * interrupted() tells when the job is done and can be deleted.
+     */
+    void interrupt();
+
+    /**
+     * Runs the job again on @p interface if it fails on its own one, which is then
+     * an in-process reader that might not support every entry of the archive.
+     */
+    void setFallbackInterface(ReadOnlyArchiveInterface *interface);
+
+    /**
+     * Stops forwarding the signals connected by connectToArchiveInterfaceSignals(), once the
+     * operation of the job is done. Otherwise the job would also report the entries of the
+     * next jobs on the same interface.
+     */
+    void disconnectFromArchiveInterfaceSignals();
+
 protected:
     Job(Archive *archive, ReadOnlyArchiveInterface *interface);
     Job(Archive *archive);
@@ -68,6 +107,22 @@ protected:
 
     void connectToArchiveInterfaceSignals();
 
+    /**
+     * Drops @p connection from the interface along with the ones made by
+     * connectToArchiveInterfaceSignals(), see disconnectFromArchiveInterfaceSignals().
+     */
+    void addArchiveInterfaceConnection(const QMetaObject::Connection &connection);
+
+    /**
+     * Prepares operation() before it gets applied, e.g. by describing it to the job trackers.
+     */
+    virtual void prepareOperation();
+
+    /**
+     * Drops what a failed run left behind, before the job runs again on the fallback interface.
+     */
+    virtual void prepareFallback();
+
 public Q_SLOTS:
     virtual void doWork() = 0;
 
@@ -77,6 +132,8 @@ protected Q_SLOTS:
     virtual void onInfo(const QString &info);
     virtual void onEntry(Archive::Entry *entry);
     virtual void onProgress(double progress);
+    virtual void onProcessedSize(qulonglong processed, qulonglong total);
+    virtual void onProcessedEntries(qulonglong processed, qulonglong total);
     virtual void onEntryRemoved(const QString &path);
     virtual void onFinished(bool result);
     virtual void onUserQuery(Kerfuffle::Query *query);
@@ -86,13 +143,25 @@ Q_SIGNALS:
     void newEntry(Archive::Entry*);
     void userQuery(Kerfuffle::Query*);
 
+    /**
+     * Emitted, possibly from a worker thread, once a job stopped by interrupt() is done.
+     */
+    void interrupted(Kerfuffle::Job *job);
+
+private Q_SLOTS:
+    void startOnFallbackInterface();
+
 private:
     Archive *m_archive;
     ReadOnlyArchiveInterface *m_archiveInterface;
+    ReadOnlyArchiveInterface *m_fallbackInterface = nullptr;
     QElapsedTimer jobTimer;
+    qint64 m_traceStart = 0;
+    QElapsedTimer m_speedTimer;
+    qulonglong m_speedBaseSize = 0;
+    QMutex m_interfaceConnectionsMutex;
+    QVector<QMetaObject::Connection> m_interfaceConnections;
 
-    class Private;
-    Private * const d;
 };
 
 /**
@@ -258,6 +327,16 @@ public:
      */
     QString validatedFilePath() const;
 
+    /**
+     * @return The entry extracted by this job.
+     */
+    Archive::Entry *entry() const;
+
+    /**
+     * @return Whether the entry has been copied from the ExtractedEntryCache instead of being extracted.
+     */
+    bool isExtractedFromCache() const;
+
     ExtractionOptions extractionOptions() const;
 
     /**
@@ -269,17 +348,33 @@ public:
 public Q_SLOTS:
     void doWork() override;
 
+protected:
+    void prepareFallback() override;
+
+protected Q_SLOTS:
+    void onFinished(bool result) override;
+
 private:
     QString extractionDir() const;
 
+    /**
+     * @return Whether the extracted file can be reused from and stored in the ExtractedEntryCache.
+     * Files of encrypted archives are never cached.
+     */
+    bool isCacheable();
+
     Archive::Entry *m_entry;
     QTemporaryDir *m_tmpExtractDir;
     bool m_passwordProtectedHint;
+    bool m_extractedFromCache = false;
 };
 
 /**
  * This TempExtractJob can be used to preview a file.
  * The temporary extraction directory will be deleted upon job's completion.
+ *
+ * Small entries are read in memory, through ReadOnlyArchiveInterface::createEntryDevice(),
+ * instead of being extracted: see isInMemory().
  */
 class KERFUFFLE_EXPORT PreviewJob : public TempExtractJob
 {
@@ -287,6 +382,36 @@ class KERFUFFLE_EXPORT PreviewJob : public TempExtractJob
 
 public:
     PreviewJob(Archive::Entry *entry, bool passwordProtectedHint, ReadOnlyArchiveInterface *interface);
+
+    /**
+     * @return Whether the entry has been read in memory rather than extracted.
+     * Its content is then in data(), and validatedFilePath() is only written by whoever needs a file.
+     */
+    bool isInMemory() const;
+    QByteArray data() const;
+
+    /**
+     * Sets the size in bytes of the biggest entry read in memory, 0 to always extract the entry.
+     */
+    void setMaxInMemorySize(qint64 maxInMemorySize);
+
+public Q_SLOTS:
+    void doWork() override;
+
+protected:
+    bool doKill() override;
+
+private:
+    QByteArray m_data;
+    qint64 m_maxInMemorySize;
+    bool m_isInMemory = false;
+
+    /**
+     * The device the entry is being read from, which has to be aborted on its own.
+     */
+    QMutex m_deviceMutex;
+    QIODevice *m_device = nullptr;
+    bool m_killed = false;
 };
 
 /**
@@ -316,9 +441,14 @@ class KERFUFFLE_EXPORT AddJob : public Job
 public:
     AddJob(const QVector<Archive::Entry*> &files, const Archive::Entry *destination, const CompressionOptions& options, ReadWriteArchiveInterface *interface);
 
+    ArchiveOperation operation() const override;
+
 public Q_SLOTS:
     void doWork() override;
 
+protected:
+    void prepareOperation() override;
+
 protected Q_SLOTS:
     void onFinished(bool result) override;
 
@@ -327,6 +457,7 @@ private:
     const QVector<Archive::Entry*> m_entries;
     const Archive::Entry *m_destination;
     CompressionOptions m_options;
+    uint m_totalCount = 0;
 };
 
 /**
@@ -340,9 +471,14 @@ Q_OBJECT
 public:
     MoveJob(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions& options, ReadWriteArchiveInterface *interface);
 
+    ArchiveOperation operation() const override;
+
 public Q_SLOTS:
     void doWork() override;
 
+protected:
+    void prepareOperation() override;
+
 protected Q_SLOTS:
     void onFinished(bool result) override;
 
@@ -364,9 +500,14 @@ Q_OBJECT
 public:
     CopyJob(const QVector<Archive::Entry*> &entries, Archive::Entry *destination, const CompressionOptions& options, ReadWriteArchiveInterface *interface);
 
+    ArchiveOperation operation() const override;
+
 public Q_SLOTS:
     void doWork() override;
 
+protected:
+    void prepareOperation() override;
+
 protected Q_SLOTS:
     void onFinished(bool result) override;
 
@@ -384,13 +525,38 @@ class KERFUFFLE_EXPORT DeleteJob : public Job
 public:
     DeleteJob(const QVector<Archive::Entry*> &files, ReadWriteArchiveInterface *interface);
 
+    ArchiveOperation operation() const override;
+
 public Q_SLOTS:
     void doWork() override;
 
+protected:
+    void prepareOperation() override;
+
 private:
     QVector<Archive::Entry*> m_entries;
 };
 
+/**
+ * Replaces the content of a single entry with a file on disk, e.g. when a file opened from the archive is modified.
+ * Unlike AddJob, only the replaced entry is listed again, so the job is never merged with the other modifications.
+ */
+class KERFUFFLE_EXPORT ReplaceJob : public Job
+{
+    Q_OBJECT
+
+public:
+    ReplaceJob(const Archive::Entry *entry, const QString &file, const CompressionOptions &options, ReadWriteArchiveInterface *interface);
+
+public Q_SLOTS:
+    void doWork() override;
+
+private:
+    const Archive::Entry *m_entry;
+    QString m_file;
+    CompressionOptions m_options;
+};
+
 class KERFUFFLE_EXPORT CommentJob : public Job
 {
     Q_OBJECT
@@ -398,9 +564,14 @@ class KERFUFFLE_EXPORT CommentJob : public Job
 public:
     CommentJob(const QString& comment, ReadWriteArchiveInterface *interface);
 
+    ArchiveOperation operation() const override;
+
 public Q_SLOTS:
     void doWork() override;
 
+protected:
+    void prepareOperation() override;
+
 private:
     QString m_comment;
 };
@@ -0,0 +1,391 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "jobthreadpool.h"
+#include "ark_debug.h"
+#include "jobs.h"
+#include "tracer.h"
+
+#include <QThread>
+
+namespace Kerfuffle
+{
+
+// Idle workers exit after this delay, like the ones of QThreadPool.
+static const unsigned long workerExpiryTimeout = 30000;
+
+Q_GLOBAL_STATIC(JobThreadPool, s_jobThreadPool)
+
+class JobThreadPool::Worker : public QThread
+{
+public:
+    explicit Worker(JobThreadPool *pool)
+        : m_pool(pool)
+    {
+    }
+
+    void run() override;
+
+private:
+    JobThreadPool *m_pool;
+};
+
+void JobThreadPool::Worker::run()
+{
+    QVector<Job*> jobs;
+    while (m_pool->takeJobs(&jobs)) {
+        TraceSpan span(jobs.first()->metaObject()->className(), "worker");
+        if (jobs.size() == 1) {
+            jobs.first()->doWork();
+            // The signals already emitted are still delivered, the ones of the next job are not.
+            jobs.first()->disconnectFromArchiveInterfaceSignals();
+        } else {
+            span.setArg(QStringLiteral("mergedJobs"), jobs.size());
+            Job::doMergedWork(jobs);
+        }
+        span.end();
+        m_pool->jobsDone(jobs);
+    }
+}
+
+JobThreadPool::JobThreadPool()
+    : m_maxThreadCount(qMax(1, QThread::idealThreadCount()))
+{
+}
+
+JobThreadPool::~JobThreadPool()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_shuttingDown = true;
+        m_jobQueued.wakeAll();
+    }
+
+    for (Worker *worker : qAsConst(m_workers)) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+JobThreadPool *JobThreadPool::instance()
+{
+    return s_jobThreadPool.isDestroyed() ? nullptr : s_jobThreadPool();
+}
+
+void JobThreadPool::enqueue(Job *job, ReadOnlyArchiveInterface *interface)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QueuedJob queuedJob;
+    queuedJob.job = job;
+    queuedJob.interface = interface;
+    queuedJob.queuedTimer.start();
+    m_queue.append(queuedJob);
+    m_peakQueuedJobs = qMax(m_peakQueuedJobs, m_queue.size());
+
+    if (m_idleWorkers > 0) {
+        m_jobQueued.wakeAll();
+    } else if (m_runningWorkers < m_maxThreadCount) {
+        startWorker();
+    }
+}
+
+void JobThreadPool::waitForJob(Job *job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    dequeue(job);
+    while (m_activeJobs.contains(job)) {
+        m_jobDone.wait(&m_mutex);
+    }
+    m_interruptedJobs.remove(job);
+}
+
+bool JobThreadPool::interrupt(Job *job, int msecs)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (dequeue(job)) {
+        return false;
+    }
+
+    if (!m_activeJobs.contains(job)) {
+        return false;
+    }
+
+    qCDebug(ARK) << "Requesting graceful cancellation, will abort in" << msecs << "ms otherwise.";
+    m_interruptedJobs.insert(job);
+    m_activeJobs.value(job)->requestCancellation();
+
+    QElapsedTimer timer;
+    timer.start();
+    while (m_activeJobs.contains(job) && timer.elapsed() < msecs) {
+        m_jobDone.wait(&m_mutex, static_cast<unsigned long>(msecs - timer.elapsed()));
+    }
+
+    if (!m_activeJobs.contains(job)) {
+        return false;
+    }
+
+    if (msecs > 0) {
+        // The job's result is ignored from now on, it will still free its interface when it returns.
+        qCWarning(ARK) << "Job did not stop within" << msecs << "ms, giving up waiting for it";
+    }
+
+    return true;
+}
+
+void JobThreadPool::deleteWhenDone(Job *job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_activeJobs.contains(job)) {
+        m_jobsToDelete.insert(job);
+    } else {
+        job->deleteLater();
+    }
+}
+
+bool JobThreadPool::isInterruptionRequested(Job *job) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_interruptedJobs.contains(job);
+}
+
+int JobThreadPool::maxThreadCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxThreadCount;
+}
+
+void JobThreadPool::setMaxThreadCount(int maxThreadCount)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxThreadCount = qMax(1, maxThreadCount);
+
+    while (m_runningWorkers < m_maxThreadCount && m_runningWorkers - m_idleWorkers < m_queue.size()) {
+        startWorker();
+    }
+}
+
+int JobThreadPool::queuedJobsCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queue.size();
+}
+
+int JobThreadPool::activeJobsCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_activeJobs.size();
+}
+
+int JobThreadPool::peakQueuedJobsCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_peakQueuedJobs;
+}
+
+int JobThreadPool::startedJobsCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_startedJobs;
+}
+
+int JobThreadPool::mergedJobsCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_mergedJobs;
+}
+
+qint64 JobThreadPool::totalWaitTime() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_totalWaitTime;
+}
+
+qint64 JobThreadPool::peakWaitTime() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_peakWaitTime;
+}
+
+void JobThreadPool::resetMetrics()
+{
+    QMutexLocker locker(&m_mutex);
+    m_peakQueuedJobs = m_queue.size();
+    m_startedJobs = 0;
+    m_mergedJobs = 0;
+    m_totalWaitTime = 0;
+    m_peakWaitTime = 0;
+}
+
+bool JobThreadPool::takeJobs(QVector<Job*> *jobs)
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_shuttingDown) {
+        for (int i = 0; i < m_queue.size(); ++i) {
+            ReadOnlyArchiveInterface *interface = m_queue.at(i).interface;
+            if (m_busyInterfaces.contains(interface)) {
+                continue;
+            }
+
+            const QueuedJob queuedJob = m_queue.takeAt(i);
+            m_busyInterfaces.insert(interface);
+            interface->beginOperation();
+            startQueuedJob(queuedJob);
+
+            jobs->clear();
+            jobs->append(queuedJob.job);
+
+            // Merge the modifications queued right after this one on the same interface, until
+            // a job that can't be merged. Jobs on other interfaces are left where they are.
+            const ArchiveOperation operation = queuedJob.job->operation();
+            if (operation.mode != ReadWriteArchiveInterface::NoOperation) {
+                // The files to add are relative to the working directory of the process.
+                bool hasAddition = (operation.mode == ReadWriteArchiveInterface::Add);
+                QString workDir = operation.options.globalWorkDir();
+
+                int j = i;
+                while (j < m_queue.size()) {
+                    if (m_queue.at(j).interface != interface) {
+                        ++j;
+                        continue;
+                    }
+
+                    const ArchiveOperation nextOperation = m_queue.at(j).job->operation();
+                    if (nextOperation.mode == ReadWriteArchiveInterface::NoOperation) {
+                        break;
+                    }
+
+                    if (nextOperation.mode == ReadWriteArchiveInterface::Add) {
+                        if (hasAddition && nextOperation.options.globalWorkDir() != workDir) {
+                            break;
+                        }
+                        hasAddition = true;
+                        workDir = nextOperation.options.globalWorkDir();
+                    }
+
+                    const QueuedJob mergedJob = m_queue.takeAt(j);
+                    startQueuedJob(mergedJob);
+                    jobs->append(mergedJob.job);
+                    ++m_mergedJobs;
+                }
+            }
+
+            qCDebug(ARK) << "Starting" << jobs->size() << "job(s)," << m_queue.size() << "job(s) still queued";
+            return true;
+        }
+
+        ++m_idleWorkers;
+        const bool woken = m_jobQueued.wait(&m_mutex, workerExpiryTimeout);
+        --m_idleWorkers;
+
+        if (!woken && m_queue.isEmpty()) {
+            break;
+        }
+    }
+
+    --m_runningWorkers;
+    return false;
+}
+
+void JobThreadPool::jobsDone(const QVector<Job*> &jobs)
+{
+    QVector<Job*> interruptedJobs;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for (Job *job : jobs) {
+            m_busyInterfaces.remove(m_activeJobs.take(job));
+            if (m_jobsToDelete.remove(job)) {
+                // Nobody owns the job anymore.
+                job->deleteLater();
+            } else if (m_interruptedJobs.contains(job)) {
+                interruptedJobs.append(job);
+            }
+        }
+        m_jobDone.wakeAll();
+
+        // The next job on the same interface may be waiting for this one.
+        if (!m_queue.isEmpty()) {
+            m_jobQueued.wakeAll();
+        }
+    }
+
+    // Their result won't be emitted, tell their owner that they can be deleted.
+    for (Job *job : qAsConst(interruptedJobs)) {
+        emit job->interrupted(job);
+    }
+}
+
+void JobThreadPool::startQueuedJob(const QueuedJob &queuedJob)
+{
+    const qint64 waitTime = queuedJob.queuedTimer.elapsed();
+    m_activeJobs.insert(queuedJob.job, queuedJob.interface);
+    ++m_startedJobs;
+    m_totalWaitTime += waitTime;
+    m_peakWaitTime = qMax(m_peakWaitTime, waitTime);
+
+    qCDebug(ARK) << "Starting job after" << waitTime << "ms in the queue";
+}
+
+void JobThreadPool::startWorker()
+{
+    Worker *worker = nullptr;
+    for (Worker *w : qAsConst(m_workers)) {
+        if (!w->isRunning()) {
+            worker = w;
+            break;
+        }
+    }
+
+    if (!worker) {
+        worker = new Worker(this);
+        m_workers.append(worker);
+    }
+
+    ++m_runningWorkers;
+    worker->start();
+}
+
+bool JobThreadPool::dequeue(Job *job)
+{
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue.at(i).job == job) {
+            m_queue.removeAt(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
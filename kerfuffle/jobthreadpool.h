@@ -0,0 +1,187 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef JOBTHREADPOOL_H
+#define JOBTHREADPOOL_H
+
+#include "kerfuffle_export.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace Kerfuffle
+{
+
+class Job;
+class ReadOnlyArchiveInterface;
+
+/**
+ * Runs the jobs of the interfaces that don't rely on an event loop on a bounded set
+ * of worker threads, which are reused from one job to the next instead of being created
+ * and torn down for each job.
+ *
+ * Interfaces are not thread-safe: the jobs on the same interface run one after another,
+ * in the order they were started. Jobs on different interfaces run in parallel.
+ *
+ * The modifications queued one after another on the same interface are merged, so that
+ * e.g. several additions to a compressed tarball rewrite it only once. Each merged job
+ * still reports its own entries and result, see Job::doMergedWork().
+ * Ark's part locks its view while a job runs, so only the clients of the library that
+ * start several modifications back to back get them merged.
+ */
+class KERFUFFLE_EXPORT JobThreadPool
+{
+public:
+    JobThreadPool();
+    ~JobThreadPool();
+
+    /**
+     * @return The pool used by Job::start(), or nullptr once it has been destroyed at exit.
+     */
+    static JobThreadPool *instance();
+
+    /**
+     * Queues @p job, whose doWork() is then called on a worker thread
+     * once the previous jobs on @p interface are done.
+     */
+    void enqueue(Job *job, ReadOnlyArchiveInterface *interface);
+
+    /**
+     * Removes @p job from the queue if it didn't start yet, otherwise waits until it is done.
+     */
+    void waitForJob(Job *job);
+
+    /**
+     * Removes @p job from the queue if it didn't start yet, otherwise requests the
+     * cancellation of its interface and waits up to @p msecs until it is done.
+     * The jobs merged with @p job are cancelled along with it.
+     * @return Whether @p job is still running.
+     */
+    bool interrupt(Job *job, int msecs);
+
+    /**
+     * Deletes @p job once it is done, so that the caller doesn't have to wait for it.
+     * Used for the jobs that interrupt() gave up waiting for.
+     */
+    void deleteWhenDone(Job *job);
+
+    /**
+     * @return Whether interrupt() has been called while @p job was running.
+     */
+    bool isInterruptionRequested(Job *job) const;
+
+    int maxThreadCount() const;
+    void setMaxThreadCount(int maxThreadCount);
+
+    /**
+     * @return The number of jobs waiting for a thread or for their interface.
+     */
+    int queuedJobsCount() const;
+    int activeJobsCount() const;
+
+    /**
+     * @return The highest number of queued jobs since the last resetMetrics().
+     */
+    int peakQueuedJobsCount() const;
+
+    /**
+     * @return The number of jobs started since the last resetMetrics().
+     */
+    int startedJobsCount() const;
+
+    /**
+     * @return The number of jobs merged with the job queued before them since the last resetMetrics().
+     */
+    int mergedJobsCount() const;
+
+    /**
+     * @return The time in milliseconds spent in the queue by the jobs started
+     * since the last resetMetrics(), in total and by the job that waited the most.
+     */
+    qint64 totalWaitTime() const;
+    qint64 peakWaitTime() const;
+
+    void resetMetrics();
+
+private:
+    class Worker;
+
+    struct QueuedJob {
+        Job *job;
+        ReadOnlyArchiveInterface *interface;
+        QElapsedTimer queuedTimer;
+    };
+
+    /**
+     * Called by a worker to get its next job, along with the modifications queued right after it
+     * on the same interface that can be merged with it. Blocks until a job can run.
+     * @return False if the worker must exit, because it has been idle for too long or the pool is being destroyed.
+     */
+    bool takeJobs(QVector<Job*> *jobs);
+
+    /**
+     * Called by a worker when @p jobs are done.
+     */
+    void jobsDone(const QVector<Job*> &jobs);
+
+    void startQueuedJob(const QueuedJob &queuedJob);
+
+    void startWorker();
+    bool dequeue(Job *job);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_jobQueued;
+    QWaitCondition m_jobDone;
+
+    QList<QueuedJob> m_queue;
+    QHash<Job*, ReadOnlyArchiveInterface*> m_activeJobs;
+    QSet<ReadOnlyArchiveInterface*> m_busyInterfaces;
+    QSet<Job*> m_interruptedJobs;
+    QSet<Job*> m_jobsToDelete;
+
+    QList<Worker*> m_workers;
+    int m_runningWorkers = 0;
+    int m_idleWorkers = 0;
+    int m_maxThreadCount;
+    bool m_shuttingDown = false;
+
+    int m_peakQueuedJobs = 0;
+    int m_startedJobs = 0;
+    int m_mergedJobs = 0;
+    qint64 m_totalWaitTime = 0;
+    qint64 m_peakWaitTime = 0;
+};
+
+}
+
+#endif // JOBTHREADPOOL_H
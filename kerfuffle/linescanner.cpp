@@ -0,0 +1,130 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "linescanner.h"
+
+#include <QIODevice>
+
+#include <cstring>
+
+namespace Kerfuffle
+{
+
+LineScanner::LineScanner()
+{
+    // Keeps the allocation around when the buffer is emptied.
+    m_buffer.reserve(64 * 1024);
+}
+
+bool LineScanner::readFrom(QIODevice *device)
+{
+    const qint64 available = device->bytesAvailable();
+    if (available <= 0) {
+        return false;
+    }
+
+    compact();
+
+    // Read straight into the buffer, instead of going through a temporary QByteArray.
+    const int oldSize = m_buffer.size();
+    m_buffer.resize(oldSize + static_cast<int>(available));
+    const qint64 bytesRead = device->read(m_buffer.data() + oldSize, available);
+    m_buffer.resize(oldSize + static_cast<int>(qMax<qint64>(0, bytesRead)));
+
+    return bytesRead > 0;
+}
+
+void LineScanner::append(const QByteArray &data)
+{
+    compact();
+    m_buffer.append(data);
+}
+
+bool LineScanner::nextLine(QByteArray *line)
+{
+    const char *data = m_buffer.constData();
+    const void *newline = memchr(data + m_scanPos, '\n', m_buffer.size() - m_scanPos);
+    if (!newline) {
+        m_scanPos = m_buffer.size();
+        return false;
+    }
+
+    const int end = static_cast<int>(static_cast<const char*>(newline) - data);
+    *line = QByteArray::fromRawData(data + m_lineStart, end - m_lineStart);
+    m_lineStart = end + 1;
+    m_scanPos = m_lineStart;
+
+    return true;
+}
+
+QByteArray LineScanner::pendingLine() const
+{
+    // Look backwards, so that only the last line is scanned.
+    int start = m_buffer.size();
+    while (start > m_scanPos && m_buffer.at(start - 1) != '\n') {
+        --start;
+    }
+    if (start == m_scanPos) {
+        start = m_lineStart;
+    }
+
+    return QByteArray::fromRawData(m_buffer.constData() + start, m_buffer.size() - start);
+}
+
+QByteArray LineScanner::takeAll()
+{
+    const QByteArray remaining = QByteArray::fromRawData(m_buffer.constData() + m_lineStart, m_buffer.size() - m_lineStart);
+    m_lineStart = m_buffer.size();
+    m_scanPos = m_lineStart;
+
+    return remaining;
+}
+
+void LineScanner::clear()
+{
+    m_buffer.resize(0);
+    m_lineStart = 0;
+    m_scanPos = 0;
+}
+
+void LineScanner::compact()
+{
+    if (m_lineStart == 0) {
+        return;
+    }
+
+    // Only the incomplete last line is left when the caller is done with the lines, so this is cheap.
+    const int remaining = m_buffer.size() - m_lineStart;
+    if (remaining > 0) {
+        memmove(m_buffer.data(), m_buffer.constData() + m_lineStart, remaining);
+    }
+    m_buffer.resize(remaining);
+    m_scanPos -= m_lineStart;
+    m_lineStart = 0;
+}
+
+}
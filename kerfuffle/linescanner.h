@@ -0,0 +1,100 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINESCANNER_H
+#define LINESCANNER_H
+
+#include "kerfuffle_export.h"
+
+#include <QByteArray>
+
+class QIODevice;
+
+namespace Kerfuffle
+{
+
+/**
+ * Splits the output of a process into lines, as it comes in.
+ *
+ * Each byte is scanned only once, no matter how many chunks a line is split into,
+ * and the lines are handed out as views of the internal buffer instead of copies.
+ * The buffer is reused: consumed lines are dropped by moving the incomplete last
+ * line back to its beginning before more data is appended.
+ */
+class KERFUFFLE_EXPORT LineScanner
+{
+public:
+    LineScanner();
+
+    /**
+     * Appends all the data available in @p device.
+     * @return Whether any data has been read.
+     */
+    bool readFrom(QIODevice *device);
+
+    /**
+     * Appends @p data.
+     */
+    void append(const QByteArray &data);
+
+    /**
+     * Consumes the next complete line.
+     * @param line Set to the line, without the newline. The data is not copied:
+     * @p line is only valid until the next call to readFrom(), append() or clear().
+     * @return False if there is no complete line left.
+     */
+    bool nextLine(QByteArray *line);
+
+    /**
+     * @return The incomplete line at the end of the data, which is empty if the data ends with a newline.
+     * The data is not copied and is only valid until the next call to readFrom(), append() or clear().
+     */
+    QByteArray pendingLine() const;
+
+    /**
+     * Consumes all the remaining data, including the incomplete last line.
+     * @return The remaining data, with the same validity as pendingLine().
+     */
+    QByteArray takeAll();
+
+    void clear();
+
+private:
+    void compact();
+
+    QByteArray m_buffer;
+
+    // Start of the first line that hasn't been consumed yet.
+    int m_lineStart = 0;
+
+    // Bytes before this position are known to contain no newline after m_lineStart.
+    int m_scanPos = 0;
+};
+
+}
+
+#endif // LINESCANNER_H
@@ -70,6 +70,16 @@ void ExtractionOptions::setAlwaysUseTempDir(bool alwaysUseTempDir)
     m_alwaysUseTempDir = alwaysUseTempDir;
 }
 
+bool ExtractionOptions::isTemporaryExtraction() const
+{
+    return m_temporaryExtraction;
+}
+
+void ExtractionOptions::setTemporaryExtraction(bool temporaryExtraction)
+{
+    m_temporaryExtraction = temporaryExtraction;
+}
+
 bool CompressionOptions::isCompressionLevelSet() const
 {
     return compressionLevel() != -1;
@@ -154,6 +164,7 @@ QDebug operator<<(QDebug d, const ExtractionOptions &options)
     d.nospace() << ", preserve paths: " << options.preservePaths();
     d.nospace() << ", drag and drop: " << options.isDragAndDropEnabled();
     d.nospace() << ", always temp dir: " << options.alwaysUseTempDir();
+    d.nospace() << ", temporary extraction: " << options.isTemporaryExtraction();
     d.nospace() << ")";
     return d.space();
 }
@@ -104,12 +104,15 @@ public:
     void setDragAndDropEnabled(bool enabled);
     bool alwaysUseTempDir() const;
     void setAlwaysUseTempDir(bool alwaysUseTempDir);
+    bool isTemporaryExtraction() const;
+    void setTemporaryExtraction(bool temporaryExtraction);
 
 private:
 
     bool m_preservePaths = true;
     bool m_dragAndDrop = false;
     bool m_alwaysUseTempDir = false;
+    bool m_temporaryExtraction = false;
 };
 
 QDebug KERFUFFLE_EXPORT operator<<(QDebug d, const CompressionOptions &options);
@@ -107,6 +107,19 @@ QVector<Plugin*> PluginManager::preferredWritePluginsFor(const QMimeType &mimeTy
     return preferredPluginsFor(mimeType, true);
 }
 
+QVector<Plugin*> PluginManager::preferredInProcessPluginsFor(const QMimeType &mimeType)
+{
+    QVector<Plugin*> inProcessPlugins;
+    const auto plugins = preferredPluginsFor(mimeType);
+    for (Plugin *plugin : plugins) {
+        if (plugin->readOnlyExecutables().isEmpty()) {
+            inProcessPlugins << plugin;
+        }
+    }
+
+    return inProcessPlugins;
+}
+
 Plugin *PluginManager::preferredPluginFor(const QMimeType &mimeType)
 {
     const QVector<Plugin*> preferredPlugins = preferredPluginsFor(mimeType);
@@ -89,6 +89,13 @@ public:
      */
     QVector<Plugin*> preferredWritePluginsFor(const QMimeType &mimeType) const;
 
+    /**
+     * @return The list of preferred plugins for the given @p mimeType which don't need any executable,
+     * i.e. the ones reading the archive in-process. The list is sorted according to the plugins priority.
+     * If no such plugin is available, returns an empty list.
+     */
+    QVector<Plugin*> preferredInProcessPluginsFor(const QMimeType &mimeType);
+
     /**
      * @return The preferred plugin for the given @p mimeType, among all the available ones.
      * If no plugin is available, returns an invalid plugin.
@@ -34,6 +34,7 @@ PreviewSettingsPage::PreviewSettingsPage(QWidget *parent, const QString &name, c
 {
     setupUi(this);
     connect(kcfg_limitPreviewFileSize, &QCheckBox::toggled, this, &PreviewSettingsPage::slotToggled);
+    connect(kcfg_prefetchPreviews, &QCheckBox::toggled, kcfg_prefetchedPreviewsCount, &QWidget::setEnabled);
 }
 
 void PreviewSettingsPage::slotToggled(bool enabled)
@@ -0,0 +1,110 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "timestamps.h"
+
+namespace Kerfuffle
+{
+
+// Returns the value of the @p count decimal digits at @p position, or -1 if
+// one of them is not a digit.
+static int readNumber(const QStringRef &text, int position, int count)
+{
+    int value = 0;
+    for (int i = position; i < position + count; ++i) {
+        const int digit = text.at(i).unicode() - '0';
+        if (digit < 0 || digit > 9) {
+            return -1;
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+static QDateTime makeTimestamp(int year, int month, int day, int hour, int minute, int second, int msec = 0)
+{
+    if (year < 0 || month < 0 || day < 0 || hour < 0 || minute < 0 || second < 0 || msec < 0) {
+        return QDateTime();
+    }
+
+    // QDate and QTime are invalid for out of range values, and so is the QDateTime.
+    return QDateTime(QDate(year, month, day), QTime(hour, minute, second, msec));
+}
+
+QDateTime parseTimestamp(const QStringRef &text)
+{
+    // yyyy-MM-dd hh:mm:ss[,zzz]
+    if ((text.size() != 19 && text.size() != 23) ||
+        text.at(4) != QLatin1Char('-') || text.at(7) != QLatin1Char('-') ||
+        text.at(10) != QLatin1Char(' ') ||
+        text.at(13) != QLatin1Char(':') || text.at(16) != QLatin1Char(':')) {
+        return QDateTime();
+    }
+
+    int msec = 0;
+    if (text.size() == 23) {
+        if (text.at(19) != QLatin1Char(',')) {
+            return QDateTime();
+        }
+        msec = readNumber(text, 20, 3);
+    }
+
+    return makeTimestamp(readNumber(text, 0, 4), readNumber(text, 5, 2), readNumber(text, 8, 2),
+                         readNumber(text, 11, 2), readNumber(text, 14, 2), readNumber(text, 17, 2),
+                         msec);
+}
+
+QDateTime parseCompactTimestamp(const QStringRef &date, const QStringRef &time)
+{
+    // yyyyMMdd hhmmss
+    if (date.size() != 8 || time.size() != 6) {
+        return QDateTime();
+    }
+
+    return makeTimestamp(readNumber(date, 0, 4), readNumber(date, 4, 2), readNumber(date, 6, 2),
+                         readNumber(time, 0, 2), readNumber(time, 2, 2), readNumber(time, 4, 2));
+}
+
+QDateTime parseShortTimestamp(const QStringRef &date, const QStringRef &time)
+{
+    // dd-MM-yy hh:mm
+    if (date.size() != 8 || time.size() != 5 ||
+        date.at(2) != QLatin1Char('-') || date.at(5) != QLatin1Char('-') ||
+        time.at(2) != QLatin1Char(':')) {
+        return QDateTime();
+    }
+
+    int year = readNumber(date, 6, 2);
+    if (year >= 0) {
+        year += (year < 50) ? 2000 : 1900;
+    }
+
+    return makeTimestamp(year, readNumber(date, 3, 2), readNumber(date, 0, 2),
+                         readNumber(time, 0, 2), readNumber(time, 3, 2), 0);
+}
+
+}
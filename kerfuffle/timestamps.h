@@ -0,0 +1,61 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TIMESTAMPS_H
+#define TIMESTAMPS_H
+
+#include "kerfuffle_export.h"
+
+#include <QDateTime>
+
+namespace Kerfuffle
+{
+    /**
+     * Parses a timestamp in the "yyyy-MM-dd hh:mm:ss" layout, optionally followed
+     * by ",zzz" milliseconds, as printed by 7z and unrar 5.
+     *
+     * This gives the same result as QDateTime::fromString() with the corresponding
+     * format, without parsing the format for every entry.
+     *
+     * @return The local time, or an invalid QDateTime if @p text does not follow the layout.
+     */
+    KERFUFFLE_EXPORT QDateTime parseTimestamp(const QStringRef &text);
+
+    /**
+     * Parses a timestamp split in a "yyyyMMdd" date and a "hhmmss" time,
+     * as printed by zipinfo -T.
+     */
+    KERFUFFLE_EXPORT QDateTime parseCompactTimestamp(const QStringRef &date, const QStringRef &time);
+
+    /**
+     * Parses a timestamp split in a "dd-MM-yy" date and a "hh:mm" time, as printed
+     * by unrar 3 and 4. Years before 50 are taken as 20yy, the others as 19yy.
+     */
+    KERFUFFLE_EXPORT QDateTime parseShortTimestamp(const QStringRef &date, const QStringRef &time);
+}
+
+#endif // TIMESTAMPS_H
@@ -0,0 +1,314 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tracer.h"
+#include "ark_debug.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+namespace Kerfuffle
+{
+
+// Spans can be recorded for each entry, don't let a huge archive exhaust the memory.
+static const int maximumEventCount = 1000000;
+// The trace is also written while recording, so that a crash or a kill doesn't lose all of it.
+static const qint64 flushInterval = 10000;
+
+static QString absoluteOutputFile(const QString &fileName)
+{
+    // Interfaces change the current directory while they work.
+    return fileName.isEmpty() ? QString() : QFileInfo(fileName).absoluteFilePath();
+}
+
+struct TraceEvent
+{
+    QByteArray name;
+    QByteArray category;
+    char phase;
+    qint64 timestamp;
+    qint64 duration;
+    int thread;
+    QVariantMap args;
+};
+
+class TraceData
+{
+public:
+    TraceData();
+    ~TraceData();
+
+    void record(const char *name, const char *category, char phase, qint64 timestamp, qint64 duration, const QVariantMap &args);
+    QByteArray toJson() const;
+    bool write();
+
+    QAtomicInt enabled;
+    QElapsedTimer clock;
+    QAtomicInt flushOnQuitConnected;
+
+    mutable QMutex mutex;
+    QString outputFile;
+    QVector<TraceEvent> events;
+    QHash<Qt::HANDLE, int> threadIndexes;
+    QStringList threadNames;
+    int droppedEvents = 0;
+    qint64 lastFlush = 0;
+    bool flushPending = false;
+};
+
+Q_GLOBAL_STATIC(TraceData, s_traceData)
+
+TraceData::TraceData()
+{
+    clock.start();
+    outputFile = absoluteOutputFile(QString::fromLocal8Bit(qgetenv("ARK_TRACE_FILE")));
+    enabled.storeRelease(!outputFile.isEmpty());
+}
+
+TraceData::~TraceData()
+{
+    if (enabled.loadAcquire() && !events.isEmpty()) {
+        write();
+    }
+}
+
+void TraceData::record(const char *name, const char *category, char phase, qint64 timestamp, qint64 duration, const QVariantMap &args)
+{
+    // The global data outlives the application, whose destruction is too late to write the trace.
+    if (!flushOnQuitConnected.loadAcquire() && QCoreApplication::instance() && flushOnQuitConnected.testAndSetOrdered(0, 1)) {
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, []() {
+            Tracer::write();
+        });
+    }
+
+    QMutexLocker locker(&mutex);
+
+    if (events.size() >= maximumEventCount) {
+        ++droppedEvents;
+        return;
+    }
+
+    const Qt::HANDLE threadId = QThread::currentThreadId();
+    auto it = threadIndexes.constFind(threadId);
+    if (it == threadIndexes.constEnd()) {
+        const QThread *thread = QThread::currentThread();
+        QString threadName = thread->objectName();
+        if (threadName.isEmpty()) {
+            const bool isMainThread = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread();
+            threadName = isMainThread ? QStringLiteral("Main thread") : QStringLiteral("Thread %1").arg(threadNames.size());
+        }
+        threadNames.append(threadName);
+        it = threadIndexes.insert(threadId, threadNames.size() - 1);
+    }
+
+    events.append({name, category, phase, timestamp, duration, it.value(), args});
+
+    // Only one thread writes the periodic flush, the others keep recording.
+    if (flushPending || clock.elapsed() - lastFlush < flushInterval) {
+        return;
+    }
+    flushPending = true;
+    locker.unlock();
+
+    write();
+}
+
+QByteArray TraceData::toJson() const
+{
+    QMutexLocker locker(&mutex);
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray traceEvents;
+
+    for (int i = 0; i < threadNames.size(); ++i) {
+        traceEvents.append(QJsonObject {
+            {QStringLiteral("name"), QStringLiteral("thread_name")},
+            {QStringLiteral("ph"), QStringLiteral("M")},
+            {QStringLiteral("pid"), pid},
+            {QStringLiteral("tid"), i},
+            {QStringLiteral("args"), QJsonObject {{QStringLiteral("name"), threadNames.at(i)}}}
+        });
+    }
+
+    for (const TraceEvent &event : events) {
+        QJsonObject object {
+            {QStringLiteral("name"), QString::fromUtf8(event.name)},
+            {QStringLiteral("cat"), QString::fromUtf8(event.category)},
+            {QStringLiteral("ph"), QString(QLatin1Char(event.phase))},
+            {QStringLiteral("ts"), event.timestamp},
+            {QStringLiteral("pid"), pid},
+            {QStringLiteral("tid"), event.thread}
+        };
+        if (event.phase == 'X') {
+            object.insert(QStringLiteral("dur"), event.duration);
+        }
+        if (!event.args.isEmpty()) {
+            object.insert(QStringLiteral("args"), QJsonObject::fromVariantMap(event.args));
+        }
+        traceEvents.append(object);
+    }
+
+    const QJsonObject document {
+        {QStringLiteral("traceEvents"), traceEvents},
+        {QStringLiteral("displayTimeUnit"), QStringLiteral("ms")},
+        {QStringLiteral("otherData"), QJsonObject {{QStringLiteral("droppedEvents"), droppedEvents}}}
+    };
+
+    return QJsonDocument(document).toJson(QJsonDocument::Compact);
+}
+
+bool TraceData::write()
+{
+    QString fileName;
+    {
+        QMutexLocker locker(&mutex);
+        fileName = outputFile;
+        lastFlush = clock.elapsed();
+        flushPending = false;
+    }
+
+    if (fileName.isEmpty()) {
+        return false;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(toJson()) == -1 || !file.commit()) {
+        qCWarning(ARK) << "Could not write the trace to" << fileName << file.errorString();
+        return false;
+    }
+
+    qCDebug(ARK) << "Trace written to" << fileName;
+    return true;
+}
+
+bool Tracer::isEnabled()
+{
+    return !s_traceData.isDestroyed() && s_traceData->enabled.loadAcquire();
+}
+
+void Tracer::setOutputFile(const QString &fileName)
+{
+    if (s_traceData.isDestroyed()) {
+        return;
+    }
+
+    QMutexLocker locker(&s_traceData->mutex);
+    s_traceData->outputFile = absoluteOutputFile(fileName);
+    s_traceData->enabled.storeRelease(!fileName.isEmpty());
+}
+
+QString Tracer::outputFile()
+{
+    if (s_traceData.isDestroyed()) {
+        return QString();
+    }
+
+    QMutexLocker locker(&s_traceData->mutex);
+    return s_traceData->outputFile;
+}
+
+qint64 Tracer::now()
+{
+    return s_traceData.isDestroyed() ? 0 : s_traceData->clock.nsecsElapsed() / 1000;
+}
+
+void Tracer::addSpan(const char *name, const char *category, qint64 start, qint64 duration, const QVariantMap &args)
+{
+    if (isEnabled()) {
+        s_traceData->record(name, category, 'X', start, duration, args);
+    }
+}
+
+void Tracer::addCounter(const char *name, const QVariantMap &values)
+{
+    if (isEnabled()) {
+        s_traceData->record(name, "counter", 'C', now(), 0, values);
+    }
+}
+
+QByteArray Tracer::toJson()
+{
+    return s_traceData.isDestroyed() ? QByteArray() : s_traceData->toJson();
+}
+
+bool Tracer::write()
+{
+    return !s_traceData.isDestroyed() && s_traceData->write();
+}
+
+void Tracer::clear()
+{
+    if (s_traceData.isDestroyed()) {
+        return;
+    }
+
+    QMutexLocker locker(&s_traceData->mutex);
+    s_traceData->events.clear();
+    s_traceData->droppedEvents = 0;
+}
+
+TraceSpan::TraceSpan(const char *name, const char *category)
+    : m_name(name)
+    , m_category(category)
+    , m_start(Tracer::isEnabled() ? Tracer::now() : -1)
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+    end();
+}
+
+void TraceSpan::setArg(const QString &name, const QVariant &value)
+{
+    if (m_start >= 0) {
+        m_args.insert(name, value);
+    }
+}
+
+void TraceSpan::end()
+{
+    if (m_start < 0) {
+        return;
+    }
+
+    Tracer::addSpan(m_name, m_category, m_start, Tracer::now() - m_start, m_args);
+    m_start = -1;
+}
+
+}
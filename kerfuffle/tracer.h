@@ -0,0 +1,110 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "kerfuffle_export.h"
+
+#include <QString>
+#include <QVariantMap>
+
+namespace Kerfuffle
+{
+
+/**
+ * Records spans of time and counters, to find out where the time goes in a slow
+ * load or extraction without attaching a profiler.
+ *
+ * Tracing is disabled unless the ARK_TRACE_FILE environment variable or the --trace
+ * option of Ark give the file to write. The trace is then written in the Chrome trace
+ * event format when the application is about to quit, every 10 seconds while events are
+ * recorded and whenever write() is called. It can be opened in chrome://tracing or
+ * https://ui.perfetto.dev. While disabled, recording costs a single atomic load.
+ */
+class KERFUFFLE_EXPORT Tracer
+{
+public:
+    static bool isEnabled();
+
+    /**
+     * Enables tracing into @p fileName, or disables it if @p fileName is empty.
+     */
+    static void setOutputFile(const QString &fileName);
+    static QString outputFile();
+
+    /**
+     * @return The time in microseconds on the clock of the trace.
+     */
+    static qint64 now();
+
+    /**
+     * Records a span of @p duration microseconds that started at @p start, on the current thread.
+     */
+    static void addSpan(const char *name, const char *category, qint64 start, qint64 duration, const QVariantMap &args = QVariantMap());
+
+    /**
+     * Records the current @p values of the counter @p name, e.g. the number of processed bytes.
+     */
+    static void addCounter(const char *name, const QVariantMap &values);
+
+    /**
+     * @return The events recorded so far, as a Chrome trace event JSON document.
+     */
+    static QByteArray toJson();
+
+    /**
+     * Writes the events recorded so far to the output file.
+     */
+    static bool write();
+    static void clear();
+};
+
+/**
+ * Records a span from its construction to its destruction, or to end().
+ */
+class KERFUFFLE_EXPORT TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const char *category = "kerfuffle");
+    ~TraceSpan();
+
+    void setArg(const QString &name, const QVariant &value);
+    void end();
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *m_name;
+    const char *m_category;
+    qint64 m_start;
+    QVariantMap m_args;
+};
+
+}
+
+#endif // TRACER_H
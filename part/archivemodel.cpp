@@ -25,6 +25,7 @@
 #include "archivemodel.h"
 #include "ark_debug.h"
 #include "jobs.h"
+#include "tracer.h"
 
 #include <KIO/Global>
 #include <KLocalizedString>
@@ -440,6 +441,13 @@ void ArchiveModel::slotEntryRemoved(const QString & path)
         QModelIndex index = indexForEntry(entry);
         Q_UNUSED(index);
 
+        // The removed entry may be the cached parent, or one of its ancestors.
+        s_previousMatch = nullptr;
+        s_previousPieces->clear();
+
+        // Only the directories that lost entries need to be cleaned up afterwards.
+        m_dirsToCleanup.insert(parent->fullPath());
+
         beginRemoveRows(indexForEntry(parent), entry->row(), entry->row());
         m_entryIcons.remove(parent->entries().at(entry->row())->fullPath(NoTrailingSlash));
         parent->removeEntryAt(entry->row());
@@ -464,6 +472,8 @@ void ArchiveModel::slotListEntry(Archive::Entry *entry)
 
 void ArchiveModel::newEntry(Archive::Entry *receivedEntry, InsertBehaviour behaviour)
 {
+    TraceSpan span("modelInsert", "part");
+
     if (receivedEntry->fullPath().isEmpty()) {
         qCDebug(ARK) << "Weird, received empty entry (no filename) - skipping";
         return;
@@ -519,6 +529,16 @@ void ArchiveModel::newEntry(Archive::Entry *receivedEntry, InsertBehaviour behav
 
     // Skip already created entries.
     Archive::Entry *existing = m_rootEntry->findByPath(entryFileName.split(QLatin1Char('/')));
+    if (existing && behaviour == NotifyViews) {
+        // The entry was overwritten or replaced by a job: only its row changes,
+        // and only if the job didn't list an unchanged entry again.
+        if (!existing->hasSameMetaData(receivedEntry)) {
+            existing->copyMetaData(receivedEntry);
+            const QModelIndex index = indexForEntry(existing);
+            emit dataChanged(index, index.sibling(index.row(), columnCount() - 1));
+        }
+        return;
+    }
     if (existing) {
         existing->setProperty("fullPath", entryFileName);
         // Multi-volume files are repeated at least in RAR archives.
@@ -574,6 +594,7 @@ void ArchiveModel::insertEntry(Archive::Entry *entry, InsertBehaviour behaviour)
     }
 
     // Save an icon for each newly added entry.
+    TraceSpan span("iconResolve", "part");
     QMimeDatabase db;
     QIcon icon;
     entry->isDir()
@@ -594,6 +615,7 @@ void ArchiveModel::reset()
     m_archive.reset(nullptr);
     s_previousMatch = nullptr;
     s_previousPieces->clear();
+    m_dirsToCleanup.clear();
     initRootEntry();
 
     // TODO: make sure if it's ok to not have calls to beginRemoveColumns here
@@ -727,6 +749,25 @@ DeleteJob* ArchiveModel::deleteFiles(QVector<Archive::Entry*> entries)
     return nullptr;
 }
 
+ReplaceJob* ArchiveModel::replaceEntry(const QString &path, const QString &file, const CompressionOptions& options)
+{
+    if (!m_archive || m_archive->isReadOnly()) {
+        return nullptr;
+    }
+
+    const Archive::Entry *entry = m_rootEntry->findByPath(path.split(QLatin1Char('/'), QString::SkipEmptyParts));
+    if (!entry || entry->isDir()) {
+        return nullptr;
+    }
+
+    ReplaceJob *job = m_archive->replaceEntry(entry, file, options);
+    if (job) {
+        connect(job, &ReplaceJob::newEntry, this, &ArchiveModel::slotNewEntry);
+        connect(job, &ReplaceJob::userQuery, this, &ArchiveModel::slotUserQuery);
+    }
+    return job;
+}
+
 void ArchiveModel::encryptArchive(const QString &password, bool encryptHeader)
 {
     if (!m_archive) {
@@ -823,37 +864,31 @@ const QHash<QString, QIcon> ArchiveModel::entryIcons() const
 
 void ArchiveModel::slotCleanupEmptyDirs()
 {
-    QList<QPersistentModelIndex> queue;
-    QList<QPersistentModelIndex> nodesToDelete;
+    // Visit only the directories that lost entries, not the whole tree.
+    const QSet<QString> dirs = m_dirsToCleanup;
+    m_dirsToCleanup.clear();
 
-    // Add root nodes.
-    for (int i = 0; i < rowCount(); ++i) {
-        queue.append(QPersistentModelIndex(index(i, 0)));
-    }
-
-    // Breadth-first traverse.
-    while (!queue.isEmpty()) {
-        QPersistentModelIndex node = queue.takeFirst();
-        Archive::Entry *entry = entryForIndex(node);
+    for (const QString &path : dirs) {
+        Archive::Entry *dir = path.isEmpty()
+                              ? m_rootEntry.data()
+                              : m_rootEntry->findByPath(path.split(QLatin1Char('/'), QString::SkipEmptyParts));
+        if (!dir || !dir->isDir()) {
+            continue;
+        }
 
-        if (!hasChildren(node)) {
-            if (entry->fullPath().isEmpty()) {
-                nodesToDelete << node;
-            }
-        } else {
-            for (int i = 0; i < rowCount(node); ++i) {
-                queue.append(QPersistentModelIndex(index(i, 0, node)));
+        const QVector<Archive::Entry*> children = dir->entries();
+        for (int row = children.size() - 1; row >= 0; --row) {
+            Archive::Entry *entry = children.at(row);
+            if (!entry->fullPath().isEmpty() || (entry->isDir() && !entry->entries().isEmpty())) {
+                continue;
             }
-        }
-    }
 
-    for (const QPersistentModelIndex& node : qAsConst(nodesToDelete)) {
-        Archive::Entry *rawEntry = static_cast<Archive::Entry*>(node.internalPointer());
-        qCDebug(ARK) << "Delete with parent entries " << rawEntry->getParent()->entries() << " and row " << rawEntry->row();
-        beginRemoveRows(parent(node), rawEntry->row(), rawEntry->row());
-        m_entryIcons.remove(rawEntry->getParent()->entries().at(rawEntry->row())->fullPath(NoTrailingSlash));
-        rawEntry->getParent()->removeEntryAt(rawEntry->row());
-        endRemoveRows();
+            qCDebug(ARK) << "Delete with parent entries " << dir->entries() << " and row " << row;
+            beginRemoveRows(indexForEntry(dir), row, row);
+            m_entryIcons.remove(entry->fullPath(NoTrailingSlash));
+            dir->removeEntryAt(row);
+            endRemoveRows();
+        }
     }
 }
 
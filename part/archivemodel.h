@@ -29,6 +29,7 @@
 
 #include <QAbstractItemModel>
 #include <QScopedPointer>
+#include <QSet>
 
 using Kerfuffle::Archive;
 
@@ -103,6 +104,13 @@ public:
     Kerfuffle::CopyJob* copyFiles(QVector<Archive::Entry*> &entries, Archive::Entry *destination, const Kerfuffle::CompressionOptions& options = Kerfuffle::CompressionOptions());
     Kerfuffle::DeleteJob* deleteFiles(QVector<Archive::Entry*> entries);
 
+    /**
+     * Replaces the content of the file at @p path within the archive with @p file, updating only its row.
+     *
+     * @return The job, or nullptr if there is no such file or the archive can't replace a single entry.
+     */
+    Kerfuffle::ReplaceJob* replaceEntry(const QString &path, const QString &file, const Kerfuffle::CompressionOptions& options = Kerfuffle::CompressionOptions());
+
     /**
      * @param password The password to encrypt the archive with.
      * @param encryptHeader Whether to encrypt also the list of files.
@@ -188,6 +196,8 @@ private:
     QScopedPointer<Kerfuffle::Archive> m_archive;
     QScopedPointer<Archive::Entry> m_rootEntry;
     QHash<QString, QIcon> m_entryIcons;
+    // Paths of the directories which lost entries, checked by slotCleanupEmptyDirs().
+    QSet<QString> m_dirsToCleanup;
     QMap<int, QByteArray> m_propertiesMap;
 
     QString m_dbusPathName;
@@ -31,7 +31,9 @@
 #include <KRun>
 #include <KXMLGUIFactory>
 
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QMimeDatabase>
 #include <QProgressDialog>
 #include <QPushButton>
@@ -80,9 +82,18 @@ ArkViewer::~ArkViewer()
 }
 
 void ArkViewer::view(const QString& fileName)
+{
+    view(fileName, QMimeDatabase().mimeTypeForFile(fileName), nullptr);
+}
+
+void ArkViewer::view(const QString &fileName, const QByteArray &data)
+{
+    view(fileName, QMimeDatabase().mimeTypeForFileNameAndData(fileName, data), &data);
+}
+
+void ArkViewer::view(const QString &fileName, QMimeType mimeType, const QByteArray *data)
 {
     QMimeDatabase db;
-    QMimeType mimeType = db.mimeTypeForFile(fileName);
     qCDebug(ARK) << "viewing" << fileName << "with mime type:" << mimeType.name();
     KService::Ptr viewer = ArkViewer::getViewer(mimeType.name());
 
@@ -95,6 +106,11 @@ void ArkViewer::view(const QString& fileName)
 
         qCDebug(ARK) << "Using external viewer";
 
+        if (!writeFile(fileName, data)) {
+            KMessageBox::sorry(nullptr, i18n("Ark could not write the file to preview it."));
+            return;
+        }
+
         const QList<QUrl> fileUrlList = {QUrl::fromLocalFile(fileName)};
         // The last argument (tempFiles) set to true means that the temporary
         // file will be removed when the viewer application exits.
@@ -148,7 +164,7 @@ void ArkViewer::view(const QString& fileName)
         qCDebug(ARK) << "Opening internal viewer";
         ArkViewer *internalViewer = new ArkViewer();
         internalViewer->show();
-        if (internalViewer->viewInInternalViewer(fileName, mimeType)) {
+        if (internalViewer->viewInInternalViewer(fileName, mimeType, data)) {
             // The internal viewer is showing the file, and will
             // remove the temporary file in its destructor.  So there
             // is no more to do here.
@@ -167,7 +183,23 @@ void ArkViewer::view(const QString& fileName)
     QFile::remove(fileName);
 }
 
-bool ArkViewer::viewInInternalViewer(const QString& fileName, const QMimeType &mimeType)
+bool ArkViewer::writeFile(const QString &fileName, const QByteArray *data)
+{
+    if (!data) {
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(*data) != data->size()) {
+        qCWarning(ARK) << "Could not write" << fileName << ":" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool ArkViewer::viewInInternalViewer(const QString& fileName, const QMimeType &mimeType, const QByteArray *data)
 {
     setWindowFilePath(fileName);
 
@@ -199,7 +231,17 @@ bool ArkViewer::viewInInternalViewer(const QString& fileName, const QMimeType &m
     createGUI(m_part.data());
     setAutoSaveSettings(QStringLiteral("Viewer"), true);
 
-    m_part.data()->openUrl(QUrl::fromLocalFile(fileName));
+    // Parts implementing streams get the content read in memory directly, the others need a file.
+    if (data && m_part.data()->openStream(mimeType.name(), QUrl::fromLocalFile(fileName))) {
+        qCDebug(ARK) << "Streaming" << data->size() << "bytes to the part";
+        m_part.data()->writeStream(*data);
+        m_part.data()->closeStream();
+    } else {
+        if (!writeFile(fileName, data)) {
+            return false;
+        }
+        m_part.data()->openUrl(QUrl::fromLocalFile(fileName));
+    }
     m_part.data()->widget()->setFocus();
     m_fileName = fileName;
 
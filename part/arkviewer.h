@@ -40,11 +40,24 @@ public:
 
     static void view(const QString& fileName);
 
+    /**
+     * Previews @p data, the content of @p fileName read in memory.
+     * The file is only written if the viewer needs one, e.g. if its part can't be fed with a stream.
+     */
+    static void view(const QString &fileName, const QByteArray &data);
+
 private:
     explicit ArkViewer();
 
+    static void view(const QString &fileName, QMimeType mimeType, const QByteArray *data);
     static KService::Ptr getViewer(const QString& mimeType);
-    bool viewInInternalViewer(const QString& fileName, const QMimeType& mimeType);
+
+    /**
+     * Writes @p data to @p fileName, if the file is only in memory.
+     */
+    static bool writeFile(const QString &fileName, const QByteArray *data);
+
+    bool viewInInternalViewer(const QString& fileName, const QMimeType& mimeType, const QByteArray *data);
 
     QPointer<KParts::ReadOnlyPart> m_part;
     QString m_fileName;
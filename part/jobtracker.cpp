@@ -23,6 +23,9 @@
 #include "jobtracker.h"
 #include "ark_debug.h"
 
+#include <KIO/Global>
+#include <KLocalizedString>
+
 JobTrackerWidget::JobTrackerWidget(QWidget *parent)
         : QFrame(parent)
 {
@@ -84,6 +87,22 @@ void JobTracker::percent(KJob *job, unsigned long percent)
     m_ui->progressBar->setValue(static_cast<int>(percent));
 }
 
+void JobTracker::speed(KJob *job, unsigned long value)
+{
+    const qulonglong total = job->totalAmount(KJob::Bytes);
+    const qulonglong processed = job->processedAmount(KJob::Bytes);
+    if (total == 0 || value == 0) {
+        return;
+    }
+
+    const unsigned int remaining = KIO::calculateRemainingSeconds(total, processed, value);
+    m_ui->informationLabel->setText(i18nc("@info:status processed size, total size, speed, remaining time",
+                                          "%1 of %2 (%3/s, %4 remaining)",
+                                          KIO::convertSize(processed), KIO::convertSize(total),
+                                          KIO::convertSize(value), KIO::convertSeconds(remaining)));
+    m_ui->informationLabel->show();
+}
+
 void JobTracker::unregisterJob(KJob *job)
 {
     m_jobs.remove(job);
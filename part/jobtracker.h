@@ -56,6 +56,7 @@ protected Q_SLOTS:
     void warning(KJob *job, const QString &plain, const QString &rich) override;
 
     void percent(KJob *job, unsigned long  percent) override;
+    void speed(KJob *job, unsigned long value) override;
 
 private Q_SLOTS:
     void resetUi();
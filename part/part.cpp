@@ -37,10 +37,13 @@
 #include "generalsettingspage.h"
 #include "extractiondialog.h"
 #include "extractionsettingspage.h"
+#include "extractedentrycache.h"
 #include "jobs.h"
 #include "settings.h"
+#include "previewprefetcher.h"
 #include "previewsettingspage.h"
 #include "propertiesdialog.h"
+#include "tracer.h"
 #include "pluginsettingspage.h"
 #include "pluginmanager.h"
 
@@ -87,6 +90,9 @@ namespace Ark
 
 static quint32 s_instanceCounter = 1;
 
+// Bigger entries would delay for too long the previews asked by the user.
+static const qlonglong maxPrefetchedEntrySize = 32 * 1024 * 1024;
+
 Part::Part(QWidget *parentWidget, QObject *parent, const QVariantList& args)
         : KParts::ReadWritePart(parent),
           m_splitter(nullptr),
@@ -114,6 +120,7 @@ Part::Part(QWidget *parentWidget, QObject *parent, const QVariantList& args)
     m_splitter = new QSplitter(Qt::Horizontal, parentWidget);
     m_view = new ArchiveView;
     m_infoPanel = new InfoPanel(m_model);
+    m_prefetcher = new PreviewPrefetcher(this);
 
     // Add widgets for the comment field.
     m_commentView = new QPlainTextEdit();
@@ -229,6 +236,11 @@ Part::~Part()
 {
     qDeleteAll(m_tmpExtractDirList);
 
+    // Wait for the prefetching, so that it doesn't cache more entries once they are removed.
+    m_prefetcher->stop();
+    m_prefetcher->waitForJobs();
+    removeCachedEntries();
+
     // Only save splitterSizes if infopanel is visible,
     // because we don't want to store zero size for infopanel.
     if (m_showInfoPanelAction->isChecked()) {
@@ -256,6 +268,8 @@ void Part::slotCommentChanged()
 
 void Part::registerJob(KJob* job)
 {
+    m_prefetcher->stop(job);
+
     if (!m_jobTracker) {
         m_jobTracker = new JobTracker(widget());
         m_statusBarExtension->addStatusBarItem(m_jobTracker->widget(nullptr), 0, true);
@@ -613,6 +627,7 @@ void Part::loadArchive()
 
 void Part::resetArchive()
 {
+    removeCachedEntries();
     m_view->setDropsEnabled(false);
     m_model->reset();
     closeUrl();
@@ -728,6 +743,47 @@ void Part::slotQuickExtractFiles(QAction *triggeredAction)
 void Part::selectionChanged()
 {
     m_infoPanel->setIndexes(getSelectedIndexes());
+    prefetchPreviews();
+}
+
+void Part::prefetchPreviews()
+{
+    const QModelIndex current = m_view->selectionModel()->currentIndex();
+    if (!ArkSettings::prefetchPreviews() || m_busy || !m_model->archive() ||
+        !current.isValid() || m_view->selectionModel()->selectedRows().count() != 1) {
+        m_prefetcher->stop();
+        return;
+    }
+
+    const qlonglong maxPreviewSize = ArkSettings::previewFileSizeLimit() * 1024 * 1024;
+    const qlonglong maxSize = ArkSettings::limitPreviewFileSize() ? qMin(maxPreviewSize, maxPrefetchedEntrySize) : maxPrefetchedEntrySize;
+    ExtractedEntryCache::instance()->setMaxEntrySize(ArkSettings::limitPreviewFileSize() ? maxPreviewSize : 0);
+
+    // The selected entry and the ones after it, in the order of the view.
+    QVector<Archive::Entry*> entries;
+    const int rowCount = m_filterModel->rowCount(current.parent());
+    for (int row = current.row(); row < rowCount && entries.size() <= ArkSettings::prefetchedPreviewsCount(); ++row) {
+        Archive::Entry *entry = m_model->entryForIndex(m_filterModel->mapToSource(current.sibling(row, 0)));
+        if (!entry || entry->isDir() || !entry->property("link").toString().isEmpty() ||
+            entry->property("size").toLongLong() >= maxSize) {
+            continue;
+        }
+        entries << entry;
+    }
+
+    m_prefetcher->prefetch(m_model->archive(), entries);
+}
+
+void Part::removeCachedEntries()
+{
+    // The extractions stopped here are no longer cached once they are done, see TempExtractJob.
+    m_prefetcher->stop();
+
+    ExtractedEntryCache *cache = ExtractedEntryCache::instance();
+    if (cache && !m_cachedArchivePath.isEmpty()) {
+        cache->removeArchive(m_cachedArchivePath);
+    }
+    m_cachedArchivePath.clear();
 }
 
 QModelIndexList Part::getSelectedIndexes()
@@ -769,6 +825,12 @@ bool Part::openFile()
 
     resetGui();
 
+    // Reopening the same archive keeps its cached entries, which are checked against the archive anyway.
+    if (localFilePath() != m_cachedArchivePath) {
+        removeCachedEntries();
+        m_cachedArchivePath = localFilePath();
+    }
+
     if (!isLocalFileValid()) {
         return false;
     }
@@ -876,7 +938,9 @@ void Part::slotCompleted()
     }
 
     // Existing archive, setup the view for it.
+    TraceSpan sortSpan("sort", "part");
     m_view->sortByColumn(0, Qt::AscendingOrder);
+    sortSpan.end();
     m_view->expandIfSingleFolder();
     m_view->header()->resizeSections(QHeaderView::ResizeToContents);
     m_view->setDropsEnabled(isArchiveWritable());
@@ -942,6 +1006,7 @@ void Part::setReadyGui()
 
     m_view->setEnabled(true);
     updateActions();
+    prefetchPreviews();
 }
 
 void Part::setBusyGui()
@@ -989,6 +1054,9 @@ void Part::slotOpenEntry(int mode)
         return;
     }
 
+    // Entries too big to be previewed are not worth caching either.
+    ExtractedEntryCache::instance()->setMaxEntrySize(ArkSettings::limitPreviewFileSize() ? maxPreviewSize : 0);
+
     // Extract the entry.
     if (!entry->fullPath().isEmpty()) {
         qCDebug(ARK) << "Opening with mode" << mode;
@@ -1051,7 +1119,11 @@ void Part::slotPreviewExtractedEntry(KJob *job)
         Q_ASSERT(previewJob);
 
         m_tmpExtractDirList << previewJob->tempDir();
-        ArkViewer::view(previewJob->validatedFilePath());
+        if (previewJob->isInMemory()) {
+            ArkViewer::view(previewJob->validatedFilePath(), previewJob->data());
+        } else {
+            ArkViewer::view(previewJob->validatedFilePath());
+        }
 
     } else if (job->error() != KJob::KilledJobError) {
         KMessageBox::error(widget(), job->errorString());
@@ -1088,10 +1160,18 @@ void Part::slotWatchedFileModified(const QString& file)
                                xi18n("The file <filename>%1</filename> was modified. Do you want to update the archive?",
                                      prettyFilename),
                                i18nc("@title:window", "File Modified")) == KMessageBox::Yes) {
-        QStringList list = QStringList() << file;
-
         qCDebug(ARK) << "Updating file" << file << "with path" << relPath;
-        slotAddFiles(list, nullptr, relPath);
+
+        // Replace only the modified entry if the plugin supports it, instead of adding the file again.
+        ReplaceJob *job = m_model->replaceEntry(prettyFilename, file, m_compressionOptions);
+        if (job) {
+            connect(job, &KJob::result, this, &Part::slotReplaceEntryDone);
+            registerJob(job);
+            job->start();
+        } else {
+            QStringList list = QStringList() << file;
+            slotAddFiles(list, nullptr, relPath);
+        }
     }
     // This is needed because some apps, such as Kate, delete and recreate
     // files when saving.
@@ -1576,6 +1656,13 @@ void Part::slotAddFilesDone(KJob* job)
     m_model->filesToCopy.clear();
 }
 
+void Part::slotReplaceEntryDone(KJob *job)
+{
+    if (job->error() && job->error() != KJob::KilledJobError) {
+        KMessageBox::error(widget(), job->errorString());
+    }
+}
+
 void Part::slotPasteFilesDone(KJob *job)
 {
     if (job->error() && job->error() != KJob::KilledJobError) {
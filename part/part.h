@@ -38,6 +38,7 @@ class ArchiveModel;
 class ArchiveSortFilterModel;
 class ArchiveView;
 class InfoPanel;
+class PreviewPrefetcher;
 
 class KAbstractWidgetJobTracker;
 class KJob;
@@ -138,6 +139,7 @@ private Q_SLOTS:
     void slotRenameFile(const QString &name);
     void slotPasteFiles();
     void slotAddFilesDone(KJob*);
+    void slotReplaceEntryDone(KJob*);
     void slotPasteFilesDone(KJob*);
     void slotTestingDone(KJob*);
     void slotDeleteFiles();
@@ -189,6 +191,18 @@ private:
     QVector<Kerfuffle::Archive::Entry*> filesAndRootNodesForIndexes(const QModelIndexList& list) const;
     QModelIndexList addChildren(const QModelIndexList &list) const;
     void registerJob(KJob *job);
+
+    /**
+     * Extracts in the background the selected entry and the ones following it in the view,
+     * if enabled in the settings.
+     */
+    void prefetchPreviews();
+
+    /**
+     * Stops the prefetching and drops the cached entries of the archive opened last,
+     * which are not needed once another archive is opened.
+     */
+    void removeCachedEntries();
     QModelIndexList getSelectedIndexes();
     void readCompressionOptions();
 
@@ -212,6 +226,8 @@ private:
     QAction *m_searchAction;
     KToggleAction *m_showInfoPanelAction;
     InfoPanel            *m_infoPanel;
+    PreviewPrefetcher    *m_prefetcher;
+    QString               m_cachedArchivePath;
     QSplitter            *m_splitter;
     QList<QTemporaryDir*>      m_tmpExtractDirList;
     bool                  m_busy;
@@ -0,0 +1,170 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "previewprefetcher.h"
+#include "ark_debug.h"
+#include "extractedentrycache.h"
+#include "jobs.h"
+#include "jobthreadpool.h"
+
+#include <QTemporaryDir>
+
+using namespace Kerfuffle;
+
+PreviewPrefetcher::PreviewPrefetcher(QObject *parent)
+    : QObject(parent)
+{
+}
+
+PreviewPrefetcher::~PreviewPrefetcher()
+{
+    stop();
+    waitForJobs();
+}
+
+void PreviewPrefetcher::prefetch(Archive *archive, const QVector<Archive::Entry*> &entries)
+{
+    if (archive != m_archive) {
+        stop();
+        m_archive = archive;
+    }
+
+    m_pendingEntries = entries;
+
+    if (m_job) {
+        const int index = m_pendingEntries.indexOf(m_job->entry());
+        if (index < 0) {
+            interruptJob();
+        } else {
+            m_pendingEntries.remove(index);
+        }
+    }
+
+    startNext();
+}
+
+void PreviewPrefetcher::stop(KJob *job)
+{
+    m_pendingEntries.clear();
+
+    if (!m_job) {
+        return;
+    }
+
+    auto previewJob = qobject_cast<TempExtractJob*>(job);
+    if (previewJob && previewJob->entry() == m_job->entry() && m_archive && m_archive->canQueueReadJobs()) {
+        return;
+    }
+
+    interruptJob();
+}
+
+void PreviewPrefetcher::waitForJobs()
+{
+    for (PreviewJob *job : qAsConst(m_jobs)) {
+        disconnect(job, nullptr, this, nullptr);
+        if (JobThreadPool *pool = JobThreadPool::instance()) {
+            pool->waitForJob(job);
+        }
+        delete job->tempDir();
+        job->deleteLater();
+    }
+    m_jobs.clear();
+}
+
+void PreviewPrefetcher::slotJobFinished(KJob *job)
+{
+    auto previewJob = qobject_cast<PreviewJob*>(job);
+    Q_ASSERT(previewJob);
+
+    // The extracted file has been copied to the cache, if it could be.
+    release(previewJob);
+
+    startNext();
+}
+
+void PreviewPrefetcher::slotJobInterrupted(Job *job)
+{
+    release(static_cast<PreviewJob*>(job));
+}
+
+void PreviewPrefetcher::interruptJob()
+{
+    qCDebug(ARK) << "Cancelling the prefetching of" << m_job->entry()->fullPath();
+
+    // A user job could be waiting for the prefetching, don't block the GUI until it stops.
+    PreviewJob *job = m_job;
+    m_job = nullptr;
+    disconnect(job, &KJob::result, this, &PreviewPrefetcher::slotJobFinished);
+    job->interrupt();
+}
+
+void PreviewPrefetcher::release(PreviewJob *job)
+{
+    // The job could have finished right before being interrupted, in which case both its
+    // result and interrupted() are received.
+    if (!m_jobs.removeOne(job)) {
+        return;
+    }
+
+    if (job == m_job) {
+        m_job = nullptr;
+    }
+
+    // The job may still be returning from the worker thread after emitting its result.
+    if (JobThreadPool *pool = JobThreadPool::instance()) {
+        pool->waitForJob(job);
+    }
+    delete job->tempDir();
+    job->deleteLater();
+}
+
+void PreviewPrefetcher::startNext()
+{
+    if (m_job || !m_archive || !m_archive->isValid()) {
+        return;
+    }
+
+    // Entries of encrypted archives are not cached.
+    if (m_archive->encryptionType() != Archive::Unencrypted) {
+        m_pendingEntries.clear();
+        return;
+    }
+
+    while (!m_pendingEntries.isEmpty()) {
+        Archive::Entry *entry = m_pendingEntries.takeFirst();
+        if (ExtractedEntryCache::instance()->contains(m_archive->fileName(), entry->fullPath())) {
+            continue;
+        }
+
+        qCDebug(ARK) << "Prefetching" << entry->fullPath();
+        m_job = m_archive->preview(entry);
+        // The point is to fill the cache, which only holds files.
+        m_job->setMaxInMemorySize(0);
+        // Interrupted jobs are deleted once they are done, see release().
+        m_job->setAutoDelete(false);
+        m_jobs.append(m_job);
+        connect(m_job.data(), &KJob::result, this, &PreviewPrefetcher::slotJobFinished);
+        connect(m_job.data(), &Job::interrupted, this, &PreviewPrefetcher::slotJobInterrupted);
+        m_job->start();
+        return;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef PREVIEWPREFETCHER_H
+#define PREVIEWPREFETCHER_H
+
+#include "archive_kerfuffle.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+class KJob;
+
+namespace Kerfuffle
+{
+class Job;
+class PreviewJob;
+}
+
+/**
+ * Extracts in the background the entries the user is likely to preview next,
+ * so that their PreviewJob only has to copy them from the ExtractedEntryCache.
+ *
+ * The entries are extracted one at a time and the prefetching yields to the jobs
+ * started by the user, see stop(). Cancelled extractions are not waited for: their
+ * temporary directory is deleted once they are done.
+ */
+class PreviewPrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PreviewPrefetcher(QObject *parent = nullptr);
+    ~PreviewPrefetcher() override;
+
+    /**
+     * Starts extracting @p entries of @p archive, in order, skipping the ones already cached.
+     * The entries of the previous call are forgotten: the extraction in progress is cancelled
+     * unless its entry is among @p entries.
+     */
+    void prefetch(Kerfuffle::Archive *archive, const QVector<Kerfuffle::Archive::Entry*> &entries);
+
+    /**
+     * Cancels the prefetching before the user starts @p job.
+     * If @p job previews the entry being prefetched and can be queued after it, the
+     * extraction in progress is kept: @p job then gets the entry from the cache.
+     */
+    void stop(KJob *job = nullptr);
+
+    /**
+     * Waits until the extractions stopped by stop() are done and deletes them.
+     * This blocks, so it is only meant to be used when closing the archive.
+     */
+    void waitForJobs();
+
+private Q_SLOTS:
+    void slotJobFinished(KJob *job);
+    void slotJobInterrupted(Kerfuffle::Job *job);
+
+private:
+    void startNext();
+
+    /**
+     * Stops the prefetching of the current entry, without waiting for the extraction in progress.
+     */
+    void interruptJob();
+
+    /**
+     * Deletes @p job and its temporary directory, once the job is done.
+     */
+    void release(Kerfuffle::PreviewJob *job);
+
+    QPointer<Kerfuffle::Archive> m_archive;
+    QVector<Kerfuffle::Archive::Entry*> m_pendingEntries;
+    QPointer<Kerfuffle::PreviewJob> m_job;
+
+    /**
+     * The jobs started and not released yet, including the interrupted ones.
+     */
+    QVector<Kerfuffle::PreviewJob*> m_jobs;
+};
+
+#endif // PREVIEWPREFETCHER_H
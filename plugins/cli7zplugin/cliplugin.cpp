@@ -24,6 +24,7 @@
 #include "cliplugin.h"
 #include "ark_debug.h"
 #include "cliinterface.h"
+#include "timestamps.h"
 
 #include <QDateTime>
 #include <QDir>
@@ -42,9 +43,13 @@ CliPlugin::CliPlugin(QObject *parent, const QVariantList & args)
         , m_parseState(ParseStateTitle)
         , m_linesComment(0)
         , m_isFirstInformationEntry(true)
+        , m_isSolid(false)
+        , m_rxVersionLine(QStringLiteral("^p7zip Version ([\\d\\.]+) .*$"))
 {
     qCDebug(ARK) << "Loaded cli_7z plugin";
 
+    m_rxVersionLine.optimize();
+
     setupCliProperties();
 }
 
@@ -57,24 +62,31 @@ void CliPlugin::resetParsing()
     m_parseState = ParseStateTitle;
     m_comment.clear();
     m_numberOfVolumes = 0;
+    m_isSolid = false;
 }
 
 void CliPlugin::setupCliProperties()
 {
     qCDebug(ARK) << "Setting up parameters...";
 
-    m_cliProps->setProperty("captureProgress", false);
+    m_cliProps->setProperty("captureProgress", true);
 
     m_cliProps->setProperty("addProgram", QStringLiteral("7z"));
     m_cliProps->setProperty("addSwitch", QStringList{QStringLiteral("a"),
-                                                 QStringLiteral("-l")});
+                                                 QStringLiteral("-l"),
+                                                 QStringLiteral("-bsp1"),
+                                                 QStringLiteral("-bb1")});
 
     m_cliProps->setProperty("deleteProgram", QStringLiteral("7z"));
     m_cliProps->setProperty("deleteSwitch", QStringLiteral("d"));
 
     m_cliProps->setProperty("extractProgram", QStringLiteral("7z"));
-    m_cliProps->setProperty("extractSwitch", QStringList{QStringLiteral("x")});
-    m_cliProps->setProperty("extractSwitchNoPreserve", QStringList{QStringLiteral("e")});
+    m_cliProps->setProperty("extractSwitch", QStringList{QStringLiteral("x"),
+                                                     QStringLiteral("-bsp1"),
+                                                     QStringLiteral("-bb1")});
+    m_cliProps->setProperty("extractSwitchNoPreserve", QStringList{QStringLiteral("e"),
+                                                               QStringLiteral("-bsp1"),
+                                                               QStringLiteral("-bb1")});
 
     m_cliProps->setProperty("listProgram", QStringLiteral("7z"));
     m_cliProps->setProperty("listSwitch", QStringList{QStringLiteral("l"),
@@ -127,12 +139,11 @@ bool CliPlugin::readListLine(const QString& line)
         return false;
     }
 
-    const QRegularExpression rxVersionLine(QStringLiteral("^p7zip Version ([\\d\\.]+) .*$"));
     QRegularExpressionMatch matchVersion;
 
     switch (m_parseState) {
     case ParseStateTitle:
-        matchVersion = rxVersionLine.match(line);
+        matchVersion = m_rxVersionLine.match(line);
         if (matchVersion.hasMatch()) {
             m_parseState = ParseStateHeader;
             const QString p7zipVersion = matchVersion.captured(1);
@@ -185,6 +196,9 @@ bool CliPlugin::readListLine(const QString& line)
         } else if (line.startsWith(QLatin1String("Volumes = "))) {
             m_numberOfVolumes = line.section(QLatin1Char('='), 1).trimmed().toInt();
 
+        } else if (line == QLatin1String("Solid = +")) {
+            m_isSolid = true;
+
         } else if (line.startsWith(QLatin1String("Method = "))) {
             QStringList methods = line.section(QLatin1Char('='), 1).trimmed().split(QLatin1Char(' '), QString::SkipEmptyParts);
             handleMethods(methods);
@@ -231,8 +245,7 @@ bool CliPlugin::readListLine(const QString& line)
             }
 
         } else if (line.startsWith(QLatin1String("Modified = "))) {
-            m_currentArchiveEntry->setProperty("timestamp", QDateTime::fromString(line.mid(11).trimmed(),
-                                                                                  QStringLiteral("yyyy-MM-dd hh:mm:ss")));
+            m_currentArchiveEntry->setProperty("timestamp", parseTimestamp(line.midRef(11).trimmed()));
 
         } else if (line.startsWith(QLatin1String("Folder = "))) {
             const QString isDirectoryStr = line.mid(9).trimmed();
@@ -321,15 +334,15 @@ void CliPlugin::handleMethods(const QStringList &methods)
 {
     for (const QString &method : methods) {
 
-        QRegularExpression rxEncMethod(QStringLiteral("^(7zAES|AES-128|AES-192|AES-256|ZipCrypto)$"));
-        if (rxEncMethod.match(method).hasMatch()) {
-            QRegularExpression rxAESMethods(QStringLiteral("^(AES-128|AES-192|AES-256)$"));
-            if (rxAESMethods.match(method).hasMatch()) {
-                // Remove dash for AES methods.
-                emit encryptionMethodFound(QString(method).remove(QLatin1Char('-')));
-            } else {
-                emit encryptionMethodFound(method);
-            }
+        if (method == QLatin1String("AES-128") ||
+            method == QLatin1String("AES-192") ||
+            method == QLatin1String("AES-256")) {
+            // Remove dash for AES methods.
+            emit encryptionMethodFound(QString(method).remove(QLatin1Char('-')));
+            continue;
+        }
+        if (method == QLatin1String("7zAES") || method == QLatin1String("ZipCrypto")) {
+            emit encryptionMethodFound(method);
             continue;
         }
 
@@ -380,4 +393,37 @@ bool CliPlugin::isFileExistsFileName(const QString &line)
             line.startsWith(QLatin1String("  Path:     ./")));
 }
 
+QString CliPlugin::stripErasedText(const QString &line) const
+{
+    // With -bsp1, messages and prompts may follow the progress that 7z has just erased.
+    return lastWrittenText(line).toString();
+}
+
+bool CliPlugin::isEntryProcessedMsg(const QString &line) const
+{
+    // With -bb1, 7z prints "- name" for each extracted entry and "+ name" for each added one.
+    const QStringRef text = lastWrittenText(line);
+    return (text.startsWith(QLatin1String("- ")) || text.startsWith(QLatin1String("+ ")));
+}
+
+bool CliPlugin::isSolid() const
+{
+    return m_isSolid;
+}
+
+bool CliPlugin::isIgnoredLine(const QByteArray &line) const
+{
+    if (m_operationMode != List || m_parseState != ParseStateEntryInformation) {
+        return false;
+    }
+
+    // Entry properties not used by readListLine(), mostly found when listing zip archives.
+    return (line.startsWith("Created = ") ||
+            line.startsWith("Accessed = ") ||
+            line.startsWith("Characteristics = ") ||
+            line.startsWith("Host OS = ") ||
+            line.startsWith("Volume Index = ") ||
+            line.startsWith("Offset = "));
+}
+
 #include "cliplugin.moc"
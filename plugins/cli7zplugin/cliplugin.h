@@ -45,6 +45,10 @@ public:
     bool isDiskFullMsg(const QString &line) override;
     bool isFileExistsMsg(const QString &line) override;
     bool isFileExistsFileName(const QString &line) override;
+    QString stripErasedText(const QString &line) const override;
+    bool isEntryProcessedMsg(const QString &line) const override;
+    bool isSolid() const override;
+    bool isIgnoredLine(const QByteArray &line) const override;
 
 private:
     enum ArchiveType {
@@ -72,6 +76,8 @@ private:
     int m_linesComment;
     Kerfuffle::Archive::Entry *m_currentArchiveEntry;
     bool m_isFirstInformationEntry;
+    bool m_isSolid;
+    const QRegularExpression m_rxVersionLine;
 };
 
 #endif // CLIPLUGIN_H
@@ -25,6 +25,7 @@
 #include "cliplugin.h"
 #include "ark_debug.h"
 #include "archiveentry.h"
+#include "timestamps.h"
 
 #include <QDateTime>
 
@@ -45,9 +46,12 @@ CliPlugin::CliPlugin(QObject *parent, const QVariantList& args)
         , m_isLocked(false)
         , m_remainingIgnoreLines(1) //The first line of UNRAR output is empty.
         , m_linesComment(0)
+        , m_rxVersionLine(QStringLiteral("^UNRAR (\\d+\\.\\d+)( beta \\d)? .*$"))
 {
     qCDebug(ARK) << "Loaded cli_rar plugin";
 
+    m_rxVersionLine.optimize();
+
     // Empty lines are needed for parsing output of unrar.
     setListEmptyLines(true);
 
@@ -135,8 +139,7 @@ bool CliPlugin::readListLine(const QString &line)
     // Parse the title line, which contains the version of unrar.
     if (m_parseState == ParseStateTitle) {
 
-        QRegularExpression rxVersionLine(QStringLiteral("^UNRAR (\\d+\\.\\d+)( beta \\d)? .*$"));
-        QRegularExpressionMatch matchVersion = rxVersionLine.match(line);
+        QRegularExpressionMatch matchVersion = m_rxVersionLine.match(line);
 
         if (matchVersion.hasMatch()) {
             m_parseState = ParseStateComment;
@@ -267,7 +270,8 @@ void CliPlugin::handleUnrar5Entry()
     compressionRatio.chop(1); // Remove the '%'
     e->setProperty("ratio", compressionRatio);
 
-    e->setProperty("timestamp", QDateTime::fromString(m_unrar5Details.value(QStringLiteral("mtime")), QStringLiteral("yyyy-MM-dd HH:mm:ss,zzz")));
+    const QString mtime = m_unrar5Details.value(QStringLiteral("mtime"));
+    e->setProperty("timestamp", parseTimestamp(QStringRef(&mtime)));
 
     bool isDirectory = (m_unrar5Details.value(QStringLiteral("type")) == QLatin1String("Directory"));
     e->setProperty("isDirectory", isDirectory);
@@ -308,6 +312,18 @@ void CliPlugin::handleUnrar5Entry()
     emit entry(e);
 }
 
+// Matches the line ending the comment field, i.e. "^(Solid archive|Archive|Volume) .+$".
+// FIXME: Comment itself could also contain the Archive path string here.
+static bool isCommentEndLine(const QString &line)
+{
+    for (const QLatin1String &prefix : {QLatin1String("Solid archive "), QLatin1String("Archive "), QLatin1String("Volume ")}) {
+        if (line.size() > prefix.size() && line.startsWith(prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool CliPlugin::handleUnrar4Line(const QString &line)
 {
     if (line.startsWith(QLatin1String("Cannot find volume "))) {
@@ -315,15 +331,7 @@ bool CliPlugin::handleUnrar4Line(const QString &line)
         return false;
     }
 
-    // RegExp matching end of comment field.
-    // FIXME: Comment itself could also contain the Archive path string here.
-    QRegularExpression rxCommentEnd(QStringLiteral("^(Solid archive|Archive|Volume) .+$"));
-
-    // Three types of subHeaders can be displayed for unrar 3 and 4.
-    // STM has 4 lines, RR has 3, and CMT has lines corresponding to
-    // length of comment field +3. We ignore the subheaders.
-    QRegularExpression rxSubHeader(QStringLiteral("^Data header type: (CMT|STM|RR)$"));
-    QRegularExpressionMatch matchSubHeader;
+    static const QLatin1String subHeaderPrefix("Data header type: ");
 
     switch (m_parseState) {
 
@@ -348,7 +356,7 @@ bool CliPlugin::handleUnrar4Line(const QString &line)
         // archive, so assume RAR4.
         emit compressionMethodFound(QStringLiteral("RAR4"));
 
-        if (rxCommentEnd.match(line).hasMatch()) {
+        if (isCommentEndLine(line)) {
 
             if (line.startsWith(QLatin1String("Volume "))) {
                 m_numberOfVolumes++;
@@ -397,18 +405,24 @@ bool CliPlugin::handleUnrar4Line(const QString &line)
             return true;
         }
 
-        matchSubHeader = rxSubHeader.match(line);
-
-        if (matchSubHeader.hasMatch()) {
-            qCDebug(ARK) << "SubHeader of type" << matchSubHeader.captured(1) << "found";
-            if (matchSubHeader.captured(1) == QLatin1String("STM")) {
-                ignoreLines(4, ParseStateEntryFileName);
-            } else if (matchSubHeader.captured(1) == QLatin1String("CMT")) {
-                ignoreLines(m_linesComment + 3, ParseStateEntryFileName);
-            } else if (matchSubHeader.captured(1) == QLatin1String("RR")) {
-                ignoreLines(3, ParseStateEntryFileName);
+        // Three types of subHeaders can be displayed for unrar 3 and 4.
+        // STM has 4 lines, RR has 3, and CMT has lines corresponding to
+        // length of comment field +3. We ignore the subheaders.
+        if (line.startsWith(subHeaderPrefix)) {
+            const QStringRef subHeaderType = line.midRef(subHeaderPrefix.size());
+            int subHeaderLines = -1;
+            if (subHeaderType == QLatin1String("STM")) {
+                subHeaderLines = 4;
+            } else if (subHeaderType == QLatin1String("CMT")) {
+                subHeaderLines = m_linesComment + 3;
+            } else if (subHeaderType == QLatin1String("RR")) {
+                subHeaderLines = 3;
+            }
+            if (subHeaderLines >= 0) {
+                qCDebug(ARK) << "SubHeader of type" << subHeaderType << "found";
+                ignoreLines(subHeaderLines, ParseStateEntryFileName);
+                return true;
             }
-            return true;
         }
 
         // The entries list ends with a horizontal line, followed by a
@@ -504,14 +518,8 @@ void CliPlugin::handleUnrar4Entry()
 {
     Archive::Entry *e = new Archive::Entry(this);
 
-    QDateTime ts = QDateTime::fromString(QString(m_unrar4Details.at(4) + QLatin1Char(' ') + m_unrar4Details.at(5)),
-                                         QStringLiteral("dd-MM-yy hh:mm"));
-    // Unrar 3 & 4 output dates with a 2-digit year but QDateTime takes it as
-    // 19??. Let's take 1950 as cut-off; similar to KDateTime.
-    if (ts.date().year() < 1950) {
-        ts = ts.addYears(100);
-    }
-    e->setProperty("timestamp", ts);
+    // Unrar 3 & 4 output dates with a 2-digit year, 1950 is taken as cut-off.
+    e->setProperty("timestamp", parseShortTimestamp(QStringRef(&m_unrar4Details.at(4)), QStringRef(&m_unrar4Details.at(5))));
 
     bool isDirectory = ((m_unrar4Details.at(6).at(0) == QLatin1Char('d')) ||
                         (m_unrar4Details.at(6).at(1) == QLatin1Char('D')));
@@ -558,8 +566,7 @@ void CliPlugin::handleUnrar4Entry()
 
 bool CliPlugin::readExtractLine(const QString &line)
 {
-    const QRegularExpression rxCRC(QStringLiteral("CRC failed"));
-    if (rxCRC.match(line).hasMatch()) {
+    if (line.contains(QLatin1String("CRC failed"))) {
         emit error(i18n("One or more wrong checksums"));
         return false;
     }
@@ -572,11 +579,6 @@ bool CliPlugin::readExtractLine(const QString &line)
     return true;
 }
 
-bool CliPlugin::hasBatchExtractionProgress() const
-{
-    return true;
-}
-
 void CliPlugin::ignoreLines(int lines, ParseState nextState)
 {
     m_remainingIgnoreLines = lines;
@@ -621,4 +623,9 @@ bool CliPlugin::isLocked() const
     return m_isLocked;
 }
 
+bool CliPlugin::isSolid() const
+{
+    return m_isSolid;
+}
+
 #include "cliplugin.moc"
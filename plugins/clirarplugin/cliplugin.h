@@ -38,7 +38,6 @@ public:
     void resetParsing() override;
     bool readListLine(const QString &line) override;
     bool readExtractLine(const QString &line) override;
-    bool hasBatchExtractionProgress() const override;
     bool isPasswordPrompt(const QString &line) override;
     bool isWrongPasswordMsg(const QString &line) override;
     bool isCorruptArchiveMsg(const QString &line) override;
@@ -46,6 +45,7 @@ public:
     bool isFileExistsMsg(const QString &line) override;
     bool isFileExistsFileName(const QString &line) override;
     bool isLocked() const override;
+    bool isSolid() const override;
 
 private:
 
@@ -78,6 +78,8 @@ private:
 
     int m_remainingIgnoreLines;
     int m_linesComment;
+
+    const QRegularExpression m_rxVersionLine;
 };
 
 #endif // CLIPLUGIN_H
@@ -25,7 +25,7 @@
 #include "queries.h"
 
 #include <QJsonArray>
-#include <QJsonParseError>
+#include <QJsonObject>
 
 #include <KLocalizedString>
 #include <KPluginFactory>
@@ -46,14 +46,6 @@ CliPlugin::~CliPlugin()
 {
 }
 
-bool CliPlugin::list()
-{
-    resetParsing();
-    m_operationMode = List;
-
-    return runProcess(m_cliProps->property("listProgram").toString(), m_cliProps->listArgs(filename(), password()));
-}
-
 bool CliPlugin::extractFiles(const QVector<Archive::Entry*> &files, const QString &destinationDirectory, const ExtractionOptions &options)
 {
     ExtractionOptions newOptions = options;
@@ -62,18 +54,23 @@ bool CliPlugin::extractFiles(const QVector<Archive::Entry*> &files, const QStrin
     // 1. creates an empty file upon entering a wrong password.
     // 2. detects that the stdout has been redirected and blocks the stdin.
     //    This prevents Ark from executing unar's overwrite queries.
-    // To prevent both, we always extract to a temporary directory
-    // and then we move the files to the intended destination.
-
-    qCDebug(ARK) << "Enabling extraction to temporary directory.";
-    newOptions.setAlwaysUseTempDir(true);
+    // To prevent both, we extract to a temporary directory and then we move
+    // the files to the intended destination, unless the archive is not encrypted
+    // and the listing shows that no existing file would be overwritten.
+    const bool encrypted = m_hasEncryptedEntries || options.encryptedArchiveHint();
+    if (encrypted || hasExtractionConflicts(files, destinationDirectory, options.preservePaths())) {
+        qCDebug(ARK) << "Enabling extraction to temporary directory.";
+        newOptions.setAlwaysUseTempDir(true);
+    }
 
     return CliInterface::extractFiles(files, destinationDirectory, newOptions);
 }
 
 void CliPlugin::resetParsing()
 {
-    m_jsonOutput.clear();
+    m_jsonReader.clear();
+    m_formatName.clear();
+    m_hasEncryptedEntries = false;
     m_numberOfVolumes = 0;
 }
 
@@ -82,8 +79,11 @@ void CliPlugin::setupCliProperties()
     m_cliProps->setProperty("captureProgress", false);
 
     m_cliProps->setProperty("extractProgram", QStringLiteral("unar"));
-    m_cliProps->setProperty("extractSwitch", QStringList{QStringLiteral("-D")});
-    m_cliProps->setProperty("extractSwitchNoPreserve", QStringList{QStringLiteral("-D")});
+    // Files created after the listing must never make unar prompt, since it would block.
+    m_cliProps->setProperty("extractSwitch", QStringList{QStringLiteral("-D"),
+                                                         QStringLiteral("-s")});
+    m_cliProps->setProperty("extractSwitchNoPreserve", QStringList{QStringLiteral("-D"),
+                                                                   QStringLiteral("-s")});
 
     m_cliProps->setProperty("listProgram", QStringLiteral("lsar"));
     m_cliProps->setProperty("listSwitch", QStringList{QStringLiteral("-json")});
@@ -92,11 +92,17 @@ void CliPlugin::setupCliProperties()
                                                       QStringLiteral("$Password")});
 }
 
-bool CliPlugin::readListLine(const QString &line)
+// Matches "Failed! \((.+)\)$", which unar prints when it cannot process an entry.
+static bool isFailedLine(const QString &line)
 {
-    const QRegularExpression rx(QStringLiteral("Failed! \\((.+)\\)$"));
+    static const QLatin1String failedPrefix("Failed! (");
+    const int index = line.indexOf(failedPrefix);
+    return index >= 0 && line.size() - index > failedPrefix.size() + 1 && line.endsWith(QLatin1Char(')'));
+}
 
-    if (rx.match(line).hasMatch()) {
+bool CliPlugin::readListLine(const QString &line)
+{
+    if (isFailedLine(line)) {
         emit error(i18n("Listing the archive failed."));
         return false;
     }
@@ -106,9 +112,7 @@ bool CliPlugin::readListLine(const QString &line)
 
 bool CliPlugin::readExtractLine(const QString &line)
 {
-    const QRegularExpression rx(QStringLiteral("Failed! \\((.+)\\)$"));
-
-    if (rx.match(line).hasMatch()) {
+    if (isFailedLine(line)) {
         emit error(i18n("Extraction failed."));
         return false;
     }
@@ -116,38 +120,36 @@ bool CliPlugin::readExtractLine(const QString &line)
     return true;
 }
 
+bool CliPlugin::isExtractionFailedExitCode(int exitCode) const
+{
+    // unar exits with code 1 if extraction fails.
+    // This happens at least with wrong passwords or not enough space in the destination folder.
+    return exitCode == 1;
+}
+
+bool CliPlugin::isEntryProcessedMsg(const QString &line) const
+{
+    // unar prints "  name  (size B)... OK." for each extracted entry.
+    return line.endsWith(QLatin1String("... OK."));
+}
+
 void CliPlugin::setJsonOutput(const QString &jsonOutput)
 {
-    m_jsonOutput = jsonOutput;
+    m_jsonReader.addData(jsonOutput.toUtf8());
     readJsonOutput();
 }
 
 void CliPlugin::readStdout(bool handleAll)
 {
-    if (!handleAll) {
-        CliInterface::readStdout(false);
-        return;
-    }
+    CliInterface::readStdout(handleAll);
 
-    // We are ready to read the json output.
-    readJsonOutput();
+    if (handleAll && m_operationMode == List && !m_jsonReader.atEnd() && !m_jsonReader.hasError()) {
+        qCDebug(ARK) << "The json output is incomplete";
+    }
 }
 
 bool CliPlugin::handleLine(const QString& line)
 {
-    // Collect the json output line by line.
-    if (m_operationMode == List) {
-        // #372210: lsar can generate huge JSONs for big archives.
-        // We can at least catch a bad_alloc here in order to not crash.
-        try {
-            m_jsonOutput += line + QLatin1Char('\n');
-        } catch (const std::bad_alloc&) {
-            m_jsonOutput.clear();
-            emit error(i18n("Not enough memory for loading the archive."));
-            return false;
-        }
-    }
-
     if (m_operationMode == List) {
         // This can only be an header-encrypted archive.
         if (isPasswordPrompt(line)) {
@@ -166,6 +168,14 @@ bool CliPlugin::handleLine(const QString& line)
 
             setPassword(query.password());
             CliPlugin::list();
+            return true;
+        }
+
+        // #372210: lsar can generate huge JSONs for big archives, so the entries
+        // are read as soon as they are printed instead of collecting the whole output.
+        if (!m_jsonReader.hasError()) {
+            m_jsonReader.addData(line.toUtf8() + '\n');
+            readJsonOutput();
         }
     }
 
@@ -184,12 +194,6 @@ void CliPlugin::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
         m_process = nullptr;
     }
 
-    // #193908 - #222392
-    // Don't emit finished() if the job was killed quietly.
-    if (m_abortingOperation) {
-        return;
-    }
-
     if (!password().isEmpty()) {
 
         // lsar -json exits with error code 1 if the archive is header-encrypted and the password is wrong.
@@ -214,61 +218,72 @@ void CliPlugin::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
 
 void CliPlugin::readJsonOutput()
 {
-    QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(m_jsonOutput.toUtf8(), &error);
-
-    if (error.error != QJsonParseError::NoError) {
-        qCDebug(ARK) << "Could not parse json output:" << error.errorString();
-        return;
-    }
-
-    const QJsonObject json = jsonDoc.object();
-
-    const QJsonObject properties = json.value(QStringLiteral("lsarProperties")).toObject();
-    const QJsonArray volumes = properties.value(QStringLiteral("XADVolumes")).toArray();
-    if (volumes.count() > 1) {
-        qCDebug(ARK) << "Detected multivolume archive";
-        m_numberOfVolumes = volumes.count();
-        setMultiVolume(true);
+    while (m_jsonReader.readNext()) {
+        const QString key = m_jsonReader.key();
+
+        if (key == QLatin1String("lsarContents")) {
+            handleJsonEntry(m_jsonReader.value().toObject());
+        } else if (key == QLatin1String("lsarFormatName")) {
+            m_formatName = m_jsonReader.value().toString();
+            if (m_formatName == QLatin1String("RAR")) {
+                emit compressionMethodFound(QStringLiteral("RAR4"));
+            } else if (m_formatName == QLatin1String("RAR 5")) {
+                emit compressionMethodFound(QStringLiteral("RAR5"));
+            }
+            if (m_hasEncryptedEntries) {
+                emitEncryptionMethod();
+            }
+        } else if (key == QLatin1String("lsarProperties")) {
+            const QJsonObject properties = m_jsonReader.value().toObject();
+            const QJsonArray volumes = properties.value(QStringLiteral("XADVolumes")).toArray();
+            if (volumes.count() > 1) {
+                qCDebug(ARK) << "Detected multivolume archive";
+                m_numberOfVolumes = volumes.count();
+                setMultiVolume(true);
+            }
+        }
     }
 
-    QString formatName = json.value(QStringLiteral("lsarFormatName")).toString();
-    if (formatName == QLatin1String("RAR")) {
-        emit compressionMethodFound(QStringLiteral("RAR4"));
-    } else if (formatName == QLatin1String("RAR 5")) {
-        emit compressionMethodFound(QStringLiteral("RAR5"));
+    if (m_jsonReader.hasError()) {
+        qCDebug(ARK) << "Could not parse json output:" << m_jsonReader.errorString();
     }
-    const QJsonArray entries = json.value(QStringLiteral("lsarContents")).toArray();
+}
 
-    for (const QJsonValue& value : entries) {
-        const QJsonObject currentEntryJson = value.toObject();
+void CliPlugin::handleJsonEntry(const QJsonObject &json)
+{
+    Archive::Entry *currentEntry = new Archive::Entry(this);
 
-        Archive::Entry *currentEntry = new Archive::Entry(this);
+    QString filename = json.value(QStringLiteral("XADFileName")).toString();
 
-        QString filename = currentEntryJson.value(QStringLiteral("XADFileName")).toString();
+    currentEntry->setProperty("isDirectory", !json.value(QStringLiteral("XADIsDirectory")).isUndefined());
+    if (currentEntry->isDir()) {
+        filename += QLatin1Char('/');
+    }
 
-        currentEntry->setProperty("isDirectory", !currentEntryJson.value(QStringLiteral("XADIsDirectory")).isUndefined());
-        if (currentEntry->isDir()) {
-            filename += QLatin1Char('/');
+    currentEntry->setProperty("fullPath", filename);
+
+    // FIXME: archives created from OSX (i.e. with the __MACOSX folder) list each entry twice, the 2nd time with size 0
+    currentEntry->setProperty("size", json.value(QStringLiteral("XADFileSize")));
+    currentEntry->setProperty("compressedSize", json.value(QStringLiteral("XADCompressedSize")));
+    currentEntry->setProperty("timestamp", json.value(QStringLiteral("XADLastModificationDate")).toVariant());
+    const bool isPasswordProtected = (json.value(QStringLiteral("XADIsEncrypted")).toInt() == 1);
+    currentEntry->setProperty("isPasswordProtected", isPasswordProtected);
+    if (isPasswordProtected && !m_hasEncryptedEntries) {
+        m_hasEncryptedEntries = true;
+        // lsar prints the format name after the entries, the method is emitted once it is known.
+        if (!m_formatName.isEmpty()) {
+            emitEncryptionMethod();
         }
+    }
+    // TODO: missing fields
 
-        currentEntry->setProperty("fullPath", filename);
-
-        // FIXME: archives created from OSX (i.e. with the __MACOSX folder) list each entry twice, the 2nd time with size 0
-        currentEntry->setProperty("size", currentEntryJson.value(QStringLiteral("XADFileSize")));
-        currentEntry->setProperty("compressedSize", currentEntryJson.value(QStringLiteral("XADCompressedSize")));
-        currentEntry->setProperty("timestamp", currentEntryJson.value(QStringLiteral("XADLastModificationDate")).toVariant());
-        currentEntry->setProperty("size", currentEntryJson.value(QStringLiteral("XADFileSize")));
-        const bool isPasswordProtected = (currentEntryJson.value(QStringLiteral("XADIsEncrypted")).toInt() == 1);
-        currentEntry->setProperty("isPasswordProtected", isPasswordProtected);
-        if (isPasswordProtected) {
-            formatName == QLatin1String("RAR 5") ? emit encryptionMethodFound(QStringLiteral("AES256")) :
-                                                   emit encryptionMethodFound(QStringLiteral("AES128"));
-        }
-        // TODO: missing fields
+    emit entry(currentEntry);
+}
 
-        emit entry(currentEntry);
-    }
+void CliPlugin::emitEncryptionMethod()
+{
+    m_formatName == QLatin1String("RAR 5") ? emit encryptionMethodFound(QStringLiteral("AES256")) :
+                                             emit encryptionMethodFound(QStringLiteral("AES128"));
 }
 
 bool CliPlugin::isPasswordPrompt(const QString &line)
@@ -24,6 +24,9 @@
 #define CLIPLUGIN_H
 
 #include "cliinterface.h"
+#include "jsonstreamreader.h"
+
+class QJsonObject;
 
 class CliPlugin : public Kerfuffle::CliInterface
 {
@@ -33,15 +36,16 @@ public:
     explicit CliPlugin(QObject *parent, const QVariantList &args);
     ~CliPlugin() override;
 
-    bool list() override;
     bool extractFiles(const QVector<Kerfuffle::Archive::Entry*> &files, const QString &destinationDirectory, const Kerfuffle::ExtractionOptions &options) override;
     void resetParsing() override;
     bool readListLine(const QString &line) override;
     bool readExtractLine(const QString &line) override;
     bool isPasswordPrompt(const QString &line) override;
+    bool isEntryProcessedMsg(const QString &line) const override;
+    bool isExtractionFailedExitCode(int exitCode) const override;
 
     /**
-     * Fill the lsar's json output all in once (useful for unit testing).
+     * Feed a chunk of lsar's json output (useful for unit testing).
      */
     void setJsonOutput(const QString &jsonOutput);
 
@@ -58,8 +62,12 @@ private Q_SLOTS:
 private:
     void setupCliProperties();
     void readJsonOutput();
+    void handleJsonEntry(const QJsonObject &json);
+    void emitEncryptionMethod();
 
-    QString m_jsonOutput;
+    JsonStreamReader m_jsonReader;
+    QString m_formatName;
+    bool m_hasEncryptedEntries = false;
 };
 
 #endif // CLIPLUGIN_H
@@ -0,0 +1,254 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "jsonstreamreader.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonParseError>
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+JsonStreamReader::JsonStreamReader()
+{
+    clear();
+}
+
+void JsonStreamReader::addData(const QByteArray &data)
+{
+    if (m_state == Error) {
+        return;
+    }
+
+    // Drop what has been read, except the key or value being read.
+    const bool keepStart = (m_state == InKey || m_state == InValue || m_state == InElement);
+    const int consumed = keepStart ? m_start : m_pos;
+    if (consumed > 0) {
+        m_buffer.remove(0, consumed);
+        m_pos -= consumed;
+        m_start = keepStart ? 0 : m_pos;
+    }
+
+    m_buffer.append(data);
+}
+
+bool JsonStreamReader::readNext()
+{
+    while (m_pos < m_buffer.size()) {
+        const char c = m_buffer.at(m_pos);
+
+        switch (m_state) {
+        case ExpectRoot:
+            if (c == '{') {
+                m_state = ExpectKey;
+            } else if (!isSpace(c)) {
+                setError(QStringLiteral("the document is not an object"));
+                return false;
+            }
+            break;
+
+        case ExpectKey:
+            if (c == '"') {
+                m_start = m_pos;
+                m_escape = false;
+                m_state = InKey;
+            } else if (c == '}') {
+                m_state = Finished;
+            } else if (!isSpace(c)) {
+                setError(QStringLiteral("expected a key"));
+                return false;
+            }
+            break;
+
+        case InKey:
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                // Let QJsonDocument unescape the key.
+                if (!readValue(m_pos + 1)) {
+                    return false;
+                }
+                m_key = m_value.toString();
+                m_value = QJsonValue();
+                m_state = ExpectColon;
+            }
+            break;
+
+        case ExpectColon:
+            if (c == ':') {
+                m_state = ExpectValue;
+            } else if (!isSpace(c)) {
+                setError(QStringLiteral("expected a colon"));
+                return false;
+            }
+            break;
+
+        case ExpectValue:
+        case ExpectElement:
+            if (isSpace(c)) {
+                break;
+            }
+            if (m_state == ExpectValue && c == '[') {
+                m_state = ExpectElement;
+                break;
+            }
+            if (m_state == ExpectElement && c == ']') {
+                m_state = AfterValue;
+                break;
+            }
+            m_start = m_pos;
+            m_depth = 0;
+            m_inString = false;
+            m_escape = false;
+            m_state = (m_state == ExpectValue) ? InValue : InElement;
+            continue;
+
+        case InValue:
+        case InElement:
+            if (m_inString) {
+                if (m_escape) {
+                    m_escape = false;
+                } else if (c == '\\') {
+                    m_escape = true;
+                } else if (c == '"') {
+                    m_inString = false;
+                }
+            } else if (c == '"') {
+                m_inString = true;
+            } else if (c == '{' || c == '[') {
+                m_depth++;
+            } else if (m_depth > 0) {
+                if (c == '}' || c == ']') {
+                    m_depth--;
+                }
+            } else if (c == ',' || c == '}' || c == ']') {
+                // The value ends before the separator, which is read by the next call.
+                m_state = (m_state == InValue) ? AfterValue : AfterElement;
+                return readValue(m_pos);
+            }
+            break;
+
+        case AfterValue:
+            if (c == ',') {
+                m_state = ExpectKey;
+            } else if (c == '}') {
+                m_state = Finished;
+            } else if (!isSpace(c)) {
+                setError(QStringLiteral("expected a comma or a closing brace"));
+                return false;
+            }
+            break;
+
+        case AfterElement:
+            if (c == ',') {
+                m_state = ExpectElement;
+            } else if (c == ']') {
+                m_state = AfterValue;
+            } else if (!isSpace(c)) {
+                setError(QStringLiteral("expected a comma or a closing bracket"));
+                return false;
+            }
+            break;
+
+        case Finished:
+        case Error:
+            return false;
+        }
+
+        m_pos++;
+    }
+
+    return false;
+}
+
+bool JsonStreamReader::readValue(int end)
+{
+    // QJsonDocument only parses objects and arrays, so wrap the value in an array.
+    QByteArray json;
+    json.reserve(end - m_start + 2);
+    json.append('[');
+    json.append(m_buffer.constData() + m_start, end - m_start);
+    json.append(']');
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(json, &error);
+    if (error.error != QJsonParseError::NoError) {
+        setError(error.errorString());
+        return false;
+    }
+
+    m_value = document.array().at(0);
+    m_start = m_pos;
+    return true;
+}
+
+QString JsonStreamReader::key() const
+{
+    return m_key;
+}
+
+QJsonValue JsonStreamReader::value() const
+{
+    return m_value;
+}
+
+bool JsonStreamReader::atEnd() const
+{
+    return m_state == Finished;
+}
+
+bool JsonStreamReader::hasError() const
+{
+    return m_state == Error;
+}
+
+QString JsonStreamReader::errorString() const
+{
+    return m_errorString;
+}
+
+void JsonStreamReader::clear()
+{
+    m_buffer.clear();
+    m_pos = 0;
+    m_start = 0;
+    m_depth = 0;
+    m_inString = false;
+    m_escape = false;
+    m_state = ExpectRoot;
+    m_key.clear();
+    m_value = QJsonValue();
+    m_errorString.clear();
+}
+
+void JsonStreamReader::setError(const QString &errorString)
+{
+    m_state = Error;
+    m_errorString = errorString;
+    m_buffer.clear();
+    m_pos = 0;
+    m_start = 0;
+}
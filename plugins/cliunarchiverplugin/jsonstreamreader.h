@@ -0,0 +1,108 @@
+/*
+ * ark -- archiver for the KDE project
+ *
+ * Copyright (C) 2017 The Ark developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef JSONSTREAMREADER_H
+#define JSONSTREAMREADER_H
+
+#include <QByteArray>
+#include <QJsonValue>
+#include <QString>
+
+/**
+ * Incremental reader for a JSON document whose root is an object, such as the output of lsar -json.
+ *
+ * The document is fed in chunks with addData(). Like QXmlStreamReader, readNext() then
+ * returns the values of the root object as soon as they are complete. The elements of
+ * an array in the root object are returned one at a time, all with the key of the array.
+ *
+ * Only the value being read is kept in memory, so reading the lsarContents array
+ * takes as much memory as its largest element, however many entries it has.
+ */
+class JsonStreamReader
+{
+public:
+    JsonStreamReader();
+
+    /**
+     * Appends @p data to the document, discarding what has already been read.
+     */
+    void addData(const QByteArray &data);
+
+    /**
+     * Reads the next value of the root object, or the next element of an array in the root object.
+     * @return Whether a value was read. False if more data is needed, at the end of the document
+     * or after an error.
+     */
+    bool readNext();
+
+    /**
+     * @return The key of the value returned by the last call to readNext().
+     */
+    QString key() const;
+
+    /**
+     * @return The value returned by the last call to readNext().
+     */
+    QJsonValue value() const;
+
+    /**
+     * @return Whether the closing brace of the root object has been read.
+     */
+    bool atEnd() const;
+
+    bool hasError() const;
+    QString errorString() const;
+
+    void clear();
+
+private:
+    enum State {
+        ExpectRoot,
+        ExpectKey,
+        InKey,
+        ExpectColon,
+        ExpectValue,
+        InValue,
+        AfterValue,
+        ExpectElement,
+        InElement,
+        AfterElement,
+        Finished,
+        Error
+    };
+
+    bool readValue(int end);
+    void setError(const QString &errorString);
+
+    QByteArray m_buffer;
+    int m_pos;
+    int m_start;
+    int m_depth;
+    bool m_inString;
+    bool m_escape;
+    State m_state;
+
+    QString m_key;
+    QJsonValue m_value;
+    QString m_errorString;
+};
+
+#endif // JSONSTREAMREADER_H
@@ -23,6 +23,7 @@
 #include "cliplugin.h"
 #include "ark_debug.h"
 #include "cliinterface.h"
+#include "timestamps.h"
 
 #include <KLocalizedString>
 #include <KPluginFactory>
@@ -40,8 +41,16 @@ CliPlugin::CliPlugin(QObject *parent, const QVariantList & args)
     : CliInterface(parent, args)
     , m_parseState(ParseStateHeader)
     , m_linesComment(0)
+    , m_rxEntry(QStringLiteral("^(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\d{8}).(\\d{6})\\s+(.+)$"))
+    , m_rxUnsupCompMethod(QStringLiteral("unsupported compression method (\\d+)"))
+    , m_rxUnsupEncMethod(QStringLiteral("need PK compat. v\\d\\.\\d \\(can do v\\d\\.\\d\\)"))
 {
     qCDebug(ARK) << "Loaded cli_zip plugin";
+
+    m_rxEntry.optimize();
+    m_rxUnsupCompMethod.optimize();
+    m_rxUnsupEncMethod.optimize();
+
     setupCliProperties();
 }
 
@@ -120,24 +129,21 @@ void CliPlugin::setupCliProperties()
 
 bool CliPlugin::readListLine(const QString &line)
 {
-    static const QRegularExpression entryPattern(QStringLiteral(
-        "^(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\d{8}).(\\d{6})\\s+(.+)$") );
-
-    // RegExp to identify the line preceding comments.
-    const QRegularExpression commentPattern(QStringLiteral("^Archive:  .*$"));
-    // RegExp to identify the line following comments.
-    const QRegularExpression commentEndPattern(QStringLiteral("^Zip file size: .*$"));
+    // Prefix of the line preceding comments.
+    static const QLatin1String commentPrefix("Archive:  ");
+    // Prefix of the line following comments.
+    static const QLatin1String commentEndPrefix("Zip file size: ");
 
     switch (m_parseState) {
     case ParseStateHeader:
-        if (commentPattern.match(line).hasMatch()) {
+        if (line.startsWith(commentPrefix)) {
             m_parseState = ParseStateComment;
-        } else if (commentEndPattern.match(line).hasMatch()){
+        } else if (line.startsWith(commentEndPrefix)) {
             m_parseState = ParseStateEntry;
         }
         break;
     case ParseStateComment:
-        if (commentEndPattern.match(line).hasMatch()) {
+        if (line.startsWith(commentEndPrefix)) {
             m_parseState = ParseStateEntry;
             if (!m_tempComment.trimmed().isEmpty()) {
                 m_comment = m_tempComment.trimmed();
@@ -149,7 +155,7 @@ bool CliPlugin::readListLine(const QString &line)
         }
         break;
     case ParseStateEntry:
-        QRegularExpressionMatch rxMatch = entryPattern.match(line);
+        QRegularExpressionMatch rxMatch = m_rxEntry.match(line);
         if (rxMatch.hasMatch()) {
             Archive::Entry *e = new Archive::Entry(this);
             e->setProperty("permissions", rxMatch.captured(1));
@@ -169,9 +175,7 @@ bool CliPlugin::readListLine(const QString &line)
             QString method = convertCompressionMethod(rxMatch.captured(7));
             emit compressionMethodFound(method);
 
-            const QDateTime ts(QDate::fromString(rxMatch.captured(8), QStringLiteral("yyyyMMdd")),
-                               QTime::fromString(rxMatch.captured(9), QStringLiteral("hhmmss")));
-            e->setProperty("timestamp", ts);
+            e->setProperty("timestamp", parseCompactTimestamp(rxMatch.capturedRef(8), rxMatch.capturedRef(9)));
 
             e->setProperty("fullPath", rxMatch.captured(10));
             emit entry(e);
@@ -184,22 +188,18 @@ bool CliPlugin::readListLine(const QString &line)
 
 bool CliPlugin::readExtractLine(const QString &line)
 {
-    const QRegularExpression rxUnsupCompMethod(QStringLiteral("unsupported compression method (\\d+)"));
-    const QRegularExpression rxUnsupEncMethod(QStringLiteral("need PK compat. v\\d\\.\\d \\(can do v\\d\\.\\d\\)"));
-    const QRegularExpression rxBadCRC(QStringLiteral("bad CRC"));
-
-    QRegularExpressionMatch unsupCompMethodMatch = rxUnsupCompMethod.match(line);
+    QRegularExpressionMatch unsupCompMethodMatch = m_rxUnsupCompMethod.match(line);
     if (unsupCompMethodMatch.hasMatch()) {
         emit error(i18n("Extraction failed due to unsupported compression method (%1).", unsupCompMethodMatch.captured(1)));
         return false;
     }
 
-    if (rxUnsupEncMethod.match(line).hasMatch()) {
+    if (m_rxUnsupEncMethod.match(line).hasMatch()) {
         emit error(i18n("Extraction failed due to unsupported encryption method."));
         return false;
     }
 
-    if (rxBadCRC.match(line).hasMatch()) {
+    if (line.contains(QLatin1String("bad CRC"))) {
         emit error(i18n("Extraction failed due to one or more corrupt files. Any extracted files may be damaged."));
         return false;
     }
@@ -207,6 +207,17 @@ bool CliPlugin::readExtractLine(const QString &line)
     return true;
 }
 
+bool CliPlugin::isEntryProcessedMsg(const QString &line) const
+{
+    // unzip prints e.g. "  inflating: name" for each extracted entry, zip "  adding: name" for each added one.
+    const QStringRef text = QStringRef(&line).trimmed();
+    return (text.startsWith(QLatin1String("inflating: ")) ||
+            text.startsWith(QLatin1String("extracting: ")) ||
+            text.startsWith(QLatin1String("creating: ")) ||
+            text.startsWith(QLatin1String("linking: ")) ||
+            text.startsWith(QLatin1String("adding: ")));
+}
+
 bool CliPlugin::moveFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options)
 {
     qCDebug(ARK) << "Moving" << files.count() << "file(s) to destination:" << destination;
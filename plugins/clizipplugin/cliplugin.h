@@ -44,6 +44,7 @@ public:
     bool isDiskFullMsg(const QString &line) override;
     bool isFileExistsMsg(const QString &line) override;
     bool isFileExistsFileName(const QString &line) override;
+    bool isEntryProcessedMsg(const QString &line) const override;
 
     bool moveFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions& options) override;
     int moveRequiredSignals() const override;
@@ -65,6 +66,10 @@ private:
 
     int m_linesComment;
     QString m_tempComment;
+
+    const QRegularExpression m_rxEntry;
+    const QRegularExpression m_rxUnsupCompMethod;
+    const QRegularExpression m_rxUnsupEncMethod;
 };
 
 #endif // CLIPLUGIN_H
@@ -76,5 +76,47 @@
         "Version": "@KDE_APPLICATIONS_VERSION@"
     },
     "X-KDE-Kerfuffle-ReadWrite": false,
-    "X-KDE-Priority": 100
+    "X-KDE-Priority": 100,
+    "application/vnd.debian.binary-package": {
+        "SupportsTesting": true
+    },
+    "application/vnd.ms-cab-compressed": {
+        "SupportsTesting": true
+    },
+    "application/x-archive": {
+        "SupportsTesting": true
+    },
+    "application/x-bcpio": {
+        "SupportsTesting": true
+    },
+    "application/x-cd-image": {
+        "SupportsTesting": true
+    },
+    "application/x-cpio": {
+        "SupportsTesting": true
+    },
+    "application/x-cpio-compressed": {
+        "SupportsTesting": true
+    },
+    "application/x-deb": {
+        "SupportsTesting": true
+    },
+    "application/x-iso9660-appimage": {
+        "SupportsTesting": true
+    },
+    "application/x-rpm": {
+        "SupportsTesting": true
+    },
+    "application/x-source-rpm": {
+        "SupportsTesting": true
+    },
+    "application/x-sv4cpio": {
+        "SupportsTesting": true
+    },
+    "application/x-sv4crc": {
+        "SupportsTesting": true
+    },
+    "application/x-xar": {
+        "SupportsTesting": true
+    }
 }
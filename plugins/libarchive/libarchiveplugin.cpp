@@ -29,18 +29,189 @@
 #include "libarchiveplugin.h"
 #include "ark_debug.h"
 #include "queries.h"
+#include "tracer.h"
 
 #include <KLocalizedString>
 
-#include <QThread>
+#include <QDateTime>
 #include <QFileInfo>
 #include <QDir>
+#include <QMutex>
+#include <QSet>
 
 #include <archive_entry.h>
 
+/**
+ * A reader opened by LibarchivePlugin::createEntryDevice(), with where it stands in the archive.
+ */
+struct EntryReader
+{
+    struct archive *reader = nullptr;
+    // The entries the reader went past, it can't go back to them.
+    QSet<QString> passedPaths;
+    // The archive file when the reader opened it.
+    QDateTime lastModified;
+    qint64 size = -1;
+};
+
+/**
+ * Keeps the reader of the last entry device open, so that the next device can carry on
+ * from there instead of parsing the archive headers (e.g. the 7z one) again.
+ */
+struct ParkedReader
+{
+    ~ParkedReader()
+    {
+        if (entryReader.reader) {
+            archive_read_free(entryReader.reader);
+        }
+    }
+
+    QMutex mutex;
+    EntryReader entryReader;
+};
+
+/**
+ * Streams the data of the entry at @p path read by @p entryReader, see LibarchivePlugin::createEntryDevice().
+ * The entries before it are skipped on the first read, so that abort() can stop the skipping too.
+ * Once closed, the reader is handed over to @p parkedReader unless it failed.
+ */
+class ArchiveEntryDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    ArchiveEntryDevice(const EntryReader &entryReader, const QString &path, const QSharedPointer<ParkedReader> &parkedReader)
+        : m_entryReader(entryReader)
+        , m_reader(entryReader.reader)
+        , m_path(path)
+        , m_parkedReader(parkedReader)
+    {
+        open(QIODevice::ReadOnly);
+    }
+
+    ~ArchiveEntryDevice() override
+    {
+        close();
+    }
+
+    /**
+     * Makes the reads fail as soon as possible, can be called from any thread.
+     * The device doesn't stop when the operations of the interface are cancelled,
+     * they could belong to an unrelated job.
+     */
+    Q_INVOKABLE void abort()
+    {
+        m_aborted.storeRelease(1);
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    bool atEnd() const override
+    {
+        return m_finished && QIODevice::atEnd();
+    }
+
+    void close() override
+    {
+        // A reader which didn't skip anything yet still stands where the previous device left it.
+        if (m_reader && (m_isReusable || !m_skipped) && !m_aborted.loadAcquire()) {
+            QMutexLocker locker(&m_parkedReader->mutex);
+            std::swap(m_parkedReader->entryReader, m_entryReader);
+            m_reader = m_entryReader.reader;
+        }
+        if (m_reader) {
+            archive_read_free(m_reader);
+            m_reader = nullptr;
+        }
+        QIODevice::close();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        if (!m_reader || m_finished) {
+            return m_finished ? 0 : -1;
+        }
+
+        if (m_aborted.loadAcquire()) {
+            setErrorString(QStringLiteral("Reading aborted"));
+            return -1;
+        }
+
+        if (!m_skipped) {
+            m_skipped = true;
+            if (!skipTo(m_path)) {
+                setErrorString(m_aborted.loadAcquire() ? QStringLiteral("Reading aborted")
+                                                       : QStringLiteral("No such file in the archive"));
+                archive_read_free(m_reader);
+                m_reader = nullptr;
+                m_entryReader.reader = nullptr;
+                return -1;
+            }
+        }
+
+        const auto readBytes = archive_read_data(m_reader, data, static_cast<size_t>(maxSize));
+        if (readBytes < 0) {
+            setErrorString(QString::fromUtf8(archive_error_string(m_reader)));
+            m_isReusable = false;
+            return -1;
+        }
+
+        m_finished = (readBytes == 0);
+        return readBytes;
+    }
+
+    qint64 writeData(const char *data, qint64 maxSize) override
+    {
+        Q_UNUSED(data)
+        Q_UNUSED(maxSize)
+        return -1;
+    }
+
+private:
+    /**
+     * Skips the headers and the data of the entries before @p path.
+     * @return Whether @p path is a regular file, at which the reader now stands.
+     */
+    bool skipTo(const QString &path)
+    {
+        struct archive_entry *aentry;
+        while (!m_aborted.loadAcquire() && archive_read_next_header(m_reader, &aentry) == ARCHIVE_OK) {
+            QString entryName = QDir::fromNativeSeparators(QFile::decodeName(archive_entry_pathname(aentry)));
+            if (entryName.startsWith(QLatin1String("./"))) {
+                entryName.remove(0, 2);
+            }
+            m_entryReader.passedPaths.insert(entryName);
+
+            if (entryName == path) {
+                m_isReusable = S_ISREG(archive_entry_mode(aentry));
+                return m_isReusable;
+            }
+
+            archive_read_data_skip(m_reader);
+        }
+
+        return false;
+    }
+
+    EntryReader m_entryReader;
+    struct archive *m_reader;
+    QString m_path;
+    QSharedPointer<ParkedReader> m_parkedReader;
+    QAtomicInt m_aborted;
+    bool m_skipped = false;
+    bool m_finished = false;
+    bool m_isReusable = false;
+};
+
 LibarchivePlugin::LibarchivePlugin(QObject *parent, const QVariantList &args)
     : ReadWriteArchiveInterface(parent, args)
     , m_archiveReadDisk(archive_read_disk_new())
+    , m_parkedReader(new ParkedReader)
     , m_cachedArchiveEntryCount(0)
     , m_emitNoEntries(false)
     , m_extractedFilesSize(0)
@@ -63,6 +234,7 @@ LibarchivePlugin::~LibarchivePlugin()
 bool LibarchivePlugin::list()
 {
     qCDebug(ARK) << "Listing archive contents";
+    TraceSpan span("list", "libarchive");
 
     if (!initializeReader()) {
         return false;
@@ -83,7 +255,7 @@ bool LibarchivePlugin::list()
     int result = ARCHIVE_RETRY;
 
     bool firstEntry = true;
-    while (!QThread::currentThread()->isInterruptionRequested() && (result = archive_read_next_header(m_archiveReader.data(), &aentry)) == ARCHIVE_OK) {
+    while (!isCancellationRequested() && (result = archive_read_next_header(m_archiveReader.data(), &aentry)) == ARCHIVE_OK) {
 
         if (firstEntry) {
             qDebug(ARK) << "Detected format for first entry:" << archive_format_name(m_archiveReader.data());
@@ -96,11 +268,12 @@ bool LibarchivePlugin::list()
 
         m_extractedFilesSize += (qlonglong)archive_entry_size(aentry);
 
-        emit progress(float(archive_filter_bytes(m_archiveReader.data(), -1))/float(compressedArchiveSize));
+        reportProgress(float(archive_filter_bytes(m_archiveReader.data(), -1))/float(compressedArchiveSize));
 
         m_cachedArchiveEntryCount++;
         archive_read_data_skip(m_archiveReader.data());
     }
+    span.setArg(QStringLiteral("entries"), m_cachedArchiveEntryCount);
 
     if (result != ARCHIVE_EOF) {
         qCWarning(ARK) << "Could not read until the end of the archive:" << QLatin1String(archive_error_string(m_archiveReader.data()));
@@ -149,7 +322,52 @@ bool LibarchivePlugin::addComment(const QString &comment)
 
 bool LibarchivePlugin::testArchive()
 {
-    return false;
+    qCDebug(ARK) << "Testing archive";
+
+    // Big blocks make a difference when reading the whole archive.
+    if (!initializeReader(testBlockSize)) {
+        return false;
+    }
+
+    const qlonglong compressedArchiveSize = QFileInfo(filename()).size();
+    QByteArray buffer(testBlockSize, '\0');
+    struct archive_entry *aentry;
+    int result = ARCHIVE_RETRY;
+
+    while ((result = archive_read_next_header(m_archiveReader.data(), &aentry)) == ARCHIVE_OK) {
+        // Decoding the data is enough for libarchive to verify the checksums of the formats
+        // and filters which have them, nothing is written to disk.
+        auto readBytes = archive_read_data(m_archiveReader.data(), buffer.data(), buffer.size());
+        while (readBytes > 0) {
+            if (isCancellationRequested()) {
+                return false;
+            }
+
+            if (compressedArchiveSize > 0) {
+                reportProgress(double(archive_filter_bytes(m_archiveReader.data(), -1)) / compressedArchiveSize);
+            }
+
+            readBytes = archive_read_data(m_archiveReader.data(), buffer.data(), buffer.size());
+        }
+
+        if (readBytes < 0) {
+            qCWarning(ARK) << "Test failed for" << archive_entry_pathname(aentry)
+                           << ":" << archive_error_string(m_archiveReader.data());
+            return false;
+        }
+    }
+
+    if (result != ARCHIVE_EOF) {
+        qCWarning(ARK) << "Could not read until the end of the archive:" << archive_error_string(m_archiveReader.data());
+        return false;
+    }
+
+    if (archive_read_close(m_archiveReader.data()) != ARCHIVE_OK) {
+        return false;
+    }
+
+    emit testSuccess();
+    return true;
 }
 
 bool LibarchivePlugin::hasBatchExtractionProgress() const
@@ -179,7 +397,7 @@ bool LibarchivePlugin::extractFiles(const QVector<Archive::Entry*> &files, const
     const bool extractAll = files.isEmpty();
     if (extractAll) {
         if (!m_cachedArchiveEntryCount) {
-            emit progress(0);
+            reportProgress(0);
             //TODO: once information progress has been implemented, send
             //feedback here that the archive is being read
             qCDebug(ARK) << "For getting progress information, the archive will be listed once";
@@ -215,7 +433,7 @@ bool LibarchivePlugin::extractFiles(const QVector<Archive::Entry*> &files, const
     QStringList remainingFiles = entryFullPaths(files);
 
     // Iterate through all entries in archive.
-    while (!QThread::currentThread()->isInterruptionRequested() && (archive_read_next_header(m_archiveReader.data(), &entry) == ARCHIVE_OK)) {
+    while (!isCancellationRequested() && (archive_read_next_header(m_archiveReader.data(), &entry) == ARCHIVE_OK)) {
 
         if (!extractAll && remainingFiles.isEmpty()) {
             break;
@@ -350,7 +568,12 @@ bool LibarchivePlugin::extractFiles(const QVector<Archive::Entry*> &files, const
             case ARCHIVE_OK:
                 // If the whole archive is extracted and the total filesize is
                 // available, we use partial progress.
-                copyData(entryName, m_archiveReader.data(), writer.data(), (extractAll && m_extractedFilesSize));
+                if (!copyData(entryName, m_archiveReader.data(), writer.data(), (extractAll && m_extractedFilesSize))
+                    && isCancellationRequested() && !entryIsDir) {
+                    // Don't leave a truncated file behind, it would look like a valid one.
+                    archive_write_finish_entry(writer.data());
+                    QFile::remove(QFile::decodeName(archive_entry_pathname(entry)));
+                }
                 break;
 
             case ARCHIVE_FAILED:
@@ -390,7 +613,7 @@ bool LibarchivePlugin::extractFiles(const QVector<Archive::Entry*> &files, const
             // number of items extracted.
             if (!extractAll && m_cachedArchiveEntryCount) {
                 ++progressEntryCount;
-                emit progress(float(progressEntryCount) / totalEntriesCount);
+                reportProgress(float(progressEntryCount) / totalEntriesCount, progressEntryCount, totalEntriesCount);
             }
 
             extractedEntriesCount++;
@@ -406,7 +629,48 @@ bool LibarchivePlugin::extractFiles(const QVector<Archive::Entry*> &files, const
     return archive_read_close(m_archiveReader.data()) == ARCHIVE_OK;
 }
 
-bool LibarchivePlugin::initializeReader()
+QIODevice *LibarchivePlugin::createEntryDevice(const Archive::Entry *entry)
+{
+    if (entry->isDir()) {
+        return nullptr;
+    }
+
+    const QFileInfo archiveInfo(filename());
+    const QString path = entry->fullPath();
+
+    // The reader of the previous device goes on if the entry comes later and the archive didn't change since.
+    EntryReader entryReader;
+    {
+        QMutexLocker locker(&m_parkedReader->mutex);
+        std::swap(entryReader, m_parkedReader->entryReader);
+    }
+    if (entryReader.reader && (entryReader.passedPaths.contains(path) ||
+                               entryReader.lastModified != archiveInfo.lastModified() ||
+                               entryReader.size != archiveInfo.size())) {
+        archive_read_free(entryReader.reader);
+        entryReader = EntryReader();
+    }
+
+    // The device doesn't share m_archiveReader, nor the cancellation, with the jobs running on this interface.
+    if (!entryReader.reader) {
+        ArchiveRead reader(archive_read_new());
+        if (!reader.data() ||
+            archive_read_support_filter_all(reader.data()) != ARCHIVE_OK ||
+            archive_read_support_format_all(reader.data()) != ARCHIVE_OK ||
+            archive_read_open_filename(reader.data(), QFile::encodeName(filename()).constData(), 10240) != ARCHIVE_OK) {
+            return nullptr;
+        }
+
+        entryReader.reader = reader.take();
+        entryReader.lastModified = archiveInfo.lastModified();
+        entryReader.size = archiveInfo.size();
+    }
+
+    // The entry is looked for on the first read, once the caller is able to abort the device.
+    return new ArchiveEntryDevice(entryReader, path, m_parkedReader);
+}
+
+bool LibarchivePlugin::initializeReader(size_t blockSize)
 {
     m_archiveReader.reset(archive_read_new());
 
@@ -423,7 +687,7 @@ bool LibarchivePlugin::initializeReader()
         return false;
     }
 
-    if (archive_read_open_filename(m_archiveReader.data(), QFile::encodeName(filename()).constData(), 10240) != ARCHIVE_OK) {
+    if (archive_read_open_filename(m_archiveReader.data(), QFile::encodeName(filename()).constData(), blockSize) != ARCHIVE_OK) {
         qCWarning(ARK) << "Could not open the archive:" << archive_error_string(m_archiveReader.data());
         emit error(i18nc("@info", "Archive corrupted or insufficient permissions."));
         return false;
@@ -490,55 +754,63 @@ int LibarchivePlugin::extractionFlags() const
     return result;
 }
 
-void LibarchivePlugin::copyData(const QString& filename, struct archive *dest, bool partialprogress)
+bool LibarchivePlugin::copyData(const QString& filename, struct archive *dest, bool partialprogress)
 {
     char buff[10240];
     QFile file(filename);
 
     if (!file.open(QIODevice::ReadOnly)) {
-        return;
+        return false;
     }
 
     auto readBytes = file.read(buff, sizeof(buff));
-    while (readBytes > 0 && !QThread::currentThread()->isInterruptionRequested()) {
+    while (readBytes > 0 && !isCancellationRequested()) {
         archive_write_data(dest, buff, static_cast<size_t>(readBytes));
         if (archive_errno(dest) != ARCHIVE_OK) {
             qCCritical(ARK) << "Error while writing" << filename << ":" << archive_error_string(dest)
                             << "(error no =" << archive_errno(dest) << ')';
-            return;
+            return false;
         }
 
         if (partialprogress) {
             m_currentExtractedFilesSize += readBytes;
-            emit progress(float(m_currentExtractedFilesSize) / m_extractedFilesSize);
+            reportProgress(float(m_currentExtractedFilesSize) / m_extractedFilesSize, 0, 0, m_currentExtractedFilesSize, m_extractedFilesSize);
         }
 
         readBytes = file.read(buff, sizeof(buff));
     }
 
     file.close();
+    return readBytes == 0;
 }
 
-void LibarchivePlugin::copyData(const QString& filename, struct archive *source, struct archive *dest, bool partialprogress)
+bool LibarchivePlugin::copyData(const QString& filename, struct archive *source, struct archive *dest, bool partialprogress)
 {
     char buff[10240];
+    TraceSpan span("decompress", "libarchive");
+    span.setArg(QStringLiteral("entry"), filename);
+    qlonglong copiedBytes = 0;
 
     auto readBytes = archive_read_data(source, buff, sizeof(buff));
-    while (readBytes > 0 && !QThread::currentThread()->isInterruptionRequested()) {
+    while (readBytes > 0 && !isCancellationRequested()) {
+        copiedBytes += readBytes;
         archive_write_data(dest, buff, static_cast<size_t>(readBytes));
         if (archive_errno(dest) != ARCHIVE_OK) {
             qCCritical(ARK) << "Error while extracting" << filename << ":" << archive_error_string(dest)
                             << "(error no =" << archive_errno(dest) << ')';
-            return;
+            return false;
         }
 
         if (partialprogress) {
             m_currentExtractedFilesSize += readBytes;
-            emit progress(float(m_currentExtractedFilesSize) / m_extractedFilesSize);
+            reportProgress(float(m_currentExtractedFilesSize) / m_extractedFilesSize, 0, 0, m_currentExtractedFilesSize, m_extractedFilesSize);
         }
 
         readBytes = archive_read_data(source, buff, sizeof(buff));
     }
+    span.setArg(QStringLiteral("bytes"), copiedBytes);
+
+    return readBytes == 0;
 }
 
 void LibarchivePlugin::slotRestoreWorkingDir()
@@ -580,3 +852,4 @@ QString LibarchivePlugin::convertCompressionName(const QString &method)
     return QString();
 }
 
+#include "libarchiveplugin.moc"
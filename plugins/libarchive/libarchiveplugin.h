@@ -33,9 +33,12 @@
 #include <archive.h>
 
 #include <QScopedPointer>
+#include <QSharedPointer>
 
 using namespace Kerfuffle;
 
+struct ParkedReader;
+
 class LibarchivePlugin : public ReadWriteArchiveInterface
 {
     Q_OBJECT
@@ -47,6 +50,7 @@ public:
     bool list() override;
     bool doKill() override;
     bool extractFiles(const QVector<Archive::Entry*> &files, const QString &destinationDirectory, const ExtractionOptions &options) override;
+    QIODevice *createEntryDevice(const Archive::Entry *entry) override;
 
     bool addFiles(const QVector<Archive::Entry*> &files, const Archive::Entry *destination, const CompressionOptions &options, uint numberOfEntriesToAdd = 0) override;
     bool moveFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options) override;
@@ -80,18 +84,24 @@ protected:
     typedef QScopedPointer<struct archive, ArchiveReadCustomDeleter> ArchiveRead;
     typedef QScopedPointer<struct archive, ArchiveWriteCustomDeleter> ArchiveWrite;
 
-    bool initializeReader();
+    bool initializeReader(size_t blockSize = 10240);
     void emitEntryFromArchiveEntry(struct archive_entry *entry);
-    void copyData(const QString& filename, struct archive *dest, bool partialprogress = true);
-    void copyData(const QString& filename, struct archive *source, struct archive *dest, bool partialprogress = true);
+    /**
+     * @return Whether all the data has been copied, false on error or cancellation.
+     */
+    bool copyData(const QString& filename, struct archive *dest, bool partialprogress = true);
+    bool copyData(const QString& filename, struct archive *source, struct archive *dest, bool partialprogress = true);
 
     ArchiveRead m_archiveReader;
     ArchiveRead m_archiveReadDisk;
+    QSharedPointer<ParkedReader> m_parkedReader;
 
 private Q_SLOTS:
     void slotRestoreWorkingDir();
 
 private:
+    static const int testBlockSize = 1024 * 1024;
+
     int extractionFlags() const;
     QString convertCompressionName(const QString &method);
 
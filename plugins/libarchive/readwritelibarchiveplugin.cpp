@@ -28,18 +28,62 @@
 
 #include "readwritelibarchiveplugin.h"
 #include "ark_debug.h"
+#include "tracer.h"
 
 #include <KLocalizedString>
 #include <KPluginFactory>
 
 #include <QDirIterator>
 #include <QSaveFile>
+#include <QTemporaryFile>
 #include <QThread>
 
 #include <archive_entry.h>
 
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 K_PLUGIN_CLASS_WITH_JSON(ReadWriteLibarchivePlugin, "kerfuffle_libarchive.json")
 
+// Sizes of the blocks and of the records of a tar archive.
+static const qint64 blockSize = 512;
+static const qint64 recordSize = 10240;
+
+// Entries replaced in place are read in memory first, bigger ones are rewritten with the archive.
+static const qint64 maximumInPlaceSize = 64 * 1024 * 1024;
+
+// Copies @p size bytes of @p from at @p position to the current position of @p to.
+static bool copyRange(QFile &from, qint64 position, qint64 size, QFile &to)
+{
+    if (!from.seek(position)) {
+        return false;
+    }
+    while (size > 0) {
+        const QByteArray buffer = from.read(qMin(size, recordSize * 100));
+        if (buffer.isEmpty() || to.write(buffer) != buffer.size()) {
+            return false;
+        }
+        size -= buffer.size();
+    }
+    return true;
+}
+
+// Flushes @p file down to the disk, not only to the system.
+static bool syncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
 ReadWriteLibarchivePlugin::ReadWriteLibarchivePlugin(QObject *parent, const QVariantList &args)
     : LibarchivePlugin(parent, args)
 {
@@ -76,7 +120,7 @@ bool ReadWriteLibarchivePlugin::addFiles(const QVector<Archive::Entry*> &files,
                                     : destination->fullPath();
 
     for (Archive::Entry *selectedFile : files) {
-        if (QThread::currentThread()->isInterruptionRequested()) {
+        if (isCancellationRequested()) {
             break;
         }
 
@@ -85,7 +129,7 @@ bool ReadWriteLibarchivePlugin::addFiles(const QVector<Archive::Entry*> &files,
             return false;
         }
         addedEntries++;
-        emit progress(float(addedEntries)/float(totalCount));
+        reportProgress(float(addedEntries)/float(totalCount), addedEntries, totalCount);
 
         // For directories, write all subfiles/folders.
         const QString &fullPath = selectedFile->fullPath();
@@ -95,7 +139,7 @@ bool ReadWriteLibarchivePlugin::addFiles(const QVector<Archive::Entry*> &files,
                             QDir::Hidden | QDir::NoDotAndDotDot,
                             QDirIterator::Subdirectories);
 
-            while (!QThread::currentThread()->isInterruptionRequested() && it.hasNext()) {
+            while (!isCancellationRequested() && it.hasNext()) {
                 QString path = it.next();
 
                 if ((it.fileName() == QLatin1String("..")) ||
@@ -114,7 +158,7 @@ bool ReadWriteLibarchivePlugin::addFiles(const QVector<Archive::Entry*> &files,
                     return false;
                 }
                 addedEntries++;
-                emit progress(float(addedEntries)/float(totalCount));
+                reportProgress(float(addedEntries)/float(totalCount), addedEntries, totalCount);
             }
         }
     }
@@ -222,6 +266,419 @@ bool ReadWriteLibarchivePlugin::deleteFiles(const QVector<Archive::Entry*> &file
     return isSuccessful;
 }
 
+bool ReadWriteLibarchivePlugin::canReplaceEntries() const
+{
+    return true;
+}
+
+bool ReadWriteLibarchivePlugin::replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions &options)
+{
+    qCDebug(ARK) << "Replacing" << entry->fullPath() << "with" << file;
+
+    switch (replaceEntryInPlace(entry, file)) {
+    case Replaced:
+        return true;
+    case ReplaceFailed:
+        return false;
+    case NotReplaceableInPlace:
+        break;
+    }
+
+    // Rewrite the archive as when adding the file, but without walking the work directory.
+    qCDebug(ARK) << "Rewriting the archive to replace" << entry->fullPath();
+    PlannedOperation operation;
+    operation.mode = Add;
+    operation.paths.insert(entry->fullPath());
+    m_plannedOperations.clear();
+    m_plannedOperations.append(operation);
+
+    QVector<PlannedFile> plannedFiles;
+    plannedFiles.append({file, entry->fullPath(), 0});
+
+    return applyPlannedOperations(plannedFiles, options);
+}
+
+ReadWriteLibarchivePlugin::InPlaceResult ReadWriteLibarchivePlugin::replaceEntryInPlace(const Archive::Entry *entry, const QString &file)
+{
+    if (!initializeReader()) {
+        return ReplaceFailed;
+    }
+
+    // Find where the entry starts (including its extended headers) and where the next one starts.
+    qint64 headerPosition = -1;
+    qint64 nextHeaderPosition = -1;
+    bool isReplaceable = true;
+    struct archive_entry *oldEntry;
+    while (isReplaceable && archive_read_next_header(m_archiveReader.data(), &oldEntry) == ARCHIVE_OK) {
+        if (headerPosition >= 0 && nextHeaderPosition < 0) {
+            nextHeaderPosition = archive_read_header_position(m_archiveReader.data());
+        }
+        if (QFile::decodeName(archive_entry_pathname(oldEntry)) == entry->fullPath()) {
+            // Duplicated entries would shadow each other.
+            isReplaceable = (headerPosition < 0) && (archive_entry_filetype(oldEntry) == AE_IFREG);
+            headerPosition = archive_read_header_position(m_archiveReader.data());
+        }
+        archive_read_data_skip(m_archiveReader.data());
+    }
+
+    isReplaceable = isReplaceable && (headerPosition >= 0) &&
+                    (archive_filter_code(m_archiveReader.data(), 0) == ARCHIVE_FILTER_NONE) &&
+                    ((archive_format(m_archiveReader.data()) & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_TAR);
+    m_archiveReader.reset();
+    if (!isReplaceable) {
+        return NotReplaceableInPlace;
+    }
+
+    struct archive_entry *newEntry = createDiskEntry(file, entry->fullPath());
+    const qint64 size = archive_entry_size(newEntry);
+    if (size > maximumInPlaceSize) {
+        archive_entry_free(newEntry);
+        return NotReplaceableInPlace;
+    }
+
+    // Render the headers of the new entry the same way initializeWriter() would.
+    QByteArray header(int(blockSize * 128), '\0');
+    size_t headerSize = 0;
+    ArchiveWrite headerWriter(archive_write_new());
+    isReplaceable = headerWriter.data() &&
+                    (archive_entry_filetype(newEntry) == AE_IFREG) &&
+                    (archive_write_set_format_pax_restricted(headerWriter.data()) == ARCHIVE_OK) &&
+                    (archive_write_set_bytes_per_block(headerWriter.data(), 0) == ARCHIVE_OK) &&
+                    (archive_write_open_memory(headerWriter.data(), header.data(), header.size(), &headerSize) == ARCHIVE_OK) &&
+                    (archive_write_header(headerWriter.data(), newEntry) == ARCHIVE_OK);
+    const int headerLength = int(headerSize);
+    // Freeing the writer pads the missing data, which overflows the buffer and fails harmlessly.
+    headerWriter.reset();
+    header.truncate(headerLength);
+
+    const qint64 paddedSize = (size + blockSize - 1) / blockSize * blockSize;
+    const bool isLast = (nextHeaderPosition < 0);
+    const qint64 dataEnd = headerPosition + header.size() + paddedSize;
+    // The two zero blocks ending the archive, padded to a whole record.
+    const qint64 end = (dataEnd + 2 * blockSize + recordSize - 1) / recordSize * recordSize;
+
+    // The last entry can only shrink, growing the archive could run out of disk space midway.
+    if (!isReplaceable || (!isLast && dataEnd != nextHeaderPosition) || (isLast && end > QFileInfo(filename()).size())) {
+        qCDebug(ARK) << "The new content of" << entry->fullPath() << "doesn't fit in place";
+        archive_entry_free(newEntry);
+        return NotReplaceableInPlace;
+    }
+
+    // Read the whole file before touching the archive, a short read would corrupt it.
+    QFile source(file);
+    if (!source.open(QIODevice::ReadOnly)) {
+        emit error(xi18nc("@info", "Could not open <filename>%1</filename> for reading.", file));
+        archive_entry_free(newEntry);
+        return ReplaceFailed;
+    }
+    const QByteArray data = source.read(size + 1);
+    if (data.size() != size) {
+        qCDebug(ARK) << "The size of" << file << "changed, rewriting the archive instead";
+        archive_entry_free(newEntry);
+        return NotReplaceableInPlace;
+    }
+
+    QFile archiveFile(filename());
+    if (!archiveFile.open(QIODevice::ReadWrite)) {
+        emit error(i18nc("@info", "Could not open the archive for writing entries."));
+        archive_entry_free(newEntry);
+        return ReplaceFailed;
+    }
+
+    // Back up the blocks about to be overwritten next to the archive, and make sure they reached the
+    // disk first: the archive is restored from there if writing fails, or by hand after a crash.
+    const qint64 archiveSize = archiveFile.size();
+    const qint64 overwrittenSize = (isLast ? archiveSize : dataEnd) - headerPosition;
+    QTemporaryFile backup(filename() + QLatin1String(".XXXXXX.ark-backup"));
+    if (!backup.open() ||
+        !copyRange(archiveFile, headerPosition, overwrittenSize, backup) ||
+        !syncFile(backup)) {
+        qCDebug(ARK) << "Could not back up the entry to replace, rewriting the archive instead:" << backup.errorString();
+        archive_entry_free(newEntry);
+        return NotReplaceableInPlace;
+    }
+
+    qCDebug(ARK) << "Overwriting" << entry->fullPath() << "in place at" << headerPosition << ", backed up in" << backup.fileName();
+    TraceSpan span("write", "libarchive");
+    span.setArg(QStringLiteral("entry"), entry->fullPath());
+
+    bool isSuccessful = archiveFile.seek(headerPosition) &&
+                        (archiveFile.write(header) == header.size()) &&
+                        (archiveFile.write(data) == data.size()) &&
+                        (archiveFile.write(QByteArray(int(paddedSize - size), '\0')) == paddedSize - size);
+
+    if (isSuccessful && isLast) {
+        const QByteArray trailer(int(end - dataEnd), '\0');
+        isSuccessful = (archiveFile.write(trailer) == trailer.size()) && archiveFile.resize(end);
+    }
+    isSuccessful = syncFile(archiveFile) && isSuccessful;
+
+    if (!isSuccessful) {
+        qCCritical(ARK) << "Could not overwrite" << entry->fullPath() << ":" << archiveFile.errorString();
+        const bool isRestored = archiveFile.seek(headerPosition) &&
+                                copyRange(backup, 0, overwrittenSize, archiveFile) &&
+                                archiveFile.resize(archiveSize) &&
+                                syncFile(archiveFile);
+        if (!isRestored) {
+            backup.setAutoRemove(false);
+            qCCritical(ARK) << "Could not restore the archive, the overwritten blocks are kept in" << backup.fileName();
+        }
+        emit error(i18nc("@info Error in a message box", "Could not compress entry."));
+        archive_entry_free(newEntry);
+        return ReplaceFailed;
+    }
+
+    // The replaced entry is emitted again, and not counted twice.
+    m_numberOfEntries--;
+    emitEntryFromArchiveEntry(newEntry);
+    archive_entry_free(newEntry);
+    reportProgress(1.0);
+
+    return Replaced;
+}
+
+QVector<bool> ReadWriteLibarchivePlugin::doApplyOperations(const QVector<ArchiveOperation> &operations)
+{
+    CompressionOptions newFileOptions;
+    for (const ArchiveOperation &operation : operations) {
+        if (operation.mode == Comment) {
+            // Comments are not supported, let them fail one by one.
+            return ReadWriteArchiveInterface::doApplyOperations(operations);
+        }
+        if (operation.mode == Add) {
+            newFileOptions = operation.options;
+        }
+    }
+
+    qCDebug(ARK) << "Applying" << operations.size() << "operations in a single pass";
+
+    const bool isSuccessful = applyPlannedOperations(planOperations(operations), newFileOptions);
+
+    // The operations share the rewritten archive, so they all succeed or fail together.
+    return QVector<bool>(operations.size(), isSuccessful);
+}
+
+bool ReadWriteLibarchivePlugin::applyPlannedOperations(const QVector<PlannedFile> &plannedFiles, const CompressionOptions &newFileOptions)
+{
+    const bool creatingNewFile = !QFileInfo::exists(filename());
+    const uint totalCount = m_numberOfEntries + plannedFiles.size();
+    uint processedEntries = 0;
+
+    if (!creatingNewFile && !initializeReader()) {
+        m_plannedOperations.clear();
+        return false;
+    }
+
+    if (!initializeWriter(creatingNewFile, newFileOptions)) {
+        m_plannedOperations.clear();
+        return false;
+    }
+
+    // First copy the old entries through all the operations, then write the new files.
+    // The paths of the new files are known beforehand, so the old entries they overwrite can be skipped,
+    // and the removals of old entries are reported before the additions that may reuse their paths.
+    bool isSuccessful = true;
+    struct archive_entry *entry;
+    while (!creatingNewFile && !isCancellationRequested() &&
+           archive_read_next_header(m_archiveReader.data(), &entry) == ARCHIVE_OK) {
+        const QString file = QFile::decodeName(archive_entry_pathname(entry));
+        const QStringList pathnames = resultingPaths(entry, file, 0);
+
+        if (pathnames.isEmpty()) {
+            archive_read_data_skip(m_archiveReader.data());
+        }
+
+        for (const QString &pathname : pathnames) {
+            archive_entry_set_pathname(entry, pathname.toUtf8().constData());
+            if (!writeEntry(entry)) {
+                isSuccessful = false;
+                break;
+            }
+        }
+
+        if (!isSuccessful) {
+            break;
+        }
+        processedEntries++;
+        reportProgress(float(processedEntries)/float(totalCount), processedEntries, totalCount);
+    }
+
+    for (const PlannedFile &file : plannedFiles) {
+        if (!isSuccessful || isCancellationRequested()) {
+            break;
+        }
+
+        if (!writePlannedFile(file)) {
+            isSuccessful = false;
+            break;
+        }
+        processedEntries++;
+        reportProgress(float(processedEntries)/float(totalCount), processedEntries, totalCount);
+    }
+
+    isSuccessful = isSuccessful && !isCancellationRequested();
+    if (isSuccessful) {
+        qCDebug(ARK) << "Applied" << m_plannedOperations.size() << "operations," << processedEntries << "entries processed";
+    } else {
+        qCDebug(ARK) << "Applying operations failed";
+    }
+
+    m_plannedOperations.clear();
+    finish(isSuccessful);
+
+    return isSuccessful;
+}
+
+QVector<ReadWriteLibarchivePlugin::PlannedFile> ReadWriteLibarchivePlugin::planOperations(const QVector<ArchiveOperation> &operations)
+{
+    QVector<PlannedFile> plannedFiles;
+    m_plannedOperations.clear();
+
+    for (int i = 0; i < operations.size(); ++i) {
+        const ArchiveOperation &operation = operations.at(i);
+        PlannedOperation plannedOperation;
+        plannedOperation.mode = operation.mode;
+
+        switch (operation.mode) {
+        case Add: {
+            // Same files and paths as addFiles().
+            const QString destinationPath = (operation.destination == nullptr)
+                                            ? QString()
+                                            : operation.destination->fullPath();
+            for (const Archive::Entry *selectedFile : operation.entries) {
+                const QString &fullPath = selectedFile->fullPath();
+                plannedFiles.append({fullPath, destinationPath + fullPath, i});
+                plannedOperation.paths.insert(destinationPath + fullPath);
+
+                if (QFileInfo(fullPath).isDir()) {
+                    QDirIterator it(fullPath,
+                                    QDir::AllEntries | QDir::Readable |
+                                    QDir::Hidden | QDir::NoDotAndDotDot,
+                                    QDirIterator::Subdirectories);
+
+                    while (it.hasNext()) {
+                        QString path = it.next();
+                        if (it.fileInfo().isDir() && !it.fileInfo().isSymLink()) {
+                            path.append(QLatin1Char('/'));
+                        }
+                        plannedFiles.append({path, destinationPath + path, i});
+                        plannedOperation.paths.insert(destinationPath + path);
+                    }
+                }
+            }
+            break;
+        }
+        case Delete: {
+            const QStringList paths = entryFullPaths(operation.entries);
+            for (const QString &path : paths) {
+                plannedOperation.paths.insert(path);
+            }
+            break;
+        }
+        case Move:
+        case Copy: {
+            // Same paths as processOldEntries().
+            QStringList paths = entryFullPaths(operation.entries);
+            paths.sort();
+            const int entriesWithoutChildrenCount = (operation.mode == Move) ? entriesWithoutChildren(operation.entries).count() : 0;
+            const QStringList newPaths = entryPathsFromDestination(paths, operation.destination, entriesWithoutChildrenCount);
+            Q_ASSERT(paths.count() == newPaths.count());
+            for (int j = 0; j < paths.count(); ++j) {
+                plannedOperation.pathMap.insert(paths.at(j), newPaths.at(j));
+            }
+            break;
+        }
+        default:
+            qCDebug(ARK) << "Mode" << operation.mode << "is not considered for planning libarchive operations";
+            Q_ASSERT(false);
+        }
+
+        m_plannedOperations.append(plannedOperation);
+    }
+
+    return plannedFiles;
+}
+
+QStringList ReadWriteLibarchivePlugin::resultingPaths(struct archive_entry *entry, QString path, int firstOperation)
+{
+    for (int i = firstOperation; i < m_plannedOperations.size(); ++i) {
+        const PlannedOperation &operation = m_plannedOperations.at(i);
+
+        switch (operation.mode) {
+        case Add:
+            if (operation.paths.contains(path)) {
+                qCDebug(ARK) << path << "is overwritten by a new entry, skipping.";
+                // The new entry was emitted in its place.
+                m_numberOfEntries--;
+                return QStringList();
+            }
+            break;
+
+        case Delete:
+            if (operation.paths.contains(path)) {
+                setCurrentOperation(i);
+                emit entryRemoved(path);
+                return QStringList();
+            }
+            break;
+
+        case Move: {
+            const QString newPath = operation.pathMap.value(path);
+            if (!newPath.isEmpty()) {
+                setCurrentOperation(i);
+                emit entryRemoved(path);
+                path = newPath;
+                archive_entry_set_pathname(entry, path.toUtf8().constData());
+                emitEntryFromArchiveEntry(entry);
+            }
+            break;
+        }
+
+        case Copy: {
+            const QString newPath = operation.pathMap.value(path);
+            if (!newPath.isEmpty()) {
+                setCurrentOperation(i);
+                archive_entry_set_pathname(entry, newPath.toUtf8().constData());
+                emitEntryFromArchiveEntry(entry);
+                return resultingPaths(entry, path, i + 1) + resultingPaths(entry, newPath, i + 1);
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    return QStringList(path);
+}
+
+bool ReadWriteLibarchivePlugin::writePlannedFile(const PlannedFile &file)
+{
+    TraceSpan span("compress", "libarchive");
+    span.setArg(QStringLiteral("entry"), file.pathname);
+
+    struct archive_entry *entry = createDiskEntry(file.relativeName, file.pathname);
+
+    // The entry belongs to its own operation, the following ones may then move or delete it.
+    setCurrentOperation(file.operation);
+    emitEntryFromArchiveEntry(entry);
+    const QStringList pathnames = resultingPaths(entry, file.pathname, file.operation + 1);
+
+    bool isSuccessful = true;
+    for (const QString &pathname : pathnames) {
+        archive_entry_set_pathname(entry, QFile::encodeName(pathname).constData());
+        if (!writeDiskEntry(entry)) {
+            isSuccessful = false;
+            break;
+        }
+    }
+
+    archive_entry_free(entry);
+
+    return isSuccessful;
+}
+
 bool ReadWriteLibarchivePlugin::initializeWriter(const bool creatingNewFile, const CompressionOptions &options)
 {
     m_tempFile.setFileName(filename());
@@ -293,6 +750,7 @@ bool ReadWriteLibarchivePlugin::initializeWriterFilters()
 #ifdef HAVE_ZSTD_SUPPORT
     case ARCHIVE_FILTER_ZSTD:
         ret = archive_write_add_filter_zstd(m_archiveWriter.data());
+        enableZstdThreads();
         break;
 #endif
     case ARCHIVE_FILTER_NONE:
@@ -351,6 +809,7 @@ bool ReadWriteLibarchivePlugin::initializeNewFileWriterFilters(const Compression
     } else if (filename().right(3).toUpper() == QLatin1String("ZST")) {
         qCDebug(ARK) << "Detected zstd compression for new file";
         ret = archive_write_add_filter_zstd(m_archiveWriter.data());
+        enableZstdThreads();
 #endif
     } else if (filename().right(3).toUpper() == QLatin1String("TAR")) {
         qCDebug(ARK) << "Detected no compression for new file (pure tar)";
@@ -382,9 +841,17 @@ bool ReadWriteLibarchivePlugin::initializeNewFileWriterFilters(const Compression
     return true;
 }
 
+void ReadWriteLibarchivePlugin::enableZstdThreads()
+{
+    const QByteArray threads = QByteArray::number(QThread::idealThreadCount());
+    if (archive_write_set_filter_option(m_archiveWriter.data(), "zstd", "threads", threads.constData()) != ARCHIVE_OK) {
+        qCDebug(ARK) << "Could not enable multithreaded zstd compression:" << archive_error_string(m_archiveWriter.data());
+    }
+}
+
 void ReadWriteLibarchivePlugin::finish(const bool isSuccessful)
 {
-    if (!isSuccessful || QThread::currentThread()->isInterruptionRequested()) {
+    if (!isSuccessful || isCancellationRequested()) {
         archive_write_fail(m_archiveWriter.data());
         m_tempFile.cancelWriting();
     } else {
@@ -416,7 +883,7 @@ bool ReadWriteLibarchivePlugin::processOldEntries(uint &entriesCounter, Operatio
     }
 
     struct archive_entry *entry;
-    while (!QThread::currentThread()->isInterruptionRequested() && archive_read_next_header(m_archiveReader.data(), &entry) == ARCHIVE_OK) {
+    while (!isCancellationRequested() && archive_read_next_header(m_archiveReader.data(), &entry) == ARCHIVE_OK) {
 
         const QString file = QFile::decodeName(archive_entry_pathname(entry));
 
@@ -445,7 +912,7 @@ bool ReadWriteLibarchivePlugin::processOldEntries(uint &entriesCounter, Operatio
             case Delete:
                 entriesCounter++;
                 emit entryRemoved(file);
-                emit progress(float(newEntries + entriesCounter + iteratedEntries)/float(totalCount));
+                reportProgress(float(newEntries + entriesCounter + iteratedEntries)/float(totalCount), newEntries + entriesCounter + iteratedEntries, totalCount);
                 break;
 
             case Add:
@@ -474,10 +941,10 @@ bool ReadWriteLibarchivePlugin::processOldEntries(uint &entriesCounter, Operatio
         } else {
             return false;
         }
-        emit progress(float(newEntries + entriesCounter + iteratedEntries)/float(totalCount));
+        reportProgress(float(newEntries + entriesCounter + iteratedEntries)/float(totalCount), newEntries + entriesCounter + iteratedEntries, totalCount);
     }
 
-    return !QThread::currentThread()->isInterruptionRequested();
+    return !isCancellationRequested();
 }
 
 bool ReadWriteLibarchivePlugin::writeEntry(struct archive_entry *entry)
@@ -508,8 +975,28 @@ bool ReadWriteLibarchivePlugin::writeEntry(struct archive_entry *entry)
 //       such as an fd to archive_read_disk_entry_from_file()
 bool ReadWriteLibarchivePlugin::writeFile(const QString &relativeName, const QString &destination)
 {
-    const QString absoluteFilename = QFileInfo(relativeName).absoluteFilePath();
     const QString destinationFilename = destination + relativeName;
+    TraceSpan span("compress", "libarchive");
+    span.setArg(QStringLiteral("entry"), destinationFilename);
+
+    struct archive_entry *entry = createDiskEntry(relativeName, destinationFilename);
+    if (!writeDiskEntry(entry)) {
+        archive_entry_free(entry);
+        return false;
+    }
+
+    m_writtenFiles.push_back(destinationFilename);
+
+    emitEntryFromArchiveEntry(entry);
+
+    archive_entry_free(entry);
+
+    return true;
+}
+
+struct archive_entry *ReadWriteLibarchivePlugin::createDiskEntry(const QString &relativeName, const QString &pathname)
+{
+    const QString absoluteFilename = QFileInfo(relativeName).absoluteFilePath();
 
     // #253059: Even if we use archive_read_disk_entry_from_file,
     //          libarchive may have been compiled without HAVE_LSTAT,
@@ -520,15 +1007,20 @@ bool ReadWriteLibarchivePlugin::writeFile(const QString &relativeName, const QSt
     lstat(QFile::encodeName(absoluteFilename).constData(), &st); // krazy:exclude=syscalls
 
     struct archive_entry *entry = archive_entry_new();
-    archive_entry_set_pathname(entry, QFile::encodeName(destinationFilename).constData());
+    archive_entry_set_pathname(entry, QFile::encodeName(pathname).constData());
     archive_entry_copy_sourcepath(entry, QFile::encodeName(absoluteFilename).constData());
     archive_read_disk_entry_from_file(m_archiveReadDisk.data(), entry, -1, &st);
 
+    return entry;
+}
+
+bool ReadWriteLibarchivePlugin::writeDiskEntry(struct archive_entry *entry)
+{
     const auto returnCode = archive_write_header(m_archiveWriter.data(), entry);
     if (returnCode == ARCHIVE_OK) {
         // If the whole archive is extracted and the total filesize is
         // available, we use partial progress.
-        copyData(absoluteFilename, m_archiveWriter.data(), false);
+        copyData(QFile::decodeName(archive_entry_sourcepath(entry)), m_archiveWriter.data(), false);
     } else {
         qCCritical(ARK) << "Writing header failed with error code " << returnCode;
         qCCritical(ARK) << "Error while writing..." << archive_error_string(m_archiveWriter.data()) << "(error no =" << archive_errno(m_archiveWriter.data()) << ')';
@@ -536,23 +1028,10 @@ bool ReadWriteLibarchivePlugin::writeFile(const QString &relativeName, const QSt
         emit error(i18nc("@info Error in a message box",
                          "Could not compress entry."));
 
-        archive_entry_free(entry);
-
         return false;
     }
 
-    if (QThread::currentThread()->isInterruptionRequested()) {
-        archive_entry_free(entry);
-        return false;
-    }
-
-    m_writtenFiles.push_back(destinationFilename);
-
-    emitEntryFromArchiveEntry(entry);
-
-    archive_entry_free(entry);
-
-    return true;
+    return !isCancellationRequested();
 }
 
 #include "readwritelibarchiveplugin.moc"
@@ -30,8 +30,10 @@
 
 #include "libarchiveplugin.h"
 
-#include <QStringList>
+#include <QMap>
 #include <QSaveFile>
+#include <QSet>
+#include <QStringList>
 
 using namespace Kerfuffle;
 
@@ -47,14 +49,82 @@ public:
     bool moveFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options) override;
     bool copyFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options) override;
     bool deleteFiles(const QVector<Archive::Entry*> &files) override;
+    bool canReplaceEntries() const override;
+    bool replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions &options) override;
 
 protected:
+    /**
+     * Applies all the operations while copying the old entries once, instead of rewriting the archive for each of them.
+     */
+    QVector<bool> doApplyOperations(const QVector<ArchiveOperation> &operations) override;
+
     bool initializeWriter(const bool creatingNewFile = false, const CompressionOptions &options = CompressionOptions());
     bool initializeWriterFilters();
     bool initializeNewFileWriterFilters(const CompressionOptions &options);
     void finish(const bool isSuccessful);
 
 private:
+    struct PlannedOperation
+    {
+        OperationMode mode;
+        // Paths of the entries added or deleted by the operation.
+        QSet<QString> paths;
+        // Old paths of the entries moved or copied by the operation, and their new paths.
+        QMap<QString, QString> pathMap;
+    };
+
+    struct PlannedFile
+    {
+        QString relativeName;
+        QString pathname;
+        int operation;
+    };
+
+    enum InPlaceResult {
+        Replaced,
+        NotReplaceableInPlace,
+        ReplaceFailed
+    };
+
+    /**
+     * Fills m_plannedOperations from @p operations.
+     *
+     * @return The files to add from disk, in the order of the operations.
+     */
+    QVector<PlannedFile> planOperations(const QVector<ArchiveOperation> &operations);
+
+    /**
+     * Applies the planned operations from @p firstOperation on to the entry at @p path,
+     * emitting the entries added and removed on the way.
+     *
+     * @return The paths of the entry once all the operations are applied: none if
+     * it's deleted or overwritten, several if it's copied.
+     */
+    QStringList resultingPaths(struct archive_entry *entry, QString path, int firstOperation);
+
+    /**
+     * Copies the old entries through m_plannedOperations, then writes @p plannedFiles.
+     *
+     * @return bool indicating whether the operation was successful.
+     */
+    bool applyPlannedOperations(const QVector<PlannedFile> &plannedFiles, const CompressionOptions &newFileOptions);
+
+    /**
+     * Overwrites the data of @p entry with the file @p file within an uncompressed tar,
+     * which is possible if it keeps the same number of blocks or if it's the last entry.
+     * The overwritten blocks are backed up on disk first, and written back if overwriting fails.
+     *
+     * @return NotReplaceableInPlace if the archive must be rewritten instead.
+     */
+    InPlaceResult replaceEntryInPlace(const Archive::Entry *entry, const QString &file);
+
+    /**
+     * Writes a file to add from disk, under each of its resulting paths.
+     *
+     * @return bool indicating whether the operation was successful.
+     */
+    bool writePlannedFile(const PlannedFile &file);
+
     /**
      * Processes all the existing entries and does manipulations to them
      * based on the OperationMode (Add/Move/Copy/Delete).
@@ -72,6 +142,12 @@ private:
      */
     bool writeEntry(struct archive_entry *entry);
 
+    /**
+     * Lets the zstd filter of the writer compress with one thread per core.
+     * Requires libarchive >= 3.6.0, older versions keep compressing with a single thread.
+     */
+    void enableZstdThreads();
+
     /**
      * Writes entry from physical disk.
      *
@@ -79,6 +155,18 @@ private:
      */
     bool writeFile(const QString &relativeName, const QString &destination);
 
+    /**
+     * @return A new entry named @p pathname for the file @p relativeName on disk, to be freed by the caller.
+     */
+    struct archive_entry *createDiskEntry(const QString &relativeName, const QString &pathname);
+
+    /**
+     * Writes the header of an entry created by createDiskEntry() and the data of its file.
+     *
+     * @return bool indicating whether the operation was successful.
+     */
+    bool writeDiskEntry(struct archive_entry *entry);
+
     QSaveFile m_tempFile;
     ArchiveWrite m_archiveWriter;
 
@@ -90,6 +178,8 @@ private:
     QStringList m_filesPaths;
     int m_entriesWithoutChildren = 0;
     const Archive::Entry *m_destination = nullptr;
+
+    QVector<PlannedOperation> m_plannedOperations;
 };
 
 #endif // READWRITELIBARCHIVEPLUGIN_H
@@ -29,8 +29,97 @@
 
 #include <KPluginFactory>
 
+#include <bzlib.h>
+
+#include <climits>
+#include <cstring>
+
 K_PLUGIN_CLASS_WITH_JSON(LibBzip2Interface, "kerfuffle_libbz2.json")
 
+namespace {
+
+// "BZh", the block size and the magic number of the first block.
+const int bzip2HeaderSize = 10;
+
+/**
+ * Decodes one or more bzip2 streams, checking their CRC.
+ */
+class Bzip2Decoder : public SingleFileDecoder
+{
+public:
+    Bzip2Decoder()
+    {
+        m_valid = (BZ2_bzDecompressInit(&m_stream, 0, 0) == BZ_OK);
+    }
+
+    ~Bzip2Decoder() override
+    {
+        if (m_valid) {
+            BZ2_bzDecompressEnd(&m_stream);
+        }
+    }
+
+    bool decode(const char **input, qint64 *inputSize, char **output, qint64 *outputSize) override
+    {
+        // Another stream follows the one that just ended.
+        if (m_finished && *inputSize > 0) {
+            BZ2_bzDecompressEnd(&m_stream);
+            m_valid = (BZ2_bzDecompressInit(&m_stream, 0, 0) == BZ_OK);
+            m_finished = false;
+        }
+
+        if (!m_valid) {
+            return false;
+        }
+
+        const unsigned int availableInput = static_cast<unsigned int>(qMin<qint64>(*inputSize, UINT_MAX));
+        const unsigned int availableOutput = static_cast<unsigned int>(qMin<qint64>(*outputSize, UINT_MAX));
+        m_stream.next_in = const_cast<char*>(*input);
+        m_stream.avail_in = availableInput;
+        m_stream.next_out = *output;
+        m_stream.avail_out = availableOutput;
+
+        const int ret = BZ2_bzDecompress(&m_stream);
+
+        *input += availableInput - m_stream.avail_in;
+        *inputSize -= availableInput - m_stream.avail_in;
+        *output += availableOutput - m_stream.avail_out;
+        *outputSize -= availableOutput - m_stream.avail_out;
+
+        if (ret == BZ_STREAM_END) {
+            m_finished = true;
+            return true;
+        }
+
+        return ret == BZ_OK;
+    }
+
+    bool isFinished() const override
+    {
+        return m_finished;
+    }
+
+private:
+    bz_stream m_stream = {};
+    bool m_valid = false;
+    bool m_finished = false;
+};
+
+/**
+ * Checks whether @p header, of at least bzip2HeaderSize bytes, is the start of a bzip2 stream
+ * followed by a block, like the ones written by pbzip2 or by concatenating bzip2 files.
+ */
+bool isBzip2Header(const uchar *header)
+{
+    static const uchar blockMagic[] = {0x31, 0x41, 0x59, 0x26, 0x53, 0x59};
+
+    return header[0] == 'B' && header[1] == 'Z' && header[2] == 'h'
+            && header[3] >= '1' && header[3] <= '9'
+            && memcmp(header + 4, blockMagic, sizeof(blockMagic)) == 0;
+}
+
+}
+
 LibBzip2Interface::LibBzip2Interface(QObject *parent, const QVariantList & args)
         : LibSingleFileInterface(parent, args)
 {
@@ -42,4 +131,20 @@ LibBzip2Interface::~LibBzip2Interface()
 {
 }
 
+QVector<SingleFileChunk> LibBzip2Interface::independentChunks(QFile *file)
+{
+    return scanForMembers(file, 'B', bzip2HeaderSize, isBzip2Header);
+}
+
+SingleFileDecoder *LibBzip2Interface::createDecoder(const SingleFileChunk &chunk) const
+{
+    Q_UNUSED(chunk)
+    return new Bzip2Decoder;
+}
+
+SingleFileDecoder *LibBzip2Interface::createStreamDecoder() const
+{
+    return new Bzip2Decoder;
+}
+
 #include "bz2plugin.moc"
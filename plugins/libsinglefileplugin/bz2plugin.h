@@ -35,6 +35,11 @@ class KERFUFFLE_EXPORT LibBzip2Interface : public LibSingleFileInterface
 public:
     LibBzip2Interface(QObject *parent, const QVariantList & args);
     ~LibBzip2Interface() override;
+
+protected:
+    QVector<SingleFileChunk> independentChunks(QFile *file) override;
+    SingleFileDecoder *createDecoder(const SingleFileChunk &chunk) const override;
+    SingleFileDecoder *createStreamDecoder() const override;
 };
 
 #endif // BZ2PLUGIN_H
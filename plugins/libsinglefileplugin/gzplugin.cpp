@@ -24,14 +24,144 @@
  */
 
 #include "gzplugin.h"
+#include "ark_debug.h"
 #include "kerfuffle_export.h"
 
+#include <QFile>
 #include <QString>
 
 #include <KPluginFactory>
 
+#include <zlib.h>
+
+#include <climits>
+
 K_PLUGIN_CLASS_WITH_JSON(LibGzipInterface, "kerfuffle_libgz.json")
 
+namespace {
+
+const int gzipHeaderSize = 10;
+const int gzipTrailerSize = 8;
+const int bgzfHeaderSize = 18;
+
+/**
+ * Deflate can't compress data by more than 1032:1, so the size of smaller members
+ * can't have wrapped around in their trailer.
+ */
+const qint64 maximumUnwrappedMemberSize = (Q_INT64_C(1) << 32) / 1032;
+
+/**
+ * Decodes one or more gzip members, checking their CRC and size.
+ */
+class GzipDecoder : public SingleFileDecoder
+{
+public:
+    GzipDecoder()
+    {
+        // 16 + MAX_WBITS: expect a gzip header and trailer instead of a zlib one.
+        m_valid = (inflateInit2(&m_stream, 16 + MAX_WBITS) == Z_OK);
+    }
+
+    ~GzipDecoder() override
+    {
+        if (m_valid) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+    bool decode(const char **input, qint64 *inputSize, char **output, qint64 *outputSize) override
+    {
+        if (!m_valid) {
+            return false;
+        }
+
+        // Another member follows the one that just ended.
+        if (m_finished && *inputSize > 0) {
+            inflateReset(&m_stream);
+            m_finished = false;
+        }
+
+        const uInt availableInput = static_cast<uInt>(qMin<qint64>(*inputSize, UINT_MAX));
+        const uInt availableOutput = static_cast<uInt>(qMin<qint64>(*outputSize, UINT_MAX));
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(*input));
+        m_stream.avail_in = availableInput;
+        m_stream.next_out = reinterpret_cast<Bytef*>(*output);
+        m_stream.avail_out = availableOutput;
+
+        const int ret = inflate(&m_stream, Z_NO_FLUSH);
+
+        *input += availableInput - m_stream.avail_in;
+        *inputSize -= availableInput - m_stream.avail_in;
+        *output += availableOutput - m_stream.avail_out;
+        *outputSize -= availableOutput - m_stream.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            m_finished = true;
+            return true;
+        }
+
+        return ret == Z_OK || ret == Z_BUF_ERROR;
+    }
+
+    bool isFinished() const override
+    {
+        return m_finished;
+    }
+
+private:
+    z_stream m_stream = {};
+    bool m_valid = false;
+    bool m_finished = false;
+};
+
+/**
+ * Checks whether @p header, of at least gzipHeaderSize bytes, looks like the header of a gzip member.
+ * Reserved flags must be unset and the extra flags and OS must have sensible values, which keeps
+ * the odds of finding one by chance in deflate data very low.
+ */
+bool isGzipHeader(const uchar *header)
+{
+    return header[0] == 0x1f && header[1] == 0x8b && header[2] == Z_DEFLATED
+            && (header[3] & 0xe0) == 0
+            && (header[8] == 0 || header[8] == 2 || header[8] == 4)
+            && (header[9] <= 13 || header[9] == 255);
+}
+
+/**
+ * BGZF, written by bgzip and many bioinformatics tools, is a series of gzip members
+ * which store their own size in an extra field of the header.
+ * @return The size of the member starting with @p header, or -1 if it isn't a BGZF member.
+ */
+qint64 bgzfMemberSize(const QByteArray &header)
+{
+    const uchar *data = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() < bgzfHeaderSize || !isGzipHeader(data) || !(data[3] & 0x04)) {
+        return -1;
+    }
+
+    const int extraLength = data[10] | (data[11] << 8);
+    if (extraLength < 6 || data[12] != 'B' || data[13] != 'C' || data[14] != 2 || data[15] != 0) {
+        return -1;
+    }
+
+    return (data[16] | (data[17] << 8)) + 1;
+}
+
+/**
+ * @return The size stored in the trailer of the member ending at @p memberEnd, or -1 on errors.
+ */
+qint64 memberUncompressedSize(QFile *file, qint64 memberEnd)
+{
+    uchar trailer[4];
+    if (!file->seek(memberEnd - 4) || file->read(reinterpret_cast<char*>(trailer), 4) != 4) {
+        return -1;
+    }
+
+    return qint64(trailer[0]) | (qint64(trailer[1]) << 8) | (qint64(trailer[2]) << 16) | (qint64(trailer[3]) << 24);
+}
+
+}
+
 LibGzipInterface::LibGzipInterface(QObject *parent, const QVariantList & args)
         : LibSingleFileInterface(parent, args)
 {
@@ -43,4 +173,92 @@ LibGzipInterface::~LibGzipInterface()
 {
 }
 
+qint64 LibGzipInterface::uncompressedSize()
+{
+    QFile file(filename());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    const qint64 fileSize = file.size();
+
+    // The trailer of each member stores its size modulo 2^32, which BGZF keeps below 64 KiB.
+    if (bgzfMemberSize(file.peek(bgzfHeaderSize)) > 0) {
+        qint64 size = 0;
+        qint64 offset = 0;
+        while (offset < fileSize) {
+            if (!file.seek(offset)) {
+                return -1;
+            }
+            const qint64 memberSize = bgzfMemberSize(file.read(bgzfHeaderSize));
+            if (memberSize < bgzfHeaderSize + gzipTrailerSize || offset + memberSize > fileSize) {
+                return -1;
+            }
+            const qint64 memberUncompressed = memberUncompressedSize(&file, offset + memberSize);
+            if (memberUncompressed < 0) {
+                return -1;
+            }
+            size += memberUncompressed;
+            offset += memberSize;
+        }
+
+        return size;
+    }
+
+    // Otherwise only the size of the last member is known, modulo 2^32. It is the size of the
+    // whole file only if there is a single member, small enough for the size not to wrap around.
+    // Such files are cheap to scan for other members.
+    if (fileSize < gzipHeaderSize + gzipTrailerSize || fileSize > maximumUnwrappedMemberSize) {
+        return -1;
+    }
+    if (findMembers(&file, 0x1f, gzipHeaderSize, isGzipHeader, fileSize).size() != 1) {
+        qCDebug(ARK) << "The uncompressed size of gzip files with several members is unknown";
+        return -1;
+    }
+
+    return memberUncompressedSize(&file, fileSize);
+}
+
+QVector<SingleFileChunk> LibGzipInterface::independentChunks(QFile *file)
+{
+    const qint64 fileSize = file->size();
+    if (fileSize < 2 * parallelChunkSize || !file->seek(0)) {
+        return QVector<SingleFileChunk>();
+    }
+
+    QVector<qint64> memberOffsets;
+
+    // BGZF members can be found without reading the whole file.
+    if (bgzfMemberSize(file->peek(bgzfHeaderSize)) > 0) {
+        qint64 offset = 0;
+        while (offset < fileSize) {
+            if (!file->seek(offset)) {
+                return QVector<SingleFileChunk>();
+            }
+            const qint64 memberSize = bgzfMemberSize(file->read(bgzfHeaderSize));
+            if (memberSize < 0) {
+                return QVector<SingleFileChunk>();
+            }
+            memberOffsets.append(offset);
+            offset += memberSize;
+        }
+
+        return groupMembers(memberOffsets, fileSize);
+    }
+
+    // Otherwise, look for the headers of the members written by pigz or by concatenating gzip files.
+    return scanForMembers(file, 0x1f, gzipHeaderSize, isGzipHeader);
+}
+
+SingleFileDecoder *LibGzipInterface::createDecoder(const SingleFileChunk &chunk) const
+{
+    Q_UNUSED(chunk)
+    return new GzipDecoder;
+}
+
+SingleFileDecoder *LibGzipInterface::createStreamDecoder() const
+{
+    return new GzipDecoder;
+}
+
 #include "gzplugin.moc"
@@ -35,6 +35,12 @@ class KERFUFFLE_EXPORT LibGzipInterface : public LibSingleFileInterface
 public:
     LibGzipInterface(QObject *parent, const QVariantList & args);
     ~LibGzipInterface() override;
+
+protected:
+    qint64 uncompressedSize() override;
+    QVector<SingleFileChunk> independentChunks(QFile *file) override;
+    SingleFileDecoder *createDecoder(const SingleFileChunk &chunk) const override;
+    SingleFileDecoder *createStreamDecoder() const override;
 };
 
 #endif // GZPLUGIN_H
@@ -76,5 +76,8 @@
         ],
         "Version": "@KDE_APPLICATIONS_VERSION@"
     },
-    "X-KDE-Priority": 100
+    "X-KDE-Priority": 100,
+    "application/x-bzip": {
+        "SupportsTesting": true
+    }
 }
@@ -76,5 +76,11 @@
         ],
         "Version": "@KDE_APPLICATIONS_VERSION@"
     },
-    "X-KDE-Priority": 100
+    "X-KDE-Priority": 100,
+    "application/x-lzma": {
+        "SupportsTesting": true
+    },
+    "application/x-xz": {
+        "SupportsTesting": true
+    }
 }
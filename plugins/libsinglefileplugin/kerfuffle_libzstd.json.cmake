@@ -0,0 +1,18 @@
+{
+    "KPlugin": {
+        "Description": "Open and extract single files compressed with the Zstandard algorithm",
+        "Id": "kerfuffle_libzstd",
+        "MimeTypes": [
+            "@SUPPORTED_MIMETYPES@"
+        ],
+        "Name": "Zstandard plugin",
+        "ServiceTypes": [
+            "Kerfuffle/Plugin"
+        ],
+        "Version": "@KDE_APPLICATIONS_VERSION@"
+    },
+    "X-KDE-Priority": 100,
+    "application/zstd": {
+        "SupportsTesting": true
+    }
+}
@@ -26,13 +26,24 @@
 #include "singlefileplugin.h"
 #include "ark_debug.h"
 #include "queries.h"
+#include "tracer.h"
 
 #include <QFile>
 #include <QFileInfo>
+#include <QQueue>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 #include <KFilterDev>
 #include <KLocalizedString>
 
+#include <cstring>
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_FREEBSD)
+#include <fcntl.h>
+#endif
+
 LibSingleFileInterface::LibSingleFileInterface(QObject *parent, const QVariantList & args)
         : Kerfuffle::ReadOnlyArchiveInterface(parent, args)
 {
@@ -48,6 +59,8 @@ bool LibSingleFileInterface::extractFiles(const QVector<Kerfuffle::Archive::Entr
     Q_UNUSED(files)
     Q_UNUSED(options)
 
+    TraceSpan span("decompress", "singlefile");
+
     QString outputFileName = destinationDirectory;
     if (!destinationDirectory.endsWith(QLatin1Char('/'))) {
         outputFileName += QLatin1Char('/');
@@ -69,35 +82,409 @@ bool LibSingleFileInterface::extractFiles(const QVector<Kerfuffle::Archive::Entr
         return false;
     }
 
-    KCompressionDevice *device = new KCompressionDevice(filename(), KFilterDev::compressionTypeForMimeType(m_mimeType));
-    if (!device) {
-        qCCritical(ARK) << "Could not create KCompressionDevice";
-        emit error(xi18nc("@info", "Ark could not open <filename>%1</filename> for extraction.", filename()));
+    preallocate(&outputFile, uncompressedSize());
+
+    qint64 bytesWritten = 0;
+    DecodeResult result = decodeInParallel(&outputFile, &bytesWritten);
+    if (result == NotSplittable) {
+        // Whatever has been written so far can't be trusted, start over.
+        bytesWritten = 0;
+        if (!outputFile.seek(0)) {
+            result = Failed;
+        } else {
+            result = decodeSerially(&outputFile, &bytesWritten);
+        }
+    }
 
+    if (result != Decoded) {
+        outputFile.remove();
         return false;
     }
 
-    device->open(QIODevice::ReadOnly);
+    // The uncompressed size is only a hint and a failed parallel attempt may have written
+    // more data than needed, make sure we don't leave trailing garbage behind.
+    if (outputFile.size() != bytesWritten) {
+        outputFile.resize(bytesWritten);
+    }
+
+    emit progress(1.0);
+
+    return true;
+}
+
+LibSingleFileInterface::DecodeResult LibSingleFileInterface::decodeSerially(QFile *outputFile, qint64 *bytesWritten)
+{
+    const KCompressionDevice::CompressionType compressionType = KFilterDev::compressionTypeForMimeType(m_mimeType);
+    if (compressionType == KCompressionDevice::None) {
+        // KArchive doesn't know this format, use our own decoder instead.
+        return decodeStream(outputFile, bytesWritten);
+    }
+
+    // We open the compressed file ourselves, so that its position can be used to compute the progress.
+    QFile *inputFile = new QFile(filename());
+    if (!inputFile->open(QIODevice::ReadOnly)) {
+        qCCritical(ARK) << "Failed to open input file" << inputFile->errorString();
+        emit error(xi18nc("@info", "Ark could not open <filename>%1</filename> for extraction.", filename()));
+        delete inputFile;
 
-    qint64 bytesRead;
-    QByteArray dataChunk(1024*16, '\0');   // 16Kb
+        return Failed;
+    }
+
+    const qint64 compressedSize = inputFile->size();
+
+    KCompressionDevice device(inputFile, true, compressionType);
+    if (!device.open(QIODevice::ReadOnly)) {
+        qCCritical(ARK) << "Could not open KCompressionDevice";
+        emit error(xi18nc("@info", "Ark could not open <filename>%1</filename> for extraction.", filename()));
+
+        return Failed;
+    }
+
+    // Start with a small buffer, so that the first progress update comes quickly,
+    // then grow it as long as the decompressor is able to fill it.
+    QByteArray dataChunk(minimumChunkSize, '\0');
 
     while (true) {
-        bytesRead = device->read(dataChunk.data(), dataChunk.size());
+        if (isCancellationRequested()) {
+            qCDebug(ARK) << "Extraction interrupted";
+            return Failed;
+        }
+
+        const qint64 bytesRead = device.read(dataChunk.data(), dataChunk.size());
 
         if (bytesRead == -1) {
             emit error(xi18nc("@info", "There was an error while reading <filename>%1</filename> during extraction.", filename()));
-            break;
+            return Failed;
         } else if (bytesRead == 0) {
             break;
         }
 
-        outputFile.write(dataChunk.data(), bytesRead);
+        if (outputFile->write(dataChunk.constData(), bytesRead) != bytesRead) {
+            qCCritical(ARK) << "Failed to write to output file" << outputFile->errorString();
+            emit error(xi18nc("@info", "There was an error while writing <filename>%1</filename> during extraction.", outputFile->fileName()));
+            return Failed;
+        }
+        *bytesWritten += bytesRead;
+
+        if (bytesRead == dataChunk.size() && dataChunk.size() < maximumChunkSize) {
+            dataChunk.resize(dataChunk.size() * 2);
+        }
+
+        if (compressedSize > 0) {
+            reportProgress(double(inputFile->pos()) / compressedSize);
+        }
+    }
+
+    return Decoded;
+}
+
+LibSingleFileInterface::DecodedChunk LibSingleFileInterface::decodeChunk(SingleFileDecoder *chunkDecoder, const QByteArray &compressedData, qint64 uncompressedSize,
+                                                                        DecodingState *state, const LibSingleFileInterface *plugin)
+{
+    QScopedPointer<SingleFileDecoder> decoder(chunkDecoder);
+    DecodedChunk result;
+
+    // Accounts for the new size of the decoded data, unless that would go over the budget of the state.
+    auto reserve = [state, &result](qint64 size) {
+        if (state) {
+            const qint64 increase = size - result.data.size();
+            if (state->decodedDataSize.fetchAndAddOrdered(increase) + increase > maximumDecodedDataSize) {
+                state->decodedDataSize.fetchAndAddOrdered(-increase);
+                return false;
+            }
+        }
+        result.data.resize(static_cast<int>(size));
+        return true;
+    };
+    auto defer = [state, &result]() {
+        state->decodedDataSize.fetchAndAddOrdered(-qint64(result.data.size()));
+        result.data.clear();
+        result.deferred = true;
+        return result;
+    };
+
+    // Leave some room after the known size, so that the decoder is able to reach the end of the chunk.
+    const qint64 capacity = uncompressedSize >= 0 ? uncompressedSize + minimumChunkSize : 4 * qint64(compressedData.size());
+    if (!reserve(qBound<qint64>(minimumChunkSize, capacity, maximumDecodedChunkSize))) {
+        return defer();
+    }
+
+    const char *input = compressedData.constData();
+    qint64 inputSize = compressedData.size();
+    qint64 outputPos = 0;
+
+    while (inputSize > 0 || !decoder->isFinished()) {
+        if ((state && state->aborted.loadAcquire()) || plugin->isCancellationRequested()) {
+            return result;
+        }
+
+        if (outputPos == result.data.size()) {
+            if (result.data.size() >= maximumDecodedChunkSize) {
+                qCDebug(ARK) << "Chunk is too big to be decoded in memory";
+                return result;
+            }
+            if (!reserve(qMin<qint64>(2 * qint64(result.data.size()), maximumDecodedChunkSize))) {
+                return defer();
+            }
+        }
+
+        char *output = result.data.data() + outputPos;
+        qint64 outputSize = result.data.size() - outputPos;
+        const qint64 previousInputSize = inputSize;
+        const qint64 previousOutputSize = outputSize;
+
+        if (!decoder->decode(&input, &inputSize, &output, &outputSize)) {
+            return result;
+        }
+        outputPos += previousOutputSize - outputSize;
+
+        // The input is exhausted and the decoder has nothing more to give: the chunk is truncated.
+        if (inputSize == previousInputSize && outputSize == previousOutputSize) {
+            return result;
+        }
+    }
+
+    reserve(outputPos);
+    result.ok = true;
+
+    return result;
+}
+
+bool LibSingleFileInterface::readChunk(QFile *file, const SingleFileChunk &chunk, QByteArray *compressedData, SingleFileDecoder **decoder) const
+{
+    if (file->seek(chunk.offset)) {
+        *compressedData = file->read(chunk.size);
+    }
+    *decoder = createDecoder(chunk);
+    if (compressedData->size() != chunk.size || !*decoder) {
+        qCWarning(ARK) << "Could not read chunk at offset" << chunk.offset;
+        delete *decoder;
+        *decoder = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+LibSingleFileInterface::DecodeResult LibSingleFileInterface::decodeInParallel(QFile *outputFile, qint64 *bytesWritten)
+{
+    TraceSpan span("decodeInParallel", "singlefile");
+
+    QFile inputFile(filename());
+    if (!inputFile.open(QIODevice::ReadOnly)) {
+        // Let the serial decoding report the error.
+        return NotSplittable;
+    }
+
+    const QVector<SingleFileChunk> chunks = independentChunks(&inputFile);
+    if (chunks.size() < 2) {
+        return NotSplittable;
+    }
+
+    const int threadCount = qMax(2, QThread::idealThreadCount());
+    qCDebug(ARK) << "Decoding" << chunks.size() << "chunks with" << threadCount << "threads";
+
+    // Use our own pool, a long extraction shouldn't starve the global one.
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+
+    DecodingState state;
+    QQueue<QFuture<DecodedChunk>> pending;
+    DecodeResult result = Decoded;
+    const qint64 compressedSize = inputFile.size();
+    int nextChunk = 0;
+    int writtenChunks = 0;
+
+    while (writtenChunks < chunks.size()) {
+        if (isCancellationRequested()) {
+            qCDebug(ARK) << "Extraction interrupted";
+            result = Failed;
+            break;
+        }
+
+        // Keep a bounded number of chunks and amount of data in memory, since the output has to be written in order.
+        if (nextChunk < chunks.size() && pending.size() < 2 * threadCount
+                && (pending.isEmpty() || state.decodedDataSize.loadAcquire() < maximumDecodedDataSize)) {
+            const SingleFileChunk &chunk = chunks.at(nextChunk);
+
+            QByteArray compressedData;
+            SingleFileDecoder *decoder = nullptr;
+            if (!readChunk(&inputFile, chunk, &compressedData, &decoder)) {
+                result = NotSplittable;
+                break;
+            }
+
+            pending.enqueue(QtConcurrent::run(&pool, &LibSingleFileInterface::decodeChunk, decoder, compressedData, chunk.uncompressedSize, &state, this));
+            nextChunk++;
+            continue;
+        }
+
+        DecodedChunk decoded = pending.dequeue().result();
+        if (decoded.deferred) {
+            // The chunk is the next one to be written, decode it regardless of the other ones.
+            const SingleFileChunk &chunk = chunks.at(writtenChunks);
+            qCDebug(ARK) << "Decoding chunk" << writtenChunks << "again, the data in memory was too big";
+
+            QByteArray compressedData;
+            SingleFileDecoder *decoder = nullptr;
+            if (!readChunk(&inputFile, chunk, &compressedData, &decoder)) {
+                result = NotSplittable;
+                break;
+            }
+            decoded = decodeChunk(decoder, compressedData, chunk.uncompressedSize, nullptr, this);
+        } else {
+            state.decodedDataSize.fetchAndAddOrdered(-qint64(decoded.data.size()));
+        }
+
+        if (!decoded.ok) {
+            qCDebug(ARK) << "Could not decode chunk" << writtenChunks << "on its own, falling back to serial decoding";
+            result = isCancellationRequested() ? Failed : NotSplittable;
+            break;
+        }
+
+        if (outputFile->write(decoded.data) != decoded.data.size()) {
+            qCCritical(ARK) << "Failed to write to output file" << outputFile->errorString();
+            emit error(xi18nc("@info", "There was an error while writing <filename>%1</filename> during extraction.", outputFile->fileName()));
+            result = Failed;
+            break;
+        }
+        *bytesWritten += decoded.data.size();
+
+        const SingleFileChunk &chunk = chunks.at(writtenChunks++);
+        reportProgress(double(chunk.offset + chunk.size) / compressedSize);
+    }
+
+    // Make the chunks still in the queue return as soon as possible.
+    state.aborted.storeRelease(1);
+    for (QFuture<DecodedChunk> &future : pending) {
+        future.waitForFinished();
     }
 
-    delete device;
+    span.setArg(QStringLiteral("chunks"), chunks.size());
+    span.setArg(QStringLiteral("decodedChunks"), writtenChunks);
+
+    return result;
+}
+
+bool LibSingleFileInterface::preallocate(QFile *file, qint64 size)
+{
+    if (size <= 0) {
+        return false;
+    }
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_FREEBSD)
+    if (!file->flush() || posix_fallocate(file->handle(), 0, size) != 0) {
+        qCDebug(ARK) << "Could not preallocate" << size << "bytes for" << file->fileName();
+        return false;
+    }
 
     return true;
+#else
+    Q_UNUSED(file)
+    return false;
+#endif
+}
+
+qint64 LibSingleFileInterface::uncompressedSize()
+{
+    return -1;
+}
+
+QVector<SingleFileChunk> LibSingleFileInterface::independentChunks(QFile *file)
+{
+    Q_UNUSED(file)
+    return QVector<SingleFileChunk>();
+}
+
+SingleFileDecoder *LibSingleFileInterface::createDecoder(const SingleFileChunk &chunk) const
+{
+    Q_UNUSED(chunk)
+    return nullptr;
+}
+
+SingleFileDecoder *LibSingleFileInterface::createStreamDecoder() const
+{
+    return nullptr;
+}
+
+QVector<SingleFileChunk> LibSingleFileInterface::groupMembers(const QVector<qint64> &memberOffsets, qint64 fileSize)
+{
+    QVector<SingleFileChunk> chunks;
+    if (memberOffsets.isEmpty() || memberOffsets.first() != 0) {
+        return chunks;
+    }
+
+    SingleFileChunk chunk;
+    for (int i = 1; i <= memberOffsets.size(); ++i) {
+        const qint64 end = (i < memberOffsets.size()) ? memberOffsets.at(i) : fileSize;
+        chunk.size = end - chunk.offset;
+
+        if (chunk.size >= parallelChunkSize || end == fileSize) {
+            if (chunk.size > maximumParallelChunkSize) {
+                return QVector<SingleFileChunk>();
+            }
+            chunks.append(chunk);
+            chunk.offset = end;
+        }
+    }
+
+    return chunks;
+}
+
+QVector<qint64> LibSingleFileInterface::findMembers(QFile *file, uchar firstByte, int headerSize, bool (*isHeader)(const uchar *header), qint64 maximumMemberSize) const
+{
+    if (!file->seek(0)) {
+        return QVector<qint64>();
+    }
+
+    QVector<qint64> memberOffsets;
+    QByteArray buffer;
+
+    while (!file->atEnd()) {
+        if (isCancellationRequested()) {
+            return QVector<qint64>();
+        }
+
+        // Keep the end of the previous block, a header could span both of them.
+        buffer = buffer.right(headerSize - 1) + file->read(maximumChunkSize);
+        if (buffer.size() < headerSize) {
+            break;
+        }
+        const qint64 bufferOffset = file->pos() - buffer.size();
+
+        const uchar *data = reinterpret_cast<const uchar*>(buffer.constData());
+        const uchar *last = data + buffer.size() - headerSize;
+        for (const uchar *p = data; p <= last; ++p) {
+            p = static_cast<const uchar*>(memchr(p, firstByte, last - p + 1));
+            if (!p) {
+                break;
+            }
+            if (isHeader(p)) {
+                memberOffsets.append(bufferOffset + (p - data));
+            }
+        }
+
+        if (memberOffsets.isEmpty() || memberOffsets.first() != 0) {
+            return QVector<qint64>();
+        }
+
+        if (file->pos() - memberOffsets.last() > maximumMemberSize) {
+            return QVector<qint64>();
+        }
+    }
+
+    return memberOffsets;
+}
+
+QVector<SingleFileChunk> LibSingleFileInterface::scanForMembers(QFile *file, uchar firstByte, int headerSize, bool (*isHeader)(const uchar *header)) const
+{
+    const qint64 fileSize = file->size();
+    if (fileSize < 2 * parallelChunkSize) {
+        return QVector<SingleFileChunk>();
+    }
+
+    // Not worth reading the whole file if it's made of a single huge member.
+    return groupMembers(findMembers(file, firstByte, headerSize, isHeader, maximumParallelChunkSize), fileSize);
 }
 
 bool LibSingleFileInterface::list()
@@ -108,6 +495,12 @@ bool LibSingleFileInterface::list()
     connect(this, &QObject::destroyed, e, &QObject::deleteLater);
     e->setProperty("fullPath", uncompressedFileName());
     e->setProperty("compressedSize", QFileInfo(filename()).size());
+
+    const qint64 size = uncompressedSize();
+    if (size >= 0) {
+        e->setProperty("size", size);
+    }
+
     emit entry(e);
 
     return true;
@@ -160,6 +553,94 @@ const QString LibSingleFileInterface::uncompressedFileName() const
 
 bool LibSingleFileInterface::testArchive()
 {
-    return false;
+    qCDebug(ARK) << "Testing archive";
+
+    // The decoders verify the checksums stored in the file, the decompressed data is just dropped.
+    if (decodeStream(nullptr, nullptr) != Decoded) {
+        return false;
+    }
+
+    emit testSuccess();
+    return true;
+}
+
+LibSingleFileInterface::DecodeResult LibSingleFileInterface::decodeStream(QFile *outputFile, qint64 *bytesWritten)
+{
+    QScopedPointer<SingleFileDecoder> decoder(createStreamDecoder());
+    QFile inputFile(filename());
+    if (!decoder || !inputFile.open(QIODevice::ReadOnly)) {
+        if (outputFile) {
+            emit error(xi18nc("@info", "Ark could not open <filename>%1</filename> for extraction.", filename()));
+        }
+        return Failed;
+    }
+
+    const qint64 compressedSize = inputFile.size();
+    QByteArray inputBuffer(maximumChunkSize, '\0');
+    QByteArray outputBuffer(maximumChunkSize, '\0');
+
+    while (true) {
+        if (isCancellationRequested()) {
+            return Failed;
+        }
+
+        const qint64 bytesRead = inputFile.read(inputBuffer.data(), inputBuffer.size());
+        if (bytesRead < 0) {
+            qCWarning(ARK) << "Failed to read" << filename() << inputFile.errorString();
+            if (outputFile) {
+                emit error(xi18nc("@info", "There was an error while reading <filename>%1</filename> during extraction.", filename()));
+            }
+            return Failed;
+        } else if (bytesRead == 0) {
+            break;
+        }
+
+        const char *input = inputBuffer.constData();
+        qint64 inputSize = bytesRead;
+
+        // Keep going while the decoder fills the output buffer, it may be holding more data.
+        while (true) {
+            char *output = outputBuffer.data();
+            qint64 outputSize = outputBuffer.size();
+            const qint64 previousInputSize = inputSize;
+
+            const bool ok = decoder->decode(&input, &inputSize, &output, &outputSize);
+            if (!ok || (outputSize > 0 && inputSize > 0 && inputSize == previousInputSize)) {
+                qCWarning(ARK) << "Corrupt data at offset" << inputFile.pos() - inputSize;
+                if (outputFile) {
+                    emit error(xi18nc("@info", "There was an error while reading <filename>%1</filename> during extraction.", filename()));
+                }
+                return Failed;
+            }
+
+            const qint64 decodedSize = outputBuffer.size() - outputSize;
+            if (outputFile && decodedSize > 0) {
+                if (outputFile->write(outputBuffer.constData(), decodedSize) != decodedSize) {
+                    qCCritical(ARK) << "Failed to write to output file" << outputFile->errorString();
+                    emit error(xi18nc("@info", "There was an error while writing <filename>%1</filename> during extraction.", outputFile->fileName()));
+                    return Failed;
+                }
+                *bytesWritten += decodedSize;
+            }
+
+            if (outputSize > 0 && inputSize == 0) {
+                break;
+            }
+        }
+
+        if (compressedSize > 0) {
+            reportProgress(double(inputFile.pos()) / compressedSize);
+        }
+    }
+
+    if (!decoder->isFinished()) {
+        qCWarning(ARK) << "Unexpected end of file";
+        if (outputFile) {
+            emit error(xi18nc("@info", "There was an error while reading <filename>%1</filename> during extraction.", filename()));
+        }
+        return Failed;
+    }
+
+    return Decoded;
 }
 
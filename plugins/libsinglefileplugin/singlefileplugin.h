@@ -28,6 +28,54 @@
 
 #include "archiveinterface.h"
 
+#include <QAtomicInteger>
+#include <QVector>
+
+class QFile;
+
+/**
+ * A range of the compressed file that can be decompressed independently
+ * of the rest of it, e.g. one or more gzip members or a xz block.
+ */
+struct SingleFileChunk
+{
+    qint64 offset = 0;
+    qint64 size = 0;
+
+    /**
+     * The size of the decompressed chunk, or -1 if unknown.
+     */
+    qint64 uncompressedSize = -1;
+
+    /**
+     * Format-specific data needed to decode the chunk, e.g. the xz integrity check.
+     */
+    int flags = 0;
+};
+Q_DECLARE_TYPEINFO(SingleFileChunk, Q_MOVABLE_TYPE);
+
+/**
+ * Decompresses the data of a SingleFileChunk.
+ * Decoders are used from a worker thread, so they must not touch the interface that created them.
+ */
+class SingleFileDecoder
+{
+public:
+    virtual ~SingleFileDecoder() {}
+
+    /**
+     * Decompresses as much as possible of @p input into @p output.
+     * The pointers are advanced and the sizes decreased by the amount of data consumed and produced.
+     * @return false if the compressed data is corrupt.
+     */
+    virtual bool decode(const char **input, qint64 *inputSize, char **output, qint64 *outputSize) = 0;
+
+    /**
+     * @return Whether the data decoded so far ends exactly at the end of a member, stream or block.
+     */
+    virtual bool isFinished() const = 0;
+};
+
 class LibSingleFileInterface : public Kerfuffle::ReadOnlyArchiveInterface
 {
     Q_OBJECT
@@ -44,8 +92,129 @@ protected:
     const QString uncompressedFileName() const;
     QString overwriteFileName(QString& filename);
 
+    /**
+     * @return The size of the uncompressed file, or -1 if it can't be known without decompressing it.
+     * Only cheap metadata such as trailers or indexes should be read.
+     * Used to list the file and to preallocate the output file during extraction.
+     */
+    virtual qint64 uncompressedSize();
+
+    /**
+     * Reserves @p size bytes on disk for @p file, if supported by the platform.
+     * @return Whether the space has been reserved.
+     */
+    static bool preallocate(QFile *file, qint64 size);
+
+    /**
+     * Splits the compressed @p file into chunks that can be decompressed in parallel.
+     * The chunks must not overlap and must be sorted by offset.
+     * @return An empty list if the file can't be split, which is the default.
+     */
+    virtual QVector<SingleFileChunk> independentChunks(QFile *file);
+
+    /**
+     * @return A new decoder for @p chunk, owned by the caller, or nullptr if not supported.
+     */
+    virtual SingleFileDecoder *createDecoder(const SingleFileChunk &chunk) const;
+
+    /**
+     * @return A new decoder for the whole file, owned by the caller, or nullptr if not supported.
+     * Used to test the file, and to extract it if KCompressionDevice doesn't support the format.
+     */
+    virtual SingleFileDecoder *createStreamDecoder() const;
+
+    /**
+     * Groups consecutive members starting at @p memberOffsets into chunks
+     * of at least parallelChunkSize bytes, for formats whose decoders can
+     * decode multiple concatenated members.
+     * @return An empty list if a chunk would be bigger than maximumParallelChunkSize.
+     */
+    static QVector<SingleFileChunk> groupMembers(const QVector<qint64> &memberOffsets, qint64 fileSize);
+
+    /**
+     * Looks for the members of @p file, whose headers of @p headerSize bytes start with
+     * @p firstByte and are recognized by @p isHeader. Anything looking like a header in the
+     * middle of a member counts as one.
+     * @return The offsets of the members, or an empty list if the file doesn't start with one,
+     * a member is bigger than @p maximumMemberSize or the operation was cancelled.
+     */
+    QVector<qint64> findMembers(QFile *file, uchar firstByte, int headerSize, bool (*isHeader)(const uchar *header), qint64 maximumMemberSize) const;
+
+    /**
+     * Finds the members of @p file with findMembers(). Anything looking like a header in the
+     * middle of a member will just fail to decode, in which case the file is decoded serially.
+     * @return The chunks grouping the members, or an empty list if the file can't be split.
+     */
+    QVector<SingleFileChunk> scanForMembers(QFile *file, uchar firstByte, int headerSize, bool (*isHeader)(const uchar *header)) const;
+
+    static const int minimumChunkSize = 64 * 1024;
+    static const int maximumChunkSize = 4 * 1024 * 1024;
+    static const int parallelChunkSize = 4 * 1024 * 1024;
+    static const int maximumParallelChunkSize = 64 * 1024 * 1024;
+
+    /**
+     * Highly compressible chunks could exhaust the memory when decoded in parallel,
+     * bigger chunks are decoded serially instead.
+     */
+    static const int maximumDecodedChunkSize = 256 * 1024 * 1024;
+
+    /**
+     * The decoded data kept in memory by the parallel decoding, written or not, is capped too.
+     * A chunk which would go over it is decoded again once it is the next one to be written.
+     */
+    static const int maximumDecodedDataSize = 512 * 1024 * 1024;
+
     QString m_mimeType;
     QStringList m_possibleExtensions;
+
+private:
+    enum DecodeResult {Decoded, Failed, NotSplittable};
+
+    struct DecodedChunk
+    {
+        QByteArray data;
+        bool ok = false;
+
+        /**
+         * The chunk didn't fit in maximumDecodedDataSize.
+         */
+        bool deferred = false;
+    };
+
+    /**
+     * What the chunks decoded in parallel share.
+     */
+    struct DecodingState
+    {
+        QAtomicInt aborted;
+
+        /**
+         * The bytes allocated for the chunks being decoded or waiting to be written.
+         */
+        QAtomicInteger<qint64> decodedDataSize;
+    };
+
+    /**
+     * Decodes a chunk on its own. Without @p state, the size of the decoded data is only
+     * limited by maximumDecodedChunkSize.
+     */
+    static DecodedChunk decodeChunk(SingleFileDecoder *chunkDecoder, const QByteArray &compressedData, qint64 uncompressedSize,
+                                    DecodingState *state, const LibSingleFileInterface *plugin);
+
+    /**
+     * Reads the compressed data of @p chunk from @p file and creates its decoder.
+     * @return false if either failed.
+     */
+    bool readChunk(QFile *file, const SingleFileChunk &chunk, QByteArray *compressedData, SingleFileDecoder **decoder) const;
+
+    DecodeResult decodeSerially(QFile *outputFile, qint64 *bytesWritten);
+
+    /**
+     * Decodes the whole file with createStreamDecoder(), writing to @p outputFile.
+     * If @p outputFile is null the data is only checked and errors are not reported to the user.
+     */
+    DecodeResult decodeStream(QFile *outputFile, qint64 *bytesWritten);
+    DecodeResult decodeInParallel(QFile *outputFile, qint64 *bytesWritten);
 };
 
 #endif // SINGLEFILEPLUGIN_H
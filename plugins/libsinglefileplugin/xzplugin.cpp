@@ -24,14 +24,268 @@
  */
 
 #include "xzplugin.h"
+#include "ark_debug.h"
 #include "kerfuffle_export.h"
 
+#include <QFile>
 #include <QString>
 
 #include <KPluginFactory>
 
+#include <lzma.h>
+
+#include <cstdlib>
+#include <limits>
+
 K_PLUGIN_CLASS_WITH_JSON(LibXzInterface, "kerfuffle_libxz.json")
 
+namespace {
+
+const int lzmaAloneHeaderSize = 13;
+
+/**
+ * Decodes a single xz block, checking its integrity.
+ */
+class XzBlockDecoder : public SingleFileDecoder
+{
+public:
+    explicit XzBlockDecoder(lzma_check check)
+    {
+        m_block.check = check;
+    }
+
+    ~XzBlockDecoder() override
+    {
+        lzma_end(&m_stream);
+    }
+
+    bool decode(const char **input, qint64 *inputSize, char **output, qint64 *outputSize) override
+    {
+        // A chunk is made of exactly one block.
+        if (m_finished) {
+            return *inputSize == 0;
+        }
+
+        // The block header is needed to set up the decoder, its size is stored in its first byte.
+        while (!m_initialized) {
+            const int headerSize = m_header.isEmpty() ? 1 : lzma_block_header_size_decode(static_cast<uchar>(m_header.at(0)));
+            if (m_header.size() == headerSize && headerSize > 1) {
+                if (!initDecoder()) {
+                    return false;
+                }
+                break;
+            }
+            if (*inputSize == 0) {
+                return true;
+            }
+            m_header.append(**input);
+            ++*input;
+            --*inputSize;
+        }
+
+        const size_t availableInput = static_cast<size_t>(*inputSize);
+        const size_t availableOutput = static_cast<size_t>(*outputSize);
+        m_stream.next_in = reinterpret_cast<const uint8_t*>(*input);
+        m_stream.avail_in = availableInput;
+        m_stream.next_out = reinterpret_cast<uint8_t*>(*output);
+        m_stream.avail_out = availableOutput;
+
+        const lzma_ret ret = lzma_code(&m_stream, LZMA_RUN);
+
+        *input += availableInput - m_stream.avail_in;
+        *inputSize -= availableInput - m_stream.avail_in;
+        *output += availableOutput - m_stream.avail_out;
+        *outputSize -= availableOutput - m_stream.avail_out;
+
+        if (ret == LZMA_STREAM_END) {
+            m_finished = true;
+            return true;
+        }
+
+        return ret == LZMA_OK || ret == LZMA_BUF_ERROR;
+    }
+
+    bool isFinished() const override
+    {
+        return m_finished;
+    }
+
+private:
+    bool initDecoder()
+    {
+        lzma_filter filters[LZMA_FILTERS_MAX + 1];
+        m_block.version = 0;
+        m_block.header_size = m_header.size();
+        m_block.filters = filters;
+
+        if (lzma_block_header_decode(&m_block, nullptr, reinterpret_cast<const uint8_t*>(m_header.constData())) != LZMA_OK) {
+            return false;
+        }
+
+        m_initialized = (lzma_block_decoder(&m_stream, &m_block) == LZMA_OK);
+
+        // The filter options are only needed to set up the decoder.
+        for (int i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i) {
+            free(filters[i].options);
+        }
+        m_block.filters = nullptr;
+
+        return m_initialized;
+    }
+
+    lzma_stream m_stream = LZMA_STREAM_INIT;
+    // Must outlive the decoder, which keeps a pointer to it.
+    lzma_block m_block = {};
+    QByteArray m_header;
+    bool m_initialized = false;
+    bool m_finished = false;
+};
+
+/**
+ * Decodes whole .xz or .lzma files, including concatenated xz streams.
+ */
+class XzStreamDecoder : public SingleFileDecoder
+{
+public:
+    XzStreamDecoder()
+    {
+        m_valid = (lzma_auto_decoder(&m_stream, UINT64_MAX, 0) == LZMA_OK);
+    }
+
+    ~XzStreamDecoder() override
+    {
+        lzma_end(&m_stream);
+    }
+
+    bool decode(const char **input, qint64 *inputSize, char **output, qint64 *outputSize) override
+    {
+        // Skip the stream padding, another stream may follow it.
+        if (m_finished && *inputSize > 0) {
+            while (*inputSize > 0 && **input == 0) {
+                ++*input;
+                --*inputSize;
+            }
+            if (*inputSize == 0) {
+                return true;
+            }
+            m_valid = (lzma_auto_decoder(&m_stream, UINT64_MAX, 0) == LZMA_OK);
+            m_finished = false;
+        }
+
+        if (!m_valid) {
+            return false;
+        }
+
+        const size_t availableInput = static_cast<size_t>(*inputSize);
+        const size_t availableOutput = static_cast<size_t>(*outputSize);
+        m_stream.next_in = reinterpret_cast<const uint8_t*>(*input);
+        m_stream.avail_in = availableInput;
+        m_stream.next_out = reinterpret_cast<uint8_t*>(*output);
+        m_stream.avail_out = availableOutput;
+
+        const lzma_ret ret = lzma_code(&m_stream, LZMA_RUN);
+
+        *input += availableInput - m_stream.avail_in;
+        *inputSize -= availableInput - m_stream.avail_in;
+        *output += availableOutput - m_stream.avail_out;
+        *outputSize -= availableOutput - m_stream.avail_out;
+
+        if (ret == LZMA_STREAM_END) {
+            m_finished = true;
+            return true;
+        }
+
+        return ret == LZMA_OK || ret == LZMA_BUF_ERROR;
+    }
+
+    bool isFinished() const override
+    {
+        return m_finished;
+    }
+
+private:
+    lzma_stream m_stream = LZMA_STREAM_INIT;
+    bool m_valid = false;
+    bool m_finished = false;
+};
+
+bool readAt(QFile *file, qint64 offset, uint8_t *data, qint64 size)
+{
+    return file->seek(offset) && file->read(reinterpret_cast<char*>(data), size) == size;
+}
+
+/**
+ * Reads the indexes of all the streams in @p file, starting from the last one, like xz --list does.
+ * @return The combined index, to be freed with lzma_index_end(), or nullptr if @p file isn't a valid xz file.
+ */
+lzma_index *readIndex(QFile *file)
+{
+    lzma_index *combinedIndex = nullptr;
+    qint64 pos = file->size();
+
+    while (pos > 0) {
+        uint8_t buffer[LZMA_STREAM_HEADER_SIZE];
+        lzma_stream_flags footerFlags;
+        lzma_stream_flags headerFlags;
+
+        // Skip the stream padding, made of null bytes in multiples of four.
+        qint64 padding = 0;
+        while (pos >= 2 * LZMA_STREAM_HEADER_SIZE && readAt(file, pos - 4, buffer, 4)
+               && buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 0 && buffer[3] == 0) {
+            pos -= 4;
+            padding += 4;
+        }
+
+        if (pos < 2 * LZMA_STREAM_HEADER_SIZE
+                || !readAt(file, pos - LZMA_STREAM_HEADER_SIZE, buffer, LZMA_STREAM_HEADER_SIZE)
+                || lzma_stream_footer_decode(&footerFlags, buffer) != LZMA_OK) {
+            break;
+        }
+
+        const qint64 indexSize = static_cast<qint64>(footerFlags.backward_size);
+        pos -= LZMA_STREAM_HEADER_SIZE + indexSize;
+        if (pos < LZMA_STREAM_HEADER_SIZE || !file->seek(pos)) {
+            break;
+        }
+
+        const QByteArray indexData = file->read(indexSize);
+        lzma_index *index = nullptr;
+        uint64_t memoryLimit = UINT64_MAX;
+        size_t indexPos = 0;
+        if (indexData.size() != indexSize
+                || lzma_index_buffer_decode(&index, &memoryLimit, nullptr, reinterpret_cast<const uint8_t*>(indexData.constData()),
+                                            &indexPos, indexData.size()) != LZMA_OK) {
+            break;
+        }
+
+        pos -= static_cast<qint64>(lzma_index_total_size(index)) + LZMA_STREAM_HEADER_SIZE;
+        if (pos < 0
+                || !readAt(file, pos, buffer, LZMA_STREAM_HEADER_SIZE)
+                || lzma_stream_header_decode(&headerFlags, buffer) != LZMA_OK
+                || lzma_stream_flags_compare(&headerFlags, &footerFlags) != LZMA_OK
+                || lzma_index_stream_flags(index, &footerFlags) != LZMA_OK
+                || lzma_index_stream_padding(index, padding) != LZMA_OK
+                || (combinedIndex && lzma_index_cat(index, combinedIndex, nullptr) != LZMA_OK)) {
+            lzma_index_end(index, nullptr);
+            break;
+        }
+
+        // lzma_index_cat() took ownership of the streams that follow this one.
+        combinedIndex = index;
+
+        if (pos == 0) {
+            return combinedIndex;
+        }
+    }
+
+    qCDebug(ARK) << "Could not read the xz index";
+    lzma_index_end(combinedIndex, nullptr);
+
+    return nullptr;
+}
+
+}
+
 LibXzInterface::LibXzInterface(QObject *parent, const QVariantList & args)
         : LibSingleFileInterface(parent, args)
 {
@@ -44,4 +298,80 @@ LibXzInterface::~LibXzInterface()
 {
 }
 
+qint64 LibXzInterface::uncompressedSize()
+{
+    QFile file(filename());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    const QByteArray header = file.peek(lzmaAloneHeaderSize);
+    if (header.startsWith("\xFD" "7zXZ")) {
+        lzma_index *index = readIndex(&file);
+        if (!index) {
+            return -1;
+        }
+        const qint64 size = static_cast<qint64>(lzma_index_uncompressed_size(index));
+        lzma_index_end(index, nullptr);
+
+        return size;
+    }
+
+    // The legacy .lzma header stores the size after the properties and the dictionary size.
+    // All ones means that it is unknown.
+    const uchar *data = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() == lzmaAloneHeaderSize && data[0] < 225) {
+        quint64 size = 0;
+        for (int i = 12; i >= 5; --i) {
+            size = (size << 8) | data[i];
+        }
+        if (size != ~quint64(0) && size <= quint64(std::numeric_limits<qint64>::max())) {
+            return static_cast<qint64>(size);
+        }
+    }
+
+    return -1;
+}
+
+QVector<SingleFileChunk> LibXzInterface::independentChunks(QFile *file)
+{
+    QVector<SingleFileChunk> chunks;
+
+    // Multithreaded xz writes the compressed and uncompressed size of each block in the index.
+    lzma_index *index = readIndex(file);
+    if (!index) {
+        return chunks;
+    }
+
+    lzma_index_iter iter;
+    lzma_index_iter_init(&iter, index);
+    while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK)) {
+        SingleFileChunk chunk;
+        chunk.offset = static_cast<qint64>(iter.block.compressed_file_offset);
+        chunk.size = static_cast<qint64>(iter.block.total_size);
+        chunk.uncompressedSize = static_cast<qint64>(iter.block.uncompressed_size);
+        chunk.flags = iter.stream.flags->check;
+
+        if (chunk.size > maximumParallelChunkSize || chunk.uncompressedSize > maximumDecodedChunkSize) {
+            chunks.clear();
+            break;
+        }
+        chunks.append(chunk);
+    }
+
+    lzma_index_end(index, nullptr);
+
+    return chunks;
+}
+
+SingleFileDecoder *LibXzInterface::createDecoder(const SingleFileChunk &chunk) const
+{
+    return new XzBlockDecoder(static_cast<lzma_check>(chunk.flags));
+}
+
+SingleFileDecoder *LibXzInterface::createStreamDecoder() const
+{
+    return new XzStreamDecoder;
+}
+
 #include "xzplugin.moc"
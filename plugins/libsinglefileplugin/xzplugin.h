@@ -35,6 +35,12 @@ class KERFUFFLE_EXPORT LibXzInterface : public LibSingleFileInterface
 public:
     LibXzInterface(QObject *parent, const QVariantList & args);
     ~LibXzInterface() override;
+
+protected:
+    qint64 uncompressedSize() override;
+    QVector<SingleFileChunk> independentChunks(QFile *file) override;
+    SingleFileDecoder *createDecoder(const SingleFileChunk &chunk) const override;
+    SingleFileDecoder *createStreamDecoder() const override;
 };
 
 #endif // XZPLUGIN_H
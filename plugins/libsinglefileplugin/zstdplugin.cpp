@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "zstdplugin.h"
+#include "ark_debug.h"
+#include "kerfuffle_export.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <QtEndian>
+
+#include <KPluginFactory>
+
+#include <zstd.h>
+
+#include <limits>
+
+K_PLUGIN_CLASS_WITH_JSON(LibZstdInterface, "kerfuffle_libzstd.json")
+
+namespace {
+
+const quint32 zstdMagic = 0xFD2FB528;
+const quint32 skippableMagic = 0x184D2A50;
+const quint32 skippableMagicMask = 0xFFFFFFF0;
+const int skippableHeaderSize = 8;
+
+// Magic number, frame header descriptor, window descriptor, dictionary ID and content size.
+const int maximumFrameHeaderSize = 18;
+const int blockHeaderSize = 3;
+const int checksumSize = 4;
+
+/**
+ * Decodes one or more zstd frames, verifying their checksums when present.
+ */
+class ZstdDecoder : public SingleFileDecoder
+{
+public:
+    ZstdDecoder()
+        : m_stream(ZSTD_createDCtx())
+    {
+        // Accept the big windows used by --long and --ultra, which are rejected by default.
+        const ZSTD_bounds bounds = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax);
+        if (m_stream && !ZSTD_isError(bounds.error)) {
+            ZSTD_DCtx_setParameter(m_stream, ZSTD_d_windowLogMax, bounds.upperBound);
+        }
+    }
+
+    ~ZstdDecoder() override
+    {
+        ZSTD_freeDCtx(m_stream);
+    }
+
+    bool decode(const char **input, qint64 *inputSize, char **output, qint64 *outputSize) override
+    {
+        if (!m_stream) {
+            return false;
+        }
+
+        // Between two frames the decoder would report that it is waiting for the next one.
+        if (m_finished && *inputSize == 0) {
+            return true;
+        }
+
+        ZSTD_inBuffer in = {*input, static_cast<size_t>(*inputSize), 0};
+        ZSTD_outBuffer out = {*output, static_cast<size_t>(*outputSize), 0};
+
+        const size_t ret = ZSTD_decompressStream(m_stream, &out, &in);
+
+        *input += in.pos;
+        *inputSize -= in.pos;
+        *output += out.pos;
+        *outputSize -= out.pos;
+
+        if (ZSTD_isError(ret)) {
+            qCDebug(ARK) << "Could not decode zstd data:" << ZSTD_getErrorName(ret);
+            return false;
+        }
+
+        // Zero means that a frame has been decoded and flushed completely.
+        m_finished = (ret == 0);
+
+        return true;
+    }
+
+    bool isFinished() const override
+    {
+        return m_finished;
+    }
+
+private:
+    ZSTD_DCtx *m_stream;
+    bool m_finished = false;
+};
+
+/**
+ * Walks the frames of @p file through their block headers, without decompressing them, like zstd --list does.
+ * The uncompressed size of a frame is only known if its header stores it.
+ * Stops early if @p plugin is asked to cancel its operation.
+ * @return An empty list if @p file isn't made of valid zstd frames.
+ */
+QVector<SingleFileChunk> readFrames(QFile *file, const Kerfuffle::ReadOnlyArchiveInterface *plugin)
+{
+    QVector<SingleFileChunk> frames;
+    const qint64 fileSize = file->size();
+    qint64 pos = 0;
+
+    while (pos < fileSize) {
+        if (plugin->isCancellationRequested()) {
+            return QVector<SingleFileChunk>();
+        }
+
+        uchar header[maximumFrameHeaderSize];
+        const qint64 headerSize = file->seek(pos) ? file->read(reinterpret_cast<char*>(header), maximumFrameHeaderSize) : -1;
+        if (headerSize < skippableHeaderSize) {
+            return QVector<SingleFileChunk>();
+        }
+
+        SingleFileChunk frame;
+        frame.offset = pos;
+
+        const quint32 magic = qFromLittleEndian<quint32>(header);
+        if ((magic & skippableMagicMask) == skippableMagic) {
+            // Skippable frames hold metadata, e.g. pzstd stores the size of the next frame in them.
+            frame.size = skippableHeaderSize + static_cast<qint64>(qFromLittleEndian<quint32>(header + 4));
+            frame.uncompressedSize = 0;
+        } else if (magic == zstdMagic) {
+            const unsigned long long contentSize = ZSTD_getFrameContentSize(header, static_cast<size_t>(headerSize));
+            if (contentSize == ZSTD_CONTENTSIZE_ERROR) {
+                return QVector<SingleFileChunk>();
+            } else if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize <= static_cast<unsigned long long>(std::numeric_limits<qint64>::max())) {
+                frame.uncompressedSize = static_cast<qint64>(contentSize);
+            }
+
+            static const int dictionaryIdSizes[] = {0, 1, 2, 4};
+            static const int contentSizeSizes[] = {0, 2, 4, 8};
+            const uchar descriptor = header[4];
+            const bool isSingleSegment = descriptor & 0x20;
+            const bool hasChecksum = descriptor & 0x04;
+            const int contentSizeFlag = descriptor >> 6;
+
+            qint64 blockPos = pos + 5 + (isSingleSegment ? 0 : 1) + dictionaryIdSizes[descriptor & 0x03]
+                              + ((isSingleSegment && contentSizeFlag == 0) ? 1 : contentSizeSizes[contentSizeFlag]);
+
+            bool isLastBlock = false;
+            while (!isLastBlock) {
+                uchar blockHeader[blockHeaderSize];
+                if (!file->seek(blockPos) || file->read(reinterpret_cast<char*>(blockHeader), blockHeaderSize) != blockHeaderSize) {
+                    return QVector<SingleFileChunk>();
+                }
+
+                const quint32 value = blockHeader[0] | (blockHeader[1] << 8) | (blockHeader[2] << 16);
+                const int blockType = (value >> 1) & 0x03;
+                isLastBlock = value & 0x01;
+
+                // Block type 3 is reserved.
+                if (blockType == 3) {
+                    return QVector<SingleFileChunk>();
+                }
+
+                // RLE blocks store a single byte, the block size is the number of repetitions.
+                blockPos += blockHeaderSize + (blockType == 1 ? 1 : static_cast<qint64>(value >> 3));
+            }
+
+            frame.size = blockPos - pos + (hasChecksum ? checksumSize : 0);
+        } else {
+            return QVector<SingleFileChunk>();
+        }
+
+        if (pos + frame.size > fileSize) {
+            qCDebug(ARK) << "Truncated zstd frame at offset" << pos;
+            return QVector<SingleFileChunk>();
+        }
+
+        frames.append(frame);
+        pos += frame.size;
+    }
+
+    return frames;
+}
+
+}
+
+LibZstdInterface::LibZstdInterface(QObject *parent, const QVariantList & args)
+        : LibSingleFileInterface(parent, args)
+{
+    m_mimeType = QStringLiteral( "application/zstd" );
+    m_possibleExtensions.append(QStringLiteral( ".zst" ));
+    m_possibleExtensions.append(QStringLiteral( ".zstd" ));
+}
+
+LibZstdInterface::~LibZstdInterface()
+{
+}
+
+qint64 LibZstdInterface::uncompressedSize()
+{
+    QFile file(filename());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    const QVector<SingleFileChunk> frames = this->frames(&file);
+    if (frames.isEmpty()) {
+        return -1;
+    }
+
+    qint64 size = 0;
+    for (const SingleFileChunk &frame : frames) {
+        if (frame.uncompressedSize < 0) {
+            return -1;
+        }
+        size += frame.uncompressedSize;
+    }
+
+    return size;
+}
+
+QVector<SingleFileChunk> LibZstdInterface::independentChunks(QFile *file)
+{
+    // Frames are independent, but a frame can't be split: only files made of
+    // multiple frames, like the ones written by pzstd, are decoded in parallel.
+    const QVector<SingleFileChunk> frames = this->frames(file);
+    if (frames.size() < 2) {
+        return QVector<SingleFileChunk>();
+    }
+
+    QVector<qint64> frameOffsets;
+    frameOffsets.reserve(frames.size());
+    for (const SingleFileChunk &frame : frames) {
+        frameOffsets.append(frame.offset);
+    }
+
+    QVector<SingleFileChunk> chunks = groupMembers(frameOffsets, file->size());
+
+    // The frame headers usually store the content size, which lets us size the chunk buffers exactly.
+    int frameIndex = 0;
+    for (SingleFileChunk &chunk : chunks) {
+        qint64 size = 0;
+        for (; frameIndex < frames.size() && frames.at(frameIndex).offset < chunk.offset + chunk.size; ++frameIndex) {
+            const qint64 contentSize = frames.at(frameIndex).uncompressedSize;
+            size = (size < 0 || contentSize < 0) ? -1 : size + contentSize;
+        }
+
+        if (size > maximumDecodedChunkSize) {
+            return QVector<SingleFileChunk>();
+        }
+        chunk.uncompressedSize = size;
+    }
+
+    return chunks;
+}
+
+QVector<SingleFileChunk> LibZstdInterface::frames(QFile *file)
+{
+    const QFileInfo fileInfo(*file);
+    if (fileInfo.absoluteFilePath() != m_framesFileName || fileInfo.size() != m_framesFileSize
+            || fileInfo.lastModified() != m_framesLastModified) {
+        m_frames = readFrames(file, this);
+
+        // Don't remember the result of a cancelled walk.
+        if (isCancellationRequested()) {
+            m_framesFileName.clear();
+            return m_frames;
+        }
+
+        m_framesFileName = fileInfo.absoluteFilePath();
+        m_framesFileSize = fileInfo.size();
+        m_framesLastModified = fileInfo.lastModified();
+    }
+
+    return m_frames;
+}
+
+SingleFileDecoder *LibZstdInterface::createDecoder(const SingleFileChunk &chunk) const
+{
+    Q_UNUSED(chunk)
+
+    return new ZstdDecoder;
+}
+
+SingleFileDecoder *LibZstdInterface::createStreamDecoder() const
+{
+    return new ZstdDecoder;
+}
+
+#include "zstdplugin.moc"
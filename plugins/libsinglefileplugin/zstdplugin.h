@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017 The Ark developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES ( INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION ) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * ( INCLUDING NEGLIGENCE OR OTHERWISE ) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ZSTDPLUGIN_H
+#define ZSTDPLUGIN_H
+
+#include "singlefileplugin.h"
+
+#include <QDateTime>
+
+class KERFUFFLE_EXPORT LibZstdInterface : public LibSingleFileInterface
+{
+    Q_OBJECT
+
+public:
+    LibZstdInterface(QObject *parent, const QVariantList & args);
+    ~LibZstdInterface() override;
+
+protected:
+    qint64 uncompressedSize() override;
+    QVector<SingleFileChunk> independentChunks(QFile *file) override;
+    SingleFileDecoder *createDecoder(const SingleFileChunk &chunk) const override;
+    SingleFileDecoder *createStreamDecoder() const override;
+
+private:
+    /**
+     * @return The frames of @p file, walked only once for both the listing and the extraction.
+     */
+    QVector<SingleFileChunk> frames(QFile *file);
+
+    QVector<SingleFileChunk> m_frames;
+    QString m_framesFileName;
+    qint64 m_framesFileSize = -1;
+    QDateTime m_framesLastModified;
+};
+
+#endif // ZSTDPLUGIN_H
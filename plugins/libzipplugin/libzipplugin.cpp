@@ -26,6 +26,7 @@
 #include "libzipplugin.h"
 #include "ark_debug.h"
 #include "queries.h"
+#include "tracer.h"
 
 #include <KIO/Global>
 #include <KLocalizedString>
@@ -37,7 +38,6 @@
 #include <QDirIterator>
 #include <QFile>
 #include <qplatformdefs.h>
-#include <QThread>
 
 #include <utime.h>
 #include <zlib.h>
@@ -45,16 +45,110 @@
 
 K_PLUGIN_CLASS_WITH_JSON(LibzipPlugin, "kerfuffle_libzip.json")
 
+// Entries are read by chunks of this size, cancellation is checked between them.
+static const int chunkSize = 64 * 1024;
+
+/**
+ * Streams an entry through a handle on the archive of its own, see LibzipPlugin::createEntryDevice().
+ */
+class ZipEntryDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    ZipEntryDevice(zip_t *archive, zip_file_t *file)
+        : m_archive(archive)
+        , m_file(file)
+    {
+        open(QIODevice::ReadOnly);
+    }
+
+    ~ZipEntryDevice() override
+    {
+        close();
+    }
+
+    /**
+     * Makes the reads fail as soon as possible, can be called from any thread.
+     */
+    Q_INVOKABLE void abort()
+    {
+        m_aborted.storeRelease(1);
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+    bool atEnd() const override
+    {
+        return m_finished && QIODevice::atEnd();
+    }
+
+    void close() override
+    {
+        if (m_file) {
+            zip_fclose(m_file);
+            m_file = nullptr;
+        }
+        if (m_archive) {
+            zip_close(m_archive);
+            m_archive = nullptr;
+        }
+        QIODevice::close();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        if (!m_file || m_finished) {
+            return m_finished ? 0 : -1;
+        }
+
+        if (m_aborted.loadAcquire()) {
+            setErrorString(QStringLiteral("Reading aborted"));
+            return -1;
+        }
+
+        const zip_int64_t readBytes = zip_fread(m_file, data, static_cast<zip_uint64_t>(maxSize));
+        if (readBytes < 0) {
+            setErrorString(QString::fromUtf8(zip_file_strerror(m_file)));
+            return -1;
+        }
+
+        m_finished = (readBytes == 0);
+        return readBytes;
+    }
+
+    qint64 writeData(const char *data, qint64 maxSize) override
+    {
+        Q_UNUSED(data)
+        Q_UNUSED(maxSize)
+        return -1;
+    }
+
+private:
+    zip_t *m_archive;
+    zip_file_t *m_file;
+    QAtomicInt m_aborted;
+    bool m_finished = false;
+};
+
 void LibzipPlugin::progressCallback(zip_t *, double progress, void *that)
 {
     static_cast<LibzipPlugin *>(that)->emitProgress(progress);
 }
 
+int LibzipPlugin::cancelCallback(zip_t *, void *that)
+{
+    return static_cast<LibzipPlugin *>(that)->isCancellationRequested() ? 1 : 0;
+}
+
 LibzipPlugin::LibzipPlugin(QObject *parent, const QVariantList & args)
     : ReadWriteArchiveInterface(parent, args)
     , m_overwriteAll(false)
     , m_skipAll(false)
-    , m_listAfterAdd(false)
 {
     qCDebug(ARK) << "Initializing libzip plugin";
 }
@@ -90,28 +184,49 @@ bool LibzipPlugin::list()
     // Get number of archive entries.
     const auto nofEntries = zip_get_num_entries(archive, 0);
     qCDebug(ARK) << "Found entries:" << nofEntries;
+    TraceSpan span("list", "libzip");
+    span.setArg(QStringLiteral("entries"), nofEntries);
 
     // Loop through all archive entries.
     for (int i = 0; i < nofEntries; i++) {
 
-        if (QThread::currentThread()->isInterruptionRequested()) {
+        if (isCancellationRequested()) {
             break;
         }
 
         emitEntryForIndex(archive, i);
-        if (m_listAfterAdd) {
-            // Start at 50%.
-            emit progress(0.5 + (0.5 * float(i + 1) / nofEntries));
-        } else {
-            emit progress(float(i + 1) / nofEntries);
-        }
+        reportProgress(float(i + 1) / nofEntries, i + 1, nofEntries);
     }
 
     zip_close(archive);
-    m_listAfterAdd = false;
     return true;
 }
 
+QIODevice *LibzipPlugin::createEntryDevice(const Archive::Entry *entry)
+{
+    if (entry->isDir()) {
+        return nullptr;
+    }
+
+    // The device doesn't share the handles of the jobs running on this interface.
+    int errcode = 0;
+    zip_t *archive = zip_open(QFile::encodeName(filename()).constData(), ZIP_RDONLY, &errcode);
+    if (!archive) {
+        qCWarning(ARK) << "Failed to open archive. Code:" << errcode;
+        return nullptr;
+    }
+
+    const zip_int64_t index = zip_name_locate(archive, entry->fullPath().toUtf8().constData(), ZIP_FL_ENC_GUESS);
+    zip_file_t *file = (index < 0) ? nullptr : zip_fopen_index(archive, static_cast<zip_uint64_t>(index), 0);
+    if (!file) {
+        qCWarning(ARK) << "Failed to open" << entry->fullPath() << ":" << QString::fromUtf8(zip_strerror(archive));
+        zip_close(archive);
+        return nullptr;
+    }
+
+    return new ZipEntryDevice(archive, file);
+}
+
 bool LibzipPlugin::addFiles(const QVector<Archive::Entry*> &files, const Archive::Entry *destination, const CompressionOptions& options, uint numberOfEntriesToAdd)
 {
     Q_UNUSED(numberOfEntriesToAdd)
@@ -127,10 +242,12 @@ bool LibzipPlugin::addFiles(const QVector<Archive::Entry*> &files, const Archive
         return false;
     }
 
+    m_writtenFiles.clear();
+
     uint i = 0;
     for (const Archive::Entry* e : files) {
 
-        if (QThread::currentThread()->isInterruptionRequested()) {
+        if (isCancellationRequested()) {
             break;
         }
 
@@ -146,7 +263,7 @@ bool LibzipPlugin::addFiles(const QVector<Archive::Entry*> &files, const Archive
                             QDir::Hidden | QDir::NoDotAndDotDot,
                             QDirIterator::Subdirectories);
 
-            while (!QThread::currentThread()->isInterruptionRequested() && it.hasNext()) {
+            while (!isCancellationRequested() && it.hasNext()) {
                 const QString path = it.next();
 
                 if (QFileInfo(path).isDir()) {
@@ -169,28 +286,110 @@ bool LibzipPlugin::addFiles(const QVector<Archive::Entry*> &files, const Archive
     }
     qCDebug(ARK) << "Added" << i << "entries";
 
-    // Register the callback function to get progress feedback.
-    zip_register_progress_callback_with_state(archive, 0.001, progressCallback, nullptr, this);
+    registerCallbacks(archive);
 
     qCDebug(ARK) << "Writing entries to disk...";
+    TraceSpan writeSpan("write", "libzip");
+    if (zip_close(archive)) {
+        if (isCancellationRequested()) {
+            // libzip leaves the archive untouched when it is cancelled.
+            qCDebug(ARK) << "Writing the archive was cancelled";
+            zip_discard(archive);
+            return false;
+        }
+        qCCritical(ARK) << "Failed to write archive";
+        emit error(xi18n("Failed to write archive."));
+        return false;
+    }
+    writeSpan.end();
+
+    emitEntriesForPaths(m_writtenFiles);
+
+    return true;
+}
+
+bool LibzipPlugin::canReplaceEntries() const
+{
+    return true;
+}
+
+bool LibzipPlugin::replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions &options)
+{
+    int errcode = 0;
+    zip_error_t err;
+
+    // Open archive.
+    zip_t *archive = zip_open(QFile::encodeName(filename()).constData(), 0, &errcode);
+    zip_error_init_with_code(&err, errcode);
+    if (!archive) {
+        qCCritical(ARK) << "Failed to open archive. Code:" << errcode;
+        emit error(xi18n("Failed to open archive: %1", QString::fromUtf8(zip_error_strerror(&err))));
+        return false;
+    }
+
+    const qlonglong index = zip_name_locate(archive, entry->fullPath().toUtf8().constData(), ZIP_FL_ENC_GUESS);
+    if (index == -1) {
+        qCCritical(ARK) << "Could not find entry to replace:" << entry->fullPath();
+        emit error(xi18n("Failed to locate entry: %1", entry->fullPath()));
+        zip_discard(archive);
+        return false;
+    }
+
+    zip_source_t *src = zip_source_file(archive, QFile::encodeName(file).constData(), 0, -1);
+    Q_ASSERT(src);
+
+    if (zip_file_replace(archive, index, src, ZIP_FL_ENC_GUESS) == -1) {
+        zip_source_free(src);
+        qCCritical(ARK) << "Could not replace entry" << entry->fullPath() << ":" << zip_strerror(archive);
+        emit error(xi18n("Failed to add entry: %1", QString::fromUtf8(zip_strerror(archive))));
+        zip_discard(archive);
+        return false;
+    }
+
+    if (!setEntryAttributes(archive, index, file, options)) {
+        zip_discard(archive);
+        return false;
+    }
+
+    registerCallbacks(archive);
+
+    // The other entries are copied as they are, without being recompressed.
+    qCDebug(ARK) << "Writing the replaced entry" << entry->fullPath() << "to disk...";
+    TraceSpan writeSpan("write", "libzip");
     if (zip_close(archive)) {
+        if (isCancellationRequested()) {
+            qCDebug(ARK) << "Writing the archive was cancelled";
+            zip_discard(archive);
+            return false;
+        }
         qCCritical(ARK) << "Failed to write archive";
         emit error(xi18n("Failed to write archive."));
+        zip_discard(archive);
         return false;
     }
+    writeSpan.end();
 
-    // We list the entire archive after adding files to ensure entry
-    // properties are up-to-date.
-    m_listAfterAdd = true;
-    list();
+    // The replaced entry is emitted again, and not counted twice.
+    m_numberOfEntries--;
+    emitEntriesForPaths({entry->fullPath()});
 
     return true;
 }
 
+void LibzipPlugin::registerCallbacks(zip_t *archive)
+{
+    // Register the callback function to get progress feedback.
+    zip_register_progress_callback_with_state(archive, 0.001, progressCallback, nullptr, this);
+
+#if LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 6)
+    // Older versions can only be cancelled between entries, not while compressing one.
+    zip_register_cancel_callback_with_state(archive, cancelCallback, nullptr, this);
+#endif
+}
+
 void LibzipPlugin::emitProgress(double percentage)
 {
-    // Go from 0 to 50%. The second half is the subsequent listing.
-    emit progress(0.5 * percentage);
+    reportProgress(percentage);
 }
 
 bool LibzipPlugin::writeEntry(zip_t *archive, const QString &file, const Archive::Entry* destination, const CompressionOptions& options, bool isDir)
@@ -212,7 +411,16 @@ bool LibzipPlugin::writeEntry(zip_t *archive, const QString &file, const Archive
             qCWarning(ARK) << "Failed to add dir " << file << ":" << zip_strerror(archive);
             return true;
         }
+        if (!destFile.endsWith('/')) {
+            destFile.append('/');
+        }
     } else {
+        // When overwriting entries, we need to decrement the counter manually,
+        // because the new entry is emitted.
+        if (zip_name_locate(archive, destFile.constData(), ZIP_FL_ENC_GUESS) != -1) {
+            m_numberOfEntries--;
+        }
+
         zip_source_t *src = zip_source_file(archive, QFile::encodeName(file).constData(), 0, -1);
         Q_ASSERT(src);
 
@@ -225,6 +433,16 @@ bool LibzipPlugin::writeEntry(zip_t *archive, const QString &file, const Archive
         }
     }
 
+    if (!setEntryAttributes(archive, index, file, options)) {
+        return false;
+    }
+
+    m_writtenFiles << QString::fromUtf8(destFile);
+    return true;
+}
+
+bool LibzipPlugin::setEntryAttributes(zip_t *archive, qlonglong index, const QString &file, const CompressionOptions &options)
+{
 #ifndef Q_OS_WIN
     // Set permissions.
     QT_STATBUF result;
@@ -377,6 +595,32 @@ bool LibzipPlugin::emitEntryForIndex(zip_t *archive, qlonglong index)
     return true;
 }
 
+void LibzipPlugin::emitEntriesForPaths(const QStringList &paths)
+{
+    int errcode = 0;
+    zip_t *archive = zip_open(QFile::encodeName(filename()).constData(), ZIP_RDONLY, &errcode);
+    if (!archive) {
+        qCCritical(ARK) << "Failed to open archive. Code:" << errcode;
+        return;
+    }
+
+    qCDebug(ARK) << "Emitting" << paths.size() << "written entries";
+    TraceSpan span("listWritten", "libzip");
+    span.setArg(QStringLiteral("entries"), paths.size());
+
+    for (const QString &path : paths) {
+        const qlonglong index = zip_name_locate(archive, path.toUtf8().constData(), ZIP_FL_ENC_GUESS);
+        if (index == -1) {
+            qCWarning(ARK) << "Could not find written entry:" << path;
+            continue;
+        }
+        emitEntryForIndex(archive, index);
+    }
+
+    zip_close(archive);
+    reportProgress(1.0);
+}
+
 bool LibzipPlugin::deleteFiles(const QVector<Archive::Entry*> &files)
 {
     int errcode = 0;
@@ -394,7 +638,7 @@ bool LibzipPlugin::deleteFiles(const QVector<Archive::Entry*> &files)
     qulonglong i = 0;
     for (const Archive::Entry* e : files) {
 
-        if (QThread::currentThread()->isInterruptionRequested()) {
+        if (isCancellationRequested()) {
             break;
         }
 
@@ -410,7 +654,8 @@ bool LibzipPlugin::deleteFiles(const QVector<Archive::Entry*> &files)
             return false;
         }
         emit entryRemoved(e->fullPath());
-        emit progress(float(++i) / files.size());
+        ++i;
+        reportProgress(float(i) / files.size(), i, files.size());
     }
     qCDebug(ARK) << "Deleted" << i << "entries";
 
@@ -466,9 +711,11 @@ bool LibzipPlugin::testArchive()
 
     // Check CRC-32 for each archive entry.
     const int nofEntries = zip_get_num_entries(archive, 0);
+    std::unique_ptr<uchar[]> buf(new uchar[chunkSize]);
     for (int i = 0; i < nofEntries; i++) {
 
-        if (QThread::currentThread()->isInterruptionRequested()) {
+        if (isCancellationRequested()) {
+            zip_close(archive);
             return false;
         }
 
@@ -476,22 +723,44 @@ bool LibzipPlugin::testArchive()
         zip_stat_t statBuffer;
         if (zip_stat_index(archive, i, 0, &statBuffer) != 0) {
             qCCritical(ARK) << "Failed to read stat for" << statBuffer.name;
+            zip_close(archive);
             return false;
         }
 
         zip_file *zipFile = zip_fopen_index(archive, i, 0);
-        std::unique_ptr<uchar[]> buf(new uchar[statBuffer.size]);
-        const int len = zip_fread(zipFile, buf.get(), statBuffer.size);
-        if (len == -1 || uint(len) != statBuffer.size) {
-            qCCritical(ARK) << "Failed to read data for" << statBuffer.name;
+        if (!zipFile) {
+            qCCritical(ARK) << "Failed to open" << statBuffer.name << ":" << zip_strerror(archive);
+            zip_close(archive);
             return false;
         }
-        if (statBuffer.crc != crc32(0, &buf.get()[0], len)) {
+        uLong crc = crc32(0, nullptr, 0);
+        zip_uint64_t sum = 0;
+        while (sum != statBuffer.size) {
+            if (isCancellationRequested()) {
+                zip_fclose(zipFile);
+                zip_close(archive);
+                return false;
+            }
+
+            const auto len = zip_fread(zipFile, buf.get(), chunkSize);
+            if (len <= 0) {
+                qCCritical(ARK) << "Failed to read data for" << statBuffer.name;
+                zip_fclose(zipFile);
+                zip_close(archive);
+                return false;
+            }
+            crc = crc32(crc, buf.get(), static_cast<uInt>(len));
+            sum += len;
+        }
+        zip_fclose(zipFile);
+
+        if (statBuffer.crc != crc) {
             qCCritical(ARK) << "CRC check failed for" << statBuffer.name;
+            zip_close(archive);
             return false;
         }
 
-        emit progress(float(i) / nofEntries);
+        reportProgress(float(i + 1) / nofEntries, i + 1, nofEntries);
     }
 
     zip_close(archive);
@@ -538,7 +807,7 @@ bool LibzipPlugin::extractFiles(const QVector<Archive::Entry*> &files, const QSt
     if (extractAll) {
         // We extract all entries.
         for (qlonglong i = 0; i < nofEntries; i++) {
-            if (QThread::currentThread()->isInterruptionRequested()) {
+            if (isCancellationRequested()) {
                 break;
             }
             if (!extractEntry(archive,
@@ -550,13 +819,13 @@ bool LibzipPlugin::extractFiles(const QVector<Archive::Entry*> &files, const QSt
                 qCDebug(ARK) << "Extraction failed";
                 return false;
             }
-            emit progress(float(i + 1) / nofEntries);
+            reportProgress(float(i + 1) / nofEntries, i + 1, nofEntries);
         }
     } else {
         // We extract only the entries in files.
         qulonglong i = 0;
         for (const Archive::Entry* e : files) {
-            if (QThread::currentThread()->isInterruptionRequested()) {
+            if (isCancellationRequested()) {
                 break;
             }
             if (!extractEntry(archive,
@@ -568,7 +837,8 @@ bool LibzipPlugin::extractFiles(const QVector<Archive::Entry*> &files, const QSt
                 qCDebug(ARK) << "Extraction failed";
                 return false;
             }
-            emit progress(float(++i) / nofEntries);
+            ++i;
+            reportProgress(float(i) / nofEntries, i, nofEntries);
         }
     }
 
@@ -579,6 +849,8 @@ bool LibzipPlugin::extractFiles(const QVector<Archive::Entry*> &files, const QSt
 bool LibzipPlugin::extractEntry(zip_t *archive, const QString &entry, const QString &rootNode, const QString &destDir, bool preservePaths, bool removeRootNode)
 {
     const bool isDirectory = entry.endsWith(QDir::separator());
+    TraceSpan span("decompress", "libzip");
+    span.setArg(QStringLiteral("entry"), entry);
 
     // Add trailing slash to destDir if not present.
     QString destDirCorrected(destDir);
@@ -706,29 +978,44 @@ bool LibzipPlugin::extractEntry(zip_t *archive, const QString &entry, const QStr
         if (!file.open(QIODevice::WriteOnly)) {
             qCCritical(ARK) << "Failed to open file for writing";
             emit error(xi18n("Failed to open file for writing: %1", destination));
+            zip_fclose(zipFile);
             return false;
         }
 
         QDataStream out(&file);
 
-        // Write archive entry to file. We use a read/write buffer of 1000 chars.
+        // Write archive entry to file, checking for cancellation between chunks.
+        // A partially written file is removed, it would look like a valid one otherwise.
         qulonglong sum = 0;
-        char buf[1000];
+        std::unique_ptr<char[]> buf(new char[chunkSize]);
         while (sum != statBuffer.size) {
-            const auto readBytes = zip_fread(zipFile, buf, 1000);
+            if (isCancellationRequested()) {
+                qCDebug(ARK) << "Extraction cancelled, removing" << destination;
+                zip_fclose(zipFile);
+                file.remove();
+                return false;
+            }
+
+            const auto readBytes = zip_fread(zipFile, buf.get(), chunkSize);
             if (readBytes < 0) {
                 qCCritical(ARK) << "Failed to read data";
                 emit error(xi18n("Failed to read data for entry: %1", entry));
+                zip_fclose(zipFile);
+                file.remove();
                 return false;
             }
-            if (out.writeRawData(buf, readBytes) != readBytes) {
+            if (out.writeRawData(buf.get(), readBytes) != readBytes) {
                 qCCritical(ARK) << "Failed to write data";
                 emit error(xi18n("Failed to write data for entry: %1", entry));
+                zip_fclose(zipFile);
+                file.remove();
                 return false;
             }
 
             sum += readBytes;
         }
+        zip_fclose(zipFile);
+        span.setArg(QStringLiteral("bytes"), sum);
 
         const auto index = zip_name_locate(archive, entry.toUtf8().constData(), ZIP_FL_ENC_GUESS);
         if (index == -1) {
@@ -813,7 +1100,7 @@ bool LibzipPlugin::moveFiles(const QVector<Archive::Entry*> &files, Archive::Ent
 
         emit entryRemoved(filePaths.at(i));
         emitEntryForIndex(archive, index);
-        emit progress(i/filePaths.count());
+        reportProgress(float(i + 1) / filePaths.count(), i + 1, filePaths.count());
     }
     if (zip_close(archive)) {
         qCCritical(ARK) << "Failed to write archive";
@@ -842,6 +1129,7 @@ bool LibzipPlugin::copyFiles(const QVector<Archive::Entry*> &files, Archive::Ent
 
     const QStringList filePaths = entryFullPaths(files);
     const QStringList destPaths = entryPathsFromDestination(filePaths, destination, 0);
+    QStringList copiedPaths;
 
     int i;
     for (i = 0; i < filePaths.size(); ++i) {
@@ -854,6 +1142,9 @@ bool LibzipPlugin::copyFiles(const QVector<Archive::Entry*> &files, Archive::Ent
                 qCWarning(ARK) << "Failed to add dir " << dest << ":" << zip_strerror(archive);
                 continue;
             }
+        } else if (zip_name_locate(archive, dest.toUtf8().constData(), ZIP_FL_ENC_GUESS) != -1) {
+            // The overwritten entry is emitted again.
+            m_numberOfEntries--;
         }
 
         const int srcIndex = zip_name_locate(archive, filePaths.at(i).toUtf8().constData(), ZIP_FL_ENC_GUESS);
@@ -892,20 +1183,25 @@ bool LibzipPlugin::copyFiles(const QVector<Archive::Entry*> &files, Archive::Ent
             emit error(xi18n("Failed to set metadata for entry: %1", dest));
             return false;
         }
+        copiedPaths << dest;
     }
 
-    // Register the callback function to get progress feedback.
-    zip_register_progress_callback_with_state(archive, 0.001, progressCallback, nullptr, this);
+    registerCallbacks(archive);
 
     if (zip_close(archive)) {
+        if (isCancellationRequested()) {
+            // libzip leaves the archive untouched when it is cancelled.
+            qCDebug(ARK) << "Writing the archive was cancelled";
+            zip_discard(archive);
+            return false;
+        }
         qCCritical(ARK) << "Failed to write archive";
         emit error(xi18n("Failed to write archive."));
         return false;
     }
 
-    // List the archive to update the model.
-    m_listAfterAdd = true;
-    list();
+    // Only the copies changed, no need to list the whole archive again.
+    emitEntriesForPaths(copiedPaths);
 
     qCDebug(ARK) << "Copied" << i << "entries";
 
@@ -44,26 +44,38 @@ public:
     bool list() override;
     bool doKill() override;
     bool extractFiles(const QVector<Archive::Entry*> &files, const QString& destinationDirectory, const ExtractionOptions& options) override;
+    QIODevice *createEntryDevice(const Archive::Entry *entry) override;
 
     bool addFiles(const QVector<Archive::Entry*> &files, const Archive::Entry *destination, const CompressionOptions& options, uint numberOfEntriesToAdd = 0) override;
     bool deleteFiles(const QVector<Archive::Entry*> &files) override;
     bool moveFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options) override;
     bool copyFiles(const QVector<Archive::Entry*> &files, Archive::Entry *destination, const CompressionOptions &options) override;
+    bool canReplaceEntries() const override;
+    bool replaceEntry(const Archive::Entry *entry, const QString &file, const CompressionOptions &options) override;
     bool addComment(const QString& comment) override;
     bool testArchive() override;
 
 private:
     bool extractEntry(zip_t *archive, const QString &entry, const QString &rootNode, const QString &destDir, bool preservePaths, bool removeRootNode);
     bool writeEntry(zip_t *archive, const QString &entry, const Archive::Entry* destination, const CompressionOptions& options, bool isDir = false);
+    bool setEntryAttributes(zip_t *archive, qlonglong index, const QString &file, const CompressionOptions &options);
     bool emitEntryForIndex(zip_t *archive, qlonglong index);
+    /**
+     * Emits the entries at @p paths once the archive is written, instead of listing it again.
+     */
+    void emitEntriesForPaths(const QStringList &paths);
+    void registerCallbacks(zip_t *archive);
     void emitProgress(double percentage);
     QString permissionsToString(const mode_t &perm);
     static void progressCallback(zip_t *, double progress, void *that);
+    static int cancelCallback(zip_t *, void *that);
 
     QVector<Archive::Entry*> m_emittedEntries;
     bool m_overwriteAll;
     bool m_skipAll;
-    bool m_listAfterAdd;
+
+    // Names of the entries written by addFiles(), as stored in the archive.
+    QStringList m_writtenFiles;
 };
 
 #endif // LIBZIPPLUGIN_H